@@ -0,0 +1,174 @@
+#include "camera_driver.h"
+#include "bench_camera.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+#include "memory_account.h"
+
+static const char *TAG = "bench_camera";
+
+static QueueHandle_t s_available_frames;
+static QueueHandle_t s_ready_frames;
+static camera_config_t s_camera_config;
+static bench_camera_config_t s_bench_config = { .frame_rate = 30, .frame_limit = 600 };
+static bench_camera_stats_t s_stats;
+static TaskHandle_t s_sensor_task;
+static TaskHandle_t s_done_waiter;
+static volatile bool s_stop_requested;
+
+void bench_camera_configure(const bench_camera_config_t *config)
+{
+    s_bench_config = *config;
+}
+
+/* Stands in for the CSI frame-done interrupt. DMA fills the buffer without the CPU, so the frame is only stamped. */
+static void sensor_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    const TickType_t period = pdMS_TO_TICKS(1000 / s_bench_config.frame_rate);
+    uint32_t sequence = 0;
+
+    while (!s_stop_requested && sequence < s_bench_config.frame_limit) {
+        vTaskDelayUntil(&last_wake, period);
+        int64_t now_us = esp_timer_get_time();
+        if (sequence == 0) {
+            s_stats.first_us = now_us;
+        }
+        s_stats.last_us = now_us;
+
+        camera_frame_t frame = {0};
+        if (xQueueReceive(s_available_frames, &frame, 0) != pdTRUE) {
+            ++s_stats.dropped;
+            ++sequence;
+            continue;
+        }
+        frame.buffer[sequence % frame.length] = (uint8_t)sequence;
+        frame.sequence = sequence++;
+        frame.timestamp_us = now_us;
+        xQueueSend(s_ready_frames, &frame, portMAX_DELAY);
+        ++s_stats.captured;
+    }
+
+    TaskHandle_t waiter = s_done_waiter;
+    s_sensor_task = NULL;
+    if (waiter) {
+        xTaskNotifyGive(waiter);
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t camera_driver_init(const camera_config_t *config)
+{
+    if (!config || s_sensor_task) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_camera_config = *config;
+    const size_t buffer_size = config->width * config->height * 2;
+
+    s_available_frames = xQueueCreate(config->frame_buffer_count, sizeof(camera_frame_t));
+    s_ready_frames = xQueueCreate(config->frame_buffer_count, sizeof(camera_frame_t));
+    if (!s_available_frames || !s_ready_frames) {
+        camera_driver_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t i = 0; i < config->frame_buffer_count; ++i) {
+        camera_frame_t frame = {
+            .buffer = memory_account_malloc(MEMORY_ACCOUNT_CAMERA, buffer_size, MEMORY_PLAN_BULK_CAPS),
+            .length = buffer_size,
+            .width = config->width,
+            .height = config->height,
+            .pixel_format = config->pixel_format,
+        };
+        if (!frame.buffer) {
+            camera_driver_deinit();
+            return ESP_ERR_NO_MEM;
+        }
+        memset(frame.buffer, 0x80, buffer_size);
+        xQueueSend(s_available_frames, &frame, 0);
+    }
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stop_requested = false;
+    if (xTaskCreate(sensor_task, "bench_sensor", 4096, NULL, tskIDLE_PRIORITY + 7, &s_sensor_task) != pdPASS) {
+        camera_driver_deinit();
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Synthetic sensor %" PRIu32 "x%" PRIu32 " at %" PRIu32 " fps", config->width, config->height,
+             s_bench_config.frame_rate);
+    return ESP_OK;
+}
+
+void bench_camera_wait_done(void)
+{
+    s_done_waiter = xTaskGetCurrentTaskHandle();
+    if (s_sensor_task) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    s_done_waiter = NULL;
+}
+
+void bench_camera_get_stats(bench_camera_stats_t *stats)
+{
+    *stats = s_stats;
+}
+
+/* Frames still held downstream are not freed; call only once the pipeline has stopped. */
+void camera_driver_deinit(void)
+{
+    if (s_sensor_task) {
+        s_stop_requested = true;
+        bench_camera_wait_done();
+    }
+    camera_frame_t frame;
+    while (s_ready_frames && xQueueReceive(s_ready_frames, &frame, 0) == pdTRUE) {
+        memory_account_free(MEMORY_ACCOUNT_CAMERA, frame.buffer);
+    }
+    while (s_available_frames && xQueueReceive(s_available_frames, &frame, 0) == pdTRUE) {
+        memory_account_free(MEMORY_ACCOUNT_CAMERA, frame.buffer);
+    }
+    if (s_ready_frames) {
+        vQueueDelete(s_ready_frames);
+        s_ready_frames = NULL;
+    }
+    if (s_available_frames) {
+        vQueueDelete(s_available_frames);
+        s_available_frames = NULL;
+    }
+}
+
+camera_config_t camera_driver_default_config(void)
+{
+    return (camera_config_t) {
+        .width = 1920,
+        .height = 1080,
+        .pixel_format = PIXFORMAT_YUV422,
+        .frame_buffer_count = 3,
+        .xclk_pin = GPIO_NUM_NC,
+        .vsync_pin = GPIO_NUM_NC,
+        .href_pin = GPIO_NUM_NC,
+        .pclk_pin = GPIO_NUM_NC,
+    };
+}
+
+esp_err_t camera_driver_acquire_frame(camera_frame_t *frame, TickType_t ticks_to_wait)
+{
+    if (!frame || !s_ready_frames) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return xQueueReceive(s_ready_frames, frame, ticks_to_wait) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+void camera_driver_release_frame(camera_frame_t *frame)
+{
+    if (!frame || !frame->buffer || !s_available_frames) {
+        return;
+    }
+    xQueueSend(s_available_frames, frame, portMAX_DELAY);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t frame_rate;
+    /* The sensor stops after this many frames, so every run covers the same work. */
+    uint32_t frame_limit;
+} bench_camera_config_t;
+
+typedef struct {
+    uint32_t captured;
+    uint32_t dropped;
+    int64_t first_us;
+    int64_t last_us;
+} bench_camera_stats_t;
+
+/* Call before camera_driver_init(). */
+void bench_camera_configure(const bench_camera_config_t *config);
+
+/* Blocks until the sensor has produced frame_limit frames. */
+void bench_camera_wait_done(void);
+
+void bench_camera_get_stats(bench_camera_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
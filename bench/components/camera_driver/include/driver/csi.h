@@ -0,0 +1,11 @@
+#pragma once
+
+/* Only the types camera_driver.h refers to; the linux target has no CSI or GPIO driver. */
+typedef enum {
+    PIXFORMAT_RGB565,
+    PIXFORMAT_YUV422,
+} pixformat_t;
+
+typedef int gpio_num_t;
+
+#define GPIO_NUM_NC (-1)
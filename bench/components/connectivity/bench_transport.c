@@ -0,0 +1,323 @@
+#include "bench_transport.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "frame_pool.h"
+#include "h264_nal.h"
+#include "memory_account.h"
+
+static const char *TAG = "bench_transport";
+
+#define BENCH_FRAME_BLOCK_SIZE          4096
+/* As RTSP_POOL_HEADROOM_FRAMES: keyframes and P-frames above the average. */
+#define BENCH_POOL_HEADROOM_FRAMES      8
+
+typedef struct {
+    atomic_uint refcount;
+    size_t length;
+    uint8_t payload[];
+} bench_frame_t;
+
+typedef enum {
+    BENCH_STAGE_QUEUE,
+    BENCH_STAGE_ENCODE,
+    BENCH_STAGE_TRANSPORT,
+    BENCH_STAGE_TOTAL,
+    BENCH_STAGE_COUNT,
+} bench_stage_t;
+
+typedef struct {
+    struct rtsp_transport_context_t *transport;
+    QueueHandle_t frames;
+    TaskHandle_t task;
+    bool skipping;
+    atomic_bool sending;
+    uint32_t delivered;
+    uint32_t skipped;
+    uint64_t bytes_delivered;
+    uint32_t sample_count;
+    uint32_t *samples[BENCH_STAGE_COUNT];
+} bench_client_t;
+
+struct rtsp_transport_context_t {
+    bench_client_t clients[BENCH_TRANSPORT_MAX_CLIENTS];
+    frame_pool_t frame_pool;
+    TaskHandle_t stop_waiter;
+    volatile bool stop_requested;
+};
+
+static bench_transport_config_t s_config = {
+    .client_count = 2,
+    .link_bitrate = 50 * 1000 * 1000,
+    .queue_frames = 8,
+    .max_samples = 1024,
+};
+static bench_transport_results_t s_results;
+
+void bench_transport_configure(const bench_transport_config_t *config)
+{
+    s_config = *config;
+    if (s_config.client_count > BENCH_TRANSPORT_MAX_CLIENTS) {
+        s_config.client_count = BENCH_TRANSPORT_MAX_CLIENTS;
+    }
+}
+
+static void frame_unref(bench_frame_t *frame)
+{
+    if (atomic_fetch_sub(&frame->refcount, 1) == 1) {
+        frame_pool_free(frame);
+    }
+}
+
+static void record_latency(bench_client_t *client, const bench_frame_t *frame, int64_t received_us)
+{
+    h264_nal_iterator_t it;
+    const uint8_t *nal = NULL;
+    size_t nal_length = 0;
+    h264_timing_sei_t timing;
+    h264_nal_iterator_init(&it, frame->payload, frame->length);
+    while (h264_nal_iterator_next(&it, &nal, &nal_length)) {
+        if (!h264_timing_sei_parse(nal, nal_length, &timing)) {
+            continue;
+        }
+        if (client->sample_count < s_config.max_samples) {
+            uint32_t i = client->sample_count++;
+            client->samples[BENCH_STAGE_QUEUE][i] = (uint32_t)(timing.encode_begin_us - timing.capture_us);
+            client->samples[BENCH_STAGE_ENCODE][i] = (uint32_t)(timing.encode_end_us - timing.encode_begin_us);
+            client->samples[BENCH_STAGE_TRANSPORT][i] = (uint32_t)(received_us - (int64_t)timing.encode_end_us);
+            client->samples[BENCH_STAGE_TOTAL][i] = (uint32_t)(received_us - (int64_t)timing.capture_us);
+        }
+        return;
+    }
+}
+
+/* A viewer on a link of link_bitrate: each frame takes its wire time, then counts as received. */
+static void client_task(void *arg)
+{
+    bench_client_t *client = (bench_client_t *)arg;
+    struct rtsp_transport_context_t *ctx = client->transport;
+
+    while (!ctx->stop_requested) {
+        bench_frame_t *frame = NULL;
+        if (xQueueReceive(client->frames, &frame, pdMS_TO_TICKS(100)) != pdTRUE) {
+            continue;
+        }
+        atomic_store(&client->sending, true);
+        vTaskDelay(pdMS_TO_TICKS((uint64_t)frame->length * 8 * 1000 / s_config.link_bitrate));
+        record_latency(client, frame, esp_timer_get_time());
+        ++client->delivered;
+        client->bytes_delivered += frame->length;
+        atomic_store(&client->sending, false);
+        frame_unref(frame);
+    }
+
+    TaskHandle_t waiter = ctx->stop_waiter;
+    client->task = NULL;
+    xTaskNotifyGive(waiter);
+    vTaskDelete(NULL);
+}
+
+transport_config_t connectivity_default_transport_config(void)
+{
+    return (transport_config_t) {0};
+}
+
+esp_err_t connectivity_start(const transport_config_t *config, transport_handle_t *out_handle)
+{
+    if (!out_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct rtsp_transport_context_t *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(&s_results, 0, sizeof(s_results));
+
+    /* Viewers hold the same frames in the same order, so at most a queue and the frames being sent and made. */
+    size_t pool_frames = s_config.queue_frames + 2 + BENCH_POOL_HEADROOM_FRAMES;
+    size_t pool_size = frame_pool_size_for(BENCH_FRAME_BLOCK_SIZE, pool_frames,
+                                           sizeof(bench_frame_t) + s_config.frame_bytes);
+    if (frame_pool_init(&ctx->frame_pool, pool_size, BENCH_FRAME_BLOCK_SIZE, MEMORY_PLAN_BULK_CAPS) != ESP_OK) {
+        free(ctx);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t i = 0; i < s_config.client_count; ++i) {
+        bench_client_t *client = &ctx->clients[i];
+        client->transport = ctx;
+        client->frames = xQueueCreate(s_config.queue_frames, sizeof(bench_frame_t *));
+        for (int stage = 0; stage < BENCH_STAGE_COUNT; ++stage) {
+            client->samples[stage] = calloc(s_config.max_samples, sizeof(uint32_t));
+            if (!client->samples[stage]) {
+                connectivity_stop(ctx);
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        if (!client->frames ||
+            xTaskCreate(client_task, "bench_client", 4096, client, tskIDLE_PRIORITY + 5, &client->task) != pdPASS) {
+            connectivity_stop(ctx);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    ESP_LOGI(TAG, "%" PRIu32 " loopback viewers at %" PRIu32 " bit/s", s_config.client_count, s_config.link_bitrate);
+    *out_handle = ctx;
+    return ESP_OK;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    uint32_t left = *(const uint32_t *)a;
+    uint32_t right = *(const uint32_t *)b;
+    return (left > right) - (left < right);
+}
+
+static bench_latency_t summarize(uint32_t *samples, size_t count)
+{
+    if (count == 0) {
+        return (bench_latency_t) {0};
+    }
+    qsort(samples, count, sizeof(uint32_t), compare_samples);
+    return (bench_latency_t) {
+        .p50_us = samples[count * 50 / 100],
+        .p90_us = samples[count * 90 / 100],
+        .p99_us = samples[count * 99 / 100],
+        .max_us = samples[count - 1],
+    };
+}
+
+static void collect_results(struct rtsp_transport_context_t *ctx)
+{
+    size_t total = 0;
+    for (uint32_t i = 0; i < s_config.client_count; ++i) {
+        total += ctx->clients[i].sample_count;
+    }
+    uint32_t *merged = malloc((total ? total : 1) * sizeof(uint32_t));
+    if (!merged) {
+        return;
+    }
+    bench_latency_t *targets[BENCH_STAGE_COUNT] = {
+        &s_results.queue, &s_results.encode, &s_results.transport, &s_results.total,
+    };
+    for (int stage = 0; stage < BENCH_STAGE_COUNT; ++stage) {
+        size_t used = 0;
+        for (uint32_t i = 0; i < s_config.client_count; ++i) {
+            const bench_client_t *client = &ctx->clients[i];
+            memcpy(merged + used, client->samples[stage], client->sample_count * sizeof(uint32_t));
+            used += client->sample_count;
+        }
+        *targets[stage] = summarize(merged, used);
+    }
+    free(merged);
+
+    for (uint32_t i = 0; i < s_config.client_count; ++i) {
+        s_results.delivered += ctx->clients[i].delivered;
+        s_results.skipped += ctx->clients[i].skipped;
+        s_results.bytes_delivered += ctx->clients[i].bytes_delivered;
+    }
+}
+
+void connectivity_stop(transport_handle_t handle)
+{
+    struct rtsp_transport_context_t *ctx = handle;
+    if (!ctx) {
+        return;
+    }
+    ctx->stop_waiter = xTaskGetCurrentTaskHandle();
+    ctx->stop_requested = true;
+    for (uint32_t i = 0; i < s_config.client_count; ++i) {
+        if (ctx->clients[i].task) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+    collect_results(ctx);
+
+    for (uint32_t i = 0; i < s_config.client_count; ++i) {
+        bench_client_t *client = &ctx->clients[i];
+        bench_frame_t *frame = NULL;
+        while (client->frames && xQueueReceive(client->frames, &frame, 0) == pdTRUE) {
+            frame_unref(frame);
+        }
+        if (client->frames) {
+            vQueueDelete(client->frames);
+        }
+        for (int stage = 0; stage < BENCH_STAGE_COUNT; ++stage) {
+            free(client->samples[stage]);
+        }
+    }
+    frame_pool_deinit(&ctx->frame_pool);
+    free(ctx);
+}
+
+void bench_transport_get_results(bench_transport_results_t *results)
+{
+    *results = s_results;
+}
+
+/* Copies the access unit once, as stream_frame_create() does, and shares it with every viewer by reference. */
+esp_err_t connectivity_stream_packet(transport_handle_t handle, const h264_packet_t *packet)
+{
+    if (!handle || !packet || !packet->data || packet->length == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct rtsp_transport_context_t *ctx = handle;
+    bench_frame_t *frame = frame_pool_alloc(&ctx->frame_pool, sizeof(*frame) + packet->length);
+    if (!frame) {
+        /* Like a lost frame at the RTSP server: every viewer waits for the next keyframe. */
+        for (uint32_t i = 0; i < s_config.client_count; ++i) {
+            ctx->clients[i].skipping = true;
+            ++ctx->clients[i].skipped;
+        }
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(frame->payload, packet->data, packet->length);
+    frame->length = packet->length;
+    atomic_init(&frame->refcount, s_config.client_count + 1);
+
+    for (uint32_t i = 0; i < s_config.client_count; ++i) {
+        bench_client_t *client = &ctx->clients[i];
+        if (client->skipping && !packet->is_keyframe) {
+            ++client->skipped;
+            frame_unref(frame);
+            continue;
+        }
+        client->skipping = xQueueSend(client->frames, &frame, 0) != pdTRUE;
+        if (client->skipping) {
+            ++client->skipped;
+            frame_unref(frame);
+        }
+    }
+    frame_unref(frame);
+    return ESP_OK;
+}
+
+/* Frames the most up-to-date viewer has not finished, the same measure the RTSP server publishes. */
+uint32_t connectivity_get_backlog(transport_handle_t handle)
+{
+    struct rtsp_transport_context_t *ctx = handle;
+    if (!ctx || s_config.client_count == 0) {
+        return 0;
+    }
+    uint32_t backlog = UINT32_MAX;
+    for (uint32_t i = 0; i < s_config.client_count; ++i) {
+        const bench_client_t *client = &ctx->clients[i];
+        uint32_t pending = (uint32_t)uxQueueMessagesWaiting(client->frames) + atomic_load(&client->sending);
+        if (pending < backlog) {
+            backlog = pending;
+        }
+    }
+    return backlog;
+}
+
+bool connectivity_take_keyframe_request(transport_handle_t handle)
+{
+    return false;
+}
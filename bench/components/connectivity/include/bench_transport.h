@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "connectivity.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BENCH_TRANSPORT_MAX_CLIENTS 8
+
+typedef struct {
+    uint32_t client_count;
+    /* Per-client link rate; sending a frame takes its size at this rate. */
+    uint32_t link_bitrate;
+    /* Frames a client may have queued before it drops to the next keyframe, like a viewer behind the ring. */
+    uint32_t queue_frames;
+    /* Latency samples kept per client. */
+    uint32_t max_samples;
+    /* Average encoded frame; sizes the frame pool the way the RTSP server sizes its own. */
+    uint32_t frame_bytes;
+} bench_transport_config_t;
+
+typedef struct {
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} bench_latency_t;
+
+typedef struct {
+    uint32_t delivered;
+    uint32_t skipped;
+    uint64_t bytes_delivered;
+    bench_latency_t queue;
+    bench_latency_t encode;
+    bench_latency_t transport;
+    bench_latency_t total;
+} bench_transport_results_t;
+
+/* Call before connectivity_start(). */
+void bench_transport_configure(const bench_transport_config_t *config);
+
+/* Totals over every client; valid after connectivity_stop(). */
+void bench_transport_get_results(bench_transport_results_t *results);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,196 @@
+#include "image_processing.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "h264_nal.h"
+#include "memory_account.h"
+
+static const char *TAG = "bench_encoder";
+
+#define IMAGE_PROCESSING_MAX_BITSTREAM_BUFFERS  4
+#define IMAGE_PROCESSING_BUFFER_WAIT_MS         1000
+#define IMAGE_PROCESSING_SEI_RESERVE            128
+/* Roughly the hardware encoder's time per megapixel at 1080p. */
+#define BENCH_ENCODE_US_PER_MEGAPIXEL           5000
+#define BENCH_KEYFRAME_SIZE_FACTOR              4
+
+static const uint8_t s_parameter_sets[] = {
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x28, 0xac, 0xd9, 0x40, 0x78, 0x02, 0x27, 0xe5, 0x84,
+    0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0,
+};
+
+struct h264_encoder_context_t {
+    encoder_config_t config;
+    uint8_t *bitstream_buffers[IMAGE_PROCESSING_MAX_BITSTREAM_BUFFERS];
+    QueueHandle_t free_buffers;
+    size_t bitstream_size;
+    uint32_t frame_index;
+    uint32_t random_state;
+    volatile bool keyframe_requested;
+};
+
+encoder_config_t image_processing_default_encoder_config(void)
+{
+    return (encoder_config_t) {
+        .width = 1920,
+        .height = 1080,
+        .fps = 30,
+        .bitrate = 8 * 1024 * 1024,
+        .bitstream_buffer_count = 4,
+        .enable_psram = true,
+        .timing_sei = true,
+    };
+}
+
+esp_err_t image_processing_create_encoder(const encoder_config_t *config, encoder_handle_t *out_handle)
+{
+    if (!config || !out_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    encoder_handle_t handle = memory_account_calloc(MEMORY_ACCOUNT_IMAGE_PROCESSING, 1, sizeof(*handle),
+                                                    MALLOC_CAP_DEFAULT);
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    handle->config = *config;
+    if (handle->config.bitstream_buffer_count == 0) {
+        handle->config.bitstream_buffer_count = 1;
+    } else if (handle->config.bitstream_buffer_count > IMAGE_PROCESSING_MAX_BITSTREAM_BUFFERS) {
+        handle->config.bitstream_buffer_count = IMAGE_PROCESSING_MAX_BITSTREAM_BUFFERS;
+    }
+    handle->bitstream_size = config->width * config->height / 2;
+    handle->random_state = 1;
+    handle->free_buffers = xQueueCreate(handle->config.bitstream_buffer_count, sizeof(uint8_t *));
+    if (!handle->free_buffers) {
+        image_processing_destroy_encoder(handle);
+        return ESP_ERR_NO_MEM;
+    }
+    const uint32_t bitstream_caps = config->enable_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL;
+    for (uint32_t i = 0; i < handle->config.bitstream_buffer_count; ++i) {
+        handle->bitstream_buffers[i] = memory_account_malloc(MEMORY_ACCOUNT_IMAGE_PROCESSING, handle->bitstream_size,
+                                                             bitstream_caps);
+        if (!handle->bitstream_buffers[i]) {
+            image_processing_destroy_encoder(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(handle->free_buffers, &handle->bitstream_buffers[i], 0);
+    }
+
+    *out_handle = handle;
+    return ESP_OK;
+}
+
+void image_processing_destroy_encoder(encoder_handle_t handle)
+{
+    if (!handle) {
+        return;
+    }
+    for (uint32_t i = 0; i < IMAGE_PROCESSING_MAX_BITSTREAM_BUFFERS; ++i) {
+        memory_account_free(MEMORY_ACCOUNT_IMAGE_PROCESSING, handle->bitstream_buffers[i]);
+    }
+    if (handle->free_buffers) {
+        vQueueDelete(handle->free_buffers);
+    }
+    memory_account_free(MEMORY_ACCOUNT_IMAGE_PROCESSING, handle);
+}
+
+/* A fixed-seed generator, so every run produces the same frame sizes. */
+static uint32_t next_random(encoder_handle_t handle)
+{
+    handle->random_state = handle->random_state * 1664525u + 1013904223u;
+    return handle->random_state >> 8;
+}
+
+/* Frame sizes follow the configured bitrate: a keyframe every second, P-frames within +-20 % of the average. */
+static size_t frame_size(encoder_handle_t handle, bool keyframe)
+{
+    size_t average = handle->config.bitrate / 8 / handle->config.fps;
+    size_t size = keyframe ? average * BENCH_KEYFRAME_SIZE_FACTOR : average * (80 + next_random(handle) % 41) / 100;
+    size_t limit = handle->bitstream_size - IMAGE_PROCESSING_SEI_RESERVE - sizeof(s_parameter_sets) - 5;
+    return size < limit ? size : limit;
+}
+
+esp_err_t image_processing_encode_frame(encoder_handle_t handle, const camera_frame_t *frame, h264_packet_t *out_packet)
+{
+    if (!handle || !frame || !frame->buffer || !out_packet) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t *bitstream = NULL;
+    if (xQueueReceive(handle->free_buffers, &bitstream, pdMS_TO_TICKS(IMAGE_PROCESSING_BUFFER_WAIT_MS)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int64_t encode_begin_us = esp_timer_get_time();
+    uint64_t pixels = (uint64_t)handle->config.width * handle->config.height;
+    vTaskDelay(pdMS_TO_TICKS(pixels * BENCH_ENCODE_US_PER_MEGAPIXEL / 1000000 / 1000));
+
+    bool keyframe = handle->keyframe_requested || handle->frame_index % handle->config.fps == 0;
+    handle->keyframe_requested = false;
+    handle->frame_index = keyframe ? 1 : handle->frame_index + 1;
+
+    uint8_t *cursor = bitstream + IMAGE_PROCESSING_SEI_RESERVE;
+    if (handle->config.timing_sei) {
+        h264_timing_sei_t timing = {
+            .sequence = frame->sequence,
+            .capture_us = frame->timestamp_us,
+            .encode_begin_us = encode_begin_us,
+            .encode_end_us = esp_timer_get_time(),
+        };
+        cursor -= H264_TIMING_SEI_SIZE;
+        h264_timing_sei_write(cursor, &timing);
+    }
+    uint8_t *end = bitstream + IMAGE_PROCESSING_SEI_RESERVE;
+    if (keyframe) {
+        memcpy(end, s_parameter_sets, sizeof(s_parameter_sets));
+        end += sizeof(s_parameter_sets);
+    }
+    size_t slice_size = frame_size(handle, keyframe);
+    end[0] = 0x00;
+    end[1] = 0x00;
+    end[2] = 0x00;
+    end[3] = 0x01;
+    end[4] = keyframe ? 0x65 : 0x41;
+    memset(end + 5, 0x5a, slice_size);
+    end += 5 + slice_size;
+
+    out_packet->data = cursor;
+    out_packet->length = (size_t)(end - cursor);
+    out_packet->is_keyframe = keyframe;
+    out_packet->timestamp_us = encode_begin_us;
+    return ESP_OK;
+}
+
+void image_processing_release_packet(encoder_handle_t handle, h264_packet_t *packet)
+{
+    if (!handle || !packet || !packet->data) {
+        return;
+    }
+    for (uint32_t i = 0; i < handle->config.bitstream_buffer_count; ++i) {
+        uint8_t *bitstream = handle->bitstream_buffers[i];
+        if (packet->data >= bitstream && packet->data < bitstream + handle->bitstream_size) {
+            xQueueSend(handle->free_buffers, &bitstream, 0);
+            break;
+        }
+    }
+    packet->data = NULL;
+    packet->length = 0;
+}
+
+void image_processing_request_keyframe(encoder_handle_t handle)
+{
+    if (handle) {
+        ESP_LOGD(TAG, "Keyframe requested");
+        handle->keyframe_requested = true;
+    }
+}
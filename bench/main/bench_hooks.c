@@ -0,0 +1,200 @@
+#include "bench_hooks.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "esp_heap_caps.h"
+#include "memory_account.h"
+
+/*
+ * Linked with -Wl,--wrap for every symbol below (see CMakeLists.txt), so calls from the pipeline, recorder and
+ * bench components land here. The heap_caps_*() wrappers go straight to the host allocator, which is all the
+ * linux target has anyway, and record which board heap the caller asked for.
+ */
+
+#define BENCH_HOOKS_TABLE_SIZE 8192
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+void *__real_memcpy(void *dest, const void *src, size_t length);
+void *__real_memmove(void *dest, const void *src, size_t length);
+
+typedef struct {
+    void *ptr;
+    size_t size;
+    bench_heap_class_t heap_class;
+} bench_allocation_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static bench_allocation_t s_allocations[BENCH_HOOKS_TABLE_SIZE];
+static size_t s_current[BENCH_HEAP_CLASS_COUNT];
+static size_t s_peak[BENCH_HEAP_CLASS_COUNT];
+static atomic_ullong s_bytes_copied;
+static atomic_ullong s_hot_path_allocations;
+
+static size_t slot_of(const void *ptr)
+{
+    return ((uintptr_t)ptr >> 4) * 2654435761u % BENCH_HOOKS_TABLE_SIZE;
+}
+
+/* Linear probing with backward-shift deletion, so lookups never need tombstones. */
+static void track(void *ptr, size_t size, bench_heap_class_t heap_class)
+{
+    if (!ptr) {
+        return;
+    }
+    if (memory_account_in_steady_hot_path()) {
+        atomic_fetch_add_explicit(&s_hot_path_allocations, 1, memory_order_relaxed);
+    }
+    pthread_mutex_lock(&s_lock);
+    size_t slot = slot_of(ptr);
+    for (size_t probe = 0; probe < BENCH_HOOKS_TABLE_SIZE; ++probe) {
+        bench_allocation_t *entry = &s_allocations[(slot + probe) % BENCH_HOOKS_TABLE_SIZE];
+        if (!entry->ptr) {
+            *entry = (bench_allocation_t) { .ptr = ptr, .size = size, .heap_class = heap_class };
+            s_current[heap_class] += size;
+            if (s_current[heap_class] > s_peak[heap_class]) {
+                s_peak[heap_class] = s_current[heap_class];
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+/* Pointers the hooks never saw, such as those from inside the C library, are ignored. */
+static void untrack(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    pthread_mutex_lock(&s_lock);
+    size_t slot = slot_of(ptr);
+    size_t hole = BENCH_HOOKS_TABLE_SIZE;
+    for (size_t probe = 0; probe < BENCH_HOOKS_TABLE_SIZE; ++probe) {
+        size_t index = (slot + probe) % BENCH_HOOKS_TABLE_SIZE;
+        if (!s_allocations[index].ptr) {
+            break;
+        }
+        if (s_allocations[index].ptr == ptr) {
+            s_current[s_allocations[index].heap_class] -= s_allocations[index].size;
+            s_allocations[index].ptr = NULL;
+            hole = index;
+            break;
+        }
+    }
+    if (hole != BENCH_HOOKS_TABLE_SIZE) {
+        size_t index = hole;
+        for (;;) {
+            index = (index + 1) % BENCH_HOOKS_TABLE_SIZE;
+            if (!s_allocations[index].ptr) {
+                break;
+            }
+            size_t home = slot_of(s_allocations[index].ptr);
+            bool movable = hole <= index ? (home <= hole || home > index) : (home <= hole && home > index);
+            if (movable) {
+                s_allocations[hole] = s_allocations[index];
+                s_allocations[index].ptr = NULL;
+                hole = index;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+static bench_heap_class_t class_of_caps(uint32_t caps)
+{
+    if (caps & MALLOC_CAP_SPIRAM) {
+        return BENCH_HEAP_SPIRAM;
+    }
+    return (caps & MALLOC_CAP_INTERNAL) ? BENCH_HEAP_INTERNAL : BENCH_HEAP_DEFAULT;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    track(ptr, size, BENCH_HEAP_DEFAULT);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    void *ptr = __real_calloc(count, size);
+    track(ptr, count * size, BENCH_HEAP_DEFAULT);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    void *resized = __real_realloc(ptr, size);
+    if (resized || size == 0) {
+        untrack(ptr);
+        track(resized, size, BENCH_HEAP_DEFAULT);
+    }
+    return resized;
+}
+
+void __wrap_free(void *ptr)
+{
+    untrack(ptr);
+    __real_free(ptr);
+}
+
+void *__wrap_heap_caps_malloc(size_t size, uint32_t caps)
+{
+    void *ptr = __real_malloc(size);
+    track(ptr, size, class_of_caps(caps));
+    return ptr;
+}
+
+void *__wrap_heap_caps_calloc(size_t count, size_t size, uint32_t caps)
+{
+    void *ptr = __real_calloc(count, size);
+    track(ptr, count * size, class_of_caps(caps));
+    return ptr;
+}
+
+void __wrap_heap_caps_free(void *ptr)
+{
+    untrack(ptr);
+    __real_free(ptr);
+}
+
+void *__wrap_memcpy(void *dest, const void *src, size_t length)
+{
+    atomic_fetch_add_explicit(&s_bytes_copied, length, memory_order_relaxed);
+    return __real_memcpy(dest, src, length);
+}
+
+void *__wrap_memmove(void *dest, const void *src, size_t length)
+{
+    atomic_fetch_add_explicit(&s_bytes_copied, length, memory_order_relaxed);
+    return __real_memmove(dest, src, length);
+}
+
+void bench_hooks_reset(void)
+{
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < BENCH_HEAP_CLASS_COUNT; ++i) {
+        s_peak[i] = s_current[i];
+    }
+    pthread_mutex_unlock(&s_lock);
+    atomic_store(&s_bytes_copied, 0);
+    atomic_store(&s_hot_path_allocations, 0);
+}
+
+void bench_hooks_get_stats(bench_hooks_stats_t *stats)
+{
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < BENCH_HEAP_CLASS_COUNT; ++i) {
+        stats->current[i] = s_current[i];
+        stats->peak[i] = s_peak[i];
+    }
+    pthread_mutex_unlock(&s_lock);
+    stats->bytes_copied = atomic_load(&s_bytes_copied);
+    stats->hot_path_allocations = atomic_load(&s_hot_path_allocations);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Where an allocation would live on the board: heap_caps_*() with SPIRAM or INTERNAL, or plain malloc(). */
+typedef enum {
+    BENCH_HEAP_INTERNAL,
+    BENCH_HEAP_SPIRAM,
+    BENCH_HEAP_DEFAULT,
+    BENCH_HEAP_CLASS_COUNT,
+} bench_heap_class_t;
+
+typedef struct {
+    size_t current[BENCH_HEAP_CLASS_COUNT];
+    size_t peak[BENCH_HEAP_CLASS_COUNT];
+    uint64_t bytes_copied;
+    /* Every allocation, accounted or not, made on the hot path once steady state has begun. */
+    uint64_t hot_path_allocations;
+} bench_hooks_stats_t;
+
+/* Zeroes the copy counter and restarts the peaks from what is allocated now. */
+void bench_hooks_reset(void);
+void bench_hooks_get_stats(bench_hooks_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
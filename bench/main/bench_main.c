@@ -0,0 +1,187 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "camera_driver.h"
+#include "image_processing.h"
+#include "connectivity.h"
+#include "recorder.h"
+#include "camera_pipeline.h"
+#include "bench_camera.h"
+#include "bench_transport.h"
+#include "bench_hooks.h"
+#include "bench_metrics.h"
+#include "memory_account.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "bench";
+
+/* Time for frames already captured to clear the encoder and the viewers once the sensor stops. */
+#define BENCH_DRAIN_MS 1000
+
+static const char *const s_stage_names[] = { "capture", "encode", "stream", "event_buffer" };
+static const char *const s_heap_names[BENCH_HEAP_CLASS_COUNT] = { "internal", "spiram", "default" };
+static const char *const s_component_names[MEMORY_ACCOUNT_COMPONENT_COUNT] = {
+    "camera_driver", "image_processing", "connectivity",
+};
+
+#if CONFIG_MEMORY_ACCOUNT_STEADY_STATE
+#define BENCH_WARMUP_FRAMES CONFIG_MEMORY_ACCOUNT_WARMUP_FRAMES
+#else
+#define BENCH_WARMUP_FRAMES UINT32_MAX
+#endif
+
+static uint32_t env_or_default(const char *name, uint32_t fallback)
+{
+    const char *value = getenv(name);
+    return value && *value ? (uint32_t)strtoul(value, NULL, 10) : fallback;
+}
+
+/* Timings are rounded to 0.1 ms and rates to 0.1 fps so that runs of the same tree diff cleanly. */
+static double round_tenths(double value)
+{
+    return (double)(int64_t)(value * 10 + 0.5) / 10;
+}
+
+static void print_latency(const char *name, const bench_latency_t *latency, bool last)
+{
+    printf("    \"%s\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}%s\n", name,
+           round_tenths(latency->p50_us / 1000.0), round_tenths(latency->p90_us / 1000.0),
+           round_tenths(latency->p99_us / 1000.0), round_tenths(latency->max_us / 1000.0), last ? "" : ",");
+}
+
+/*
+ * Runs BENCH_FRAMES frames at BENCH_FPS to BENCH_CLIENTS loopback viewers on a BENCH_LINK_MBPS link and prints
+ * the results as JSON. BENCH_FAIL_ON_HOT_ALLOCATIONS=1 exits with status 1 on any hot-path allocation after warm-up.
+ * BENCH_METRICS_PORT serves GET /metrics on 127.0.0.1 during the run and keeps serving after it until interrupted.
+ */
+void app_main(void)
+{
+    const bench_camera_config_t camera_bench_cfg = {
+        .frame_rate = env_or_default("BENCH_FPS", 30),
+        .frame_limit = env_or_default("BENCH_FRAMES", 300),
+    };
+    encoder_config_t encoder_cfg = image_processing_default_encoder_config();
+    encoder_cfg.fps = camera_bench_cfg.frame_rate;
+    const bench_transport_config_t transport_bench_cfg = {
+        .client_count = env_or_default("BENCH_CLIENTS", 2),
+        .link_bitrate = env_or_default("BENCH_LINK_MBPS", 50) * 1000 * 1000,
+        .queue_frames = 8,
+        .max_samples = camera_bench_cfg.frame_limit,
+        .frame_bytes = encoder_cfg.bitrate / 8 / encoder_cfg.fps,
+    };
+    bench_camera_configure(&camera_bench_cfg);
+    bench_transport_configure(&transport_bench_cfg);
+    bench_hooks_reset();
+    uint32_t metrics_port = env_or_default("BENCH_METRICS_PORT", 0);
+    if (metrics_port) {
+        ESP_ERROR_CHECK(bench_metrics_start((uint16_t)metrics_port));
+    }
+
+    /* The same setup as main_app.c, minus the SD card, which the linux target does not have. */
+    camera_config_t camera_cfg = camera_driver_default_config();
+    ESP_ERROR_CHECK(camera_driver_init(&camera_cfg));
+
+    transport_config_t transport_cfg = connectivity_default_transport_config();
+
+    static camera_pipeline_t camera = {0};
+    transport_handle_t transport = NULL;
+    ESP_ERROR_CHECK(image_processing_create_encoder(&encoder_cfg, &camera.encoder));
+    ESP_ERROR_CHECK(connectivity_start(&transport_cfg, &transport));
+    camera.transport = transport;
+
+    event_buffer_config_t event_buffer_cfg = recorder_default_event_buffer_config();
+    event_buffer_cfg.frame_rate = encoder_cfg.fps;
+    ESP_ERROR_CHECK(recorder_create_event_buffer(&event_buffer_cfg, &camera.event_buffer));
+
+    pipeline_handle_t pipeline = NULL;
+    ESP_ERROR_CHECK(camera_pipeline_start(&camera, &pipeline));
+
+    bench_camera_wait_done();
+    vTaskDelay(pdMS_TO_TICKS(BENCH_DRAIN_MS));
+
+    const size_t stage_count = sizeof(s_stage_names) / sizeof(s_stage_names[0]);
+    pipeline_stage_stats_t stage_stats[sizeof(s_stage_names) / sizeof(s_stage_names[0])] = {0};
+    for (size_t i = 0; i < stage_count; ++i) {
+        if (pipeline_get_stage_stats(pipeline, s_stage_names[i], &stage_stats[i]) != ESP_OK) {
+            ESP_LOGW(TAG, "No stats for stage %s", s_stage_names[i]);
+        }
+    }
+    pipeline_stop(pipeline);
+    connectivity_stop(transport);
+    recorder_destroy_event_buffer(camera.event_buffer);
+    image_processing_destroy_encoder(camera.encoder);
+
+    bench_camera_stats_t camera_stats;
+    bench_transport_results_t results;
+    bench_hooks_stats_t hooks;
+    bench_camera_get_stats(&camera_stats);
+    bench_transport_get_results(&results);
+    bench_hooks_get_stats(&hooks);
+    camera_driver_deinit();
+
+    /* The last frame's period counts too, so a clean run reports the configured rate. */
+    double seconds = (camera_stats.last_us - camera_stats.first_us) / 1e6 + 1.0 / camera_bench_cfg.frame_rate;
+    uint32_t viewers = transport_bench_cfg.client_count ? transport_bench_cfg.client_count : 1;
+    uint32_t frames = camera_stats.captured ? camera_stats.captured : 1;
+
+    printf("{\n");
+    printf("  \"config\": {\"frames\": %" PRIu32 ", \"fps\": %" PRIu32 ", \"clients\": %" PRIu32
+           ", \"link_mbps\": %" PRIu32 ", \"width\": %" PRIu32 ", \"height\": %" PRIu32 "},\n",
+           camera_bench_cfg.frame_limit, camera_bench_cfg.frame_rate, transport_bench_cfg.client_count,
+           transport_bench_cfg.link_bitrate / 1000000, camera_cfg.width, camera_cfg.height);
+    printf("  \"frames\": {\"captured\": %" PRIu32 ", \"dropped_at_capture\": %" PRIu32 ", \"encoded\": %" PRIu32
+           ", \"delivered\": %" PRIu32 ", \"skipped_for_viewers\": %" PRIu32 "},\n",
+           camera_stats.captured, camera_stats.dropped, stage_stats[1].items, results.delivered, results.skipped);
+    printf("  \"fps\": {\"capture\": %.1f, \"encode\": %.1f, \"per_viewer\": %.1f},\n",
+           round_tenths(seconds > 0 ? camera_stats.captured / seconds : 0),
+           round_tenths(seconds > 0 ? stage_stats[1].items / seconds : 0),
+           round_tenths(seconds > 0 ? (double)results.delivered / viewers / seconds : 0));
+    printf("  \"latency_ms\": {\n");
+    print_latency("queue", &results.queue, false);
+    print_latency("encode", &results.encode, false);
+    print_latency("transport", &results.transport, false);
+    print_latency("total", &results.total, true);
+    printf("  },\n");
+    printf("  \"stages\": {\n");
+    for (size_t i = 0; i < stage_count; ++i) {
+        const pipeline_stage_stats_t *stats = &stage_stats[i];
+        printf("    \"%s\": {\"items\": %" PRIu32 ", \"dropped\": %" PRIu32 ", \"busy_ms_per_item\": %.1f}%s\n",
+               s_stage_names[i], stats->items, stats->dropped,
+               round_tenths(stats->items ? stats->busy_us / 1000.0 / stats->items : 0), i + 1 < stage_count ? "," : "");
+    }
+    printf("  },\n");
+    printf("  \"heap_peak_bytes\": {");
+    for (int i = 0; i < BENCH_HEAP_CLASS_COUNT; ++i) {
+        printf("\"%s\": %zu%s", s_heap_names[i], hooks.peak[i], i + 1 < BENCH_HEAP_CLASS_COUNT ? ", " : "");
+    }
+    printf("},\n");
+    printf("  \"bytes_copied_per_frame\": %" PRIu64 ",\n", hooks.bytes_copied / frames);
+    /* Allocations on the pipeline stages and frame ingest after warm-up; accounted ones also by component. */
+    uint32_t encoded = stage_stats[1].items;
+    uint32_t steady_frames = encoded > BENCH_WARMUP_FRAMES ? encoded - BENCH_WARMUP_FRAMES : 0;
+    printf("  \"steady_state_allocations\": {\"frames\": %" PRIu32 ", \"total\": %" PRIu64 ", \"per_frame\": %.1f",
+           steady_frames, hooks.hot_path_allocations,
+           round_tenths(steady_frames ? (double)hooks.hot_path_allocations / steady_frames : 0));
+    for (int i = 0; i < MEMORY_ACCOUNT_COMPONENT_COUNT; ++i) {
+        memory_account_stats_t account;
+        memory_account_get_stats(i, &account);
+        printf(", \"%s\": %" PRIu32, s_component_names[i], account.steady_state_allocations);
+    }
+    printf("}\n");
+    printf("}\n");
+    fflush(stdout);
+
+    while (metrics_port) {
+        vTaskDelay(portMAX_DELAY);
+    }
+
+    /* On the linux target app_main returning leaves the scheduler running. */
+    exit(env_or_default("BENCH_FAIL_ON_HOT_ALLOCATIONS", 0) && hooks.hot_path_allocations ? 1 : 0);
+}
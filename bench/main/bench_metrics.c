@@ -0,0 +1,130 @@
+#include "bench_metrics.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "metrics.h"
+
+static const char *TAG = "bench_metrics";
+
+/*
+ * The board serves /metrics from http_server.c over lwip; the bench replaces connectivity with loopback viewers,
+ * so this is a minimal stand-in on host sockets that lets curl and Prometheus scrape a bench run.
+ */
+
+#define BENCH_METRICS_REQUEST_SIZE 1024
+#define BENCH_METRICS_HEADER_SIZE  128
+
+static void send_all(int sock, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t sent = send(sock, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+}
+
+static void send_response(int sock, const char *status, const char *body, size_t length)
+{
+    char header[BENCH_METRICS_HEADER_SIZE];
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.1 %s\r\n"
+                                 "Content-Type: text/plain; version=0.0.4\r\n"
+                                 "Content-Length: %u\r\n"
+                                 "Connection: close\r\n\r\n",
+                                 status, (unsigned)length);
+    send_all(sock, header, (size_t)header_length);
+    send_all(sock, body, length);
+}
+
+static bool is_metrics_request(const char *request)
+{
+    static const char prefix[] = "GET /metrics";
+    if (strncmp(request, prefix, sizeof(prefix) - 1) != 0) {
+        return false;
+    }
+    char next = request[sizeof(prefix) - 1];
+    return next == ' ' || next == '?';
+}
+
+static void serve_client(int sock)
+{
+    char request[BENCH_METRICS_REQUEST_SIZE];
+    ssize_t received = recv(sock, request, sizeof(request) - 1, 0);
+    if (received <= 0) {
+        return;
+    }
+    request[received] = '\0';
+    if (!is_metrics_request(request)) {
+        static const char not_found[] = "Not Found\n";
+        send_response(sock, "404 Not Found", not_found, sizeof(not_found) - 1);
+        return;
+    }
+
+    /* Values may grow between the sizing pass and the real one; the output then ends early, never overflows. */
+    size_t capacity = metrics_format_prometheus(NULL, 0) + 1;
+    char *body = malloc(capacity);
+    if (!body) {
+        static const char unavailable[] = "Out of memory\n";
+        send_response(sock, "503 Service Unavailable", unavailable, sizeof(unavailable) - 1);
+        return;
+    }
+    size_t length = metrics_format_prometheus(body, capacity);
+    send_response(sock, "200 OK", body, length < capacity ? length : capacity - 1);
+    free(body);
+}
+
+static void bench_metrics_task(void *arg)
+{
+    int listener = (int)(intptr_t)arg;
+    while (true) {
+        int sock = accept(listener, NULL, NULL);
+        if (sock < 0) {
+            ESP_LOGW(TAG, "accept failed: %s", strerror(errno));
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        serve_client(sock);
+        close(sock);
+    }
+}
+
+esp_err_t bench_metrics_start(uint16_t port)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        ESP_LOGE(TAG, "socket failed: %s", strerror(errno));
+        return ESP_FAIL;
+    }
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 4) != 0) {
+        ESP_LOGE(TAG, "Cannot listen on port %u: %s", port, strerror(errno));
+        close(listener);
+        return ESP_FAIL;
+    }
+    if (xTaskCreate(bench_metrics_task, "bench_metrics", 4096, (void *)(intptr_t)listener, 1, NULL) != pdPASS) {
+        close(listener);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Serving http://127.0.0.1:%u/metrics", port);
+    return ESP_OK;
+}
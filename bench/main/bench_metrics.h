@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Serves GET /metrics in the Prometheus text format on 127.0.0.1:`port` from a background task. */
+esp_err_t bench_metrics_start(uint16_t port);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "image_processing_microbench.h"
+#include "connectivity_microbench.h"
+
+/*
+ * MICROBENCH_FILTER runs only the kernels whose name contains it, MICROBENCH_ITERATIONS sets the sample
+ * count and MICROBENCH_COLD=1 evicts the caches before every call.
+ */
+void app_main(void)
+{
+    microbench_config_t config = microbench_default_config();
+    const char *iterations = getenv("MICROBENCH_ITERATIONS");
+    if (iterations && *iterations) {
+        config.iterations = (uint32_t)strtoul(iterations, NULL, 10);
+    }
+    const char *cold = getenv("MICROBENCH_COLD");
+    if (cold && *cold == '1') {
+        config.cache = MICROBENCH_CACHE_COLD;
+    }
+    const char *filter = getenv("MICROBENCH_FILTER");
+
+    size_t count = 0;
+    const microbench_case_t *cases = image_processing_microbench_cases(&count);
+    esp_err_t err = microbench_run_suite(&config, cases, count, filter);
+    cases = connectivity_microbench_cases(&count);
+    if (microbench_run_suite(&config, cases, count, filter) != ESP_OK) {
+        err = ESP_FAIL;
+    }
+    fflush(stdout);
+
+    /* On the linux target app_main returning leaves the scheduler running. */
+    exit(err == ESP_OK ? 0 : 1);
+}
@@ -6,23 +6,39 @@
 #include "esp_check.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "driver/gpio.h"
 #include "driver/csi.h"
 
+#include "memory_account.h"
+#include "metrics.h"
+#include "trace.h"
+
 static const char *TAG = "camera_driver";
 
 static QueueHandle_t s_available_frames;
 static QueueHandle_t s_ready_frames;
 static csi_device_handle_t s_csi_handle;
 static camera_config_t s_camera_config;
+static uint32_t s_frame_sequence;
+
+static METRICS_DEFINE_COUNTER(s_frames_captured, "camera_frames_captured_total", "Frames copied out of the CSI buffers");
+static METRICS_DEFINE_COUNTER(s_frames_dropped, "camera_frames_dropped_total", "Frames lost because every buffer was held downstream");
+static METRICS_DEFINE_COUNTER(s_acquire_timeouts, "camera_acquire_timeouts_total", "Acquire calls that timed out without a frame");
+
+static size_t frame_buffer_size(const camera_config_t *config)
+{
+    return config->width * config->height * 2;
+}
 
 static esp_err_t allocate_frame_buffers(void)
 {
-    const size_t buffer_size = s_camera_config.width * s_camera_config.height * 2;
+    const size_t buffer_size = frame_buffer_size(&s_camera_config);
 
+    /* Not zeroed: the frame-ready callback copies a whole frame into a buffer before anything reads it. */
     for (uint32_t i = 0; i < s_camera_config.frame_buffer_count; ++i) {
-        uint8_t *buffer = (uint8_t *)heap_caps_calloc(1, buffer_size, MALLOC_CAP_SPIRAM);
+        uint8_t *buffer = (uint8_t *)memory_account_malloc(MEMORY_ACCOUNT_CAMERA, buffer_size, MEMORY_PLAN_BULK_CAPS);
         if (!buffer) {
             ESP_LOGE(TAG, "Failed to allocate frame buffer %" PRIu32, i);
             return ESP_ERR_NO_MEM;
@@ -36,7 +52,7 @@ static esp_err_t allocate_frame_buffers(void)
         };
         if (xQueueSend(s_available_frames, &frame, 0) != pdTRUE) {
             ESP_LOGE(TAG, "Failed to populate frame queue");
-            heap_caps_free(buffer);
+            memory_account_free(MEMORY_ACCOUNT_CAMERA, buffer);
             return ESP_FAIL;
         }
     }
@@ -45,15 +61,23 @@ static esp_err_t allocate_frame_buffers(void)
 
 static bool csi_frame_ready_callback(const csi_frame_buffer_t *buffer, void *user_ctx)
 {
+    int64_t now_us = esp_timer_get_time();
     camera_frame_t frame = {0};
     if (xQueueReceiveFromISR(s_available_frames, &frame, NULL) != pdTRUE) {
+        metrics_counter_add(&s_frames_dropped, 1);
+        TRACE_EVENT(TRACE_EVENT_FRAME_DROPPED, s_frame_sequence);
+        ++s_frame_sequence;
         return false;
     }
 
     memcpy(frame.buffer, buffer->buffer, frame.length);
+    frame.sequence = s_frame_sequence++;
+    frame.timestamp_us = now_us;
 
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     xQueueSendFromISR((QueueHandle_t)user_ctx, &frame, &xHigherPriorityTaskWoken);
+    metrics_counter_add(&s_frames_captured, 1);
+    TRACE_EVENT(TRACE_EVENT_FRAME_CAPTURED, frame.sequence);
     return xHigherPriorityTaskWoken == pdTRUE;
 }
 
@@ -64,6 +88,9 @@ esp_err_t camera_driver_init(const camera_config_t *config)
     }
 
     s_camera_config = *config;
+    metrics_register(&s_frames_captured);
+    metrics_register(&s_frames_dropped);
+    metrics_register(&s_acquire_timeouts);
 
     if (!s_available_frames) {
         s_available_frames = xQueueCreate(config->frame_buffer_count, sizeof(camera_frame_t));
@@ -100,7 +127,7 @@ esp_err_t camera_driver_init(const camera_config_t *config)
             config->data.d7,
         },
         .frame_buffer_count = config->frame_buffer_count,
-        .frame_buffer_size = config->width * config->height * 2,
+        .frame_buffer_size = frame_buffer_size(config),
         .flags = {
             .double_speed = false,
         },
@@ -126,7 +153,7 @@ void camera_driver_deinit(void)
     if (s_available_frames) {
         camera_frame_t frame;
         while (xQueueReceive(s_available_frames, &frame, 0) == pdTRUE) {
-            heap_caps_free(frame.buffer);
+            memory_account_free(MEMORY_ACCOUNT_CAMERA, frame.buffer);
         }
         vQueueDelete(s_available_frames);
         s_available_frames = NULL;
@@ -134,7 +161,7 @@ void camera_driver_deinit(void)
     if (s_ready_frames) {
         camera_frame_t frame;
         while (xQueueReceive(s_ready_frames, &frame, 0) == pdTRUE) {
-            heap_caps_free(frame.buffer);
+            memory_account_free(MEMORY_ACCOUNT_CAMERA, frame.buffer);
         }
         vQueueDelete(s_ready_frames);
         s_ready_frames = NULL;
@@ -165,12 +192,23 @@ camera_config_t camera_driver_default_config(void)
     };
 }
 
+esp_err_t camera_driver_plan_memory(const camera_config_t *config, memory_plan_t *plan)
+{
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "camera frames", MEMORY_PLAN_SPIRAM, frame_buffer_size(config),
+                                        config->frame_buffer_count), TAG, "Failed to plan frame buffers");
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "CSI frames", MEMORY_PLAN_SPIRAM, frame_buffer_size(config),
+                                        config->frame_buffer_count), TAG, "Failed to plan CSI buffers");
+    return memory_plan_add(plan, "camera frame queues", MEMORY_PLAN_INTERNAL, sizeof(camera_frame_t),
+                           2 * config->frame_buffer_count);
+}
+
 esp_err_t camera_driver_acquire_frame(camera_frame_t *frame, TickType_t ticks_to_wait)
 {
     if (!frame || !s_ready_frames) {
         return ESP_ERR_INVALID_STATE;
     }
     if (xQueueReceive(s_ready_frames, frame, ticks_to_wait) != pdTRUE) {
+        metrics_counter_add(&s_acquire_timeouts, 1);
         return ESP_ERR_TIMEOUT;
     }
     return ESP_OK;
@@ -8,6 +8,8 @@
 
 #include "driver/csi.h"
 
+#include "memory_plan.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -39,6 +41,8 @@ typedef struct {
     uint32_t width;
     uint32_t height;
     pixformat_t pixel_format;
+    uint32_t sequence;
+    uint64_t timestamp_us;
 } camera_frame_t;
 
 esp_err_t camera_driver_init(const camera_config_t *config);
@@ -46,6 +50,9 @@ void camera_driver_deinit(void);
 
 camera_config_t camera_driver_default_config(void);
 
+/* Adds what camera_driver_init() allocates for `config`, including the CSI driver's own frame buffers. */
+esp_err_t camera_driver_plan_memory(const camera_config_t *config, memory_plan_t *plan);
+
 esp_err_t camera_driver_acquire_frame(camera_frame_t *frame, TickType_t ticks_to_wait);
 void camera_driver_release_frame(camera_frame_t *frame);
 
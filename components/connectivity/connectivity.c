@@ -1,8 +1,8 @@
 #include "connectivity.h"
 
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #include "esp_check.h"
 #include "esp_event.h"
@@ -10,29 +10,40 @@
 #include "esp_netif.h"
 #include "esp_wifi.h"
 #include "esp_eth.h"
-#include "lwip/sockets.h"
+#include "esp_timer.h"
 #include "lwip/inet.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "freertos/queue.h"
+
+#include "http_server.h"
+#include "link_failover.h"
+#include "memory_account.h"
+#include "metrics.h"
+#include "rtsp_server.h"
+#include "stream_frame.h"
+#include "trace.h"
 
 static const char *TAG = "connectivity";
 
-#define CONNECTIVITY_PACKET_QUEUE_LENGTH 4
+static METRICS_DEFINE_COUNTER(s_frames_submitted, "stream_frames_total", "Encoded frames handed to the streaming servers");
+static METRICS_DEFINE_COUNTER(s_frames_dropped, "stream_frames_dropped_total",
+                              "Encoded frames dropped because the RTSP server queue was full");
+static METRICS_DEFINE_COUNTER(s_link_switches, "link_switches_total", "Egress moves between Ethernet and Wi-Fi");
 
-typedef struct {
-    uint8_t *payload;
-    size_t length;
-    int is_keyframe;
-    uint64_t timestamp_us;
-} rtsp_frame_packet_t;
+typedef struct rtsp_transport_context_t rtsp_transport_context_t;
 
 struct rtsp_transport_context_t {
     transport_config_t config;
-    QueueHandle_t packet_queue;
-    TaskHandle_t server_task;
-    int client_socket;
-    esp_netif_t *netif;
+    rtsp_server_t *rtsp_server;
+    http_server_t *http_server;
+    esp_netif_t *eth_netif;
+    esp_netif_t *wifi_netif;
+    esp_eth_handle_t eth_handle;
+    esp_eth_mac_t *eth_mac;
+    esp_eth_phy_t *eth_phy;
+    esp_eth_netif_glue_handle_t eth_glue;
+    bool wifi_started;
+    esp_timer_handle_t link_timer;
+    link_failover_t failover;
+    atomic_bool keyframe_requested;
 };
 
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
@@ -70,84 +81,135 @@ static esp_err_t start_wifi(rtsp_transport_context_t *ctx)
 
 static void stop_wifi(void)
 {
+    esp_event_handler_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler);
+    esp_event_handler_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler);
     esp_wifi_stop();
     esp_wifi_deinit();
 }
 
-static void rtsp_server_task(void *arg)
+static esp_err_t start_ethernet(rtsp_transport_context_t *ctx)
 {
-    rtsp_transport_context_t *ctx = (rtsp_transport_context_t *)arg;
-    struct sockaddr_in server_addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(ctx->config.rtsp_port),
-        .sin_addr.s_addr = htonl(INADDR_ANY),
-    };
-
-    int listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
-    if (listen_socket < 0) {
-        ESP_LOGE(TAG, "Failed to create RTSP socket");
-        vTaskDelete(NULL);
-        return;
+    eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
+    eth_esp32_emac_config_t emac_config = ETH_ESP32_EMAC_DEFAULT_CONFIG();
+    eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
+    phy_config.phy_addr = ctx->config.ethernet.phy_address;
+    phy_config.reset_gpio_num = ctx->config.ethernet.phy_reset_gpio;
+
+    ctx->eth_mac = esp_eth_mac_new_esp32(&emac_config, &mac_config);
+    ctx->eth_phy = esp_eth_phy_new_generic(&phy_config);
+    if (!ctx->eth_mac || !ctx->eth_phy) {
+        return ESP_FAIL;
     }
+    esp_eth_config_t eth_config = ETH_DEFAULT_CONFIG(ctx->eth_mac, ctx->eth_phy);
+    ESP_RETURN_ON_ERROR(esp_eth_driver_install(&eth_config, &ctx->eth_handle), TAG, "Ethernet driver install failed");
 
-    int enable = 1;
-    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    ctx->eth_glue = esp_eth_new_netif_glue(ctx->eth_handle);
+    ESP_RETURN_ON_ERROR(esp_netif_attach(ctx->eth_netif, ctx->eth_glue), TAG, "Failed to attach Ethernet netif");
+    ESP_RETURN_ON_ERROR(esp_eth_start(ctx->eth_handle), TAG, "Failed to start Ethernet");
+    return ESP_OK;
+}
 
-    if (bind(listen_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        ESP_LOGE(TAG, "Failed to bind RTSP socket");
-        close(listen_socket);
-        vTaskDelete(NULL);
-        return;
+static void stop_ethernet(rtsp_transport_context_t *ctx)
+{
+    if (ctx->eth_handle) {
+        esp_eth_stop(ctx->eth_handle);
+    }
+    if (ctx->eth_glue) {
+        esp_eth_del_netif_glue(ctx->eth_glue);
+        ctx->eth_glue = NULL;
+    }
+    if (ctx->eth_handle) {
+        esp_eth_driver_uninstall(ctx->eth_handle);
+        ctx->eth_handle = NULL;
     }
+    if (ctx->eth_phy) {
+        ctx->eth_phy->del(ctx->eth_phy);
+        ctx->eth_phy = NULL;
+    }
+    if (ctx->eth_mac) {
+        ctx->eth_mac->del(ctx->eth_mac);
+        ctx->eth_mac = NULL;
+    }
+}
 
-    listen(listen_socket, 1);
-    ESP_LOGI(TAG, "RTSP server listening on rtsp://%s:%d%s", ctx->config.hostname, ctx->config.rtsp_port, ctx->config.rtsp_path);
+static bool netif_healthy(esp_netif_t *netif)
+{
+    esp_netif_ip_info_t ip_info;
+    return netif && esp_netif_is_netif_up(netif) && esp_netif_get_ip_info(netif, &ip_info) == ESP_OK &&
+           ip_info.ip.addr != 0;
+}
 
-    while (true) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_socket = accept(listen_socket, (struct sockaddr *)&client_addr, &client_len);
-        if (client_socket < 0) {
-            continue;
-        }
+static const char *transport_name(transport_type_t type)
+{
+    return type == CONNECTIVITY_TRANSPORT_ETHERNET ? "Ethernet" : "Wi-Fi";
+}
 
-        ESP_LOGI(TAG, "RTSP client connected: %s", inet_ntoa(client_addr.sin_addr));
-        ctx->client_socket = client_socket;
-
-        while (true) {
-            rtsp_frame_packet_t packet;
-            if (xQueueReceive(ctx->packet_queue, &packet, portMAX_DELAY) != pdTRUE) {
-                continue;
-            }
-
-            if (ctx->client_socket >= 0) {
-                int sent = send(ctx->client_socket, packet.payload, packet.length, 0);
-                if (sent < 0) {
-                    ESP_LOGW(TAG, "Client disconnected");
-                    close(ctx->client_socket);
-                    ctx->client_socket = -1;
-                    free(packet.payload);
-                    break;
-                }
-            }
-
-            free(packet.payload);
-        }
+/*
+ * Sockets are bound to INADDR_ANY, so moving the default netif moves unicast and multicast egress with it.
+ * The RTP packetizer state lives in the servers, so sequence numbers and timestamps continue across the switch.
+ */
+static void link_monitor_callback(void *arg)
+{
+    rtsp_transport_context_t *ctx = arg;
+    if (!link_failover_update(&ctx->failover, netif_healthy(ctx->eth_netif), netif_healthy(ctx->wifi_netif),
+                              esp_timer_get_time())) {
+        return;
+    }
+
+    transport_type_t active = ctx->failover.active;
+    esp_netif_set_default_netif(active == CONNECTIVITY_TRANSPORT_ETHERNET ? ctx->eth_netif : ctx->wifi_netif);
+    if (ctx->failover.switches > 0) {
+        ESP_LOGW(TAG, "Egress moved to %s", transport_name(active));
+        metrics_counter_add(&s_link_switches, 1);
+        atomic_store(&ctx->keyframe_requested, true);
+        rtsp_server_notify_link_change(ctx->rtsp_server);
+    } else {
+        ESP_LOGI(TAG, "Streaming over %s", transport_name(active));
     }
 }
 
+static esp_err_t start_link_monitor(rtsp_transport_context_t *ctx)
+{
+    link_failover_init(&ctx->failover, ctx->config.transport_type, ctx->config.failover.hold_down_ms);
+    esp_timer_create_args_t timer_args = {
+        .callback = link_monitor_callback,
+        .arg = ctx,
+        .name = "link_monitor",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &ctx->link_timer), TAG, "Failed to create link monitor");
+    return esp_timer_start_periodic(ctx->link_timer, (uint64_t)ctx->config.failover.check_interval_ms * 1000);
+}
+
 static esp_err_t start_network(rtsp_transport_context_t *ctx)
 {
     ESP_RETURN_ON_ERROR(esp_netif_init(), TAG, "esp_netif init failed");
 
-    if (ctx->config.transport_type == CONNECTIVITY_TRANSPORT_ETHERNET) {
-        ctx->netif = esp_netif_create_default_eth_netif();
-        ESP_LOGI(TAG, "Created default Ethernet netif");
-    } else {
-        ctx->netif = esp_netif_create_default_wifi_sta();
+    bool failover = ctx->config.failover.enable;
+    bool both_links = failover || ctx->config.redundancy.enable;
+    bool use_ethernet = both_links || ctx->config.transport_type == CONNECTIVITY_TRANSPORT_ETHERNET;
+    /* Without credentials there is no second link to use. */
+    bool use_wifi = ctx->config.transport_type == CONNECTIVITY_TRANSPORT_WIFI ||
+                    (both_links && ctx->config.wifi_ssid && ctx->config.wifi_ssid[0]);
+
+    if (use_ethernet) {
+        ctx->eth_netif = esp_netif_create_default_eth_netif();
+        esp_err_t err = start_ethernet(ctx);
+        if (err != ESP_OK && !use_wifi) {
+            return err;
+        }
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Ethernet unavailable, continuing with Wi-Fi only");
+        }
+    }
+    if (use_wifi) {
+        ctx->wifi_netif = esp_netif_create_default_wifi_sta();
         ESP_RETURN_ON_ERROR(start_wifi(ctx), TAG, "Failed to start Wi-Fi");
+        ctx->wifi_started = true;
     }
 
+    if (failover) {
+        ESP_RETURN_ON_ERROR(start_link_monitor(ctx), TAG, "Failed to start link monitor");
+    }
     return ESP_OK;
 }
 
@@ -156,12 +218,23 @@ static void stop_network(rtsp_transport_context_t *ctx)
     if (!ctx) {
         return;
     }
-    if (ctx->config.transport_type == CONNECTIVITY_TRANSPORT_WIFI) {
+    if (ctx->link_timer) {
+        esp_timer_stop(ctx->link_timer);
+        esp_timer_delete(ctx->link_timer);
+        ctx->link_timer = NULL;
+    }
+    if (ctx->wifi_started) {
         stop_wifi();
+        ctx->wifi_started = false;
     }
-    if (ctx->netif) {
-        esp_netif_destroy(ctx->netif);
-        ctx->netif = NULL;
+    stop_ethernet(ctx);
+    if (ctx->wifi_netif) {
+        esp_netif_destroy(ctx->wifi_netif);
+        ctx->wifi_netif = NULL;
+    }
+    if (ctx->eth_netif) {
+        esp_netif_destroy(ctx->eth_netif);
+        ctx->eth_netif = NULL;
     }
 }
 
@@ -175,37 +248,142 @@ transport_config_t connectivity_default_transport_config(void)
         .wifi_password = "",
         .enable_ipv6 = true,
         .rtsp_port = 8554,
+        .rtp_port = 5004,
+        .max_clients = 4,
+        .server_task = {
+            .priority = tskIDLE_PRIORITY + 4,
+            .core_id = tskNO_AFFINITY,
+        },
+        .ethernet = {
+            .phy_address = -1,
+            .phy_reset_gpio = -1,
+        },
+        .failover = {
+            .enable = true,
+            .check_interval_ms = 250,
+            .hold_down_ms = 5000,
+        },
+        .pacing = {
+            .enable = true,
+            .bitrate = 8 * 1024 * 1024,
+            .frame_rate = 30,
+            .spread_percent = 80,
+            .burst_bytes = 8 * 1024,
+        },
+        .retransmission = {
+            .enable = true,
+            .history_packets = 1024,
+            .max_age_ms = 500,
+        },
+        .fec = {
+            .enable = false,
+            .keyframe_group_size = 4,
+            .delta_group_size = 10,
+        },
+        .multicast = {
+            .enable = false,
+            .group_address = "239.255.0.1",
+            .port = 5006,
+            .ttl = 16,
+        },
+        .http = {
+            .enable = true,
+            .port = 8080,
+            .max_clients = 4,
+        },
+        .fmp4 = {
+            .enable = true,
+            .path = "/stream.mp4",
+            .fragment_frames = 1,
+        },
+        .websocket = {
+            .enable = true,
+            .path = "/ws",
+        },
+        .metrics = {
+            .enable = true,
+            .path = "/metrics",
+        },
+        .trace = {
+            .enable = true,
+            .path = "/trace",
+        },
+        .clock = {
+            .enable = true,
+            .path = "/clock",
+        },
+        .mpegts = {
+            .enable = false,
+            .destination = "239.255.0.2",
+            .port = 1234,
+            .ttl = 16,
+        },
+        .redundancy = {
+            .enable = false,
+        },
+        .gop_cache = {
+            .enable = true,
+            .burst_percent = 200,
+        },
     };
 }
 
+esp_err_t connectivity_plan_memory(const transport_config_t *config, memory_plan_t *plan)
+{
+    if (!config || !plan) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "transport context", MEMORY_PLAN_INTERNAL,
+                                        sizeof(rtsp_transport_context_t), 1), TAG, "Failed to plan transport");
+    ESP_RETURN_ON_ERROR(rtsp_server_plan_memory(config, plan), TAG, "Failed to plan RTSP server");
+    if (config->http.enable) {
+        ESP_RETURN_ON_ERROR(http_server_plan_memory(config, plan), TAG, "Failed to plan HTTP server");
+    }
+    return ESP_OK;
+}
+
 esp_err_t connectivity_start(const transport_config_t *config, transport_handle_t *out_handle)
 {
     if (!config || !out_handle) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    rtsp_transport_context_t *ctx = calloc(1, sizeof(*ctx));
+    rtsp_transport_context_t *ctx = memory_account_calloc(MEMORY_ACCOUNT_CONNECTIVITY, 1, sizeof(*ctx),
+                                                          MEMORY_PLAN_HOT_CAPS);
     if (!ctx) {
         return ESP_ERR_NO_MEM;
     }
 
     ctx->config = *config;
-    ctx->client_socket = -1;
-    ctx->packet_queue = xQueueCreate(CONNECTIVITY_PACKET_QUEUE_LENGTH, sizeof(rtsp_frame_packet_t));
-    if (!ctx->packet_queue) {
-        free(ctx);
-        return ESP_ERR_NO_MEM;
-    }
+    metrics_register(&s_frames_submitted);
+    metrics_register(&s_frames_dropped);
+    metrics_register(&s_link_switches);
 
-    ESP_RETURN_ON_ERROR(start_network(ctx), TAG, "Failed to start network");
+    esp_err_t err = start_network(ctx);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start network: %s", esp_err_to_name(err));
+        stop_network(ctx);
+        memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, ctx);
+        return err;
+    }
 
-    BaseType_t task_created = xTaskCreatePinnedToCore(rtsp_server_task, "rtsp_server", 6 * 1024, ctx, tskIDLE_PRIORITY + 4, &ctx->server_task, tskNO_AFFINITY);
-    if (task_created != pdPASS) {
-        ESP_LOGE(TAG, "Failed to create RTSP server task");
+    err = rtsp_server_start(&ctx->config, &ctx->rtsp_server);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start RTSP server: %s", esp_err_to_name(err));
         stop_network(ctx);
-        vQueueDelete(ctx->packet_queue);
-        free(ctx);
-        return ESP_ERR_NO_MEM;
+        memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, ctx);
+        return err;
+    }
+
+    if (ctx->config.http.enable) {
+        err = http_server_start(&ctx->config, &ctx->http_server);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start HTTP server: %s", esp_err_to_name(err));
+            rtsp_server_stop(ctx->rtsp_server);
+            stop_network(ctx);
+            memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, ctx);
+            return err;
+        }
     }
 
     *out_handle = ctx;
@@ -219,24 +397,15 @@ void connectivity_stop(transport_handle_t handle)
     }
 
     rtsp_transport_context_t *ctx = handle;
-    if (ctx->server_task) {
-        vTaskDelete(ctx->server_task);
-        ctx->server_task = NULL;
-    }
-    if (ctx->client_socket >= 0) {
-        close(ctx->client_socket);
-        ctx->client_socket = -1;
-    }
-    if (ctx->packet_queue) {
-        rtsp_frame_packet_t packet;
-        while (xQueueReceive(ctx->packet_queue, &packet, 0) == pdTRUE) {
-            free(packet.payload);
-        }
-        vQueueDelete(ctx->packet_queue);
-        ctx->packet_queue = NULL;
+    if (ctx->link_timer) {
+        esp_timer_stop(ctx->link_timer);
     }
+    http_server_stop(ctx->http_server);
+    ctx->http_server = NULL;
+    rtsp_server_stop(ctx->rtsp_server);
+    ctx->rtsp_server = NULL;
     stop_network(ctx);
-    free(ctx);
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, ctx);
 }
 
 esp_err_t connectivity_stream_packet(transport_handle_t handle, const h264_packet_t *packet)
@@ -246,24 +415,58 @@ esp_err_t connectivity_stream_packet(transport_handle_t handle, const h264_packe
     }
 
     rtsp_transport_context_t *ctx = handle;
-    rtsp_frame_packet_t frame_packet = {
-        .length = packet->length,
-        .is_keyframe = packet->is_keyframe,
-        .timestamp_us = packet->timestamp_us,
-        .payload = malloc(packet->length),
-    };
-
-    if (!frame_packet.payload) {
+    TRACE_EVENT(TRACE_EVENT_STREAM_SUBMIT_BEGIN, packet->timestamp_us);
+    stream_frame_t *frame = stream_frame_create(rtsp_server_get_frame_pool(ctx->rtsp_server), packet);
+    if (!frame) {
+        /* The pool is full of frames slow viewers still hold; they resync on the next keyframe. */
+        rtsp_server_mark_frame_lost(ctx->rtsp_server);
+        http_server_mark_frame_lost(ctx->http_server);
+        metrics_counter_add(&s_frames_dropped, 1);
+        TRACE_EVENT(TRACE_EVENT_STREAM_SUBMIT_END, packet->timestamp_us);
         return ESP_ERR_NO_MEM;
     }
+    metrics_counter_add(&s_frames_submitted, 1);
 
-    memcpy(frame_packet.payload, packet->data, packet->length);
-
-    if (xQueueSend(ctx->packet_queue, &frame_packet, pdMS_TO_TICKS(10)) != pdTRUE) {
-        free(frame_packet.payload);
+    /* HTTP viewers never hold up the encoder; a full queue there only costs them a resync on the next keyframe. */
+    if (ctx->http_server) {
+        http_server_submit_frame(ctx->http_server, stream_frame_ref(frame), 0);
+    }
+    esp_err_t err = rtsp_server_submit_frame(ctx->rtsp_server, frame, pdMS_TO_TICKS(10));
+    TRACE_EVENT(TRACE_EVENT_STREAM_SUBMIT_END, packet->timestamp_us);
+    if (err != ESP_OK) {
         ESP_LOGW(TAG, "Dropping packet due to full queue");
+        metrics_counter_add(&s_frames_dropped, 1);
         return ESP_ERR_TIMEOUT;
     }
 
     return ESP_OK;
 }
+
+uint32_t connectivity_get_backlog(transport_handle_t handle)
+{
+    if (!handle) {
+        return 0;
+    }
+    rtsp_transport_context_t *ctx = handle;
+    return rtsp_server_get_backlog(ctx->rtsp_server);
+}
+
+bool connectivity_take_keyframe_request(transport_handle_t handle)
+{
+    if (!handle) {
+        return false;
+    }
+    rtsp_transport_context_t *ctx = handle;
+    return atomic_exchange(&ctx->keyframe_requested, false);
+}
+
+esp_err_t connectivity_get_client_stats(transport_handle_t handle, connectivity_client_stats_t *stats, size_t max_stats, size_t *out_count)
+{
+    if (!handle || (!stats && max_stats > 0) || !out_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    rtsp_transport_context_t *ctx = handle;
+    *out_count = rtsp_server_get_client_stats(ctx->rtsp_server, stats, max_stats);
+    return ESP_OK;
+}
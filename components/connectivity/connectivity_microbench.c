@@ -0,0 +1,182 @@
+#include "connectivity_microbench.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtp_fec.h"
+#include "rtp_packetizer.h"
+#include "ts_muxer.h"
+
+#define MICROBENCH_PIXELS               (1920 * 1080)
+/* About a keyframe at the default 8 Mbit/s and 30 fps. */
+#define MICROBENCH_ACCESS_UNIT_SIZE     (128 * 1024)
+/* The default keyframe group size in connectivity_default_transport_config(). */
+#define MICROBENCH_FEC_GROUP_SIZE       4
+#define MICROBENCH_TS_SECTION_SIZE      (TS_PACKET_SIZE - 4)
+
+/* Keeps the compiler from dropping results nothing else reads. */
+static volatile uint32_t s_sink;
+
+typedef struct {
+    uint8_t *access_unit;
+    rtp_packetizer_t packetizer;
+    rtp_packet_t *packets;
+    size_t packet_count;
+    rtp_fec_encoder_t fec;
+    uint8_t *fec_buffer;
+    rtp_packet_t *fec_packets;
+    ts_muxer_t ts;
+    uint8_t ts_packet[TS_PACKET_SIZE];
+} stream_ctx_t;
+
+static void stream_teardown(void *ctx)
+{
+    stream_ctx_t *stream = (stream_ctx_t *)ctx;
+    if (!stream) {
+        return;
+    }
+    free(stream->access_unit);
+    free(stream->packets);
+    free(stream->fec_buffer);
+    free(stream->fec_packets);
+    free(stream);
+}
+
+/* One keyframe, already split into RTP packets, with room for the FEC packets that protect it. */
+static esp_err_t stream_setup(void **out_ctx)
+{
+    stream_ctx_t *stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        return ESP_ERR_NO_MEM;
+    }
+    stream->access_unit = malloc(MICROBENCH_ACCESS_UNIT_SIZE);
+    if (!stream->access_unit) {
+        stream_teardown(stream);
+        return ESP_ERR_NO_MEM;
+    }
+    microbench_fill_access_unit(stream->access_unit, MICROBENCH_ACCESS_UNIT_SIZE, 1);
+
+    /* Fixed identifiers instead of esp_random(), so every run packetizes identically. */
+    rtp_packetizer_init(&stream->packetizer, RTP_DEFAULT_MTU);
+    stream->packetizer.ssrc = 0x12345678;
+    stream->packetizer.sequence = 0;
+    stream->fec.ssrc = 0x12345679;
+    stream->fec.sequence = 0;
+
+    stream->packet_count = rtp_packetizer_count(&stream->packetizer, stream->access_unit, MICROBENCH_ACCESS_UNIT_SIZE);
+    size_t fec_count = rtp_fec_group_count(stream->packet_count, MICROBENCH_FEC_GROUP_SIZE);
+    stream->packets = calloc(stream->packet_count, sizeof(rtp_packet_t));
+    stream->fec_buffer = malloc(fec_count * RTP_FEC_PACKET_BUFFER_SIZE);
+    stream->fec_packets = calloc(fec_count, sizeof(rtp_packet_t));
+    if (!stream->packets || !stream->fec_buffer || !stream->fec_packets) {
+        stream_teardown(stream);
+        return ESP_ERR_NO_MEM;
+    }
+    rtp_packetizer_packetize(&stream->packetizer, stream->access_unit, MICROBENCH_ACCESS_UNIT_SIZE, 0,
+                             stream->packets, stream->packet_count);
+    *out_ctx = stream;
+    return ESP_OK;
+}
+
+static void rtp_packetize_run(void *ctx)
+{
+    stream_ctx_t *stream = (stream_ctx_t *)ctx;
+    stream->packetizer.sequence = 0;
+    s_sink = rtp_packetizer_packetize(&stream->packetizer, stream->access_unit, MICROBENCH_ACCESS_UNIT_SIZE, 0,
+                                      stream->packets, stream->packet_count);
+}
+
+static void rtp_fec_protect_run(void *ctx)
+{
+    stream_ctx_t *stream = (stream_ctx_t *)ctx;
+    stream->fec.sequence = 0;
+    s_sink = rtp_fec_protect(&stream->fec, stream->packets, stream->packet_count, MICROBENCH_FEC_GROUP_SIZE,
+                             stream->fec_buffer, stream->fec_packets);
+}
+
+static void ts_mux_run(void *ctx)
+{
+    stream_ctx_t *stream = (stream_ctx_t *)ctx;
+    uint32_t packets = 0;
+    ts_muxer_init(&stream->ts);
+    ts_muxer_begin_frame(&stream->ts, stream->access_unit, MICROBENCH_ACCESS_UNIT_SIZE, 0, true);
+    while (ts_muxer_write_packet(&stream->ts, stream->ts_packet)) {
+        ++packets;
+    }
+    s_sink = packets;
+}
+
+static esp_err_t buffers_setup(void **out_ctx)
+{
+    uint8_t *buffers = malloc(2 * RTP_DEFAULT_MTU);
+    if (!buffers) {
+        return ESP_ERR_NO_MEM;
+    }
+    microbench_fill_access_unit(buffers, 2 * RTP_DEFAULT_MTU, 2);
+    *out_ctx = buffers;
+    return ESP_OK;
+}
+
+static void free_ctx(void *ctx)
+{
+    free(ctx);
+}
+
+static void rtp_fec_xor_run(void *ctx)
+{
+    uint8_t *buffers = (uint8_t *)ctx;
+    rtp_fec_xor(buffers, buffers + RTP_DEFAULT_MTU, RTP_DEFAULT_MTU);
+    s_sink = buffers[0];
+}
+
+static void ts_crc32_run(void *ctx)
+{
+    s_sink = ts_crc32((const uint8_t *)ctx, MICROBENCH_TS_SECTION_SIZE);
+}
+
+static const microbench_case_t s_cases[] = {
+    {
+        .name = "rtp_packetize",
+        .bytes = MICROBENCH_ACCESS_UNIT_SIZE,
+        .pixels = MICROBENCH_PIXELS,
+        .setup = stream_setup,
+        .run = rtp_packetize_run,
+        .teardown = stream_teardown,
+    },
+    {
+        .name = "rtp_fec_protect",
+        .bytes = MICROBENCH_ACCESS_UNIT_SIZE,
+        .pixels = MICROBENCH_PIXELS,
+        .setup = stream_setup,
+        .run = rtp_fec_protect_run,
+        .teardown = stream_teardown,
+    },
+    {
+        .name = "rtp_fec_xor",
+        .bytes = RTP_DEFAULT_MTU,
+        .setup = buffers_setup,
+        .run = rtp_fec_xor_run,
+        .teardown = free_ctx,
+    },
+    {
+        .name = "ts_mux",
+        .bytes = MICROBENCH_ACCESS_UNIT_SIZE,
+        .pixels = MICROBENCH_PIXELS,
+        .setup = stream_setup,
+        .run = ts_mux_run,
+        .teardown = stream_teardown,
+    },
+    {
+        .name = "ts_crc32",
+        .bytes = MICROBENCH_TS_SECTION_SIZE,
+        .setup = buffers_setup,
+        .run = ts_crc32_run,
+        .teardown = free_ctx,
+    },
+};
+
+const microbench_case_t *connectivity_microbench_cases(size_t *count)
+{
+    *count = sizeof(s_cases) / sizeof(s_cases[0]);
+    return s_cases;
+}
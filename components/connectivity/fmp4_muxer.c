@@ -0,0 +1,387 @@
+#include "fmp4_muxer.h"
+
+#include <string.h>
+
+#include "h264_nal.h"
+
+#define FMP4_TRACK_ID                   1
+
+/* Fixed offsets inside the moof template; only sizes, counters and sample entries change per fragment. */
+#define MOOF_MFHD_SEQUENCE_OFFSET       20
+#define MOOF_TRAF_OFFSET                24
+#define MOOF_TFDT_TIME_OFFSET           60
+#define MOOF_TRUN_OFFSET                68
+#define MOOF_TRUN_COUNT_OFFSET          80
+#define MOOF_TRUN_DATA_OFFSET           84
+#define MOOF_TRUN_ENTRIES_OFFSET        88
+#define MOOF_TRUN_ENTRY_SIZE            12
+#define MDAT_HEADER_SIZE                8
+
+#define TRUN_FLAGS                      0x000701    /* data-offset, sample duration, size and flags present */
+#define TFHD_FLAGS                      0x020000    /* default-base-is-moof */
+#define SAMPLE_FLAGS_SYNC               0x02000000
+#define SAMPLE_FLAGS_NON_SYNC           0x01010000
+
+typedef struct {
+    uint8_t *data;
+    size_t capacity;
+    size_t length;
+} box_writer_t;
+
+static void put_bytes(box_writer_t *writer, const void *data, size_t length)
+{
+    if (writer->length + length <= writer->capacity) {
+        memcpy(writer->data + writer->length, data, length);
+    }
+    writer->length += length;
+}
+
+static void put_u32_at(uint8_t *data, uint32_t value)
+{
+    data[0] = (uint8_t)(value >> 24);
+    data[1] = (uint8_t)(value >> 16);
+    data[2] = (uint8_t)(value >> 8);
+    data[3] = (uint8_t)value;
+}
+
+static void put_u8(box_writer_t *writer, uint8_t value)
+{
+    put_bytes(writer, &value, 1);
+}
+
+static void put_u16(box_writer_t *writer, uint16_t value)
+{
+    uint8_t bytes[2] = { (uint8_t)(value >> 8), (uint8_t)value };
+    put_bytes(writer, bytes, sizeof(bytes));
+}
+
+static void put_u32(box_writer_t *writer, uint32_t value)
+{
+    uint8_t bytes[4];
+    put_u32_at(bytes, value);
+    put_bytes(writer, bytes, sizeof(bytes));
+}
+
+static void put_zeros(box_writer_t *writer, size_t count)
+{
+    while (count-- > 0) {
+        put_u8(writer, 0);
+    }
+}
+
+static size_t box_begin(box_writer_t *writer, const char *type)
+{
+    size_t start = writer->length;
+    put_u32(writer, 0);
+    put_bytes(writer, type, 4);
+    return start;
+}
+
+static size_t full_box_begin(box_writer_t *writer, const char *type, uint8_t version, uint32_t flags)
+{
+    size_t start = box_begin(writer, type);
+    put_u32(writer, ((uint32_t)version << 24) | flags);
+    return start;
+}
+
+static void box_end(box_writer_t *writer, size_t start)
+{
+    if (writer->length <= writer->capacity) {
+        put_u32_at(writer->data + start, (uint32_t)(writer->length - start));
+    }
+}
+
+static void put_matrix(box_writer_t *writer)
+{
+    static const uint32_t unity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+    for (size_t i = 0; i < 9; ++i) {
+        put_u32(writer, unity[i]);
+    }
+}
+
+static void write_sample_entry(box_writer_t *writer, const fmp4_muxer_t *muxer, const uint8_t *sps, size_t sps_length,
+                               const uint8_t *pps, size_t pps_length)
+{
+    size_t avc1 = box_begin(writer, "avc1");
+    put_zeros(writer, 6);
+    put_u16(writer, 1);
+    put_zeros(writer, 16);
+    put_u16(writer, (uint16_t)muxer->width);
+    put_u16(writer, (uint16_t)muxer->height);
+    put_u32(writer, 0x00480000);
+    put_u32(writer, 0x00480000);
+    put_u32(writer, 0);
+    put_u16(writer, 1);
+    put_zeros(writer, 32);
+    put_u16(writer, 0x0018);
+    put_u16(writer, 0xFFFF);
+
+    size_t avcc = box_begin(writer, "avcC");
+    put_u8(writer, 1);
+    put_u8(writer, sps[1]);
+    put_u8(writer, sps[2]);
+    put_u8(writer, sps[3]);
+    put_u8(writer, 0xFC | (FMP4_NAL_LENGTH_SIZE - 1));
+    put_u8(writer, 0xE1);
+    put_u16(writer, (uint16_t)sps_length);
+    put_bytes(writer, sps, sps_length);
+    put_u8(writer, 1);
+    put_u16(writer, (uint16_t)pps_length);
+    put_bytes(writer, pps, pps_length);
+    box_end(writer, avcc);
+    box_end(writer, avc1);
+}
+
+static void write_empty_table(box_writer_t *writer, const char *type)
+{
+    size_t table = full_box_begin(writer, type, 0, 0);
+    if (strcmp(type, "stsz") == 0) {
+        put_u32(writer, 0);
+    }
+    put_u32(writer, 0);
+    box_end(writer, table);
+}
+
+static void write_init_segment(box_writer_t *writer, const fmp4_muxer_t *muxer, const uint8_t *sps, size_t sps_length,
+                               const uint8_t *pps, size_t pps_length)
+{
+    size_t ftyp = box_begin(writer, "ftyp");
+    put_bytes(writer, "iso6", 4);
+    put_u32(writer, 0);
+    put_bytes(writer, "iso6cmfcavc1mp41", 16);
+    box_end(writer, ftyp);
+
+    size_t moov = box_begin(writer, "moov");
+    size_t mvhd = full_box_begin(writer, "mvhd", 0, 0);
+    put_zeros(writer, 8);
+    put_u32(writer, 1000);
+    put_u32(writer, 0);
+    put_u32(writer, 0x00010000);
+    put_u16(writer, 0x0100);
+    put_zeros(writer, 10);
+    put_matrix(writer);
+    put_zeros(writer, 24);
+    put_u32(writer, FMP4_TRACK_ID + 1);
+    box_end(writer, mvhd);
+
+    size_t trak = box_begin(writer, "trak");
+    size_t tkhd = full_box_begin(writer, "tkhd", 0, 0x000003);
+    put_zeros(writer, 8);
+    put_u32(writer, FMP4_TRACK_ID);
+    put_zeros(writer, 8);
+    put_zeros(writer, 8);
+    put_zeros(writer, 8);
+    put_matrix(writer);
+    put_u32(writer, muxer->width << 16);
+    put_u32(writer, muxer->height << 16);
+    box_end(writer, tkhd);
+
+    size_t mdia = box_begin(writer, "mdia");
+    size_t mdhd = full_box_begin(writer, "mdhd", 0, 0);
+    put_zeros(writer, 8);
+    put_u32(writer, FMP4_TIMESCALE);
+    put_u32(writer, 0);
+    put_u16(writer, 0x55C4);
+    put_u16(writer, 0);
+    box_end(writer, mdhd);
+
+    size_t hdlr = full_box_begin(writer, "hdlr", 0, 0);
+    put_u32(writer, 0);
+    put_bytes(writer, "vide", 4);
+    put_zeros(writer, 12);
+    put_bytes(writer, "VideoHandler", 13);
+    box_end(writer, hdlr);
+
+    size_t minf = box_begin(writer, "minf");
+    size_t vmhd = full_box_begin(writer, "vmhd", 0, 0x000001);
+    put_zeros(writer, 8);
+    box_end(writer, vmhd);
+    size_t dinf = box_begin(writer, "dinf");
+    size_t dref = full_box_begin(writer, "dref", 0, 0);
+    put_u32(writer, 1);
+    box_end(writer, full_box_begin(writer, "url ", 0, 0x000001));
+    box_end(writer, dref);
+    box_end(writer, dinf);
+
+    size_t stbl = box_begin(writer, "stbl");
+    size_t stsd = full_box_begin(writer, "stsd", 0, 0);
+    put_u32(writer, 1);
+    write_sample_entry(writer, muxer, sps, sps_length, pps, pps_length);
+    box_end(writer, stsd);
+    write_empty_table(writer, "stts");
+    write_empty_table(writer, "stsc");
+    write_empty_table(writer, "stsz");
+    write_empty_table(writer, "stco");
+    box_end(writer, stbl);
+    box_end(writer, minf);
+    box_end(writer, mdia);
+    box_end(writer, trak);
+
+    size_t mvex = box_begin(writer, "mvex");
+    size_t trex = full_box_begin(writer, "trex", 0, 0);
+    put_u32(writer, FMP4_TRACK_ID);
+    put_u32(writer, 1);
+    put_zeros(writer, 12);
+    box_end(writer, trex);
+    box_end(writer, mvex);
+    box_end(writer, moov);
+}
+
+static void write_fragment_template(fmp4_muxer_t *muxer)
+{
+    box_writer_t writer = {
+        .data = muxer->header,
+        .capacity = sizeof(muxer->header),
+    };
+    box_begin(&writer, "moof");
+    size_t mfhd = full_box_begin(&writer, "mfhd", 0, 0);
+    put_u32(&writer, 0);
+    box_end(&writer, mfhd);
+    box_begin(&writer, "traf");
+    size_t tfhd = full_box_begin(&writer, "tfhd", 0, TFHD_FLAGS);
+    put_u32(&writer, FMP4_TRACK_ID);
+    box_end(&writer, tfhd);
+    size_t tfdt = full_box_begin(&writer, "tfdt", 1, 0);
+    put_zeros(&writer, 8);
+    box_end(&writer, tfdt);
+    full_box_begin(&writer, "trun", 0, TRUN_FLAGS);
+}
+
+void fmp4_muxer_init(fmp4_muxer_t *muxer, uint32_t frame_rate)
+{
+    memset(muxer, 0, sizeof(*muxer));
+    muxer->default_duration = FMP4_TIMESCALE / (frame_rate ? frame_rate : 30);
+    muxer->previous_ticks = -1;
+    write_fragment_template(muxer);
+}
+
+esp_err_t fmp4_muxer_write_init_segment(fmp4_muxer_t *muxer, const uint8_t *access_unit, size_t length)
+{
+    const uint8_t *sps = NULL;
+    const uint8_t *pps = NULL;
+    size_t sps_length = 0;
+    size_t pps_length = 0;
+    const uint8_t *nal = NULL;
+    size_t nal_length = 0;
+    h264_nal_iterator_t it;
+    h264_nal_iterator_init(&it, access_unit, length);
+    while (h264_nal_iterator_next(&it, &nal, &nal_length)) {
+        if (H264_NAL_TYPE(nal[0]) == H264_NAL_TYPE_SPS && !sps) {
+            sps = nal;
+            sps_length = nal_length;
+        } else if (H264_NAL_TYPE(nal[0]) == H264_NAL_TYPE_PPS && !pps) {
+            pps = nal;
+            pps_length = nal_length;
+        }
+    }
+    if (!sps || !pps) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (sps_length > FMP4_MAX_PARAMETER_SET_SIZE || pps_length > FMP4_MAX_PARAMETER_SET_SIZE ||
+        !h264_sps_parse_resolution(sps, sps_length, &muxer->width, &muxer->height)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    box_writer_t writer = {
+        .data = muxer->init,
+        .capacity = sizeof(muxer->init),
+    };
+    write_init_segment(&writer, muxer, sps, sps_length, pps, pps_length);
+    if (writer.length > writer.capacity) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    muxer->init_length = writer.length;
+    muxer->sequence_number = 0;
+    muxer->previous_ticks = -1;
+    return ESP_OK;
+}
+
+static int64_t media_ticks(const fmp4_muxer_t *muxer, uint64_t timestamp_us)
+{
+    if (timestamp_us <= muxer->base_timestamp_us) {
+        return 0;
+    }
+    return (int64_t)((timestamp_us - muxer->base_timestamp_us) * FMP4_TIMESCALE / 1000000);
+}
+
+static bool keep_nal(uint8_t nal_header)
+{
+    uint8_t type = H264_NAL_TYPE(nal_header);
+    return type != H264_NAL_TYPE_SPS && type != H264_NAL_TYPE_PPS && type != H264_NAL_TYPE_AUD;
+}
+
+esp_err_t fmp4_muxer_write_fragment(fmp4_muxer_t *muxer, const fmp4_sample_t *samples, size_t count,
+                                    fmp4_fragment_t *fragment)
+{
+    if (!muxer || !samples || !fragment || count == 0 || count > FMP4_MAX_FRAGMENT_SAMPLES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (muxer->init_length == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (muxer->previous_ticks < 0) {
+        muxer->base_timestamp_us = samples[0].timestamp_us;
+    }
+
+    int64_t first_ticks = media_ticks(muxer, samples[0].timestamp_us);
+    if (muxer->previous_ticks >= 0 && first_ticks > muxer->previous_ticks) {
+        muxer->default_duration = (uint32_t)(first_ticks - muxer->previous_ticks);
+    }
+
+    size_t nal_count = 0;
+    size_t mdat_length = 0;
+    fragment->segment_count = 1;
+    uint8_t *entry = muxer->header + MOOF_TRUN_ENTRIES_OFFSET;
+    for (size_t i = 0; i < count; ++i) {
+        size_t sample_size = 0;
+        const uint8_t *nal = NULL;
+        size_t nal_length = 0;
+        h264_nal_iterator_t it;
+        h264_nal_iterator_init(&it, samples[i].data, samples[i].length);
+        while (h264_nal_iterator_next(&it, &nal, &nal_length)) {
+            if (!keep_nal(nal[0])) {
+                continue;
+            }
+            if (nal_count == FMP4_MAX_FRAGMENT_NALS) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            uint8_t *prefix = muxer->length_prefixes[nal_count++];
+            put_u32_at(prefix, (uint32_t)nal_length);
+            fragment->segments[fragment->segment_count++] = (fmp4_segment_t){ prefix, FMP4_NAL_LENGTH_SIZE };
+            fragment->segments[fragment->segment_count++] = (fmp4_segment_t){ nal, nal_length };
+            sample_size += FMP4_NAL_LENGTH_SIZE + nal_length;
+        }
+
+        uint32_t duration = muxer->default_duration;
+        if (i + 1 < count) {
+            int64_t delta = media_ticks(muxer, samples[i + 1].timestamp_us) - media_ticks(muxer, samples[i].timestamp_us);
+            if (delta > 0) {
+                duration = (uint32_t)delta;
+                muxer->default_duration = duration;
+            }
+        }
+        put_u32_at(entry, duration);
+        put_u32_at(entry + 4, (uint32_t)sample_size);
+        put_u32_at(entry + 8, samples[i].is_keyframe ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_NON_SYNC);
+        entry += MOOF_TRUN_ENTRY_SIZE;
+        mdat_length += sample_size;
+    }
+    muxer->previous_ticks = media_ticks(muxer, samples[count - 1].timestamp_us);
+
+    uint32_t moof_size = MOOF_TRUN_ENTRIES_OFFSET + (uint32_t)count * MOOF_TRUN_ENTRY_SIZE;
+    uint8_t *header = muxer->header;
+    put_u32_at(header, moof_size);
+    put_u32_at(header + MOOF_MFHD_SEQUENCE_OFFSET, ++muxer->sequence_number);
+    put_u32_at(header + MOOF_TRAF_OFFSET, moof_size - MOOF_TRAF_OFFSET);
+    put_u32_at(header + MOOF_TFDT_TIME_OFFSET, (uint32_t)((uint64_t)first_ticks >> 32));
+    put_u32_at(header + MOOF_TFDT_TIME_OFFSET + 4, (uint32_t)first_ticks);
+    put_u32_at(header + MOOF_TRUN_OFFSET, moof_size - MOOF_TRUN_OFFSET);
+    put_u32_at(header + MOOF_TRUN_COUNT_OFFSET, (uint32_t)count);
+    put_u32_at(header + MOOF_TRUN_DATA_OFFSET, moof_size + MDAT_HEADER_SIZE);
+    put_u32_at(entry, (uint32_t)(MDAT_HEADER_SIZE + mdat_length));
+    memcpy(entry + 4, "mdat", 4);
+
+    fragment->segments[0] = (fmp4_segment_t){ header, moof_size + MDAT_HEADER_SIZE };
+    fragment->length = moof_size + MDAT_HEADER_SIZE + mdat_length;
+    return ESP_OK;
+}
@@ -0,0 +1,141 @@
+#include "frame_pool.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "memory_account.h"
+
+/* Placed in front of every allocation, so frame_pool_free() needs only the pointer. */
+typedef struct {
+    frame_pool_t *pool;
+    uint32_t first_block;
+    uint32_t block_count;
+} frame_pool_header_t;
+
+/* Keeps the caller's bytes as aligned as the blocks themselves. */
+#define FRAME_POOL_HEADER_SIZE  ((sizeof(frame_pool_header_t) + 15) & ~(size_t)15)
+#define FRAME_POOL_NOT_FOUND    SIZE_MAX
+
+static size_t blocks_for(const frame_pool_t *pool, size_t size)
+{
+    return (FRAME_POOL_HEADER_SIZE + size + pool->block_size - 1) / pool->block_size;
+}
+
+static bool block_used(const frame_pool_t *pool, size_t block)
+{
+    return pool->used[block / 32] & (1u << (block % 32));
+}
+
+static void mark_blocks(frame_pool_t *pool, size_t first, size_t count, bool used)
+{
+    for (size_t block = first; block < first + count; ++block) {
+        if (used) {
+            pool->used[block / 32] |= 1u << (block % 32);
+        } else {
+            pool->used[block / 32] &= ~(1u << (block % 32));
+        }
+    }
+}
+
+/* First run of `count` free blocks starting in [begin, end); fully used words are skipped whole. */
+static size_t find_run(const frame_pool_t *pool, size_t begin, size_t end, size_t count)
+{
+    if (begin >= end) {
+        return FRAME_POOL_NOT_FOUND;
+    }
+    size_t run = 0;
+    for (size_t block = begin; block < pool->block_count; ++block) {
+        if (block % 32 == 0 && pool->used[block / 32] == UINT32_MAX) {
+            run = 0;
+            block += 31;
+        } else if (block_used(pool, block)) {
+            run = 0;
+        } else if (++run == count) {
+            return block + 1 - count;
+        }
+        if (run == 0 && block + 1 >= end) {
+            break;
+        }
+    }
+    return FRAME_POOL_NOT_FOUND;
+}
+
+size_t frame_pool_size_for(size_t block_size, size_t count, size_t average_size)
+{
+    return count * (FRAME_POOL_HEADER_SIZE + average_size + block_size);
+}
+
+esp_err_t frame_pool_init(frame_pool_t *pool, size_t size, size_t block_size, uint32_t caps)
+{
+    memset(pool, 0, sizeof(*pool));
+    portMUX_INITIALIZE(&pool->lock);
+    pool->block_size = block_size;
+    pool->block_count = block_size ? size / block_size : 0;
+    if (pool->block_count == 0) {
+        return ESP_OK;
+    }
+
+    pool->region = memory_account_malloc(MEMORY_ACCOUNT_CONNECTIVITY, pool->block_count * block_size, caps);
+    pool->used = memory_account_calloc(MEMORY_ACCOUNT_CONNECTIVITY, (pool->block_count + 31) / 32,
+                                       sizeof(uint32_t), MEMORY_PLAN_HOT_CAPS);
+    if (!pool->region || !pool->used) {
+        frame_pool_deinit(pool);
+        return ESP_ERR_NO_MEM;
+    }
+    pool->free_blocks = pool->block_count;
+    return ESP_OK;
+}
+
+void frame_pool_deinit(frame_pool_t *pool)
+{
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, pool->region);
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, pool->used);
+    pool->region = NULL;
+    pool->used = NULL;
+    pool->block_count = 0;
+    pool->free_blocks = 0;
+}
+
+void *frame_pool_alloc(frame_pool_t *pool, size_t size)
+{
+    if (!pool->region) {
+        return NULL;
+    }
+    size_t count = blocks_for(pool, size);
+    portENTER_CRITICAL(&pool->lock);
+    size_t first = FRAME_POOL_NOT_FOUND;
+    if (count <= pool->free_blocks) {
+        first = find_run(pool, pool->next_block, pool->block_count, count);
+        if (first == FRAME_POOL_NOT_FOUND) {
+            first = find_run(pool, 0, pool->next_block, count);
+        }
+    }
+    if (first != FRAME_POOL_NOT_FOUND) {
+        mark_blocks(pool, first, count, true);
+        pool->free_blocks -= count;
+        pool->next_block = first + count < pool->block_count ? first + count : 0;
+    }
+    portEXIT_CRITICAL(&pool->lock);
+    if (first == FRAME_POOL_NOT_FOUND) {
+        return NULL;
+    }
+
+    frame_pool_header_t *header = (frame_pool_header_t *)(pool->region + first * pool->block_size);
+    header->pool = pool;
+    header->first_block = (uint32_t)first;
+    header->block_count = (uint32_t)count;
+    return (uint8_t *)header + FRAME_POOL_HEADER_SIZE;
+}
+
+void frame_pool_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    const frame_pool_header_t *header = (const frame_pool_header_t *)((uint8_t *)ptr - FRAME_POOL_HEADER_SIZE);
+    frame_pool_t *pool = header->pool;
+    portENTER_CRITICAL(&pool->lock);
+    mark_blocks(pool, header->first_block, header->block_count, false);
+    pool->free_blocks += header->block_count;
+    portEXIT_CRITICAL(&pool->lock);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A region allocated once at start-up and cut into equal blocks; each allocation takes a run of contiguous blocks.
+ * Frames are freed roughly in the order they were taken, so runs are searched next-fit from the last allocation
+ * and the free space stays in one piece. Allocation and free are safe from any task.
+ */
+typedef struct {
+    uint8_t *region;
+    uint32_t *used;
+    size_t block_size;
+    size_t block_count;
+    size_t free_blocks;
+    size_t next_block;
+    portMUX_TYPE lock;
+} frame_pool_t;
+
+/* Region size for `count` allocations averaging `average_size` bytes, allowing for the header and rounding. */
+size_t frame_pool_size_for(size_t block_size, size_t count, size_t average_size);
+
+/* Allocates `size` bytes, rounded down to whole blocks, with `caps`; a size of 0 leaves the pool empty. */
+esp_err_t frame_pool_init(frame_pool_t *pool, size_t size, size_t block_size, uint32_t caps);
+void frame_pool_deinit(frame_pool_t *pool);
+
+/* Never falls back to the heap: returns NULL when no run of free blocks is long enough. */
+void *frame_pool_alloc(frame_pool_t *pool, size_t size);
+
+/* Returns the block run to the pool it came from; NULL is ignored. */
+void frame_pool_free(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
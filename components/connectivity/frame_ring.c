@@ -0,0 +1,112 @@
+#include "frame_ring.h"
+
+#include <stddef.h>
+
+static void clear_gop(frame_ring_t *ring)
+{
+    for (size_t i = 0; i < ring->gop_length; ++i) {
+        stream_frame_unref(ring->gop[i]);
+        ring->gop[i] = NULL;
+    }
+    ring->gop_length = 0;
+}
+
+static void cache_frame(frame_ring_t *ring, uint32_t sequence, stream_frame_t *frame, bool discontinuity)
+{
+    if (frame->is_keyframe || discontinuity || ring->gop_length == FRAME_RING_GOP_LENGTH) {
+        clear_gop(ring);
+    }
+    if (frame->is_keyframe) {
+        ring->gop_sequence = sequence;
+    } else if (ring->gop_length == 0) {
+        return;
+    }
+    ring->gop[ring->gop_length++] = stream_frame_ref(frame);
+}
+
+void frame_ring_push(frame_ring_t *ring, stream_frame_t *frame)
+{
+    uint32_t sequence = ring->next_sequence++;
+    size_t slot = sequence % FRAME_RING_LENGTH;
+    stream_frame_unref(ring->frames[slot]);
+    ring->frames[slot] = frame;
+    ring->discontinuity[slot] = ring->pending_discontinuity;
+    ring->pending_discontinuity = false;
+    if (ring->cache_gop) {
+        cache_frame(ring, sequence, frame, ring->discontinuity[slot]);
+    }
+}
+
+void frame_ring_mark_discontinuity(frame_ring_t *ring)
+{
+    ring->pending_discontinuity = true;
+}
+
+void frame_ring_clear(frame_ring_t *ring)
+{
+    for (size_t i = 0; i < FRAME_RING_LENGTH; ++i) {
+        stream_frame_unref(ring->frames[i]);
+        ring->frames[i] = NULL;
+    }
+    clear_gop(ring);
+}
+
+void frame_cursor_seek_live(frame_cursor_t *cursor, const frame_ring_t *ring)
+{
+    cursor->next_sequence = ring->next_sequence;
+    cursor->burst_end = ring->next_sequence;
+    cursor->wait_keyframe = true;
+}
+
+void frame_cursor_seek_gop(frame_cursor_t *cursor, const frame_ring_t *ring)
+{
+    frame_cursor_seek_live(cursor, ring);
+    if (ring->gop_length > 0) {
+        cursor->next_sequence = ring->gop_sequence;
+    }
+}
+
+bool frame_cursor_catching_up(const frame_cursor_t *cursor)
+{
+    return cursor->next_sequence <= cursor->burst_end;
+}
+
+uint32_t frame_cursor_backlog(const frame_cursor_t *cursor, const frame_ring_t *ring)
+{
+    uint32_t backlog = ring->next_sequence - cursor->next_sequence;
+    return backlog < FRAME_RING_LENGTH ? backlog : FRAME_RING_LENGTH;
+}
+
+stream_frame_t *frame_cursor_next(frame_cursor_t *cursor, const frame_ring_t *ring)
+{
+    uint32_t oldest = ring->next_sequence > FRAME_RING_LENGTH ? ring->next_sequence - FRAME_RING_LENGTH : 0;
+    bool from_gop = cursor->next_sequence < cursor->burst_end && ring->gop_length > 0 && ring->gop_sequence < oldest;
+    if (from_gop) {
+        oldest = ring->gop_sequence;
+    }
+    if (cursor->next_sequence < oldest) {
+        cursor->frames_dropped += oldest - cursor->next_sequence;
+        cursor->next_sequence = oldest;
+        cursor->wait_keyframe = true;
+    }
+    while (cursor->next_sequence < ring->next_sequence) {
+        uint32_t sequence = cursor->next_sequence++;
+        size_t slot = sequence % FRAME_RING_LENGTH;
+        stream_frame_t *frame = NULL;
+        if (sequence + FRAME_RING_LENGTH >= ring->next_sequence) {
+            frame = ring->frames[slot];
+            if (ring->discontinuity[slot]) {
+                cursor->wait_keyframe = true;
+            }
+        } else {
+            frame = ring->gop[sequence - ring->gop_sequence];
+        }
+        if (cursor->wait_keyframe && !frame->is_keyframe) {
+            ++cursor->frames_dropped;
+            continue;
+        }
+        cursor->wait_keyframe = false;
+        return stream_frame_ref(frame);
+    }
+    return NULL;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "stream_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_RING_LENGTH 8
+#define FRAME_RING_GOP_LENGTH 64
+
+/*
+ * The last few frames of the stream, shared by reference between every consumer of one event loop. With
+ * cache_gop set, every frame since the last keyframe is also kept so new consumers can start decoding at once;
+ * a GOP longer than FRAME_RING_GOP_LENGTH or a discontinuity empties the cache until the next keyframe.
+ */
+typedef struct {
+    stream_frame_t *frames[FRAME_RING_LENGTH];
+    bool discontinuity[FRAME_RING_LENGTH];
+    uint32_t next_sequence;
+    bool pending_discontinuity;
+    bool cache_gop;
+    stream_frame_t *gop[FRAME_RING_GOP_LENGTH];
+    uint32_t gop_sequence;
+    size_t gop_length;
+} frame_ring_t;
+
+/*
+ * A consumer's read position; consumers that fall behind the ring skip ahead to the next keyframe. Frames
+ * before burst_end were cached when the consumer joined and may still be read from the GOP cache.
+ */
+typedef struct {
+    uint32_t next_sequence;
+    uint32_t burst_end;
+    bool wait_keyframe;
+    uint32_t frames_dropped;
+} frame_cursor_t;
+
+/* Takes ownership of the frame reference. */
+void frame_ring_push(frame_ring_t *ring, stream_frame_t *frame);
+
+/* Frames were lost before reaching the ring; readers crossing the gap resynchronise on a keyframe. */
+void frame_ring_mark_discontinuity(frame_ring_t *ring);
+
+void frame_ring_clear(frame_ring_t *ring);
+
+/* Moves the cursor to the live edge; it starts delivering from the next keyframe. */
+void frame_cursor_seek_live(frame_cursor_t *cursor, const frame_ring_t *ring);
+
+/* Moves the cursor to the start of the cached GOP, or to the live edge when nothing is cached. */
+void frame_cursor_seek_gop(frame_cursor_t *cursor, const frame_ring_t *ring);
+
+/* True while the frame last returned by frame_cursor_next() came from the cached backlog. */
+bool frame_cursor_catching_up(const frame_cursor_t *cursor);
+
+/* Frames pushed since the cursor's position, capped at what the ring still holds. */
+uint32_t frame_cursor_backlog(const frame_cursor_t *cursor, const frame_ring_t *ring);
+
+/* Returns a new reference to the next deliverable frame, or NULL when the cursor has caught up. */
+stream_frame_t *frame_cursor_next(frame_cursor_t *cursor, const frame_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
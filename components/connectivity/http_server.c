@@ -0,0 +1,948 @@
+#include "http_server.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "lwip/inet.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "fmp4_muxer.h"
+#include "frame_ring.h"
+#include "http_util.h"
+#include "memory_account.h"
+#include "metrics.h"
+#include "socket_util.h"
+#include "trace.h"
+
+static const char *TAG = "http_server";
+
+#define HTTP_SERVER_MAX_CLIENTS         8
+#define HTTP_SERVER_FIXED_SOCKETS       3
+#define HTTP_FRAME_QUEUE_LENGTH         4
+#define HTTP_RX_BUFFER_SIZE             1024
+#define HTTP_TX_BUFFER_SIZE             512
+#define HTTP_REQUEST_TIMEOUT_S          10
+#define HTTP_HOUSEKEEPING_INTERVAL_MS   1000
+#define HTTP_CHUNK_HEADER_SIZE          12
+#define HTTP_MAX_IOV                    (FMP4_MAX_FRAGMENT_SEGMENTS + 6)
+#define WS_FRAME_HEADER_MAX_SIZE        10
+#define WS_MESSAGE_HEADER_SIZE          16
+#define WS_OPCODE_BINARY                0x2
+#define WS_OPCODE_CLOSE                 0x8
+#define WS_OPCODE_PING                  0x9
+#define WS_OPCODE_PONG                  0xA
+#define WS_MAX_CONTROL_PAYLOAD          125
+#define HTTP_RESPONSE_HEADER_SIZE       128
+#define HTTP_METRICS_SLACK              256
+
+typedef enum {
+    HTTP_CLIENT_FREE = 0,
+    HTTP_CLIENT_REQUEST,
+    HTTP_CLIENT_STREAMING,
+} http_client_state_t;
+
+typedef enum {
+    HTTP_STREAM_NONE = 0,
+    HTTP_STREAM_FMP4,
+    HTTP_STREAM_WEBSOCKET,
+} http_stream_t;
+
+typedef struct {
+    int socket;
+    http_client_state_t state;
+    http_stream_t stream;
+    bool closing;
+    bool blocked;
+    bool init_sent;
+    struct sockaddr_in peer_addr;
+    frame_cursor_t cursor;
+    stream_frame_t *next;
+    stream_frame_t *pending[FMP4_MAX_FRAGMENT_SAMPLES];
+    size_t pending_count;
+    char *response;
+    struct iovec iov[HTTP_MAX_IOV];
+    int iov_count;
+    size_t iov_offset;
+    size_t iov_length;
+    char chunk_headers[2][HTTP_CHUNK_HEADER_SIZE];
+    uint8_t message_header[WS_FRAME_HEADER_MAX_SIZE + WS_MESSAGE_HEADER_SIZE];
+    int64_t last_activity_us;
+    size_t rx_length;
+    size_t tx_length;
+    size_t tx_offset;
+    fmp4_muxer_t muxer;
+    char rx_buffer[HTTP_RX_BUFFER_SIZE];
+    char tx_buffer[HTTP_TX_BUFFER_SIZE];
+} http_client_t;
+
+struct http_server_t {
+    transport_config_t config;
+    QueueHandle_t frame_queue;
+    TaskHandle_t task;
+    TaskHandle_t stop_waiter;
+    volatile bool stop_requested;
+    int listen_socket;
+    int wake_socket;
+    int wake_tx_socket;
+    frame_ring_t ring;
+    atomic_bool frames_lost;
+    uint32_t fragment_frames;
+    uint32_t max_clients;
+    http_client_t *clients;
+};
+
+static const char crlf[] = "\r\n";
+
+static METRICS_DEFINE_GAUGE(s_http_clients, "http_stream_clients", "HTTP fMP4 and WebSocket viewers");
+
+static void drain_frame_queue(http_server_t *server)
+{
+    stream_frame_t *frame = NULL;
+    while (xQueueReceive(server->frame_queue, &frame, 0) == pdTRUE) {
+        if (atomic_exchange(&server->frames_lost, false)) {
+            frame_ring_mark_discontinuity(&server->ring);
+        }
+        frame_ring_push(&server->ring, frame);
+    }
+}
+
+static void release_pending(http_client_t *client)
+{
+    for (size_t i = 0; i < client->pending_count; ++i) {
+        stream_frame_unref(client->pending[i]);
+        client->pending[i] = NULL;
+    }
+    client->pending_count = 0;
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, client->response);
+    client->response = NULL;
+}
+
+static void close_client(http_client_t *client)
+{
+    if (client->state == HTTP_CLIENT_FREE) {
+        return;
+    }
+    ESP_LOGI(TAG, "HTTP client disconnected: %s (%" PRIu32 " frames dropped)", inet_ntoa(client->peer_addr.sin_addr),
+             client->cursor.frames_dropped);
+    release_pending(client);
+    stream_frame_unref(client->next);
+    close(client->socket);
+    memset(client, 0, offsetof(http_client_t, muxer));
+    client->socket = -1;
+    client->state = HTTP_CLIENT_FREE;
+}
+
+static void client_printf(http_client_t *client, const char *format, ...)
+{
+    if (client->tx_length >= sizeof(client->tx_buffer)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(client->tx_buffer + client->tx_length, sizeof(client->tx_buffer) - client->tx_length, format, args);
+    va_end(args);
+    if (written > 0) {
+        client->tx_length += (size_t)written;
+        if (client->tx_length > sizeof(client->tx_buffer)) {
+            client->tx_length = sizeof(client->tx_buffer);
+        }
+    }
+}
+
+static void client_append(http_client_t *client, const void *data, size_t length)
+{
+    if (client->tx_length + length > sizeof(client->tx_buffer)) {
+        return;
+    }
+    memcpy(client->tx_buffer + client->tx_length, data, length);
+    client->tx_length += length;
+}
+
+static void send_error(http_client_t *client, int status, const char *reason)
+{
+    client_printf(client, "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status, reason);
+    client->closing = true;
+}
+
+static void start_fmp4_stream(http_server_t *server, http_client_t *client)
+{
+    client_printf(client,
+                  "HTTP/1.1 200 OK\r\n"
+                  "Content-Type: video/mp4\r\n"
+                  "Transfer-Encoding: chunked\r\n"
+                  "Cache-Control: no-cache, no-store\r\n"
+                  "Access-Control-Allow-Origin: *\r\n"
+                  "Connection: close\r\n\r\n");
+    fmp4_muxer_init(&client->muxer, server->config.pacing.frame_rate);
+    frame_cursor_seek_gop(&client->cursor, &server->ring);
+    client->state = HTTP_CLIENT_STREAMING;
+    client->stream = HTTP_STREAM_FMP4;
+    ESP_LOGI(TAG, "HTTP client streaming fMP4: %s", inet_ntoa(client->peer_addr.sin_addr));
+}
+
+static void start_websocket_stream(http_server_t *server, http_client_t *client, const char *request)
+{
+    char upgrade[16];
+    char key[64];
+    if (!http_util_find_header(request, "Upgrade", upgrade, sizeof(upgrade)) || strcasecmp(upgrade, "websocket") != 0 ||
+        !http_util_find_header(request, "Sec-WebSocket-Key", key, sizeof(key))) {
+        send_error(client, 400, "Bad Request");
+        return;
+    }
+
+    char accept[HTTP_UTIL_WEBSOCKET_ACCEPT_SIZE];
+    http_util_websocket_accept(key, accept);
+    client_printf(client,
+                  "HTTP/1.1 101 Switching Protocols\r\n"
+                  "Upgrade: websocket\r\n"
+                  "Connection: Upgrade\r\n"
+                  "Sec-WebSocket-Accept: %s\r\n\r\n",
+                  accept);
+    frame_cursor_seek_gop(&client->cursor, &server->ring);
+    client->state = HTTP_CLIENT_STREAMING;
+    client->stream = HTTP_STREAM_WEBSOCKET;
+    ESP_LOGI(TAG, "WebSocket client streaming H.264: %s", inet_ntoa(client->peer_addr.sin_addr));
+}
+
+static void append_iov(http_client_t *client, const void *data, size_t length);
+
+/*
+ * Takes ownership of `response`, whose body starts HTTP_RESPONSE_HEADER_SIZE bytes in. Headers and body go
+ * out as one buffer on the stream path, which is always flushed before tx_buffer.
+ */
+static void send_owned_response(http_client_t *client, const char *content_type, char *response, size_t length)
+{
+    char *body = response + HTTP_RESPONSE_HEADER_SIZE;
+    char header[HTTP_RESPONSE_HEADER_SIZE];
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.1 200 OK\r\n"
+                                 "Content-Type: %s\r\n"
+                                 "Content-Length: %u\r\n"
+                                 "Connection: close\r\n\r\n",
+                                 content_type, (unsigned)length);
+    memcpy(body - header_length, header, header_length);
+    client->response = response;
+    append_iov(client, body - header_length, header_length + length);
+    client->closing = true;
+}
+
+static void serve_metrics(http_client_t *client)
+{
+    size_t capacity = metrics_format_prometheus(NULL, 0) + HTTP_METRICS_SLACK;
+    char *response = memory_account_malloc(MEMORY_ACCOUNT_CONNECTIVITY, HTTP_RESPONSE_HEADER_SIZE + capacity,
+                                           MALLOC_CAP_DEFAULT);
+    if (!response) {
+        send_error(client, 503, "Service Unavailable");
+        return;
+    }
+    char *body = response + HTTP_RESPONSE_HEADER_SIZE;
+    size_t length = metrics_format_prometheus(body, capacity);
+    /* Values grew past the slack since the sizing pass; end on a whole line. */
+    if (length >= capacity) {
+        length = capacity - 1;
+        while (length > 0 && body[length - 1] != '\n') {
+            --length;
+        }
+    }
+    send_owned_response(client, "text/plain; version=0.0.4", response, length);
+}
+
+typedef struct {
+    char *cursor;
+} trace_writer_t;
+
+static esp_err_t write_trace(void *user_ctx, const void *data, size_t length)
+{
+    trace_writer_t *writer = (trace_writer_t *)user_ctx;
+    memcpy(writer->cursor, data, length);
+    writer->cursor += length;
+    return ESP_OK;
+}
+
+/* `?start` and `?stop` switch recording; a plain GET returns the binary dump for tools/trace_to_chrome.py. */
+static void serve_trace(http_client_t *client, const char *query)
+{
+    size_t capacity = trace_dump_size();
+    if (capacity == 0) {
+        send_error(client, 404, "Not Found");
+        return;
+    }
+    bool start = query && strcmp(query, "start") == 0;
+    if (start || (query && strcmp(query, "stop") == 0)) {
+        if (start) {
+            trace_start();
+        } else {
+            trace_stop();
+        }
+        client_printf(client, "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n");
+        client->closing = true;
+        return;
+    }
+
+    char *response = memory_account_malloc(MEMORY_ACCOUNT_CONNECTIVITY, HTTP_RESPONSE_HEADER_SIZE + capacity,
+                                           MALLOC_CAP_DEFAULT);
+    if (!response) {
+        send_error(client, 503, "Service Unavailable");
+        return;
+    }
+    trace_writer_t writer = { .cursor = response + HTTP_RESPONSE_HEADER_SIZE };
+    if (trace_dump(write_trace, &writer) != ESP_OK) {
+        memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, response);
+        send_error(client, 500, "Internal Server Error");
+        return;
+    }
+    send_owned_response(client, "application/octet-stream", response,
+                        (size_t)(writer.cursor - (response + HTTP_RESPONSE_HEADER_SIZE)));
+}
+
+/* The board's esp_timer time, which the timing SEI uses, so probes can estimate their clock offset. */
+static void serve_clock(http_client_t *client)
+{
+    char body[24];
+    int length = snprintf(body, sizeof(body), "%" PRId64 "\n", esp_timer_get_time());
+    client_printf(client,
+                  "HTTP/1.1 200 OK\r\n"
+                  "Content-Type: text/plain\r\n"
+                  "Cache-Control: no-cache, no-store\r\n"
+                  "Content-Length: %d\r\n"
+                  "Connection: close\r\n\r\n%s",
+                  length, body);
+    client->closing = true;
+}
+
+static void handle_request(http_server_t *server, http_client_t *client, char *request)
+{
+    char method[8] = {0};
+    char path[128] = {0};
+    if (sscanf(request, "%7s %127s", method, path) != 2) {
+        send_error(client, 400, "Bad Request");
+        return;
+    }
+    char *query = strchr(path, '?');
+    if (query) {
+        *query++ = '\0';
+    }
+
+    if (strcmp(method, "GET") != 0) {
+        send_error(client, 405, "Method Not Allowed");
+    } else if (server->config.fmp4.enable && strcmp(path, server->config.fmp4.path) == 0) {
+        start_fmp4_stream(server, client);
+    } else if (server->config.websocket.enable && strcmp(path, server->config.websocket.path) == 0) {
+        start_websocket_stream(server, client, request);
+    } else if (server->config.metrics.enable && strcmp(path, server->config.metrics.path) == 0) {
+        serve_metrics(client);
+    } else if (server->config.trace.enable && strcmp(path, server->config.trace.path) == 0) {
+        serve_trace(client, query);
+    } else if (server->config.clock.enable && strcmp(path, server->config.clock.path) == 0) {
+        serve_clock(client);
+    } else {
+        send_error(client, 404, "Not Found");
+    }
+}
+
+static void queue_control_frame(http_client_t *client, uint8_t opcode, const uint8_t *payload, size_t length)
+{
+    uint8_t header[2] = { 0x80 | opcode, (uint8_t)length };
+    client_append(client, header, sizeof(header));
+    client_append(client, payload, length);
+}
+
+/* Handles pings and close requests; browsers send nothing else on this endpoint, other frames are ignored. */
+static bool process_websocket_rx(http_client_t *client)
+{
+    uint8_t *data = (uint8_t *)client->rx_buffer;
+    while (client->rx_length >= 2 && !client->closing) {
+        uint8_t opcode = data[0] & 0x0F;
+        size_t length = data[1] & 0x7F;
+        size_t header_length = 6;
+        if (!(data[1] & 0x80) || length == 127) {
+            ESP_LOGW(TAG, "Unsupported WebSocket frame from %s", inet_ntoa(client->peer_addr.sin_addr));
+            return false;
+        }
+        if (length == 126) {
+            header_length += 2;
+            if (client->rx_length < 4) {
+                break;
+            }
+            length = ((size_t)data[2] << 8) | data[3];
+        }
+        if (header_length + length > sizeof(client->rx_buffer) - 1) {
+            ESP_LOGW(TAG, "Oversized WebSocket frame");
+            return false;
+        }
+        if (client->rx_length < header_length + length) {
+            break;
+        }
+
+        uint8_t *payload = data + header_length;
+        const uint8_t *mask = payload - 4;
+        for (size_t i = 0; i < length; ++i) {
+            payload[i] ^= mask[i % 4];
+        }
+        if (opcode == WS_OPCODE_PING && length <= WS_MAX_CONTROL_PAYLOAD) {
+            queue_control_frame(client, WS_OPCODE_PONG, payload, length);
+        } else if (opcode == WS_OPCODE_CLOSE) {
+            queue_control_frame(client, WS_OPCODE_CLOSE, payload, length < 2 ? length : 2);
+            client->closing = true;
+        }
+        client->rx_length -= header_length + length;
+        memmove(data, data + header_length + length, client->rx_length);
+    }
+    return true;
+}
+
+static bool process_rx(http_server_t *server, http_client_t *client)
+{
+    if (client->state == HTTP_CLIENT_STREAMING) {
+        if (client->stream == HTTP_STREAM_WEBSOCKET) {
+            return process_websocket_rx(client);
+        }
+        client->rx_length = 0;
+        return true;
+    }
+    client->rx_buffer[client->rx_length] = '\0';
+    char *end = strstr(client->rx_buffer, "\r\n\r\n");
+    if (!end) {
+        if (client->rx_length >= sizeof(client->rx_buffer) - 1) {
+            ESP_LOGW(TAG, "Oversized HTTP request");
+            return false;
+        }
+        return true;
+    }
+    end[2] = '\0';
+    handle_request(server, client, client->rx_buffer);
+    client->rx_length = 0;
+    return true;
+}
+
+static void handle_client_read(http_server_t *server, http_client_t *client)
+{
+    size_t space = sizeof(client->rx_buffer) - 1 - client->rx_length;
+    int received = recv(client->socket, client->rx_buffer + client->rx_length, space, 0);
+    if (received == 0 || (received < 0 && !socket_util_would_block())) {
+        close_client(client);
+        return;
+    }
+    if (received < 0) {
+        return;
+    }
+    client->rx_length += (size_t)received;
+    client->last_activity_us = esp_timer_get_time();
+    if (!process_rx(server, client)) {
+        close_client(client);
+    }
+}
+
+static void accept_clients(http_server_t *server)
+{
+    while (true) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int sock = accept(server->listen_socket, (struct sockaddr *)&client_addr, &client_len);
+        if (sock < 0) {
+            return;
+        }
+
+        http_client_t *client = NULL;
+        for (uint32_t i = 0; i < server->max_clients && !client; ++i) {
+            if (server->clients[i].state == HTTP_CLIENT_FREE) {
+                client = &server->clients[i];
+            }
+        }
+        if (!client || socket_util_set_non_blocking(sock) < 0) {
+            ESP_LOGW(TAG, "Rejecting HTTP client %s: client limit reached", inet_ntoa(client_addr.sin_addr));
+            close(sock);
+            continue;
+        }
+
+        int enable = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        memset(client, 0, offsetof(http_client_t, muxer));
+        client->socket = sock;
+        client->state = HTTP_CLIENT_REQUEST;
+        client->peer_addr = client_addr;
+        client->last_activity_us = esp_timer_get_time();
+    }
+}
+
+static void append_iov(http_client_t *client, const void *data, size_t length)
+{
+    if (client->iov_count < HTTP_MAX_IOV) {
+        client->iov[client->iov_count++] = (struct iovec){ .iov_base = (void *)data, .iov_len = length };
+        client->iov_length += length;
+    }
+}
+
+static void append_chunk(http_client_t *client, char *chunk_header, const fmp4_segment_t *segments, size_t count,
+                         size_t length)
+{
+    int header_length = snprintf(chunk_header, HTTP_CHUNK_HEADER_SIZE, "%zx\r\n", length);
+    append_iov(client, chunk_header, (size_t)header_length);
+    for (size_t i = 0; i < count; ++i) {
+        append_iov(client, segments[i].data, segments[i].length);
+    }
+    append_iov(client, crlf, sizeof(crlf) - 1);
+}
+
+/* Turns the pending frames into one HTTP chunk carrying a moof+mdat, preceded by the init segment once. */
+static void build_fragment(http_client_t *client)
+{
+    client->iov_count = 0;
+    client->iov_offset = 0;
+    client->iov_length = 0;
+
+    if (!client->init_sent) {
+        stream_frame_t *keyframe = client->pending[0];
+        if (fmp4_muxer_write_init_segment(&client->muxer, keyframe->payload, keyframe->length) != ESP_OK) {
+            ESP_LOGW(TAG, "Keyframe without parameter sets, waiting for the next one");
+            release_pending(client);
+            client->cursor.wait_keyframe = true;
+            return;
+        }
+        fmp4_segment_t init = { client->muxer.init, client->muxer.init_length };
+        append_chunk(client, client->chunk_headers[0], &init, 1, init.length);
+        client->init_sent = true;
+    }
+
+    fmp4_sample_t samples[FMP4_MAX_FRAGMENT_SAMPLES];
+    for (size_t i = 0; i < client->pending_count; ++i) {
+        const stream_frame_t *frame = client->pending[i];
+        samples[i] = (fmp4_sample_t){
+            .data = frame->payload,
+            .length = frame->length,
+            .timestamp_us = frame->timestamp_us,
+            .is_keyframe = frame->is_keyframe,
+        };
+    }
+    fmp4_fragment_t fragment;
+    esp_err_t err = fmp4_muxer_write_fragment(&client->muxer, samples, client->pending_count, &fragment);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to build fragment: %s", esp_err_to_name(err));
+        client->iov_count = 0;
+        client->iov_length = 0;
+        release_pending(client);
+        client->cursor.wait_keyframe = true;
+        return;
+    }
+    append_chunk(client, client->chunk_headers[1], fragment.segments, fragment.segment_count, fragment.length);
+}
+
+/* One binary message per access unit: flags, sequence and capture timestamp, then the Annex-B payload. */
+static void build_websocket_message(http_client_t *client, stream_frame_t *frame, uint32_t sequence)
+{
+    client->pending[0] = frame;
+    client->pending_count = 1;
+
+    uint64_t length = WS_MESSAGE_HEADER_SIZE + frame->length;
+    uint8_t *header = client->message_header;
+    size_t used = 0;
+    header[used++] = 0x80 | WS_OPCODE_BINARY;
+    if (length < 126) {
+        header[used++] = (uint8_t)length;
+    } else if (length <= 0xFFFF) {
+        header[used++] = 126;
+        header[used++] = (uint8_t)(length >> 8);
+        header[used++] = (uint8_t)length;
+    } else {
+        header[used++] = 127;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            header[used++] = (uint8_t)(length >> shift);
+        }
+    }
+    header[used++] = frame->is_keyframe ? 0x01 : 0x00;
+    header[used++] = 0;
+    header[used++] = 0;
+    header[used++] = 0;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        header[used++] = (uint8_t)(sequence >> shift);
+    }
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        header[used++] = (uint8_t)(frame->timestamp_us >> shift);
+    }
+
+    client->iov_count = 0;
+    client->iov_offset = 0;
+    client->iov_length = 0;
+    append_iov(client, header, used);
+    append_iov(client, frame->payload, frame->length);
+}
+
+static bool fail_send(http_client_t *client)
+{
+    if (socket_util_would_block()) {
+        client->blocked = true;
+    } else {
+        client->closing = true;
+        client->tx_length = client->tx_offset = 0;
+        client->iov_count = 0;
+        client->iov_offset = client->iov_length = 0;
+        release_pending(client);
+    }
+    return false;
+}
+
+static bool flush_stream(http_client_t *client)
+{
+    while (client->iov_offset < client->iov_length) {
+        struct iovec iov[HTTP_MAX_IOV];
+        memcpy(iov, client->iov, client->iov_count * sizeof(iov[0]));
+        ssize_t sent = socket_util_send_iov_from(client->socket, iov, client->iov_count, client->iov_offset);
+        if (sent < 0) {
+            return fail_send(client);
+        }
+        client->iov_offset += (size_t)sent;
+    }
+    client->iov_count = 0;
+    client->iov_offset = 0;
+    client->iov_length = 0;
+    release_pending(client);
+    return true;
+}
+
+static bool flush_tx(http_client_t *client)
+{
+    while (client->tx_offset < client->tx_length) {
+        int sent = send(client->socket, client->tx_buffer + client->tx_offset, client->tx_length - client->tx_offset, 0);
+        if (sent < 0) {
+            return fail_send(client);
+        }
+        client->tx_offset += (size_t)sent;
+    }
+    client->tx_length = 0;
+    client->tx_offset = 0;
+    return true;
+}
+
+static void pump_stream(http_server_t *server, http_client_t *client)
+{
+    while (!client->closing) {
+        if ((client->iov_count > 0 && !flush_stream(client)) || !flush_tx(client)) {
+            return;
+        }
+        if (!client->next) {
+            client->next = frame_cursor_next(&client->cursor, &server->ring);
+            if (!client->next) {
+                return;
+            }
+        }
+        if (client->stream == HTTP_STREAM_WEBSOCKET) {
+            build_websocket_message(client, client->next, client->cursor.next_sequence - 1);
+            client->next = NULL;
+            continue;
+        }
+        /* Fragments start at keyframes so a player can join or recover at any fragment boundary. */
+        if (client->pending_count > 0 && client->next->is_keyframe) {
+            build_fragment(client);
+            continue;
+        }
+        client->pending[client->pending_count++] = client->next;
+        client->next = NULL;
+        if (client->pending_count >= server->fragment_frames) {
+            build_fragment(client);
+        }
+    }
+}
+
+static void service_client(http_server_t *server, http_client_t *client)
+{
+    if (client->blocked) {
+        return;
+    }
+    /* A partly sent message always goes out first so control frames never land inside it. */
+    bool flushed = (client->iov_count == 0 || flush_stream(client)) && flush_tx(client);
+    if (flushed && !client->closing && client->state == HTTP_CLIENT_STREAMING) {
+        pump_stream(server, client);
+    }
+    if (client->closing && client->tx_length == 0 && client->iov_count == 0) {
+        close_client(client);
+    }
+}
+
+static void expire_requests(http_server_t *server)
+{
+    int64_t now = esp_timer_get_time();
+    for (uint32_t i = 0; i < server->max_clients; ++i) {
+        http_client_t *client = &server->clients[i];
+        if (client->state == HTTP_CLIENT_REQUEST &&
+            now - client->last_activity_us > (int64_t)HTTP_REQUEST_TIMEOUT_S * 1000000) {
+            close_client(client);
+        }
+    }
+}
+
+static void publish_metrics(http_server_t *server)
+{
+    int32_t streaming = 0;
+    for (uint32_t i = 0; i < server->max_clients; ++i) {
+        streaming += server->clients[i].state == HTTP_CLIENT_STREAMING;
+    }
+    metrics_gauge_set(&s_http_clients, streaming);
+}
+
+static void close_server_sockets(http_server_t *server)
+{
+    int *sockets[] = { &server->listen_socket, &server->wake_socket, &server->wake_tx_socket };
+    for (size_t i = 0; i < sizeof(sockets) / sizeof(sockets[0]); ++i) {
+        if (*sockets[i] >= 0) {
+            close(*sockets[i]);
+            *sockets[i] = -1;
+        }
+    }
+}
+
+static void http_server_task(void *arg)
+{
+    http_server_t *server = (http_server_t *)arg;
+    int64_t last_housekeeping_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "HTTP server listening on port %d", server->config.http.port);
+
+    while (!server->stop_requested) {
+        fd_set read_set;
+        fd_set write_set;
+        FD_ZERO(&read_set);
+        FD_ZERO(&write_set);
+        int max_fd = -1;
+
+        socket_util_watch(server->listen_socket, &read_set, &max_fd);
+        socket_util_watch(server->wake_socket, &read_set, &max_fd);
+        for (uint32_t i = 0; i < server->max_clients; ++i) {
+            http_client_t *client = &server->clients[i];
+            if (client->state == HTTP_CLIENT_FREE) {
+                continue;
+            }
+            socket_util_watch(client->socket, &read_set, &max_fd);
+            if (client->blocked) {
+                socket_util_watch(client->socket, &write_set, &max_fd);
+            }
+        }
+
+        struct timeval timeout = {
+            .tv_sec = 0,
+            .tv_usec = HTTP_HOUSEKEEPING_INTERVAL_MS * 1000,
+        };
+        int ready = select(max_fd + 1, &read_set, &write_set, NULL, &timeout);
+        if (ready < 0) {
+            if (errno != EINTR) {
+                ESP_LOGE(TAG, "select failed: errno %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+            continue;
+        }
+
+        if (ready > 0) {
+            if (FD_ISSET(server->wake_socket, &read_set)) {
+                socket_util_drain(server->wake_socket);
+            }
+            if (FD_ISSET(server->listen_socket, &read_set)) {
+                accept_clients(server);
+            }
+            for (uint32_t i = 0; i < server->max_clients; ++i) {
+                http_client_t *client = &server->clients[i];
+                if (client->state == HTTP_CLIENT_FREE) {
+                    continue;
+                }
+                if (FD_ISSET(client->socket, &write_set)) {
+                    client->blocked = false;
+                }
+                if (FD_ISSET(client->socket, &read_set)) {
+                    handle_client_read(server, client);
+                }
+            }
+        }
+
+        drain_frame_queue(server);
+        for (uint32_t i = 0; i < server->max_clients; ++i) {
+            if (server->clients[i].state != HTTP_CLIENT_FREE) {
+                service_client(server, &server->clients[i]);
+            }
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (now - last_housekeeping_us >= HTTP_HOUSEKEEPING_INTERVAL_MS * 1000) {
+            last_housekeeping_us = now;
+            expire_requests(server);
+            publish_metrics(server);
+        }
+    }
+
+    for (uint32_t i = 0; i < server->max_clients; ++i) {
+        close_client(&server->clients[i]);
+    }
+    frame_ring_clear(&server->ring);
+
+    TaskHandle_t waiter = server->stop_waiter;
+    server->task = NULL;
+    xTaskNotifyGive(waiter);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t open_server_sockets(http_server_t *server)
+{
+    server->listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (server->listen_socket < 0) {
+        ESP_LOGE(TAG, "Failed to create HTTP socket");
+        return ESP_FAIL;
+    }
+
+    int enable = 1;
+    setsockopt(server->listen_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    struct sockaddr_in server_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(server->config.http.port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(server->listen_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 ||
+        listen(server->listen_socket, (int)server->max_clients) < 0 ||
+        socket_util_set_non_blocking(server->listen_socket) < 0) {
+        ESP_LOGE(TAG, "Failed to bind HTTP socket");
+        return ESP_FAIL;
+    }
+
+    if (socket_util_create_wake_pair(&server->wake_socket, &server->wake_tx_socket) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create wake-up socket");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static void destroy_server(http_server_t *server)
+{
+    close_server_sockets(server);
+    if (server->frame_queue) {
+        stream_frame_t *frame = NULL;
+        while (xQueueReceive(server->frame_queue, &frame, 0) == pdTRUE) {
+            stream_frame_unref(frame);
+        }
+        vQueueDelete(server->frame_queue);
+    }
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, server->clients);
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, server);
+}
+
+static uint32_t plan_max_clients(const transport_config_t *config)
+{
+    return config->http.max_clients == 0 || config->http.max_clients > HTTP_SERVER_MAX_CLIENTS
+           ? HTTP_SERVER_MAX_CLIENTS : config->http.max_clients;
+}
+
+uint32_t http_server_socket_count(const transport_config_t *config)
+{
+    return config->http.enable ? HTTP_SERVER_FIXED_SOCKETS + plan_max_clients(config) : 0;
+}
+
+uint32_t http_server_queued_frames(const transport_config_t *config)
+{
+    return config->http.enable ? HTTP_FRAME_QUEUE_LENGTH : 0;
+}
+
+esp_err_t http_server_plan_memory(const transport_config_t *config, memory_plan_t *plan)
+{
+    uint32_t max_clients = plan_max_clients(config);
+    esp_err_t err = memory_plan_add(plan, "HTTP server", MEMORY_PLAN_INTERNAL, sizeof(http_server_t), 1);
+    return err == ESP_OK ? memory_plan_add(plan, "HTTP clients", MEMORY_PLAN_INTERNAL, sizeof(http_client_t),
+                                           max_clients) : err;
+}
+
+esp_err_t http_server_start(const transport_config_t *config, http_server_t **out_server)
+{
+    if (!config || !out_server) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    http_server_t *server = memory_account_calloc(MEMORY_ACCOUNT_CONNECTIVITY, 1, sizeof(*server),
+                                                  MEMORY_PLAN_HOT_CAPS);
+    if (!server) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    server->config = *config;
+    server->ring.cache_gop = config->gop_cache.enable;
+    metrics_register(&s_http_clients);
+    server->max_clients = plan_max_clients(config);
+    server->fragment_frames = config->fmp4.fragment_frames;
+    if (server->fragment_frames == 0 || server->fragment_frames > FMP4_MAX_FRAGMENT_SAMPLES) {
+        server->fragment_frames = FMP4_MAX_FRAGMENT_SAMPLES;
+    }
+    server->listen_socket = server->wake_socket = server->wake_tx_socket = -1;
+
+    server->clients = memory_account_calloc(MEMORY_ACCOUNT_CONNECTIVITY, server->max_clients, sizeof(http_client_t),
+                                            MEMORY_PLAN_HOT_CAPS);
+    server->frame_queue = xQueueCreate(HTTP_FRAME_QUEUE_LENGTH, sizeof(stream_frame_t *));
+    if (!server->clients || !server->frame_queue) {
+        destroy_server(server);
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint32_t i = 0; i < server->max_clients; ++i) {
+        server->clients[i].socket = -1;
+    }
+
+    esp_err_t err = open_server_sockets(server);
+    if (err != ESP_OK) {
+        destroy_server(server);
+        return err;
+    }
+
+    BaseType_t task_created = xTaskCreatePinnedToCore(http_server_task, "http_server", 6 * 1024, server,
+                                                      config->server_task.priority, &server->task,
+                                                      config->server_task.core_id);
+    if (task_created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create HTTP server task");
+        destroy_server(server);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *out_server = server;
+    return ESP_OK;
+}
+
+void http_server_stop(http_server_t *server)
+{
+    if (!server) {
+        return;
+    }
+
+    if (server->task) {
+        server->stop_waiter = xTaskGetCurrentTaskHandle();
+        server->stop_requested = true;
+        socket_util_wake(server->wake_tx_socket);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    destroy_server(server);
+}
+
+esp_err_t http_server_submit_frame(http_server_t *server, stream_frame_t *frame, TickType_t ticks_to_wait)
+{
+    if (!server || !frame) {
+        stream_frame_unref(frame);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xQueueSend(server->frame_queue, &frame, ticks_to_wait) != pdTRUE) {
+        atomic_store(&server->frames_lost, true);
+        stream_frame_unref(frame);
+        return ESP_ERR_TIMEOUT;
+    }
+    socket_util_wake(server->wake_tx_socket);
+    return ESP_OK;
+}
+
+void http_server_mark_frame_lost(http_server_t *server)
+{
+    if (server) {
+        atomic_store(&server->frames_lost, true);
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#include "connectivity.h"
+#include "stream_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct http_server_t http_server_t;
+
+esp_err_t http_server_start(const transport_config_t *config, http_server_t **out_server);
+void http_server_stop(http_server_t *server);
+
+esp_err_t http_server_plan_memory(const transport_config_t *config, memory_plan_t *plan);
+
+/* lwIP sockets the server holds open at most: listener, wake-up pair and one per client; 0 when disabled. */
+uint32_t http_server_socket_count(const transport_config_t *config);
+
+/* Frames the server may hold queued ahead of its ring; 0 when disabled. */
+uint32_t http_server_queued_frames(const transport_config_t *config);
+
+/* Takes ownership of the caller's frame reference, also when the queue is full. */
+esp_err_t http_server_submit_frame(http_server_t *server, stream_frame_t *frame, TickType_t ticks_to_wait);
+
+/* A frame never reached the server; viewers resync on the next keyframe. */
+void http_server_mark_frame_lost(http_server_t *server);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,150 @@
+#include "http_util.h"
+
+#include <string.h>
+#include <strings.h>
+
+#define SHA1_DIGEST_SIZE    20
+#define SHA1_BLOCK_SIZE     64
+
+static const char websocket_guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+const char *http_util_find_header(const char *request, const char *name, char *value, size_t value_size)
+{
+    size_t name_length = strlen(name);
+    const char *line = strstr(request, "\r\n");
+    while (line && line[2] != '\r' && line[2] != '\0') {
+        line += 2;
+        if (strncasecmp(line, name, name_length) == 0 && line[name_length] == ':') {
+            const char *start = line + name_length + 1;
+            while (*start == ' ') {
+                ++start;
+            }
+            const char *end = strstr(start, "\r\n");
+            size_t length = end ? (size_t)(end - start) : strlen(start);
+            if (length >= value_size) {
+                length = value_size - 1;
+            }
+            memcpy(value, start, length);
+            value[length] = '\0';
+            return value;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return NULL;
+}
+
+size_t http_util_base64_encode(const uint8_t *input, size_t length, char *output, size_t output_size)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t written = 0;
+    for (size_t i = 0; i < length; i += 3) {
+        if (written + 5 > output_size) {
+            break;
+        }
+        uint32_t chunk = (uint32_t)input[i] << 16;
+        if (i + 1 < length) {
+            chunk |= (uint32_t)input[i + 1] << 8;
+        }
+        if (i + 2 < length) {
+            chunk |= input[i + 2];
+        }
+        output[written++] = alphabet[(chunk >> 18) & 0x3F];
+        output[written++] = alphabet[(chunk >> 12) & 0x3F];
+        output[written++] = i + 1 < length ? alphabet[(chunk >> 6) & 0x3F] : '=';
+        output[written++] = i + 2 < length ? alphabet[chunk & 0x3F] : '=';
+    }
+    if (output_size > 0) {
+        output[written < output_size ? written : output_size - 1] = '\0';
+    }
+    return written;
+}
+
+static uint32_t rotate_left(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1_block(uint32_t state[5], const uint8_t block[SHA1_BLOCK_SIZE])
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) |
+               block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rotate_left(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = rotate_left(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotate_left(b, 30);
+        b = a;
+        a = temp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+/* Enough SHA-1 for the handshake; the input is a 24-character key plus the GUID, so at most two blocks. */
+static void sha1(const uint8_t *data, size_t length, uint8_t digest[SHA1_DIGEST_SIZE])
+{
+    uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint8_t block[SHA1_BLOCK_SIZE];
+    size_t offset = 0;
+    for (; offset + SHA1_BLOCK_SIZE <= length; offset += SHA1_BLOCK_SIZE) {
+        sha1_block(state, data + offset);
+    }
+
+    size_t tail = length - offset;
+    memset(block, 0, sizeof(block));
+    memcpy(block, data + offset, tail);
+    block[tail] = 0x80;
+    if (tail >= SHA1_BLOCK_SIZE - 8) {
+        sha1_block(state, block);
+        memset(block, 0, sizeof(block));
+    }
+    uint64_t bits = (uint64_t)length * 8;
+    for (int i = 0; i < 8; ++i) {
+        block[SHA1_BLOCK_SIZE - 1 - i] = (uint8_t)(bits >> (i * 8));
+    }
+    sha1_block(state, block);
+
+    for (int i = 0; i < 5; ++i) {
+        digest[i * 4] = (uint8_t)(state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)state[i];
+    }
+}
+
+void http_util_websocket_accept(const char *key, char accept[HTTP_UTIL_WEBSOCKET_ACCEPT_SIZE])
+{
+    uint8_t input[128];
+    size_t key_length = strnlen(key, sizeof(input) - sizeof(websocket_guid));
+    memcpy(input, key, key_length);
+    memcpy(input + key_length, websocket_guid, sizeof(websocket_guid) - 1);
+
+    uint8_t digest[SHA1_DIGEST_SIZE];
+    sha1(input, key_length + sizeof(websocket_guid) - 1, digest);
+    http_util_base64_encode(digest, sizeof(digest), accept, HTTP_UTIL_WEBSOCKET_ACCEPT_SIZE);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_UTIL_WEBSOCKET_ACCEPT_SIZE 29
+
+/* Looks up a header of an RTSP or HTTP request; returns value or NULL. */
+const char *http_util_find_header(const char *request, const char *name, char *value, size_t value_size);
+
+size_t http_util_base64_encode(const uint8_t *input, size_t length, char *output, size_t output_size);
+
+/* Sec-WebSocket-Accept for a client's Sec-WebSocket-Key (RFC 6455 section 4.2.2). */
+void http_util_websocket_accept(const char *key, char accept[HTTP_UTIL_WEBSOCKET_ACCEPT_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,6 +5,7 @@
 #include "esp_err.h"
 
 #include "image_processing.h"
+#include "memory_plan.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,6 +13,9 @@ extern "C" {
 
 typedef struct rtsp_transport_context_t *transport_handle_t;
 
+/* Redundant RTP paths, indexed by transport_type_t. */
+#define CONNECTIVITY_MAX_PATHS 2
+
 typedef enum {
     CONNECTIVITY_TRANSPORT_ETHERNET,
     CONNECTIVITY_TRANSPORT_WIFI,
@@ -25,15 +29,150 @@ typedef struct {
     const char *wifi_password;
     bool enable_ipv6;
     uint16_t rtsp_port;
+    uint16_t rtp_port;
+    /* RTSP sessions, at most 24 and no more than the lwIP sockets the servers leave free. 0 selects the cap. */
+    uint32_t max_clients;
+    struct {
+        UBaseType_t priority;
+        BaseType_t core_id;
+    } server_task;
+    struct {
+        int phy_address;
+        int phy_reset_gpio;
+    } ethernet;
+    /* Moves egress to the other link when the active one fails; transport_type is retaken after hold_down_ms. */
+    struct {
+        bool enable;
+        uint32_t check_interval_ms;
+        uint32_t hold_down_ms;
+    } failover;
+    /* Token bucket per UDP viewer: each frame spread over spread_percent of its interval, at least at bitrate. */
+    struct {
+        bool enable;
+        uint32_t bitrate;
+        uint32_t frame_rate;
+        uint32_t spread_percent;
+        uint32_t burst_bytes;
+    } pacing;
+    /* Answers RFC 4585 generic NACKs from a history of sent packets that references frames rather than copies. */
+    struct {
+        bool enable;
+        uint32_t history_packets;
+        uint32_t max_age_ms;
+    } retransmission;
+    /* One RFC 5109 ULPFEC packet (payload type 127, own SSRC) per group of media packets for UDP viewers. */
+    struct {
+        bool enable;
+        uint32_t keyframe_group_size;
+        uint32_t delta_group_size;
+    } fec;
+    /* Sent once to the group while at least one multicast session is playing. */
+    struct {
+        bool enable;
+        const char *group_address;
+        uint16_t port;
+        uint8_t ttl;
+    } multicast;
+    struct {
+        bool enable;
+        uint16_t port;
+        uint32_t max_clients;
+    } http;
+    /* Fragmented MP4 (CMAF) over chunked HTTP, one moof+mdat of fragment_frames frames per chunk. */
+    struct {
+        bool enable;
+        const char *path;
+        uint32_t fragment_frames;
+    } fmp4;
+    /*
+     * One binary message per access unit: a 16-byte header (byte 0 bit 0 keyframe, 3 reserved bytes, big-endian
+     * 32-bit frame sequence, big-endian 64-bit capture time in microseconds), then the Annex-B payload.
+     */
+    struct {
+        bool enable;
+        const char *path;
+    } websocket;
+    struct {
+        bool enable;
+        const char *path;
+    } metrics;
+    struct {
+        bool enable;
+        const char *path;
+    } trace;
+    struct {
+        bool enable;
+        const char *path;
+    } clock;
+    /* Single-program MPEG-TS in paced datagrams of up to 7x188 bytes; ttl applies to a multicast destination. */
+    struct {
+        bool enable;
+        const char *destination;
+        uint16_t port;
+        uint8_t ttl;
+    } mpegts;
+    /* Every RTP packet over Ethernet and Wi-Fi at once with the same sequence number, SMPTE 2022-7 style. */
+    struct {
+        bool enable;
+    } redundancy;
+    /* New viewers start on the last keyframe; cached frames go out at burst_percent of the paced rate. */
+    struct {
+        bool enable;
+        uint32_t burst_percent;
+    } gop_cache;
 } transport_config_t;
 
+typedef struct {
+    uint32_t packets_sent;
+    uint32_t packets_lost;
+} connectivity_path_stats_t;
+
+typedef struct {
+    uint32_t session_id;
+    uint32_t address;
+    bool interleaved;
+    bool playing;
+    uint32_t packets_sent;
+    uint32_t octets_sent;
+    uint32_t frames_dropped;
+    uint32_t send_errors;
+    uint32_t nack_requests;
+    uint32_t retransmitted;
+    uint32_t retransmit_misses;
+    float fraction_lost;
+    int32_t cumulative_lost;
+    uint32_t jitter_us;
+    uint32_t rtt_us;
+    int64_t last_report_us;
+    uint32_t startup_us;
+    uint32_t cached_frames_sent;
+    connectivity_path_stats_t paths[CONNECTIVITY_MAX_PATHS];
+} connectivity_client_stats_t;
+
 esp_err_t connectivity_start(const transport_config_t *config, transport_handle_t *out_handle);
 void connectivity_stop(transport_handle_t handle);
 
 transport_config_t connectivity_default_transport_config(void);
 
+/*
+ * Adds what connectivity_start() keeps for `config`: server state, client tables and the retransmission
+ * history, plus an estimate of the encoded frames and packet descriptors held for viewers at the paced bitrate.
+ */
+esp_err_t connectivity_plan_memory(const transport_config_t *config, memory_plan_t *plan);
+
 esp_err_t connectivity_stream_packet(transport_handle_t handle, const h264_packet_t *packet);
 
+/*
+ * Frames already handed to connectivity_stream_packet() that the RTSP viewer furthest ahead has not finished
+ * sending, 0 without viewers. Lets the producer skip encoding frames the network cannot take yet.
+ */
+uint32_t connectivity_get_backlog(transport_handle_t handle);
+
+/* True once after the egress interface changed; the caller should have the encoder emit an IDR frame. */
+bool connectivity_take_keyframe_request(transport_handle_t handle);
+
+esp_err_t connectivity_get_client_stats(transport_handle_t handle, connectivity_client_stats_t *stats, size_t max_stats, size_t *out_count);
+
 #ifdef __cplusplus
 }
 #endif
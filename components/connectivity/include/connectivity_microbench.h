@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "microbench.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per-frame and per-packet kernels of the streaming path: RTP packetization, ULPFEC, MPEG-TS. */
+const microbench_case_t *connectivity_microbench_cases(size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
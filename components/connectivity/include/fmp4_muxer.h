@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FMP4_TIMESCALE                  90000
+#define FMP4_MAX_FRAGMENT_SAMPLES       8
+#define FMP4_MAX_FRAGMENT_NALS          32
+#define FMP4_MAX_FRAGMENT_SEGMENTS      (1 + 2 * FMP4_MAX_FRAGMENT_NALS)
+#define FMP4_MAX_PARAMETER_SET_SIZE     64
+#define FMP4_INIT_SEGMENT_MAX_SIZE      768
+#define FMP4_FRAGMENT_HEADER_MAX_SIZE   (96 + 12 * FMP4_MAX_FRAGMENT_SAMPLES)
+#define FMP4_NAL_LENGTH_SIZE            4
+
+/* One Annex-B access unit. */
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    uint64_t timestamp_us;
+    bool is_keyframe;
+} fmp4_sample_t;
+
+typedef struct {
+    const void *data;
+    size_t length;
+} fmp4_segment_t;
+
+/*
+ * A moof+mdat pair described as a gather list: the box headers and NAL length prefixes live in the
+ * muxer, the NAL payloads stay in the caller's buffers and must outlive the fragment.
+ */
+typedef struct {
+    fmp4_segment_t segments[FMP4_MAX_FRAGMENT_SEGMENTS];
+    size_t segment_count;
+    size_t length;
+} fmp4_fragment_t;
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t sequence_number;
+    uint32_t default_duration;
+    uint64_t base_timestamp_us;
+    int64_t previous_ticks;
+    size_t init_length;
+    uint8_t init[FMP4_INIT_SEGMENT_MAX_SIZE];
+    uint8_t header[FMP4_FRAGMENT_HEADER_MAX_SIZE];
+    uint8_t length_prefixes[FMP4_MAX_FRAGMENT_NALS][FMP4_NAL_LENGTH_SIZE];
+} fmp4_muxer_t;
+
+/* The frame rate only seeds the duration of a fragment's last sample until real frame intervals are seen. */
+void fmp4_muxer_init(fmp4_muxer_t *muxer, uint32_t frame_rate);
+
+/* Builds the ftyp+moov init segment from the SPS/PPS of a keyframe and restarts the media timeline. */
+esp_err_t fmp4_muxer_write_init_segment(fmp4_muxer_t *muxer, const uint8_t *access_unit, size_t length);
+
+esp_err_t fmp4_muxer_write_fragment(fmp4_muxer_t *muxer, const fmp4_sample_t *samples, size_t count,
+                                    fmp4_fragment_t *fragment);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,58 @@
+#include "link_failover.h"
+
+static transport_type_t other_link(transport_type_t type)
+{
+    return type == CONNECTIVITY_TRANSPORT_ETHERNET ? CONNECTIVITY_TRANSPORT_WIFI : CONNECTIVITY_TRANSPORT_ETHERNET;
+}
+
+void link_failover_init(link_failover_t *failover, transport_type_t preferred, uint32_t hold_down_ms)
+{
+    *failover = (link_failover_t) {
+        .preferred = preferred,
+        .active = preferred,
+        .hold_down_us = (int64_t)hold_down_ms * 1000,
+    };
+}
+
+static bool activate(link_failover_t *failover, transport_type_t type)
+{
+    if (failover->has_active && failover->active == type) {
+        return false;
+    }
+    if (failover->has_active) {
+        ++failover->switches;
+    }
+    failover->active = type;
+    failover->has_active = true;
+    return true;
+}
+
+bool link_failover_update(link_failover_t *failover, bool ethernet_healthy, bool wifi_healthy, int64_t now_us)
+{
+    const bool healthy[2] = {
+        [CONNECTIVITY_TRANSPORT_ETHERNET] = ethernet_healthy,
+        [CONNECTIVITY_TRANSPORT_WIFI] = wifi_healthy,
+    };
+    for (int i = 0; i < 2; ++i) {
+        if (healthy[i] && !failover->healthy[i]) {
+            failover->healthy_since_us[i] = now_us;
+        }
+        failover->healthy[i] = healthy[i];
+    }
+
+    transport_type_t preferred = failover->preferred;
+    if (failover->has_active && healthy[failover->active]) {
+        if (failover->active != preferred && healthy[preferred] &&
+            now_us - failover->healthy_since_us[preferred] >= failover->hold_down_us) {
+            return activate(failover, preferred);
+        }
+        return false;
+    }
+    if (healthy[preferred]) {
+        return activate(failover, preferred);
+    }
+    if (healthy[other_link(preferred)]) {
+        return activate(failover, other_link(preferred));
+    }
+    return false;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "connectivity.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Chooses the egress interface from polled link health. A failed active link is abandoned immediately; the
+ * preferred link is only taken back after it has stayed healthy for the hold-down time.
+ */
+typedef struct {
+    transport_type_t preferred;
+    transport_type_t active;
+    bool has_active;
+    bool healthy[2];
+    int64_t healthy_since_us[2];
+    int64_t hold_down_us;
+    uint32_t switches;
+} link_failover_t;
+
+void link_failover_init(link_failover_t *failover, transport_type_t preferred, uint32_t hold_down_ms);
+
+/* Returns true when the active interface changed. */
+bool link_failover_update(link_failover_t *failover, bool ethernet_healthy, bool wifi_healthy, int64_t now_us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,159 @@
+#include "rtcp.h"
+
+#include <string.h>
+#include <sys/time.h>
+
+#define RTCP_VERSION            2
+#define RTCP_HEADER_SIZE        4
+#define RTCP_SR_SIZE            28
+#define RTCP_REPORT_BLOCK_SIZE  24
+#define RTCP_SDES_CNAME         1
+#define NTP_UNIX_EPOCH_OFFSET   2208988800ULL
+
+static void put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+static void put_u32(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >> 8) & 0xFF;
+    p[3] = value & 0xFF;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+uint64_t rtcp_ntp_now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    uint64_t seconds = (uint64_t)tv.tv_sec + NTP_UNIX_EPOCH_OFFSET;
+    uint64_t fraction = ((uint64_t)tv.tv_usec << 32) / 1000000;
+    return (seconds << 32) | fraction;
+}
+
+size_t rtcp_build_sender_report(uint8_t *buffer, size_t size, uint32_t ssrc, uint64_t ntp, uint32_t rtp_timestamp,
+                                uint32_t packet_count, uint32_t octet_count, const char *cname)
+{
+    size_t cname_length = cname ? strnlen(cname, 255) : 0;
+    size_t sdes_length = (RTCP_HEADER_SIZE + 4 + 2 + cname_length + 1 + 3) & ~(size_t)3;
+    if (size < RTCP_SR_SIZE + sdes_length) {
+        return 0;
+    }
+
+    uint8_t *sr = buffer;
+    sr[0] = RTCP_VERSION << 6;
+    sr[1] = RTCP_PT_SR;
+    put_u16(sr + 2, RTCP_SR_SIZE / 4 - 1);
+    put_u32(sr + 4, ssrc);
+    put_u32(sr + 8, (uint32_t)(ntp >> 32));
+    put_u32(sr + 12, (uint32_t)ntp);
+    put_u32(sr + 16, rtp_timestamp);
+    put_u32(sr + 20, packet_count);
+    put_u32(sr + 24, octet_count);
+
+    uint8_t *sdes = buffer + RTCP_SR_SIZE;
+    memset(sdes, 0, sdes_length);
+    sdes[0] = (RTCP_VERSION << 6) | 1;
+    sdes[1] = RTCP_PT_SDES;
+    put_u16(sdes + 2, (uint16_t)(sdes_length / 4 - 1));
+    put_u32(sdes + 4, ssrc);
+    sdes[8] = RTCP_SDES_CNAME;
+    sdes[9] = (uint8_t)cname_length;
+    if (cname_length) {
+        memcpy(sdes + 10, cname, cname_length);
+    }
+
+    return RTCP_SR_SIZE + sdes_length;
+}
+
+static void parse_report_blocks(const uint8_t *blocks, size_t count, uint32_t reporter_ssrc, const rtcp_callbacks_t *callbacks)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t *p = blocks + i * RTCP_REPORT_BLOCK_SIZE;
+        int32_t cumulative_lost = (int32_t)(((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7]);
+        if (cumulative_lost & 0x800000) {
+            cumulative_lost -= 0x1000000;
+        }
+        rtcp_report_block_t block = {
+            .ssrc = get_u32(p),
+            .fraction_lost = p[4],
+            .cumulative_lost = cumulative_lost,
+            .highest_sequence = get_u32(p + 8),
+            .jitter = get_u32(p + 12),
+            .last_sr = get_u32(p + 16),
+            .delay_since_last_sr = get_u32(p + 20),
+        };
+        if (callbacks->on_report_block) {
+            callbacks->on_report_block(callbacks->user_ctx, reporter_ssrc, &block);
+        }
+    }
+}
+
+static void parse_generic_nack(const uint8_t *packet, size_t length, const rtcp_callbacks_t *callbacks)
+{
+    if (!callbacks->on_nack || length < 12) {
+        return;
+    }
+    uint32_t media_ssrc = get_u32(packet + 8);
+    for (size_t offset = 12; offset + 4 <= length; offset += 4) {
+        uint16_t pid = get_u16(packet + offset);
+        uint16_t blp = get_u16(packet + offset + 2);
+        callbacks->on_nack(callbacks->user_ctx, media_ssrc, pid);
+        for (unsigned bit = 0; bit < 16; ++bit) {
+            if (blp & (1u << bit)) {
+                callbacks->on_nack(callbacks->user_ctx, media_ssrc, (uint16_t)(pid + bit + 1));
+            }
+        }
+    }
+}
+
+bool rtcp_parse(const uint8_t *data, size_t length, const rtcp_callbacks_t *callbacks)
+{
+    while (length >= RTCP_HEADER_SIZE) {
+        if ((data[0] >> 6) != RTCP_VERSION) {
+            return false;
+        }
+        size_t packet_length = ((size_t)((data[2] << 8) | data[3]) + 1) * 4;
+        if (packet_length > length) {
+            return false;
+        }
+
+        size_t count = data[0] & 0x1F;
+        uint8_t type = data[1];
+        if (type == RTCP_PT_RR && packet_length >= 8 + count * RTCP_REPORT_BLOCK_SIZE) {
+            parse_report_blocks(data + 8, count, get_u32(data + 4), callbacks);
+        } else if (type == RTCP_PT_SR && packet_length >= RTCP_SR_SIZE + count * RTCP_REPORT_BLOCK_SIZE) {
+            parse_report_blocks(data + RTCP_SR_SIZE, count, get_u32(data + 4), callbacks);
+        } else if (type == RTCP_PT_RTPFB && count == RTCP_FMT_GENERIC_NACK) {
+            parse_generic_nack(data, packet_length, callbacks);
+        }
+
+        data += packet_length;
+        length -= packet_length;
+    }
+    return length == 0;
+}
+
+uint32_t rtcp_round_trip_us(const rtcp_report_block_t *block, uint64_t ntp_now)
+{
+    if (block->last_sr == 0) {
+        return 0;
+    }
+    uint32_t rtt = rtcp_ntp_compact(ntp_now) - block->last_sr - block->delay_since_last_sr;
+    if (rtt & 0x80000000) {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)rtt * 1000000) >> 16);
+}
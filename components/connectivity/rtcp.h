@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTCP_PT_SR              200
+#define RTCP_PT_RR              201
+#define RTCP_PT_SDES            202
+#define RTCP_PT_BYE             203
+#define RTCP_PT_RTPFB           205
+#define RTCP_FMT_GENERIC_NACK   1
+#define RTCP_MAX_PACKET_SIZE    128
+
+typedef struct {
+    uint32_t ssrc;
+    uint8_t fraction_lost;
+    int32_t cumulative_lost;
+    uint32_t highest_sequence;
+    uint32_t jitter;
+    uint32_t last_sr;
+    uint32_t delay_since_last_sr;
+} rtcp_report_block_t;
+
+typedef struct {
+    void (*on_report_block)(void *user_ctx, uint32_t reporter_ssrc, const rtcp_report_block_t *block);
+    /* Called once per lost sequence number listed in an RFC 4585 generic NACK. */
+    void (*on_nack)(void *user_ctx, uint32_t media_ssrc, uint16_t sequence);
+    void *user_ctx;
+} rtcp_callbacks_t;
+
+uint64_t rtcp_ntp_now(void);
+
+static inline uint32_t rtcp_ntp_compact(uint64_t ntp)
+{
+    return (uint32_t)(ntp >> 16);
+}
+
+/* Builds a compound SR + SDES(CNAME) packet, returns its length or 0 if it does not fit. */
+size_t rtcp_build_sender_report(uint8_t *buffer, size_t size, uint32_t ssrc, uint64_t ntp, uint32_t rtp_timestamp,
+                                uint32_t packet_count, uint32_t octet_count, const char *cname);
+
+/* Walks a compound RTCP packet; returns false if it is malformed. */
+bool rtcp_parse(const uint8_t *data, size_t length, const rtcp_callbacks_t *callbacks);
+
+/* Round-trip time from an RR block per RFC 3550 section 6.4.1, or 0 when the receiver has no SR yet. */
+uint32_t rtcp_round_trip_us(const rtcp_report_block_t *block, uint64_t ntp_now);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,127 @@
+#include "rtp_fec.h"
+
+#include <string.h>
+
+#include "esp_random.h"
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+static void put_u32(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >> 8) & 0xFF;
+    p[3] = value & 0xFF;
+}
+
+void rtp_fec_init(rtp_fec_encoder_t *encoder)
+{
+    encoder->ssrc = esp_random();
+    encoder->sequence = (uint16_t)esp_random();
+}
+
+size_t rtp_fec_group_count(size_t media_packet_count, uint32_t group_size)
+{
+    if (group_size == 0 || media_packet_count == 0) {
+        return 0;
+    }
+    if (group_size > RTP_FEC_MAX_GROUP_SIZE) {
+        group_size = RTP_FEC_MAX_GROUP_SIZE;
+    }
+    return (media_packet_count + group_size - 1) / group_size;
+}
+
+void rtp_fec_xor(uint8_t *dst, const uint8_t *src, size_t length)
+{
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint32_t a[4];
+        uint32_t b[4];
+        memcpy(a, dst + i, sizeof(a));
+        memcpy(b, src + i, sizeof(b));
+        a[0] ^= b[0];
+        a[1] ^= b[1];
+        a[2] ^= b[2];
+        a[3] ^= b[3];
+        memcpy(dst + i, a, sizeof(a));
+    }
+    for (; i < length; ++i) {
+        dst[i] ^= src[i];
+    }
+}
+
+static size_t protect_group(rtp_fec_encoder_t *encoder, const rtp_packet_t *media, size_t count, uint8_t *out, rtp_packet_t *fec)
+{
+    uint8_t *fec_header = out;
+    uint8_t *level_header = out + RTP_FEC_HEADER_SIZE;
+    uint8_t *parity = level_header + RTP_FEC_LEVEL_HEADER_SIZE;
+
+    uint8_t byte0 = 0;
+    uint8_t byte1 = 0;
+    uint32_t timestamp = 0;
+    uint16_t length_recovery = 0;
+    size_t protection_length = 0;
+    uint16_t mask = 0;
+    uint16_t sequence_base = rtp_packet_sequence(&media[0]);
+
+    for (size_t i = 0; i < count; ++i) {
+        const rtp_packet_t *packet = &media[i];
+        size_t extra_header = packet->header_length - RTP_HEADER_SIZE;
+        size_t length = extra_header + packet->payload_length;
+        if (length > protection_length) {
+            memset(parity + protection_length, 0, length - protection_length);
+            protection_length = length;
+        }
+        rtp_fec_xor(parity, packet->header + RTP_HEADER_SIZE, extra_header);
+        rtp_fec_xor(parity + extra_header, packet->payload, packet->payload_length);
+
+        byte0 ^= packet->header[0];
+        byte1 ^= packet->header[1];
+        timestamp ^= get_u32(packet->header + 4);
+        length_recovery ^= (uint16_t)length;
+        mask |= (uint16_t)(0x8000 >> (uint16_t)(rtp_packet_sequence(packet) - sequence_base));
+    }
+
+    fec_header[0] = byte0 & 0x3F;
+    fec_header[1] = byte1;
+    put_u16(fec_header + 2, sequence_base);
+    put_u32(fec_header + 4, timestamp);
+    put_u16(fec_header + 8, length_recovery);
+    put_u16(level_header, (uint16_t)protection_length);
+    put_u16(level_header + 2, mask);
+
+    const uint8_t *media_header = media[0].header;
+    fec->header[0] = 2 << 6;
+    fec->header[1] = RTP_FEC_PAYLOAD_TYPE;
+    put_u16(fec->header + 2, encoder->sequence++);
+    memcpy(fec->header + 4, media_header + 4, 4);
+    put_u32(fec->header + 8, encoder->ssrc);
+    fec->header_length = RTP_HEADER_SIZE;
+    fec->payload = out;
+    fec->payload_length = (uint16_t)(RTP_FEC_HEADER_SIZE + RTP_FEC_LEVEL_HEADER_SIZE + protection_length);
+    return fec->payload_length;
+}
+
+size_t rtp_fec_protect(rtp_fec_encoder_t *encoder, const rtp_packet_t *media, size_t media_count, uint32_t group_size,
+                       uint8_t *buffer, rtp_packet_t *fec_packets)
+{
+    size_t groups = rtp_fec_group_count(media_count, group_size);
+    if (group_size > RTP_FEC_MAX_GROUP_SIZE) {
+        group_size = RTP_FEC_MAX_GROUP_SIZE;
+    }
+    for (size_t g = 0; g < groups; ++g) {
+        size_t first = g * group_size;
+        size_t count = media_count - first < group_size ? media_count - first : group_size;
+        protect_group(encoder, media + first, count, buffer + g * RTP_FEC_PACKET_BUFFER_SIZE, &fec_packets[g]);
+    }
+    return groups;
+}
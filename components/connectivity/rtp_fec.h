@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rtp_packetizer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTP_FEC_PAYLOAD_TYPE        127
+#define RTP_FEC_HEADER_SIZE         10
+#define RTP_FEC_LEVEL_HEADER_SIZE   4
+#define RTP_FEC_MAX_GROUP_SIZE      16
+#define RTP_FEC_PACKET_BUFFER_SIZE  (RTP_FEC_HEADER_SIZE + RTP_FEC_LEVEL_HEADER_SIZE + RTP_DEFAULT_MTU)
+
+typedef struct {
+    uint32_t ssrc;
+    uint16_t sequence;
+} rtp_fec_encoder_t;
+
+void rtp_fec_init(rtp_fec_encoder_t *encoder);
+
+size_t rtp_fec_group_count(size_t media_packet_count, uint32_t group_size);
+
+/*
+ * Emits one RFC 5109 ULPFEC packet (16-bit mask) per group of group_size consecutive media packets.
+ * buffer must hold rtp_fec_group_count() * RTP_FEC_PACKET_BUFFER_SIZE bytes.
+ */
+size_t rtp_fec_protect(rtp_fec_encoder_t *encoder, const rtp_packet_t *media, size_t media_count, uint32_t group_size,
+                       uint8_t *buffer, rtp_packet_t *fec_packets);
+
+/* dst ^= src, a word at a time. */
+void rtp_fec_xor(uint8_t *dst, const uint8_t *src, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
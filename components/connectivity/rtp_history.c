@@ -0,0 +1,80 @@
+#include "rtp_history.h"
+
+#include <stdlib.h>
+
+#include "memory_account.h"
+
+#define RTP_HISTORY_MAX_CAPACITY    32768
+
+size_t rtp_history_slots(size_t capacity)
+{
+    /* A power of two divides the 16-bit sequence space, so slots stay stable across wrap-around. */
+    size_t slots = 1;
+    while (slots < capacity && slots < RTP_HISTORY_MAX_CAPACITY) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+esp_err_t rtp_history_init(rtp_history_t *history, size_t capacity)
+{
+    if (!history || capacity == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t slots = rtp_history_slots(capacity);
+    history->entries = memory_account_calloc(MEMORY_ACCOUNT_CONNECTIVITY, slots, sizeof(rtp_history_entry_t),
+                                             MEMORY_PLAN_HOT_CAPS);
+    if (!history->entries) {
+        return ESP_ERR_NO_MEM;
+    }
+    history->capacity = slots;
+    history->hits = 0;
+    history->misses = 0;
+    return ESP_OK;
+}
+
+void rtp_history_deinit(rtp_history_t *history)
+{
+    if (!history || !history->entries) {
+        return;
+    }
+    for (size_t i = 0; i < history->capacity; ++i) {
+        stream_frame_unref(history->entries[i].frame);
+    }
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, history->entries);
+    history->entries = NULL;
+    history->capacity = 0;
+}
+
+void rtp_history_store_frame(rtp_history_t *history, stream_frame_t *frame, int64_t now_us)
+{
+    if (!history->entries) {
+        return;
+    }
+    for (size_t i = 0; i < frame->media_packet_count; ++i) {
+        uint16_t sequence = rtp_packet_sequence(&frame->packets[i]);
+        rtp_history_entry_t *entry = &history->entries[sequence & (history->capacity - 1)];
+        if (entry->frame != frame) {
+            stream_frame_unref(entry->frame);
+            entry->frame = stream_frame_ref(frame);
+        }
+        entry->packet_index = (uint16_t)i;
+        entry->sequence = sequence;
+        entry->stored_us = now_us;
+    }
+}
+
+const rtp_packet_t *rtp_history_lookup(rtp_history_t *history, uint16_t sequence, int64_t max_age_us, int64_t now_us)
+{
+    if (!history->entries) {
+        return NULL;
+    }
+    rtp_history_entry_t *entry = &history->entries[sequence & (history->capacity - 1)];
+    if (!entry->frame || entry->sequence != sequence || now_us - entry->stored_us > max_age_us) {
+        ++history->misses;
+        return NULL;
+    }
+    ++history->hits;
+    return &entry->frame->packets[entry->packet_index];
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "stream_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    stream_frame_t *frame;
+    uint16_t packet_index;
+    uint16_t sequence;
+    int64_t stored_us;
+} rtp_history_entry_t;
+
+typedef struct {
+    rtp_history_entry_t *entries;
+    size_t capacity;
+    uint32_t hits;
+    uint32_t misses;
+} rtp_history_t;
+
+/* Entries rtp_history_init() allocates for `capacity` packets. */
+size_t rtp_history_slots(size_t capacity);
+
+esp_err_t rtp_history_init(rtp_history_t *history, size_t capacity);
+void rtp_history_deinit(rtp_history_t *history);
+
+/* Records every packet of an already packetized frame; each entry holds a frame reference, never a copy. */
+void rtp_history_store_frame(rtp_history_t *history, stream_frame_t *frame, int64_t now_us);
+
+const rtp_packet_t *rtp_history_lookup(rtp_history_t *history, uint16_t sequence, int64_t max_age_us, int64_t now_us);
+
+#ifdef __cplusplus
+}
+#endif
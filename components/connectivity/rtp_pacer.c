@@ -0,0 +1,73 @@
+#include "rtp_pacer.h"
+
+#define RTP_PACER_TOKEN_SCALE   1000000LL
+
+static void refill(rtp_pacer_t *pacer, int64_t now_us)
+{
+    int64_t elapsed_us = now_us - pacer->last_refill_us;
+    if (elapsed_us <= 0) {
+        return;
+    }
+    pacer->last_refill_us = now_us;
+    pacer->tokens += elapsed_us * pacer->rate_bytes_per_s;
+    if (pacer->tokens > pacer->depth) {
+        pacer->tokens = pacer->depth;
+    }
+}
+
+void rtp_pacer_init(rtp_pacer_t *pacer, uint32_t rate_bytes_per_s, size_t burst_bytes, int64_t now_us)
+{
+    pacer->rate_bytes_per_s = rate_bytes_per_s ? rate_bytes_per_s : 1;
+    if (burst_bytes < RTP_PACER_MIN_BURST_BYTES) {
+        burst_bytes = RTP_PACER_MIN_BURST_BYTES;
+    }
+    pacer->depth = (int64_t)burst_bytes * RTP_PACER_TOKEN_SCALE;
+    pacer->tokens = pacer->depth;
+    pacer->last_refill_us = now_us;
+}
+
+void rtp_pacer_set_rate(rtp_pacer_t *pacer, uint32_t rate_bytes_per_s, int64_t now_us)
+{
+    refill(pacer, now_us);
+    pacer->rate_bytes_per_s = rate_bytes_per_s ? rate_bytes_per_s : 1;
+}
+
+static int64_t tokens_for(const rtp_pacer_t *pacer, size_t bytes)
+{
+    int64_t needed = (int64_t)bytes * RTP_PACER_TOKEN_SCALE;
+    return needed > pacer->depth ? pacer->depth : needed;
+}
+
+int64_t rtp_pacer_reserve(rtp_pacer_t *pacer, size_t bytes, int64_t now_us)
+{
+    refill(pacer, now_us);
+    int64_t needed = tokens_for(pacer, bytes);
+    if (pacer->tokens >= needed) {
+        pacer->tokens -= needed;
+        return 0;
+    }
+    return (needed - pacer->tokens + pacer->rate_bytes_per_s - 1) / pacer->rate_bytes_per_s;
+}
+
+void rtp_pacer_refund(rtp_pacer_t *pacer, size_t bytes)
+{
+    pacer->tokens += tokens_for(pacer, bytes);
+    if (pacer->tokens > pacer->depth) {
+        pacer->tokens = pacer->depth;
+    }
+}
+
+uint32_t rtp_pacer_frame_rate(uint32_t bitrate, uint32_t frame_rate, uint32_t spread_percent, size_t frame_bytes)
+{
+    if (frame_rate == 0) {
+        frame_rate = 30;
+    }
+    if (spread_percent == 0 || spread_percent > 100) {
+        spread_percent = 100;
+    }
+    uint64_t spread_us = 1000000ULL * spread_percent / 100 / frame_rate;
+    uint64_t base_rate = (uint64_t)bitrate / 8 * 100 / spread_percent;
+    uint64_t frame_rate_bytes = (uint64_t)frame_bytes * 1000000ULL / (spread_us ? spread_us : 1);
+    uint64_t rate = frame_rate_bytes > base_rate ? frame_rate_bytes : base_rate;
+    return rate > UINT32_MAX ? UINT32_MAX : (uint32_t)rate;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rtp_packetizer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t rate_bytes_per_s;
+    int64_t depth;
+    int64_t tokens;
+    int64_t last_refill_us;
+} rtp_pacer_t;
+
+/* A bucket shallower than one packet would clamp every reservation to nothing and leave the stream unpaced. */
+#define RTP_PACER_MIN_BURST_BYTES RTP_DEFAULT_MTU
+
+/* burst_bytes below RTP_PACER_MIN_BURST_BYTES, including 0, is raised to it. */
+void rtp_pacer_init(rtp_pacer_t *pacer, uint32_t rate_bytes_per_s, size_t burst_bytes, int64_t now_us);
+void rtp_pacer_set_rate(rtp_pacer_t *pacer, uint32_t rate_bytes_per_s, int64_t now_us);
+
+/* Consumes tokens for `bytes` and returns 0, or returns the wait in microseconds until they are available. */
+int64_t rtp_pacer_reserve(rtp_pacer_t *pacer, size_t bytes, int64_t now_us);
+
+/* Returns what rtp_pacer_reserve() took for `bytes` that were then not sent and will be retried. */
+void rtp_pacer_refund(rtp_pacer_t *pacer, size_t bytes);
+
+/* Rate that spreads frame_bytes over spread_percent of the frame interval, never below the encoder bitrate share. */
+uint32_t rtp_pacer_frame_rate(uint32_t bitrate, uint32_t frame_rate, uint32_t spread_percent, size_t frame_bytes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,101 @@
+#include "rtp_packetizer.h"
+
+#include <stdbool.h>
+
+#include "esp_random.h"
+
+#include "h264_nal.h"
+
+#define RTP_VERSION             2
+#define RTP_NAL_TYPE_FU_A       28
+
+static void write_rtp_header(uint8_t *header, bool marker, uint16_t sequence, uint32_t timestamp, uint32_t ssrc)
+{
+    header[0] = RTP_VERSION << 6;
+    header[1] = (marker ? 0x80 : 0x00) | RTP_H264_PAYLOAD_TYPE;
+    header[2] = sequence >> 8;
+    header[3] = sequence & 0xFF;
+    header[4] = timestamp >> 24;
+    header[5] = (timestamp >> 16) & 0xFF;
+    header[6] = (timestamp >> 8) & 0xFF;
+    header[7] = timestamp & 0xFF;
+    header[8] = ssrc >> 24;
+    header[9] = (ssrc >> 16) & 0xFF;
+    header[10] = (ssrc >> 8) & 0xFF;
+    header[11] = ssrc & 0xFF;
+}
+
+void rtp_packetizer_init(rtp_packetizer_t *packetizer, size_t mtu)
+{
+    packetizer->ssrc = esp_random();
+    packetizer->sequence = (uint16_t)esp_random();
+    packetizer->timestamp_offset = esp_random();
+    packetizer->max_payload_size = (mtu ? mtu : RTP_DEFAULT_MTU) - RTP_MAX_HEADER_SIZE;
+}
+
+uint32_t rtp_packetizer_timestamp(const rtp_packetizer_t *packetizer, uint64_t timestamp_us)
+{
+    return (uint32_t)(timestamp_us * (RTP_H264_CLOCK_RATE / 1000) / 1000) + packetizer->timestamp_offset;
+}
+
+size_t rtp_packetizer_count(const rtp_packetizer_t *packetizer, const uint8_t *access_unit, size_t length)
+{
+    size_t count = 0;
+    const uint8_t *nal = NULL;
+    size_t nal_length = 0;
+    h264_nal_iterator_t it;
+    h264_nal_iterator_init(&it, access_unit, length);
+    while (h264_nal_iterator_next(&it, &nal, &nal_length)) {
+        if (nal_length <= packetizer->max_payload_size) {
+            ++count;
+        } else {
+            count += (nal_length - 1 + packetizer->max_payload_size - 1) / packetizer->max_payload_size;
+        }
+    }
+    return count;
+}
+
+size_t rtp_packetizer_packetize(rtp_packetizer_t *packetizer, const uint8_t *access_unit, size_t length,
+                                uint32_t rtp_timestamp, rtp_packet_t *packets, size_t max_packets)
+{
+    size_t count = 0;
+    const uint8_t *nal = NULL;
+    size_t nal_length = 0;
+    h264_nal_iterator_t it;
+    h264_nal_iterator_init(&it, access_unit, length);
+
+    while (count < max_packets && h264_nal_iterator_next(&it, &nal, &nal_length)) {
+        if (nal_length <= packetizer->max_payload_size) {
+            rtp_packet_t *packet = &packets[count++];
+            write_rtp_header(packet->header, false, packetizer->sequence++, rtp_timestamp, packetizer->ssrc);
+            packet->header_length = RTP_HEADER_SIZE;
+            packet->payload = nal;
+            packet->payload_length = nal_length;
+            continue;
+        }
+
+        const uint8_t nal_header = nal[0];
+        const uint8_t *fragment = nal + 1;
+        size_t remaining = nal_length - 1;
+        bool first = true;
+        while (remaining > 0 && count < max_packets) {
+            size_t chunk = remaining < packetizer->max_payload_size ? remaining : packetizer->max_payload_size;
+            bool last = chunk == remaining;
+            rtp_packet_t *packet = &packets[count++];
+            write_rtp_header(packet->header, false, packetizer->sequence++, rtp_timestamp, packetizer->ssrc);
+            packet->header[RTP_HEADER_SIZE] = (nal_header & 0xE0) | RTP_NAL_TYPE_FU_A;
+            packet->header[RTP_HEADER_SIZE + 1] = (first ? 0x80 : 0x00) | (last ? 0x40 : 0x00) | H264_NAL_TYPE(nal_header);
+            packet->header_length = RTP_MAX_HEADER_SIZE;
+            packet->payload = fragment;
+            packet->payload_length = chunk;
+            fragment += chunk;
+            remaining -= chunk;
+            first = false;
+        }
+    }
+
+    if (count > 0) {
+        packets[count - 1].header[1] |= 0x80;
+    }
+    return count;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTP_HEADER_SIZE         12
+#define RTP_FU_A_HEADER_SIZE    2
+#define RTP_MAX_HEADER_SIZE     (RTP_HEADER_SIZE + RTP_FU_A_HEADER_SIZE)
+#define RTP_H264_PAYLOAD_TYPE   96
+#define RTP_H264_CLOCK_RATE     90000
+#define RTP_DEFAULT_MTU         1400
+
+typedef struct {
+    uint8_t header[RTP_MAX_HEADER_SIZE];
+    uint8_t header_length;
+    uint16_t payload_length;
+    const uint8_t *payload;
+} rtp_packet_t;
+
+typedef struct {
+    uint32_t ssrc;
+    uint16_t sequence;
+    uint32_t timestamp_offset;
+    size_t max_payload_size;
+} rtp_packetizer_t;
+
+void rtp_packetizer_init(rtp_packetizer_t *packetizer, size_t mtu);
+
+uint32_t rtp_packetizer_timestamp(const rtp_packetizer_t *packetizer, uint64_t timestamp_us);
+
+size_t rtp_packetizer_count(const rtp_packetizer_t *packetizer, const uint8_t *access_unit, size_t length);
+
+/* Splits an Annex-B access unit into RFC 6184 single NAL and FU-A packets that point into access_unit. */
+size_t rtp_packetizer_packetize(rtp_packetizer_t *packetizer, const uint8_t *access_unit, size_t length,
+                                uint32_t rtp_timestamp, rtp_packet_t *packets, size_t max_packets);
+
+static inline uint16_t rtp_packet_sequence(const rtp_packet_t *packet)
+{
+    return (uint16_t)((packet->header[2] << 8) | packet->header[3]);
+}
+
+static inline size_t rtp_packet_size(const rtp_packet_t *packet)
+{
+    return packet->header_length + packet->payload_length;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,1675 @@
+#include "rtsp_server.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "lwip/sockets.h"
+#include "lwip/inet.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "h264_nal.h"
+#include "frame_pool.h"
+#include "frame_ring.h"
+#include "http_server.h"
+#include "http_util.h"
+#include "memory_account.h"
+#include "metrics.h"
+#include "socket_util.h"
+#include "trace.h"
+#include "rtp_packetizer.h"
+#include "rtp_pacer.h"
+#include "rtcp.h"
+#include "rtp_history.h"
+#include "rtp_fec.h"
+#include "ts_output.h"
+
+static const char *TAG = "rtsp_server";
+
+#define RTSP_SERVER_MAX_CLIENTS         24
+/* Listener, RTP, RTCP, wake-up pair, two redundant path sockets and MPEG-TS, plus one for a refused accept(). */
+#define RTSP_SERVER_FIXED_SOCKETS       9
+#define RTSP_FRAME_QUEUE_LENGTH         4
+#define RTSP_RX_BUFFER_SIZE             1536
+#define RTSP_TX_BUFFER_SIZE             1536
+#define RTSP_SDP_BUFFER_SIZE            768
+#define RTSP_SESSION_TIMEOUT_S          60
+#define RTSP_HOUSEKEEPING_INTERVAL_MS   1000
+#define RTSP_MAX_PARAMETER_SET_SIZE     64
+#define RTSP_INTERLEAVED_HEADER_SIZE    4
+#define RTSP_RTCP_BUFFER_SIZE           256
+#define RTSP_RTCP_INTERVAL_MS           1000
+#define RTSP_FRAME_BLOCK_SIZE           4096
+#define RTSP_DESCRIPTOR_BLOCK_SIZE      256
+#define RTSP_FEC_BLOCK_SIZE             4096
+/* Pooled frames beyond the queues and the ring: keyframes above the average and frames viewers are still sending. */
+#define RTSP_POOL_HEADROOM_FRAMES       8
+
+typedef enum {
+    RTSP_CLIENT_FREE = 0,
+    RTSP_CLIENT_INIT,
+    RTSP_CLIENT_READY,
+    RTSP_CLIENT_PLAYING,
+} rtsp_client_state_t;
+
+/* One copy of the RTP stream in redundant mode; paths pace independently over the shared frame packets. */
+typedef struct {
+    size_t packet_index;
+    rtp_pacer_t pacer;
+    int64_t deadline_us;
+} rtsp_path_t;
+
+typedef struct {
+    int socket;
+    rtsp_client_state_t state;
+    bool interleaved;
+    bool closing;
+    bool blocked;
+    bool multicast;
+    uint8_t rtp_channel;
+    uint8_t rtcp_channel;
+    uint32_t session_id;
+    struct sockaddr_in peer_addr;
+    struct sockaddr_in rtp_addr;
+    struct sockaddr_in rtcp_addr;
+    stream_frame_t *current;
+    frame_cursor_t cursor;
+    size_t packet_index;
+    size_t packet_offset;
+    uint8_t interleaved_header[RTSP_INTERLEAVED_HEADER_SIZE];
+    rtp_pacer_t pacer;
+    rtsp_path_t paths[CONNECTIVITY_MAX_PATHS];
+    int64_t pacing_deadline_us;
+    int64_t last_sr_us;
+    int64_t play_start_us;
+    bool startup_pending;
+    connectivity_client_stats_t stats;
+    int64_t last_activity_us;
+    size_t rx_length;
+    size_t tx_length;
+    size_t tx_offset;
+    char rx_buffer[RTSP_RX_BUFFER_SIZE];
+    char tx_buffer[RTSP_TX_BUFFER_SIZE];
+} rtsp_client_t;
+
+struct rtsp_server_t {
+    transport_config_t config;
+    QueueHandle_t frame_queue;
+    TaskHandle_t task;
+    TaskHandle_t stop_waiter;
+    volatile bool stop_requested;
+    int listen_socket;
+    int rtp_socket;
+    int rtcp_socket;
+    int wake_socket;
+    int wake_tx_socket;
+    bool rtp_blocked;
+    int path_sockets[CONNECTIVITY_MAX_PATHS];
+    bool path_blocked[CONNECTIVITY_MAX_PATHS];
+    rtp_packetizer_t packetizer;
+    rtp_history_t history;
+    rtp_fec_encoder_t fec;
+    frame_pool_t frame_pool;
+    frame_pool_t descriptor_pool;
+    frame_pool_t fec_pool;
+    frame_ring_t ring;
+    atomic_bool frames_lost;
+    atomic_bool link_changed;
+    atomic_uint backlog_frames;
+    uint8_t sps[RTSP_MAX_PARAMETER_SET_SIZE];
+    size_t sps_length;
+    uint8_t pps[RTSP_MAX_PARAMETER_SET_SIZE];
+    size_t pps_length;
+    uint32_t max_clients;
+    rtsp_client_t *clients;
+    rtsp_client_t multicast_sender;
+    ts_output_t ts_output;
+    portMUX_TYPE stats_lock;
+    connectivity_client_stats_t *published_stats;
+    size_t published_count;
+};
+
+static METRICS_DEFINE_GAUGE(s_rtsp_clients, "rtsp_playing_clients", "RTSP sessions currently playing");
+static METRICS_DEFINE_GAUGE(s_rtsp_backlog, "rtsp_backlog_frames", "Frames the most up-to-date RTSP viewer has yet to send");
+static METRICS_DEFINE_COUNTER(s_rtp_packets_sent, "rtp_packets_sent_total", "RTP media packets sent, all sessions");
+static METRICS_DEFINE_COUNTER(s_rtp_retransmitted, "rtp_retransmitted_total", "RTP packets resent after a NACK");
+
+static void wake_server(rtsp_server_t *server)
+{
+    socket_util_wake(server->wake_tx_socket);
+}
+
+static void cache_parameter_sets(rtsp_server_t *server, const stream_frame_t *frame)
+{
+    const uint8_t *nal = NULL;
+    size_t nal_length = 0;
+    h264_nal_iterator_t it;
+    h264_nal_iterator_init(&it, frame->payload, frame->length);
+    while (h264_nal_iterator_next(&it, &nal, &nal_length)) {
+        uint8_t type = H264_NAL_TYPE(nal[0]);
+        if (type == H264_NAL_TYPE_SPS && nal_length <= sizeof(server->sps)) {
+            memcpy(server->sps, nal, nal_length);
+            server->sps_length = nal_length;
+        } else if (type == H264_NAL_TYPE_PPS && nal_length <= sizeof(server->pps)) {
+            memcpy(server->pps, nal, nal_length);
+            server->pps_length = nal_length;
+        } else if (type != H264_NAL_TYPE_SPS && type != H264_NAL_TYPE_PPS && type != H264_NAL_TYPE_AUD &&
+                   type != H264_NAL_TYPE_SEI) {
+            break;
+        }
+    }
+}
+
+static size_t fec_group_size(const rtsp_server_t *server, const stream_frame_t *frame)
+{
+    if (!server->config.fec.enable) {
+        return 0;
+    }
+    return frame->is_keyframe ? server->config.fec.keyframe_group_size : server->config.fec.delta_group_size;
+}
+
+static void ingest_frame(rtsp_server_t *server, stream_frame_t *frame)
+{
+    TRACE_EVENT(TRACE_EVENT_RTSP_PACKETIZE_BEGIN, frame->timestamp_us);
+    size_t count = rtp_packetizer_count(&server->packetizer, frame->payload, frame->length);
+    size_t group_size = fec_group_size(server, frame);
+    size_t fec_count = rtp_fec_group_count(count, group_size);
+    /* Descriptors and RTP headers are read for every packet sent; the FEC payloads are bulk data like the frame. */
+    size_t packets_size = (count + fec_count) * sizeof(rtp_packet_t);
+    size_t fec_size = fec_count * RTP_FEC_PACKET_BUFFER_SIZE;
+    frame->packets = count ? frame_pool_alloc(&server->descriptor_pool, packets_size) : NULL;
+    frame->fec_buffer = fec_count ? frame_pool_alloc(&server->fec_pool, fec_size) : NULL;
+    if (!frame->packets || (fec_count && !frame->fec_buffer)) {
+        ESP_LOGW(TAG, "Dropping frame without packet descriptors");
+        TRACE_EVENT(TRACE_EVENT_RTSP_PACKETIZE_END, frame->timestamp_us);
+        stream_frame_unref(frame);
+        frame_ring_mark_discontinuity(&server->ring);
+        return;
+    }
+
+    uint32_t rtp_timestamp = rtp_packetizer_timestamp(&server->packetizer, frame->timestamp_us);
+    frame->media_packet_count = rtp_packetizer_packetize(&server->packetizer, frame->payload, frame->length,
+                                                         rtp_timestamp, frame->packets, count);
+    frame->packet_count = frame->media_packet_count;
+    if (fec_count) {
+        frame->packet_count += rtp_fec_protect(&server->fec, frame->packets, frame->media_packet_count, group_size,
+                                               frame->fec_buffer, frame->packets + frame->media_packet_count);
+    }
+    if (frame->is_keyframe) {
+        cache_parameter_sets(server, frame);
+    }
+    rtp_history_store_frame(&server->history, frame, esp_timer_get_time());
+    TRACE_EVENT(TRACE_EVENT_RTSP_PACKETIZE_END, frame->timestamp_us);
+
+    frame_ring_push(&server->ring, frame);
+}
+
+static void drain_frame_queue(rtsp_server_t *server)
+{
+    stream_frame_t *frame = NULL;
+    while (xQueueReceive(server->frame_queue, &frame, 0) == pdTRUE) {
+        if (atomic_exchange(&server->frames_lost, false)) {
+            frame_ring_mark_discontinuity(&server->ring);
+        }
+        memory_account_enter_hot_path();
+        ingest_frame(server, frame);
+        memory_account_leave_hot_path();
+    }
+}
+
+static void client_reset_media(rtsp_client_t *client)
+{
+    stream_frame_unref(client->current);
+    client->current = NULL;
+    client->packet_index = 0;
+    client->packet_offset = 0;
+}
+
+static void close_client(rtsp_client_t *client)
+{
+    if (client->state == RTSP_CLIENT_FREE) {
+        return;
+    }
+    ESP_LOGI(TAG, "RTSP client disconnected: %s (%" PRIu32 " frames dropped)", inet_ntoa(client->peer_addr.sin_addr),
+             client->cursor.frames_dropped);
+    client_reset_media(client);
+    close(client->socket);
+    memset(client, 0, offsetof(rtsp_client_t, rx_buffer));
+    client->socket = -1;
+    client->state = RTSP_CLIENT_FREE;
+}
+
+static void client_printf(rtsp_client_t *client, const char *format, ...)
+{
+    if (client->tx_length >= sizeof(client->tx_buffer)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(client->tx_buffer + client->tx_length, sizeof(client->tx_buffer) - client->tx_length, format, args);
+    va_end(args);
+    if (written > 0) {
+        client->tx_length += (size_t)written;
+        if (client->tx_length > sizeof(client->tx_buffer)) {
+            client->tx_length = sizeof(client->tx_buffer);
+        }
+    }
+}
+
+static void client_append(rtsp_client_t *client, const void *data, size_t length)
+{
+    if (client->tx_length + length > sizeof(client->tx_buffer)) {
+        return;
+    }
+    memcpy(client->tx_buffer + client->tx_length, data, length);
+    client->tx_length += length;
+}
+
+static void begin_response(rtsp_client_t *client, int status, const char *reason, int cseq)
+{
+    client_printf(client, "RTSP/1.0 %d %s\r\nCSeq: %d\r\nServer: esp32-p4-rtsp\r\n", status, reason, cseq);
+    if (client->session_id) {
+        client_printf(client, "Session: %08" PRIX32 ";timeout=%d\r\n", client->session_id, RTSP_SESSION_TIMEOUT_S);
+    }
+}
+
+static void send_simple_response(rtsp_client_t *client, int status, const char *reason, int cseq)
+{
+    begin_response(client, status, reason, cseq);
+    client_printf(client, "\r\n");
+}
+
+/* Appends to the SDP at `*length`; false, with nothing usable appended, once the text no longer fits. */
+static bool sdp_printf(char *sdp, size_t size, size_t *length, const char *format, ...)
+{
+    if (*length >= size) {
+        return false;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(sdp + *length, size - *length, format, args);
+    va_end(args);
+    if (written < 0 || (size_t)written >= size - *length) {
+        *length = size;
+        return false;
+    }
+    *length += (size_t)written;
+    return true;
+}
+
+static void handle_describe(rtsp_server_t *server, rtsp_client_t *client, const char *uri, int cseq)
+{
+    if (!strstr(uri, server->config.rtsp_path)) {
+        send_simple_response(client, 404, "Not Found", cseq);
+        return;
+    }
+
+    struct sockaddr_in local_addr = {0};
+    socklen_t local_len = sizeof(local_addr);
+    getsockname(client->socket, (struct sockaddr *)&local_addr, &local_len);
+    const char *local_ip = inet_ntoa(local_addr.sin_addr);
+
+    char payload_types[16];
+    snprintf(payload_types, sizeof(payload_types), server->config.fec.enable ? "%d %d" : "%d", RTP_H264_PAYLOAD_TYPE,
+             RTP_FEC_PAYLOAD_TYPE);
+
+    char connection[32] = "0.0.0.0";
+    if (server->config.multicast.enable) {
+        snprintf(connection, sizeof(connection), "%s/%u", server->config.multicast.group_address,
+                 server->config.multicast.ttl);
+    }
+
+    char sdp[RTSP_SDP_BUFFER_SIZE];
+    size_t length = 0;
+    bool fits = sdp_printf(sdp, sizeof(sdp), &length,
+                           "v=0\r\n"
+                           "o=- %" PRIu32 " 1 IN IP4 %s\r\n"
+                           "s=%s\r\n"
+                           "c=IN IP4 %s\r\n"
+                           "t=0 0\r\n"
+                           "a=control:*\r\n"
+                           "m=video %u RTP/AVP %s\r\n"
+                           "a=rtpmap:%d H264/%d\r\n"
+                           "a=fmtp:%d packetization-mode=1",
+                           server->packetizer.ssrc, local_ip, server->config.hostname, connection,
+                           server->config.multicast.enable ? server->config.multicast.port : 0, payload_types,
+                           RTP_H264_PAYLOAD_TYPE, RTP_H264_CLOCK_RATE, RTP_H264_PAYLOAD_TYPE);
+    if (server->sps_length >= 4 && server->pps_length > 0) {
+        char sps_base64[RTSP_MAX_PARAMETER_SET_SIZE * 2];
+        char pps_base64[RTSP_MAX_PARAMETER_SET_SIZE * 2];
+        http_util_base64_encode(server->sps, server->sps_length, sps_base64, sizeof(sps_base64));
+        http_util_base64_encode(server->pps, server->pps_length, pps_base64, sizeof(pps_base64));
+        fits = fits && sdp_printf(sdp, sizeof(sdp), &length,
+                                  ";profile-level-id=%02X%02X%02X;sprop-parameter-sets=%s,%s", server->sps[1],
+                                  server->sps[2], server->sps[3], sps_base64, pps_base64);
+    }
+    fits = fits && sdp_printf(sdp, sizeof(sdp), &length, "\r\na=control:trackID=0\r\n");
+    if (server->config.retransmission.enable) {
+        fits = fits && sdp_printf(sdp, sizeof(sdp), &length, "a=rtcp-fb:%d nack\r\n", RTP_H264_PAYLOAD_TYPE);
+    }
+    if (server->config.fec.enable) {
+        fits = fits && sdp_printf(sdp, sizeof(sdp), &length, "a=rtpmap:%d ulpfec/%d\r\n", RTP_FEC_PAYLOAD_TYPE,
+                                  RTP_H264_CLOCK_RATE);
+    }
+    if (!fits) {
+        ESP_LOGE(TAG, "SDP does not fit in %d bytes", RTSP_SDP_BUFFER_SIZE);
+        send_simple_response(client, 500, "Internal Server Error", cseq);
+        return;
+    }
+
+    begin_response(client, 200, "OK", cseq);
+    client_printf(client,
+                  "Content-Base: rtsp://%s:%d%s/\r\n"
+                  "Content-Type: application/sdp\r\n"
+                  "Content-Length: %zu\r\n\r\n%s",
+                  local_ip, server->config.rtsp_port, server->config.rtsp_path, length, sdp);
+}
+
+static void handle_setup(rtsp_server_t *server, rtsp_client_t *client, const char *request, int cseq)
+{
+    char transport[128];
+    if (!http_util_find_header(request, "Transport", transport, sizeof(transport))) {
+        send_simple_response(client, 461, "Unsupported Transport", cseq);
+        return;
+    }
+
+    if (strstr(transport, "RTP/AVP/TCP")) {
+        unsigned rtp_channel = 0;
+        unsigned rtcp_channel = 1;
+        const char *interleaved = strstr(transport, "interleaved=");
+        if (interleaved) {
+            sscanf(interleaved, "interleaved=%u-%u", &rtp_channel, &rtcp_channel);
+        }
+        client->interleaved = true;
+        client->multicast = false;
+        client->rtp_channel = (uint8_t)rtp_channel;
+        client->rtcp_channel = (uint8_t)rtcp_channel;
+    } else if (strstr(transport, "multicast")) {
+        if (!server->config.multicast.enable) {
+            send_simple_response(client, 461, "Unsupported Transport", cseq);
+            return;
+        }
+        client->interleaved = false;
+        client->multicast = true;
+    } else {
+        unsigned rtp_port = 0;
+        unsigned rtcp_port = 0;
+        const char *client_port = strstr(transport, "client_port=");
+        if (!client_port || sscanf(client_port, "client_port=%u-%u", &rtp_port, &rtcp_port) < 1 || rtp_port == 0) {
+            send_simple_response(client, 461, "Unsupported Transport", cseq);
+            return;
+        }
+        client->interleaved = false;
+        client->multicast = false;
+        client->rtp_addr = client->peer_addr;
+        client->rtp_addr.sin_port = htons((uint16_t)rtp_port);
+        client->rtcp_addr = client->peer_addr;
+        client->rtcp_addr.sin_port = htons((uint16_t)(rtcp_port ? rtcp_port : rtp_port + 1));
+    }
+
+    if (!client->session_id) {
+        client->session_id = esp_random() | 1;
+    }
+    client->state = RTSP_CLIENT_READY;
+
+    begin_response(client, 200, "OK", cseq);
+    if (client->multicast) {
+        client_printf(client, "Transport: RTP/AVP;multicast;destination=%s;port=%u-%u;ttl=%u;ssrc=%08" PRIX32 "\r\n\r\n",
+                      server->config.multicast.group_address, server->config.multicast.port,
+                      server->config.multicast.port + 1, server->config.multicast.ttl, server->packetizer.ssrc);
+    } else if (client->interleaved) {
+        client_printf(client, "Transport: RTP/AVP/TCP;unicast;interleaved=%u-%u;ssrc=%08" PRIX32 "\r\n\r\n",
+                      client->rtp_channel, client->rtcp_channel, server->packetizer.ssrc);
+    } else {
+        client_printf(client, "Transport: RTP/AVP;unicast;client_port=%u-%u;server_port=%u-%u;ssrc=%08" PRIX32 "\r\n\r\n",
+                      ntohs(client->rtp_addr.sin_port), ntohs(client->rtcp_addr.sin_port), server->config.rtp_port,
+                      server->config.rtp_port + 1, server->packetizer.ssrc);
+    }
+}
+
+static void start_media(rtsp_server_t *server, rtsp_client_t *client)
+{
+    client_reset_media(client);
+    /* Start on the cached GOP so the first frame sent is decodable without waiting for or forcing an IDR. */
+    frame_cursor_seek_gop(&client->cursor, &server->ring);
+    client->state = RTSP_CLIENT_PLAYING;
+    client->play_start_us = esp_timer_get_time();
+    client->startup_pending = true;
+    client->stats.startup_us = 0;
+    client->stats.cached_frames_sent = 0;
+    memset(client->stats.paths, 0, sizeof(client->stats.paths));
+    rtp_pacer_init(&client->pacer, server->config.pacing.bitrate / 8, server->config.pacing.burst_bytes,
+                   client->play_start_us);
+    for (int i = 0; i < CONNECTIVITY_MAX_PATHS; ++i) {
+        client->paths[i].packet_index = 0;
+        client->paths[i].deadline_us = 0;
+        rtp_pacer_init(&client->paths[i].pacer, server->config.pacing.bitrate / 8, server->config.pacing.burst_bytes,
+                       client->play_start_us);
+    }
+}
+
+/* The multicast group is fed once by a pseudo-client while at least one multicast session is playing. */
+static void update_multicast_sender(rtsp_server_t *server)
+{
+    if (!server->config.multicast.enable) {
+        return;
+    }
+    bool subscribed = false;
+    for (uint32_t i = 0; i < server->max_clients; ++i) {
+        const rtsp_client_t *client = &server->clients[i];
+        subscribed |= client->multicast && client->state == RTSP_CLIENT_PLAYING && !client->closing;
+    }
+
+    rtsp_client_t *sender = &server->multicast_sender;
+    if (subscribed && sender->state != RTSP_CLIENT_PLAYING) {
+        ESP_LOGI(TAG, "Multicast output started on %s:%d", server->config.multicast.group_address,
+                 server->config.multicast.port);
+        start_media(server, sender);
+    } else if (!subscribed && sender->state == RTSP_CLIENT_PLAYING) {
+        ESP_LOGI(TAG, "Multicast output stopped");
+        client_reset_media(sender);
+        sender->state = RTSP_CLIENT_READY;
+    }
+}
+
+static void handle_play(rtsp_server_t *server, rtsp_client_t *client, int cseq)
+{
+    if (client->state != RTSP_CLIENT_READY && client->state != RTSP_CLIENT_PLAYING) {
+        send_simple_response(client, 455, "Method Not Valid in This State", cseq);
+        return;
+    }
+    if (client->state == RTSP_CLIENT_READY) {
+        start_media(server, client);
+        ESP_LOGI(TAG, "RTSP client playing: %s over %s", inet_ntoa(client->peer_addr.sin_addr),
+                 client->multicast ? "multicast" : client->interleaved ? "TCP" : "UDP");
+    }
+    begin_response(client, 200, "OK", cseq);
+    client_printf(client, "Range: npt=0.000-\r\n\r\n");
+}
+
+static void handle_request(rtsp_server_t *server, rtsp_client_t *client, char *request)
+{
+    char method[16] = {0};
+    char uri[128] = {0};
+    char value[32];
+    int cseq = 0;
+
+    if (sscanf(request, "%15s %127s", method, uri) != 2) {
+        send_simple_response(client, 400, "Bad Request", cseq);
+        return;
+    }
+    if (http_util_find_header(request, "CSeq", value, sizeof(value))) {
+        cseq = atoi(value);
+    }
+    if (client->session_id && http_util_find_header(request, "Session", value, sizeof(value)) &&
+        strtoul(value, NULL, 16) != client->session_id) {
+        send_simple_response(client, 454, "Session Not Found", cseq);
+        return;
+    }
+
+    if (strcmp(method, "OPTIONS") == 0) {
+        begin_response(client, 200, "OK", cseq);
+        client_printf(client, "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER, SET_PARAMETER\r\n\r\n");
+    } else if (strcmp(method, "DESCRIBE") == 0) {
+        handle_describe(server, client, uri, cseq);
+    } else if (strcmp(method, "SETUP") == 0) {
+        handle_setup(server, client, request, cseq);
+    } else if (strcmp(method, "PLAY") == 0) {
+        handle_play(server, client, cseq);
+    } else if (strcmp(method, "PAUSE") == 0) {
+        if (client->state == RTSP_CLIENT_PLAYING) {
+            client_reset_media(client);
+            client->state = RTSP_CLIENT_READY;
+        }
+        send_simple_response(client, 200, "OK", cseq);
+    } else if (strcmp(method, "TEARDOWN") == 0) {
+        send_simple_response(client, 200, "OK", cseq);
+        client_reset_media(client);
+        client->state = RTSP_CLIENT_INIT;
+        client->closing = true;
+    } else if (strcmp(method, "GET_PARAMETER") == 0 || strcmp(method, "SET_PARAMETER") == 0) {
+        send_simple_response(client, 200, "OK", cseq);
+    } else {
+        send_simple_response(client, 501, "Not Implemented", cseq);
+    }
+}
+
+typedef struct {
+    rtsp_server_t *server;
+    rtsp_client_t *client;
+} rtcp_report_context_t;
+
+static void on_report_block(void *user_ctx, uint32_t reporter_ssrc, const rtcp_report_block_t *block)
+{
+    rtcp_report_context_t *report = (rtcp_report_context_t *)user_ctx;
+    if (block->ssrc != report->server->packetizer.ssrc) {
+        return;
+    }
+    connectivity_client_stats_t *stats = &report->client->stats;
+    stats->fraction_lost = block->fraction_lost / 256.0f;
+    stats->cumulative_lost = block->cumulative_lost;
+    stats->jitter_us = (uint32_t)((uint64_t)block->jitter * 1000000 / RTP_H264_CLOCK_RATE);
+    uint32_t rtt_us = rtcp_round_trip_us(block, rtcp_ntp_now());
+    if (rtt_us) {
+        stats->rtt_us = rtt_us;
+    }
+    stats->last_report_us = esp_timer_get_time();
+}
+
+static bool send_udp_packet(rtsp_server_t *server, rtsp_client_t *client, const rtp_packet_t *packet);
+
+static void on_nack(void *user_ctx, uint32_t media_ssrc, uint16_t sequence)
+{
+    rtcp_report_context_t *report = (rtcp_report_context_t *)user_ctx;
+    rtsp_server_t *server = report->server;
+    rtsp_client_t *client = report->client;
+    if (media_ssrc != server->packetizer.ssrc || client->interleaved || !server->config.retransmission.enable) {
+        return;
+    }
+
+    ++client->stats.nack_requests;
+    const rtp_packet_t *packet = rtp_history_lookup(&server->history, sequence,
+                                                    (int64_t)server->config.retransmission.max_age_ms * 1000,
+                                                    esp_timer_get_time());
+    if (packet && send_udp_packet(server, client, packet)) {
+        metrics_counter_add(&s_rtp_retransmitted, 1);
+        ++client->stats.retransmitted;
+    } else {
+        ++client->stats.retransmit_misses;
+    }
+}
+
+static void handle_rtcp(rtsp_server_t *server, rtsp_client_t *client, const uint8_t *data, size_t length)
+{
+    rtcp_report_context_t report = {
+        .server = server,
+        .client = client,
+    };
+    rtcp_callbacks_t callbacks = {
+        .on_report_block = on_report_block,
+        .on_nack = on_nack,
+        .user_ctx = &report,
+    };
+    client->last_activity_us = esp_timer_get_time();
+    if (!rtcp_parse(data, length, &callbacks)) {
+        ESP_LOGD(TAG, "Malformed RTCP packet from %s", inet_ntoa(client->peer_addr.sin_addr));
+    }
+}
+
+static bool process_rx(rtsp_server_t *server, rtsp_client_t *client)
+{
+    while (client->rx_length > 0 && client->tx_length == 0 && !client->closing) {
+        size_t consumed = 0;
+        if (client->rx_buffer[0] == '$') {
+            if (client->rx_length < RTSP_INTERLEAVED_HEADER_SIZE) {
+                break;
+            }
+            const uint8_t *header = (const uint8_t *)client->rx_buffer;
+            size_t length = ((size_t)header[2] << 8) | header[3];
+            if (RTSP_INTERLEAVED_HEADER_SIZE + length > sizeof(client->rx_buffer)) {
+                ESP_LOGW(TAG, "Oversized interleaved packet");
+                return false;
+            }
+            if (client->rx_length < RTSP_INTERLEAVED_HEADER_SIZE + length) {
+                break;
+            }
+            if (client->interleaved && header[1] == client->rtcp_channel) {
+                handle_rtcp(server, client, header + RTSP_INTERLEAVED_HEADER_SIZE, length);
+            }
+            consumed = RTSP_INTERLEAVED_HEADER_SIZE + length;
+        } else {
+            client->rx_buffer[client->rx_length] = '\0';
+            char *end = strstr(client->rx_buffer, "\r\n\r\n");
+            if (!end) {
+                if (client->rx_length >= sizeof(client->rx_buffer) - 1) {
+                    ESP_LOGW(TAG, "Oversized RTSP request");
+                    return false;
+                }
+                break;
+            }
+            end[2] = '\0';
+            size_t header_length = (size_t)(end - client->rx_buffer) + 4;
+            char value[16];
+            size_t body_length = 0;
+            if (http_util_find_header(client->rx_buffer, "Content-Length", value, sizeof(value))) {
+                body_length = strtoul(value, NULL, 10);
+            }
+            if (header_length + body_length > sizeof(client->rx_buffer) - 1) {
+                ESP_LOGW(TAG, "Oversized RTSP request body");
+                return false;
+            }
+            if (client->rx_length < header_length + body_length) {
+                end[2] = '\r';
+                break;
+            }
+            handle_request(server, client, client->rx_buffer);
+            consumed = header_length + body_length;
+        }
+        client->rx_length -= consumed;
+        memmove(client->rx_buffer, client->rx_buffer + consumed, client->rx_length);
+    }
+    return true;
+}
+
+static void handle_client_read(rtsp_server_t *server, rtsp_client_t *client)
+{
+    size_t space = sizeof(client->rx_buffer) - 1 - client->rx_length;
+    if (space == 0) {
+        return;
+    }
+    int received = recv(client->socket, client->rx_buffer + client->rx_length, space, 0);
+    if (received == 0 || (received < 0 && !socket_util_would_block())) {
+        close_client(client);
+        return;
+    }
+    if (received < 0) {
+        return;
+    }
+    client->rx_length += (size_t)received;
+    client->last_activity_us = esp_timer_get_time();
+    if (!process_rx(server, client)) {
+        close_client(client);
+    }
+}
+
+static void accept_clients(rtsp_server_t *server)
+{
+    while (true) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int sock = accept(server->listen_socket, (struct sockaddr *)&client_addr, &client_len);
+        if (sock < 0) {
+            return;
+        }
+
+        rtsp_client_t *client = NULL;
+        uint32_t active = 0;
+        for (uint32_t i = 0; i < server->max_clients; ++i) {
+            if (server->clients[i].state == RTSP_CLIENT_FREE) {
+                client = client ? client : &server->clients[i];
+            } else {
+                ++active;
+            }
+        }
+        if (!client || active >= server->max_clients || socket_util_set_non_blocking(sock) < 0) {
+            ESP_LOGW(TAG, "Rejecting RTSP client %s: client limit reached", inet_ntoa(client_addr.sin_addr));
+            close(sock);
+            continue;
+        }
+
+        int enable = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        memset(client, 0, offsetof(rtsp_client_t, rx_buffer));
+        client->socket = sock;
+        client->state = RTSP_CLIENT_INIT;
+        client->peer_addr = client_addr;
+        client->last_activity_us = esp_timer_get_time();
+        ESP_LOGI(TAG, "RTSP client connected: %s", inet_ntoa(client_addr.sin_addr));
+    }
+}
+
+/* Returns false when the socket cannot take more data right now. */
+static bool send_interleaved_packet(rtsp_client_t *client, const rtp_packet_t *packet)
+{
+    size_t total = RTSP_INTERLEAVED_HEADER_SIZE + rtp_packet_size(packet);
+    if (client->packet_offset == 0) {
+        client->interleaved_header[0] = '$';
+        client->interleaved_header[1] = client->rtp_channel;
+        client->interleaved_header[2] = (uint8_t)(rtp_packet_size(packet) >> 8);
+        client->interleaved_header[3] = (uint8_t)(rtp_packet_size(packet) & 0xFF);
+    }
+
+    while (client->packet_offset < total) {
+        struct iovec iov[3] = {
+            { .iov_base = client->interleaved_header, .iov_len = RTSP_INTERLEAVED_HEADER_SIZE },
+            { .iov_base = (void *)packet->header, .iov_len = packet->header_length },
+            { .iov_base = (void *)packet->payload, .iov_len = packet->payload_length },
+        };
+        ssize_t sent = socket_util_send_iov_from(client->socket, iov, 3, client->packet_offset);
+        if (sent < 0) {
+            if (!socket_util_would_block()) {
+                client->closing = true;
+                client->tx_length = client->tx_offset = 0;
+            }
+            return false;
+        }
+        client->packet_offset += (size_t)sent;
+    }
+    client->packet_offset = 0;
+    return true;
+}
+
+static int send_rtp_to(int sock, const struct sockaddr_in *addr, const rtp_packet_t *packet)
+{
+    struct iovec iov[2] = {
+        { .iov_base = (void *)packet->header, .iov_len = packet->header_length },
+        { .iov_base = (void *)packet->payload, .iov_len = packet->payload_length },
+    };
+    struct msghdr msg = {
+        .msg_name = (void *)addr,
+        .msg_namelen = sizeof(*addr),
+        .msg_iov = iov,
+        .msg_iovlen = 2,
+    };
+    return sendmsg(sock, &msg, 0);
+}
+
+/* Sends over one redundant path; a full socket marks the path blocked until select() reports it writable. */
+static bool send_path_packet(rtsp_server_t *server, int path, const struct sockaddr_in *addr, const rtp_packet_t *packet)
+{
+    int sock = server->path_sockets[path];
+    if (sock < 0) {
+        return false;
+    }
+    if (send_rtp_to(sock, addr, packet) < 0) {
+        server->path_blocked[path] = socket_util_would_block();
+        return false;
+    }
+    return true;
+}
+
+static bool send_udp_packet(rtsp_server_t *server, rtsp_client_t *client, const rtp_packet_t *packet)
+{
+    if (server->config.redundancy.enable) {
+        bool sent = false;
+        for (int i = 0; i < CONNECTIVITY_MAX_PATHS; ++i) {
+            sent |= send_path_packet(server, i, &client->rtp_addr, packet);
+        }
+        return sent;
+    }
+    if (send_rtp_to(server->rtp_socket, &client->rtp_addr, packet) < 0) {
+        server->rtp_blocked = socket_util_would_block();
+        return false;
+    }
+    return true;
+}
+
+static bool pacing_enabled(const rtsp_server_t *server, const rtsp_client_t *client)
+{
+    return server->config.pacing.enable && !client->interleaved;
+}
+
+static size_t frame_wire_size(const stream_frame_t *frame)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < frame->packet_count; ++i) {
+        bytes += rtp_packet_size(&frame->packets[i]);
+    }
+    return bytes;
+}
+
+static void complete_packet(rtsp_client_t *client)
+{
+    const rtp_packet_t *packet = &client->current->packets[client->packet_index];
+    if (client->packet_index < client->current->media_packet_count) {
+        metrics_counter_add(&s_rtp_packets_sent, 1);
+        ++client->stats.packets_sent;
+        client->stats.octets_sent += rtp_packet_size(packet) - RTP_HEADER_SIZE;
+    }
+    ++client->packet_index;
+}
+
+static void complete_frame(rtsp_client_t *client)
+{
+    TRACE_EVENT(TRACE_EVENT_RTSP_FRAME_SENT, client->current->timestamp_us);
+    if (client->startup_pending) {
+        client->startup_pending = false;
+        client->stats.startup_us = (uint32_t)(esp_timer_get_time() - client->play_start_us);
+    }
+    if (frame_cursor_catching_up(&client->cursor)) {
+        ++client->stats.cached_frames_sent;
+    }
+}
+
+static size_t client_packet_limit(const rtsp_client_t *client)
+{
+    return client->interleaved ? client->current->media_packet_count : client->current->packet_count;
+}
+
+static bool next_frame(rtsp_server_t *server, rtsp_client_t *client)
+{
+    client->current = frame_cursor_next(&client->cursor, &server->ring);
+    client->packet_index = 0;
+    client->packet_offset = 0;
+    for (int i = 0; i < CONNECTIVITY_MAX_PATHS; ++i) {
+        client->paths[i].packet_index = 0;
+    }
+    if (!client->current) {
+        return false;
+    }
+    if (pacing_enabled(server, client)) {
+        uint32_t rate = rtp_pacer_frame_rate(server->config.pacing.bitrate, server->config.pacing.frame_rate,
+                                             server->config.pacing.spread_percent, frame_wire_size(client->current));
+        if (frame_cursor_catching_up(&client->cursor) && server->config.gop_cache.burst_percent > 100) {
+            rate = (uint32_t)((uint64_t)rate * server->config.gop_cache.burst_percent / 100);
+        }
+        int64_t now = esp_timer_get_time();
+        rtp_pacer_set_rate(&client->pacer, rate, now);
+        for (int i = 0; i < CONNECTIVITY_MAX_PATHS; ++i) {
+            rtp_pacer_set_rate(&client->paths[i].pacer, rate, now);
+        }
+    }
+    return true;
+}
+
+/* Returns false while the path waits for its pacer. A blocked path gives up the rest of the frame. */
+static bool pump_path(rtsp_server_t *server, rtsp_client_t *client, int path_index)
+{
+    rtsp_path_t *path = &client->paths[path_index];
+    connectivity_path_stats_t *stats = &client->stats.paths[path_index];
+    size_t limit = client->current->packet_count;
+    while (path->packet_index < limit) {
+        if (server->path_blocked[path_index]) {
+            stats->packets_lost += limit - path->packet_index;
+            path->packet_index = limit;
+            break;
+        }
+        const rtp_packet_t *packet = &client->current->packets[path->packet_index];
+        if (pacing_enabled(server, client)) {
+            int64_t now = esp_timer_get_time();
+            int64_t wait_us = rtp_pacer_reserve(&path->pacer, rtp_packet_size(packet), now);
+            if (wait_us > 0) {
+                path->deadline_us = now + wait_us;
+                return false;
+            }
+        }
+        if (send_path_packet(server, path_index, &client->rtp_addr, packet)) {
+            ++stats->packets_sent;
+        } else {
+            ++stats->packets_lost;
+        }
+        ++path->packet_index;
+    }
+    path->deadline_us = 0;
+    return true;
+}
+
+/*
+ * Redundant mode sends every packet, with its single sequence number, over each path so the receiver can
+ * merge the copies. The next frame starts once every path has finished or given up the current one.
+ */
+static void pump_redundant_media(rtsp_server_t *server, rtsp_client_t *client)
+{
+    while (client->state == RTSP_CLIENT_PLAYING && !client->closing) {
+        if (!client->current && !next_frame(server, client)) {
+            return;
+        }
+        bool done = true;
+        client->pacing_deadline_us = 0;
+        for (int i = 0; i < CONNECTIVITY_MAX_PATHS; ++i) {
+            if (pump_path(server, client, i)) {
+                continue;
+            }
+            done = false;
+            if (!client->pacing_deadline_us || client->paths[i].deadline_us < client->pacing_deadline_us) {
+                client->pacing_deadline_us = client->paths[i].deadline_us;
+            }
+        }
+        if (!done) {
+            return;
+        }
+        for (client->packet_index = 0; client->packet_index < client->current->packet_count;) {
+            complete_packet(client);
+        }
+        complete_frame(client);
+        client_reset_media(client);
+    }
+}
+
+static void pump_media(rtsp_server_t *server, rtsp_client_t *client)
+{
+    if (server->config.redundancy.enable && !client->interleaved) {
+        pump_redundant_media(server, client);
+        return;
+    }
+    while (client->state == RTSP_CLIENT_PLAYING && !client->closing) {
+        if (!client->current && !next_frame(server, client)) {
+            return;
+        }
+        while (client->packet_index < client_packet_limit(client)) {
+            const rtp_packet_t *packet = &client->current->packets[client->packet_index];
+            if (pacing_enabled(server, client)) {
+                int64_t now = esp_timer_get_time();
+                int64_t wait_us = rtp_pacer_reserve(&client->pacer, rtp_packet_size(packet), now);
+                if (wait_us > 0) {
+                    client->pacing_deadline_us = now + wait_us;
+                    return;
+                }
+            }
+            bool sent = client->interleaved ? send_interleaved_packet(client, packet)
+                                            : send_udp_packet(server, client, packet);
+            if (!sent) {
+                /* Unless part of it went out and service_client() finishes it, the packet is reserved again. */
+                if (pacing_enabled(server, client) && client->packet_offset == 0) {
+                    rtp_pacer_refund(&client->pacer, rtp_packet_size(packet));
+                }
+                if (client->interleaved || server->rtp_blocked) {
+                    client->blocked = client->interleaved;
+                    return;
+                }
+                /* A hard error such as an unreachable network drops the packet; the receiver may NACK it. */
+                ++client->stats.send_errors;
+                ++client->packet_index;
+                continue;
+            }
+            complete_packet(client);
+        }
+        complete_frame(client);
+        client_reset_media(client);
+    }
+}
+
+static bool flush_control(rtsp_client_t *client)
+{
+    while (client->tx_offset < client->tx_length) {
+        int sent = send(client->socket, client->tx_buffer + client->tx_offset, client->tx_length - client->tx_offset, 0);
+        if (sent < 0) {
+            if (socket_util_would_block()) {
+                client->blocked = true;
+            } else {
+                client->closing = true;
+                client->tx_length = client->tx_offset = 0;
+            }
+            return false;
+        }
+        client->tx_offset += (size_t)sent;
+    }
+    client->tx_length = 0;
+    client->tx_offset = 0;
+    return true;
+}
+
+static void service_client(rtsp_server_t *server, rtsp_client_t *client)
+{
+    client->pacing_deadline_us = 0;
+    if (client->blocked) {
+        return;
+    }
+    if (client->interleaved && client->current && client->packet_offset > 0) {
+        const rtp_packet_t *packet = &client->current->packets[client->packet_index];
+        if (!send_interleaved_packet(client, packet)) {
+            client->blocked = !client->closing;
+            if (client->closing) {
+                close_client(client);
+            }
+            return;
+        }
+        complete_packet(client);
+    }
+
+    while (flush_control(client) && client->rx_length > 0 && !client->closing) {
+        size_t pending = client->rx_length;
+        if (!process_rx(server, client)) {
+            close_client(client);
+            return;
+        }
+        if (client->tx_length == 0 && client->rx_length == pending) {
+            break;
+        }
+    }
+    if (client->closing) {
+        if (client->tx_length == 0) {
+            close_client(client);
+        }
+        return;
+    }
+    /* Media written now would land inside the unfinished control message on the same TCP stream. */
+    if (client->blocked || client->tx_length > 0) {
+        return;
+    }
+    if (!client->multicast && (client->interleaved || !server->rtp_blocked)) {
+        pump_media(server, client);
+    }
+    if (client->closing && client->tx_length == 0) {
+        close_client(client);
+    }
+}
+
+static void expire_sessions(rtsp_server_t *server)
+{
+    int64_t now = esp_timer_get_time();
+    /* Receiver reports sent towards the failed link were lost; restart the timeout instead of dropping viewers. */
+    bool link_changed = atomic_exchange(&server->link_changed, false);
+    for (uint32_t i = 0; i < server->max_clients; ++i) {
+        rtsp_client_t *client = &server->clients[i];
+        if (link_changed && client->state != RTSP_CLIENT_FREE && !client->interleaved) {
+            client->last_activity_us = now;
+        }
+        if (client->state != RTSP_CLIENT_FREE && !client->interleaved &&
+            now - client->last_activity_us > (int64_t)RTSP_SESSION_TIMEOUT_S * 1000000) {
+            ESP_LOGW(TAG, "RTSP session timed out");
+            close_client(client);
+        }
+    }
+}
+
+static void receive_rtcp(rtsp_server_t *server)
+{
+    uint8_t buffer[RTSP_RTCP_BUFFER_SIZE];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    int received;
+    while ((received = recvfrom(server->rtcp_socket, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &from_len)) >= 0) {
+        for (uint32_t i = 0; i < server->max_clients; ++i) {
+            rtsp_client_t *client = &server->clients[i];
+            if (client->state != RTSP_CLIENT_FREE && !client->interleaved &&
+                client->rtcp_addr.sin_addr.s_addr == from.sin_addr.s_addr && client->rtcp_addr.sin_port == from.sin_port) {
+                handle_rtcp(server, client, buffer, (size_t)received);
+            }
+        }
+        from_len = sizeof(from);
+    }
+}
+
+static void send_sender_report(rtsp_server_t *server, rtsp_client_t *client, int64_t now_us)
+{
+    if (client->state != RTSP_CLIENT_PLAYING || client->multicast || client->stats.packets_sent == 0 ||
+        now_us - client->last_sr_us < RTSP_RTCP_INTERVAL_MS * 1000) {
+        return;
+    }
+    client->last_sr_us = now_us;
+
+    uint8_t report[RTCP_MAX_PACKET_SIZE + RTSP_INTERLEAVED_HEADER_SIZE];
+    size_t length = rtcp_build_sender_report(report + RTSP_INTERLEAVED_HEADER_SIZE, RTCP_MAX_PACKET_SIZE,
+                                             server->packetizer.ssrc, rtcp_ntp_now(),
+                                             rtp_packetizer_timestamp(&server->packetizer, now_us),
+                                             client->stats.packets_sent, client->stats.octets_sent,
+                                             server->config.hostname);
+    if (length == 0) {
+        return;
+    }
+    if (client->interleaved) {
+        report[0] = '$';
+        report[1] = client->rtcp_channel;
+        report[2] = (uint8_t)(length >> 8);
+        report[3] = (uint8_t)(length & 0xFF);
+        client_append(client, report, length + RTSP_INTERLEAVED_HEADER_SIZE);
+    } else {
+        sendto(server->rtcp_socket, report + RTSP_INTERLEAVED_HEADER_SIZE, length, 0,
+               (struct sockaddr *)&client->rtcp_addr, sizeof(client->rtcp_addr));
+    }
+}
+
+static void send_sender_reports(rtsp_server_t *server, int64_t now_us)
+{
+    for (uint32_t i = 0; i < server->max_clients; ++i) {
+        send_sender_report(server, &server->clients[i], now_us);
+    }
+    send_sender_report(server, &server->multicast_sender, now_us);
+}
+
+static void publish_stats(rtsp_server_t *server)
+{
+    int32_t playing = 0;
+    portENTER_CRITICAL(&server->stats_lock);
+    size_t count = 0;
+    for (uint32_t i = 0; i < server->max_clients; ++i) {
+        rtsp_client_t *client = &server->clients[i];
+        if (client->state == RTSP_CLIENT_FREE) {
+            continue;
+        }
+        connectivity_client_stats_t *stats = &server->published_stats[count++];
+        *stats = client->stats;
+        stats->frames_dropped = client->cursor.frames_dropped;
+        stats->session_id = client->session_id;
+        stats->address = client->peer_addr.sin_addr.s_addr;
+        stats->interleaved = client->interleaved;
+        stats->playing = client->state == RTSP_CLIENT_PLAYING;
+        playing += stats->playing;
+    }
+    server->published_count = count;
+    portEXIT_CRITICAL(&server->stats_lock);
+    metrics_gauge_set(&s_rtsp_clients, playing);
+}
+
+/*
+ * Frames the best-placed viewer has yet to finish, plus frames still queued for the server. A viewer bursting
+ * from the GOP cache counts as keeping up; without playing viewers there is no backlog.
+ */
+static void publish_backlog(rtsp_server_t *server)
+{
+    uint32_t backlog = UINT32_MAX;
+    for (uint32_t i = 0; i <= server->max_clients; ++i) {
+        const rtsp_client_t *client = i < server->max_clients ? &server->clients[i] : &server->multicast_sender;
+        if (client->state != RTSP_CLIENT_PLAYING || client->multicast || client->closing) {
+            continue;
+        }
+        uint32_t client_backlog = 0;
+        if (!frame_cursor_catching_up(&client->cursor)) {
+            client_backlog = frame_cursor_backlog(&client->cursor, &server->ring) + (client->current ? 1 : 0);
+        }
+        if (client_backlog < backlog) {
+            backlog = client_backlog;
+        }
+    }
+    if (backlog == UINT32_MAX) {
+        backlog = 0;
+    }
+    backlog += (uint32_t)uxQueueMessagesWaiting(server->frame_queue);
+    atomic_store(&server->backlog_frames, backlog);
+    metrics_gauge_set(&s_rtsp_backlog, (int32_t)backlog);
+}
+
+static int64_t next_wakeup_us(const rtsp_server_t *server, int64_t last_housekeeping_us)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t deadline = last_housekeeping_us + RTSP_HOUSEKEEPING_INTERVAL_MS * 1000;
+    for (uint32_t i = 0; i <= server->max_clients; ++i) {
+        const rtsp_client_t *client = i < server->max_clients ? &server->clients[i] : &server->multicast_sender;
+        if (client->state == RTSP_CLIENT_PLAYING && client->pacing_deadline_us && client->pacing_deadline_us < deadline) {
+            deadline = client->pacing_deadline_us;
+        }
+    }
+    if (server->config.mpegts.enable && server->ts_output.deadline_us && server->ts_output.deadline_us < deadline) {
+        deadline = server->ts_output.deadline_us;
+    }
+    return deadline > now ? deadline - now : 0;
+}
+
+/* Retried from housekeeping because an interface may not be registered with lwIP yet when the server starts. */
+static void open_redundant_paths(rtsp_server_t *server)
+{
+    static const char *const path_if_keys[CONNECTIVITY_MAX_PATHS] = {
+        [CONNECTIVITY_TRANSPORT_ETHERNET] = "ETH_DEF",
+        [CONNECTIVITY_TRANSPORT_WIFI] = "WIFI_STA_DEF",
+    };
+    if (!server->config.redundancy.enable) {
+        return;
+    }
+    for (int i = 0; i < CONNECTIVITY_MAX_PATHS; ++i) {
+        if (server->path_sockets[i] >= 0) {
+            continue;
+        }
+        server->path_sockets[i] = socket_util_create_shared_udp(path_if_keys[i], server->config.rtp_port);
+        if (server->path_sockets[i] < 0) {
+            continue;
+        }
+        if (server->config.multicast.enable) {
+            uint8_t ttl = server->config.multicast.ttl;
+            setsockopt(server->path_sockets[i], IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        }
+        ESP_LOGI(TAG, "Redundant RTP path open on %s", path_if_keys[i]);
+    }
+}
+
+static void close_server_sockets(rtsp_server_t *server)
+{
+    int *sockets[] = { &server->listen_socket, &server->rtp_socket, &server->rtcp_socket, &server->wake_socket,
+                       &server->wake_tx_socket, &server->path_sockets[0], &server->path_sockets[1] };
+    for (size_t i = 0; i < sizeof(sockets) / sizeof(sockets[0]); ++i) {
+        if (*sockets[i] >= 0) {
+            close(*sockets[i]);
+            *sockets[i] = -1;
+        }
+    }
+}
+
+static void rtsp_server_task(void *arg)
+{
+    rtsp_server_t *server = (rtsp_server_t *)arg;
+    int64_t last_housekeeping_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "RTSP server listening on rtsp://%s:%d%s", server->config.hostname, server->config.rtsp_port,
+             server->config.rtsp_path);
+
+    while (!server->stop_requested) {
+        fd_set read_set;
+        fd_set write_set;
+        FD_ZERO(&read_set);
+        FD_ZERO(&write_set);
+        int max_fd = -1;
+
+        socket_util_watch(server->listen_socket, &read_set, &max_fd);
+        socket_util_watch(server->wake_socket, &read_set, &max_fd);
+        socket_util_watch(server->rtp_socket, &read_set, &max_fd);
+        socket_util_watch(server->rtcp_socket, &read_set, &max_fd);
+        if (server->rtp_blocked) {
+            socket_util_watch(server->rtp_socket, &write_set, &max_fd);
+        }
+        for (int i = 0; i < CONNECTIVITY_MAX_PATHS; ++i) {
+            if (server->path_sockets[i] >= 0) {
+                socket_util_watch(server->path_sockets[i], &read_set, &max_fd);
+                if (server->path_blocked[i]) {
+                    socket_util_watch(server->path_sockets[i], &write_set, &max_fd);
+                }
+            }
+        }
+        if (server->config.mpegts.enable && server->ts_output.blocked) {
+            socket_util_watch(server->ts_output.socket, &write_set, &max_fd);
+        }
+        for (uint32_t i = 0; i < server->max_clients; ++i) {
+            rtsp_client_t *client = &server->clients[i];
+            if (client->state == RTSP_CLIENT_FREE) {
+                continue;
+            }
+            if (client->rx_length < sizeof(client->rx_buffer) - 1) {
+                socket_util_watch(client->socket, &read_set, &max_fd);
+            }
+            if (client->blocked) {
+                socket_util_watch(client->socket, &write_set, &max_fd);
+            }
+        }
+
+        int64_t wait_us = next_wakeup_us(server, last_housekeeping_us);
+        struct timeval timeout = {
+            .tv_sec = wait_us / 1000000,
+            .tv_usec = wait_us % 1000000,
+        };
+        int ready = select(max_fd + 1, &read_set, &write_set, NULL, &timeout);
+        if (ready < 0) {
+            if (errno != EINTR) {
+                ESP_LOGE(TAG, "select failed: errno %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+            continue;
+        }
+        TRACE_EVENT(TRACE_EVENT_RTSP_SERVICE_BEGIN, ready);
+
+        if (ready > 0) {
+            if (FD_ISSET(server->wake_socket, &read_set)) {
+                socket_util_drain(server->wake_socket);
+            }
+            if (FD_ISSET(server->rtcp_socket, &read_set)) {
+                receive_rtcp(server);
+            }
+            if (FD_ISSET(server->rtp_socket, &read_set)) {
+                socket_util_drain(server->rtp_socket);
+            }
+            if (FD_ISSET(server->rtp_socket, &write_set)) {
+                server->rtp_blocked = false;
+            }
+            for (int i = 0; i < CONNECTIVITY_MAX_PATHS; ++i) {
+                if (server->path_sockets[i] < 0) {
+                    continue;
+                }
+                if (FD_ISSET(server->path_sockets[i], &read_set)) {
+                    socket_util_drain(server->path_sockets[i]);
+                }
+                if (FD_ISSET(server->path_sockets[i], &write_set)) {
+                    server->path_blocked[i] = false;
+                }
+            }
+            if (server->config.mpegts.enable && FD_ISSET(server->ts_output.socket, &write_set)) {
+                server->ts_output.blocked = false;
+            }
+            if (FD_ISSET(server->listen_socket, &read_set)) {
+                accept_clients(server);
+            }
+            for (uint32_t i = 0; i < server->max_clients; ++i) {
+                rtsp_client_t *client = &server->clients[i];
+                if (client->state == RTSP_CLIENT_FREE) {
+                    continue;
+                }
+                if (FD_ISSET(client->socket, &write_set)) {
+                    client->blocked = false;
+                }
+                if (FD_ISSET(client->socket, &read_set)) {
+                    handle_client_read(server, client);
+                }
+            }
+        }
+
+        drain_frame_queue(server);
+        for (uint32_t i = 0; i < server->max_clients; ++i) {
+            if (server->clients[i].state != RTSP_CLIENT_FREE) {
+                service_client(server, &server->clients[i]);
+            }
+        }
+        update_multicast_sender(server);
+        if (server->multicast_sender.state == RTSP_CLIENT_PLAYING && !server->rtp_blocked) {
+            server->multicast_sender.pacing_deadline_us = 0;
+            pump_media(server, &server->multicast_sender);
+        }
+        if (server->config.mpegts.enable) {
+            ts_output_pump(&server->ts_output, &server->ring, &server->config);
+        }
+        publish_backlog(server);
+        TRACE_EVENT(TRACE_EVENT_RTSP_SERVICE_END, atomic_load(&server->backlog_frames));
+
+        int64_t now = esp_timer_get_time();
+        if (now - last_housekeeping_us >= RTSP_HOUSEKEEPING_INTERVAL_MS * 1000) {
+            last_housekeeping_us = now;
+            expire_sessions(server);
+            open_redundant_paths(server);
+            send_sender_reports(server, now);
+            publish_stats(server);
+        }
+    }
+
+    for (uint32_t i = 0; i < server->max_clients; ++i) {
+        close_client(&server->clients[i]);
+    }
+    client_reset_media(&server->multicast_sender);
+    frame_ring_clear(&server->ring);
+
+    TaskHandle_t waiter = server->stop_waiter;
+    server->task = NULL;
+    xTaskNotifyGive(waiter);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t open_server_sockets(rtsp_server_t *server)
+{
+    server->listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (server->listen_socket < 0) {
+        ESP_LOGE(TAG, "Failed to create RTSP socket");
+        return ESP_FAIL;
+    }
+
+    int enable = 1;
+    setsockopt(server->listen_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    struct sockaddr_in server_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(server->config.rtsp_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(server->listen_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 ||
+        listen(server->listen_socket, (int)server->max_clients) < 0 || socket_util_set_non_blocking(server->listen_socket) < 0) {
+        ESP_LOGE(TAG, "Failed to bind RTSP socket");
+        return ESP_FAIL;
+    }
+
+    if (server->config.redundancy.enable) {
+        /* The path sockets share the RTP port so both copies carry the same source port as the SDP announces. */
+        server->rtp_socket = socket_util_create_shared_udp(NULL, server->config.rtp_port);
+    } else {
+        server->rtp_socket = socket_util_create_udp(INADDR_ANY, server->config.rtp_port);
+    }
+    server->rtcp_socket = socket_util_create_udp(INADDR_ANY, server->config.rtp_port + 1);
+    if (server->rtp_socket < 0 || server->rtcp_socket < 0) {
+        ESP_LOGE(TAG, "Failed to bind RTP/RTCP sockets on ports %d-%d", server->config.rtp_port, server->config.rtp_port + 1);
+        return ESP_FAIL;
+    }
+
+    if (server->config.multicast.enable) {
+        uint8_t ttl = server->config.multicast.ttl;
+        setsockopt(server->rtp_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        setsockopt(server->rtcp_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    }
+    open_redundant_paths(server);
+
+    if (socket_util_create_wake_pair(&server->wake_socket, &server->wake_tx_socket) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create wake-up socket");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static void destroy_server(rtsp_server_t *server)
+{
+    close_server_sockets(server);
+    if (server->config.mpegts.enable) {
+        ts_output_deinit(&server->ts_output);
+    }
+    rtp_history_deinit(&server->history);
+    if (server->frame_queue) {
+        stream_frame_t *frame = NULL;
+        while (xQueueReceive(server->frame_queue, &frame, 0) == pdTRUE) {
+            stream_frame_unref(frame);
+        }
+        vQueueDelete(server->frame_queue);
+    }
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, server->clients);
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, server->published_stats);
+    /* Last, as frames still held anywhere above go back to these pools. */
+    frame_pool_deinit(&server->frame_pool);
+    frame_pool_deinit(&server->descriptor_pool);
+    frame_pool_deinit(&server->fec_pool);
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, server);
+}
+
+static esp_err_t init_multicast_sender(rtsp_server_t *server)
+{
+    rtsp_client_t *sender = &server->multicast_sender;
+    sender->socket = -1;
+    if (!server->config.multicast.enable) {
+        return ESP_OK;
+    }
+
+    struct in_addr group;
+    const char *group_address = server->config.multicast.group_address;
+    if (!group_address || inet_aton(group_address, &group) == 0 || !IN_MULTICAST(ntohl(group.s_addr))) {
+        ESP_LOGE(TAG, "Invalid multicast group %s", group_address ? group_address : "(null)");
+        return ESP_ERR_INVALID_ARG;
+    }
+    sender->state = RTSP_CLIENT_READY;
+    sender->rtp_addr.sin_family = AF_INET;
+    sender->rtp_addr.sin_addr = group;
+    sender->rtp_addr.sin_port = htons(server->config.multicast.port);
+    sender->rtcp_addr = sender->rtp_addr;
+    sender->rtcp_addr.sin_port = htons(server->config.multicast.port + 1);
+    return ESP_OK;
+}
+
+static size_t history_slots(const transport_config_t *config)
+{
+    return config->retransmission.enable ? rtp_history_slots(config->retransmission.history_packets) : 0;
+}
+
+typedef struct {
+    size_t frames;
+    size_t descriptors;
+    size_t fec;
+} rtsp_pool_sizes_t;
+
+/*
+ * Pools for every frame the servers may hold at once, at the average frame of the paced rate: both queues, the
+ * ring or GOP cache or retransmission history, whichever reaches furthest back, and the headroom frames.
+ */
+static rtsp_pool_sizes_t plan_pools(const transport_config_t *config)
+{
+    uint32_t frame_rate = config->pacing.frame_rate ? config->pacing.frame_rate : 30;
+    size_t frame_size = config->pacing.bitrate / 8 / frame_rate;
+    const size_t max_payload = RTP_DEFAULT_MTU - RTP_MAX_HEADER_SIZE;
+    size_t packets = frame_size / max_payload + 1;
+    size_t group_size = config->fec.enable ? config->fec.delta_group_size : 0;
+    size_t fec_packets = rtp_fec_group_count(packets, group_size);
+
+    size_t history_frames = (history_slots(config) + packets - 1) / packets;
+    size_t ring_frames = config->gop_cache.enable ? FRAME_RING_GOP_LENGTH : FRAME_RING_LENGTH;
+    size_t frames = RTSP_FRAME_QUEUE_LENGTH + http_server_queued_frames(config) +
+                    (history_frames > ring_frames ? history_frames : ring_frames) + RTSP_POOL_HEADROOM_FRAMES;
+    return (rtsp_pool_sizes_t) {
+        .frames = frame_pool_size_for(RTSP_FRAME_BLOCK_SIZE, frames, sizeof(stream_frame_t) + frame_size),
+        .descriptors = frame_pool_size_for(RTSP_DESCRIPTOR_BLOCK_SIZE, frames,
+                                           (packets + fec_packets) * sizeof(rtp_packet_t)),
+        .fec = fec_packets ? frame_pool_size_for(RTSP_FEC_BLOCK_SIZE, frames, fec_packets * RTP_FEC_PACKET_BUFFER_SIZE)
+                           : 0,
+    };
+}
+
+static uint32_t requested_max_clients(const transport_config_t *config)
+{
+    return config->max_clients == 0 || config->max_clients > RTSP_SERVER_MAX_CLIENTS ? RTSP_SERVER_MAX_CLIENTS
+                                                                                     : config->max_clients;
+}
+
+/* Each RTSP client holds one TCP socket; the clients share what the servers' fixed sockets leave of lwIP's table. */
+static uint32_t plan_max_clients(const transport_config_t *config)
+{
+    int budget = CONFIG_LWIP_MAX_SOCKETS - RTSP_SERVER_FIXED_SOCKETS - (int)http_server_socket_count(config);
+    uint32_t requested = requested_max_clients(config);
+    if (budget < 1) {
+        budget = 1;
+    }
+    return requested > (uint32_t)budget ? (uint32_t)budget : requested;
+}
+
+esp_err_t rtsp_server_start(const transport_config_t *config, rtsp_server_t **out_server)
+{
+    if (!config || !out_server) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    metrics_register(&s_rtsp_clients);
+    metrics_register(&s_rtsp_backlog);
+    metrics_register(&s_rtp_packets_sent);
+    metrics_register(&s_rtp_retransmitted);
+
+    rtsp_server_t *server = memory_account_calloc(MEMORY_ACCOUNT_CONNECTIVITY, 1, sizeof(*server),
+                                                  MEMORY_PLAN_HOT_CAPS);
+    if (!server) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    server->config = *config;
+    server->ring.cache_gop = config->gop_cache.enable;
+    portMUX_INITIALIZE(&server->stats_lock);
+    server->max_clients = plan_max_clients(config);
+    if (server->max_clients < requested_max_clients(config)) {
+        ESP_LOGW(TAG, "Only %" PRIu32 " of %" PRIu32 " RTSP clients fit in CONFIG_LWIP_MAX_SOCKETS=%d",
+                 server->max_clients, requested_max_clients(config), CONFIG_LWIP_MAX_SOCKETS);
+    }
+    server->listen_socket = server->rtp_socket = server->rtcp_socket = -1;
+    server->path_sockets[0] = server->path_sockets[1] = -1;
+    server->wake_socket = server->wake_tx_socket = -1;
+    rtp_packetizer_init(&server->packetizer, RTP_DEFAULT_MTU);
+    rtp_fec_init(&server->fec);
+
+    server->clients = memory_account_calloc(MEMORY_ACCOUNT_CONNECTIVITY, server->max_clients, sizeof(rtsp_client_t),
+                                            MEMORY_PLAN_HOT_CAPS);
+    server->published_stats = memory_account_calloc(MEMORY_ACCOUNT_CONNECTIVITY, server->max_clients,
+                                                    sizeof(connectivity_client_stats_t), MEMORY_PLAN_HOT_CAPS);
+    server->frame_queue = xQueueCreate(RTSP_FRAME_QUEUE_LENGTH, sizeof(stream_frame_t *));
+    rtsp_pool_sizes_t pools = plan_pools(config);
+    if (!server->clients || !server->published_stats || !server->frame_queue ||
+        frame_pool_init(&server->frame_pool, pools.frames, RTSP_FRAME_BLOCK_SIZE, MEMORY_PLAN_BULK_CAPS) != ESP_OK ||
+        frame_pool_init(&server->descriptor_pool, pools.descriptors, RTSP_DESCRIPTOR_BLOCK_SIZE,
+                        MEMORY_PLAN_HOT_CAPS) != ESP_OK ||
+        frame_pool_init(&server->fec_pool, pools.fec, RTSP_FEC_BLOCK_SIZE, MEMORY_PLAN_BULK_CAPS) != ESP_OK ||
+        (config->retransmission.enable && rtp_history_init(&server->history, config->retransmission.history_packets) != ESP_OK)) {
+        destroy_server(server);
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint32_t i = 0; i < server->max_clients; ++i) {
+        server->clients[i].socket = -1;
+    }
+
+    server->ts_output.socket = -1;
+    esp_err_t err = init_multicast_sender(server);
+    if (err == ESP_OK) {
+        err = open_server_sockets(server);
+    }
+    if (err == ESP_OK && config->mpegts.enable) {
+        err = ts_output_init(&server->ts_output, config, &server->ring);
+    }
+    if (err != ESP_OK) {
+        destroy_server(server);
+        return err;
+    }
+
+    BaseType_t task_created = xTaskCreatePinnedToCore(rtsp_server_task, "rtsp_server", 6 * 1024, server,
+                                                      config->server_task.priority, &server->task,
+                                                      config->server_task.core_id);
+    if (task_created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create RTSP server task");
+        destroy_server(server);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *out_server = server;
+    return ESP_OK;
+}
+
+esp_err_t rtsp_server_plan_memory(const transport_config_t *config, memory_plan_t *plan)
+{
+    rtsp_pool_sizes_t pools = plan_pools(config);
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "RTSP server", MEMORY_PLAN_INTERNAL, sizeof(rtsp_server_t), 1), TAG,
+                        "Failed to plan server");
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "RTSP clients", MEMORY_PLAN_INTERNAL,
+                                        sizeof(rtsp_client_t) + sizeof(connectivity_client_stats_t),
+                                        plan_max_clients(config)), TAG, "Failed to plan clients");
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "RTP history", MEMORY_PLAN_INTERNAL, sizeof(rtp_history_entry_t),
+                                        history_slots(config)), TAG, "Failed to plan history");
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "stream frame pool", MEMORY_PLAN_SPIRAM, pools.frames, 1), TAG,
+                        "Failed to plan frames");
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "RTP descriptor pool", MEMORY_PLAN_INTERNAL, pools.descriptors, 1),
+                        TAG, "Failed to plan descriptors");
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "FEC packet pool", MEMORY_PLAN_SPIRAM, pools.fec, 1), TAG,
+                        "Failed to plan FEC packets");
+    if (config->mpegts.enable) {
+        ESP_RETURN_ON_ERROR(memory_plan_add(plan, "MPEG-TS datagrams", MEMORY_PLAN_INTERNAL, TS_DATAGRAM_SIZE,
+                                            TS_OUTPUT_POOL_SIZE), TAG, "Failed to plan MPEG-TS pool");
+    }
+    return ESP_OK;
+}
+
+void rtsp_server_stop(rtsp_server_t *server)
+{
+    if (!server) {
+        return;
+    }
+
+    if (server->task) {
+        server->stop_waiter = xTaskGetCurrentTaskHandle();
+        server->stop_requested = true;
+        wake_server(server);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    destroy_server(server);
+}
+
+frame_pool_t *rtsp_server_get_frame_pool(rtsp_server_t *server)
+{
+    return server ? &server->frame_pool : NULL;
+}
+
+esp_err_t rtsp_server_submit_frame(rtsp_server_t *server, stream_frame_t *frame, TickType_t ticks_to_wait)
+{
+    if (!server || !frame) {
+        stream_frame_unref(frame);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xQueueSend(server->frame_queue, &frame, ticks_to_wait) != pdTRUE) {
+        atomic_store(&server->frames_lost, true);
+        stream_frame_unref(frame);
+        return ESP_ERR_TIMEOUT;
+    }
+    wake_server(server);
+    return ESP_OK;
+}
+
+void rtsp_server_mark_frame_lost(rtsp_server_t *server)
+{
+    if (server) {
+        atomic_store(&server->frames_lost, true);
+    }
+}
+
+void rtsp_server_notify_link_change(rtsp_server_t *server)
+{
+    if (server) {
+        atomic_store(&server->link_changed, true);
+    }
+}
+
+uint32_t rtsp_server_get_backlog(rtsp_server_t *server)
+{
+    return server ? atomic_load(&server->backlog_frames) : 0;
+}
+
+size_t rtsp_server_get_client_stats(rtsp_server_t *server, connectivity_client_stats_t *stats, size_t max_stats)
+{
+    if (!server) {
+        return 0;
+    }
+    portENTER_CRITICAL(&server->stats_lock);
+    size_t count = server->published_count < max_stats ? server->published_count : max_stats;
+    memcpy(stats, server->published_stats, count * sizeof(*stats));
+    portEXIT_CRITICAL(&server->stats_lock);
+    return count;
+}
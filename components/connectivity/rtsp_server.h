@@ -0,0 +1,39 @@
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#include "connectivity.h"
+#include "stream_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct rtsp_server_t rtsp_server_t;
+
+esp_err_t rtsp_server_start(const transport_config_t *config, rtsp_server_t **out_server);
+void rtsp_server_stop(rtsp_server_t *server);
+
+/* Server state plus the pools of frames, descriptors and FEC packets held for viewers, sized from the paced rate. */
+esp_err_t rtsp_server_plan_memory(const transport_config_t *config, memory_plan_t *plan);
+
+/* The pool stream_frame_create() takes frames from; the HTTP server shares the same frames. */
+frame_pool_t *rtsp_server_get_frame_pool(rtsp_server_t *server);
+
+/* Takes ownership of the caller's frame reference, also when the queue is full. */
+esp_err_t rtsp_server_submit_frame(rtsp_server_t *server, stream_frame_t *frame, TickType_t ticks_to_wait);
+
+/* A frame never reached the server; viewers resync on the next keyframe. */
+void rtsp_server_mark_frame_lost(rtsp_server_t *server);
+
+/* Called when egress failed over to the other link; UDP sessions get a fresh timeout rather than expiring. */
+void rtsp_server_notify_link_change(rtsp_server_t *server);
+
+uint32_t rtsp_server_get_backlog(rtsp_server_t *server);
+
+size_t rtsp_server_get_client_stats(rtsp_server_t *server, connectivity_client_stats_t *stats, size_t max_stats);
+
+#ifdef __cplusplus
+}
+#endif
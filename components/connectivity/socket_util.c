@@ -0,0 +1,131 @@
+#include "socket_util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "esp_netif.h"
+
+#define SOCKET_UTIL_DRAIN_BUFFER_SIZE 256
+
+int socket_util_set_non_blocking(int sock)
+{
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+}
+
+int socket_util_create_udp(uint32_t address, uint16_t port)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return -1;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(address),
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || socket_util_set_non_blocking(sock) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int socket_util_create_shared_udp(const char *if_key, uint16_t port)
+{
+    struct ifreq ifr = {0};
+    if (if_key) {
+        esp_netif_t *netif = esp_netif_get_handle_from_ifkey(if_key);
+        if (!netif || esp_netif_get_netif_impl_name(netif, ifr.ifr_name) != ESP_OK) {
+            return -1;
+        }
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return -1;
+    }
+    int enable = 1;
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0 ||
+        (if_key && setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, &ifr, sizeof(ifr)) < 0) ||
+        bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || socket_util_set_non_blocking(sock) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+bool socket_util_would_block(void)
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+void socket_util_drain(int sock)
+{
+    uint8_t buffer[SOCKET_UTIL_DRAIN_BUFFER_SIZE];
+    while (recv(sock, buffer, sizeof(buffer), 0) >= 0) {
+    }
+}
+
+void socket_util_watch(int sock, fd_set *set, int *max_fd)
+{
+    FD_SET(sock, set);
+    if (sock > *max_fd) {
+        *max_fd = sock;
+    }
+}
+
+ssize_t socket_util_send_iov_from(int sock, struct iovec *iov, int iov_count, size_t offset)
+{
+    int first = 0;
+    while (first < iov_count && offset >= iov[first].iov_len) {
+        offset -= iov[first].iov_len;
+        ++first;
+    }
+    if (first == iov_count) {
+        return 0;
+    }
+    iov[first].iov_base = (uint8_t *)iov[first].iov_base + offset;
+    iov[first].iov_len -= offset;
+
+    struct msghdr msg = {
+        .msg_iov = iov + first,
+        .msg_iovlen = iov_count - first,
+    };
+    return sendmsg(sock, &msg, 0);
+}
+
+esp_err_t socket_util_create_wake_pair(int *rx_socket, int *tx_socket)
+{
+    *rx_socket = socket_util_create_udp(INADDR_LOOPBACK, 0);
+    *tx_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    struct sockaddr_in addr = {0};
+    socklen_t addr_len = sizeof(addr);
+    if (*rx_socket >= 0 && *tx_socket >= 0 && getsockname(*rx_socket, (struct sockaddr *)&addr, &addr_len) == 0 &&
+        connect(*tx_socket, (struct sockaddr *)&addr, addr_len) == 0 && socket_util_set_non_blocking(*tx_socket) == 0) {
+        return ESP_OK;
+    }
+    if (*rx_socket >= 0) {
+        close(*rx_socket);
+    }
+    if (*tx_socket >= 0) {
+        close(*tx_socket);
+    }
+    *rx_socket = *tx_socket = -1;
+    return ESP_FAIL;
+}
+
+void socket_util_wake(int tx_socket)
+{
+    const uint8_t token = 0;
+    send(tx_socket, &token, sizeof(token), MSG_DONTWAIT);
+}
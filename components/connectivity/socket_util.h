@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "lwip/sockets.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int socket_util_set_non_blocking(int sock);
+int socket_util_create_udp(uint32_t address, uint16_t port);
+
+/* A UDP socket that may share its port (SO_REUSEADDR); with if_key, egress is pinned to that esp_netif. */
+int socket_util_create_shared_udp(const char *if_key, uint16_t port);
+bool socket_util_would_block(void);
+void socket_util_drain(int sock);
+void socket_util_watch(int sock, fd_set *set, int *max_fd);
+
+/* Sends the vector starting `offset` bytes in; the entries are adjusted in place. */
+ssize_t socket_util_send_iov_from(int sock, struct iovec *iov, int iov_count, size_t offset);
+
+/* A connected loopback datagram pair that lets other tasks interrupt a select() loop. */
+esp_err_t socket_util_create_wake_pair(int *rx_socket, int *tx_socket);
+void socket_util_wake(int tx_socket);
+
+#ifdef __cplusplus
+}
+#endif
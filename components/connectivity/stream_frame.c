@@ -0,0 +1,48 @@
+#include "stream_frame.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+stream_frame_t *stream_frame_create(frame_pool_t *pool, const h264_packet_t *packet)
+{
+    if (!pool || !packet || !packet->data || packet->length == 0) {
+        return NULL;
+    }
+
+    stream_frame_t *frame = frame_pool_alloc(pool, sizeof(*frame) + packet->length);
+    if (!frame) {
+        return NULL;
+    }
+
+    atomic_init(&frame->refcount, 1);
+    frame->is_keyframe = packet->is_keyframe;
+    frame->timestamp_us = packet->timestamp_us;
+    frame->packets = NULL;
+    frame->packet_count = 0;
+    frame->media_packet_count = 0;
+    frame->fec_buffer = NULL;
+    frame->length = packet->length;
+    memcpy(frame->payload, packet->data, packet->length);
+    return frame;
+}
+
+stream_frame_t *stream_frame_ref(stream_frame_t *frame)
+{
+    if (frame) {
+        atomic_fetch_add_explicit(&frame->refcount, 1, memory_order_relaxed);
+    }
+    return frame;
+}
+
+void stream_frame_unref(stream_frame_t *frame)
+{
+    if (!frame) {
+        return;
+    }
+    if (atomic_fetch_sub_explicit(&frame->refcount, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    frame_pool_free(frame->packets);
+    frame_pool_free(frame->fec_buffer);
+    frame_pool_free(frame);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame_pool.h"
+#include "image_processing.h"
+#include "rtp_packetizer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct stream_frame_t {
+    atomic_uint refcount;
+    int is_keyframe;
+    uint64_t timestamp_us;
+    rtp_packet_t *packets;
+    size_t packet_count;
+    size_t media_packet_count;
+    uint8_t *fec_buffer;
+    size_t length;
+    uint8_t payload[];
+} stream_frame_t;
+
+/*
+ * The payload is copied into a block run of `pool`; NULL when the pool has no room. packets and fec_buffer are
+ * attached later by the RTSP server from its own pools; all three go back to their pools on the last unref.
+ */
+stream_frame_t *stream_frame_create(frame_pool_t *pool, const h264_packet_t *packet);
+stream_frame_t *stream_frame_ref(stream_frame_t *frame);
+void stream_frame_unref(stream_frame_t *frame);
+
+#ifdef __cplusplus
+}
+#endif
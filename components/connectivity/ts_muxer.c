@@ -0,0 +1,206 @@
+#include "ts_muxer.h"
+
+#include <string.h>
+
+#include "h264_nal.h"
+
+#define TS_SYNC_BYTE                0x47
+#define TS_HEADER_SIZE              4
+#define TS_PAYLOAD_SIZE             (TS_PACKET_SIZE - TS_HEADER_SIZE)
+#define TS_PCR_FIELD_SIZE           8       /* length, flags and the 6-byte PCR */
+#define TS_STREAM_TYPE_H264         0x1B
+#define TS_PES_STREAM_ID_VIDEO      0xE0
+#define TS_PROGRAM_NUMBER           1
+#define TS_TABLE_INTERVAL_US        100000
+/* Decoders present a frame this long after its PCR, leaving time for the datagrams to arrive. */
+#define TS_PTS_DELAY_TICKS          (90 * 100)
+
+static const uint8_t access_unit_delimiter[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xF0 };
+
+uint32_t ts_crc32(const uint8_t *data, size_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= (uint32_t)data[i] << 24;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void write_header(uint8_t *packet, uint16_t pid, bool unit_start, bool adaptation, uint8_t *continuity)
+{
+    packet[0] = TS_SYNC_BYTE;
+    packet[1] = (unit_start ? 0x40 : 0x00) | (uint8_t)(pid >> 8);
+    packet[2] = (uint8_t)pid;
+    packet[3] = (adaptation ? 0x30 : 0x10) | (*continuity & 0x0F);
+    *continuity = (*continuity + 1) & 0x0F;
+}
+
+static void write_section(uint8_t *packet, uint16_t pid, uint8_t *continuity, const uint8_t *section, size_t length)
+{
+    write_header(packet, pid, true, false, continuity);
+    packet[TS_HEADER_SIZE] = 0;
+    memcpy(packet + TS_HEADER_SIZE + 1, section, length);
+    uint32_t crc = ts_crc32(section, length);
+    uint8_t *tail = packet + TS_HEADER_SIZE + 1 + length;
+    tail[0] = (uint8_t)(crc >> 24);
+    tail[1] = (uint8_t)(crc >> 16);
+    tail[2] = (uint8_t)(crc >> 8);
+    tail[3] = (uint8_t)crc;
+    memset(tail + 4, 0xFF, TS_PACKET_SIZE - (size_t)(tail + 4 - packet));
+}
+
+static void write_pat(ts_muxer_t *muxer, uint8_t *packet)
+{
+    const uint8_t section[] = {
+        0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00,
+        0x00, TS_PROGRAM_NUMBER, 0xE0 | (TS_PMT_PID >> 8), TS_PMT_PID & 0xFF,
+    };
+    write_section(packet, 0x0000, &muxer->pat_continuity, section, sizeof(section));
+}
+
+static void write_pmt(ts_muxer_t *muxer, uint8_t *packet)
+{
+    const uint8_t section[] = {
+        0x02, 0xB0, 0x12, 0x00, TS_PROGRAM_NUMBER, 0xC1, 0x00, 0x00,
+        0xE0 | (TS_VIDEO_PID >> 8), TS_VIDEO_PID & 0xFF, 0xF0, 0x00,
+        TS_STREAM_TYPE_H264, 0xE0 | (TS_VIDEO_PID >> 8), TS_VIDEO_PID & 0xFF, 0xF0, 0x00,
+    };
+    write_section(packet, TS_PMT_PID, &muxer->pmt_continuity, section, sizeof(section));
+}
+
+static void write_timestamp(uint8_t *out, uint8_t marker, uint64_t ticks)
+{
+    out[0] = (uint8_t)(marker | ((ticks >> 29) & 0x0E) | 0x01);
+    out[1] = (uint8_t)(ticks >> 22);
+    out[2] = (uint8_t)(((ticks >> 14) & 0xFE) | 0x01);
+    out[3] = (uint8_t)(ticks >> 7);
+    out[4] = (uint8_t)(((ticks << 1) & 0xFE) | 0x01);
+}
+
+void ts_muxer_init(ts_muxer_t *muxer)
+{
+    memset(muxer, 0, sizeof(*muxer));
+}
+
+void ts_muxer_begin_frame(ts_muxer_t *muxer, const uint8_t *data, size_t length, uint64_t timestamp_us, bool is_keyframe)
+{
+    if (!muxer->has_base) {
+        muxer->has_base = true;
+        muxer->base_timestamp_us = timestamp_us;
+        muxer->last_tables_us = timestamp_us - TS_TABLE_INTERVAL_US;
+    }
+    uint64_t elapsed_us = timestamp_us > muxer->base_timestamp_us ? timestamp_us - muxer->base_timestamp_us : 0;
+    muxer->pcr_base = (elapsed_us * 90000 / 1000000) & 0x1FFFFFFFFULL;
+
+    if (is_keyframe || timestamp_us - muxer->last_tables_us >= TS_TABLE_INTERVAL_US) {
+        muxer->next_table = TS_TABLE_PAT;
+        muxer->last_tables_us = timestamp_us;
+    }
+
+    uint8_t *pes = muxer->prefix;
+    pes[0] = 0x00;
+    pes[1] = 0x00;
+    pes[2] = 0x01;
+    pes[3] = TS_PES_STREAM_ID_VIDEO;
+    pes[4] = 0x00;
+    pes[5] = 0x00;
+    pes[6] = 0x80;
+    pes[7] = 0x80;
+    pes[8] = 5;
+    write_timestamp(pes + 9, 0x20, (muxer->pcr_base + TS_PTS_DELAY_TICKS) & 0x1FFFFFFFFULL);
+    muxer->prefix_length = 14;
+
+    /* H.264 in MPEG-TS requires every access unit to start with a delimiter. */
+    h264_nal_iterator_t it;
+    const uint8_t *nal = NULL;
+    size_t nal_length = 0;
+    h264_nal_iterator_init(&it, data, length);
+    if (!h264_nal_iterator_next(&it, &nal, &nal_length) || H264_NAL_TYPE(nal[0]) != H264_NAL_TYPE_AUD) {
+        memcpy(pes + muxer->prefix_length, access_unit_delimiter, sizeof(access_unit_delimiter));
+        muxer->prefix_length += sizeof(access_unit_delimiter);
+    }
+
+    muxer->prefix_offset = 0;
+    muxer->payload = data;
+    muxer->payload_length = length;
+    muxer->payload_offset = 0;
+    muxer->first_packet = true;
+    muxer->random_access = is_keyframe;
+}
+
+static size_t remaining_payload(const ts_muxer_t *muxer)
+{
+    return (muxer->prefix_length - muxer->prefix_offset) + (muxer->payload_length - muxer->payload_offset);
+}
+
+static void copy_payload(ts_muxer_t *muxer, uint8_t *out, size_t length)
+{
+    size_t from_prefix = muxer->prefix_length - muxer->prefix_offset;
+    if (from_prefix > length) {
+        from_prefix = length;
+    }
+    memcpy(out, muxer->prefix + muxer->prefix_offset, from_prefix);
+    muxer->prefix_offset += from_prefix;
+    memcpy(out + from_prefix, muxer->payload + muxer->payload_offset, length - from_prefix);
+    muxer->payload_offset += length - from_prefix;
+}
+
+bool ts_muxer_write_packet(ts_muxer_t *muxer, uint8_t *packet)
+{
+    if (muxer->next_table == TS_TABLE_PAT) {
+        write_pat(muxer, packet);
+        muxer->next_table = TS_TABLE_PMT;
+        return true;
+    }
+    if (muxer->next_table == TS_TABLE_PMT) {
+        write_pmt(muxer, packet);
+        muxer->next_table = TS_TABLE_NONE;
+        return true;
+    }
+
+    size_t remaining = remaining_payload(muxer);
+    if (remaining == 0) {
+        return false;
+    }
+
+    size_t adaptation = muxer->first_packet ? TS_PCR_FIELD_SIZE : 0;
+    size_t payload = TS_PAYLOAD_SIZE - adaptation;
+    if (remaining < payload) {
+        adaptation += payload - remaining;
+        payload = remaining;
+    }
+
+    write_header(packet, TS_VIDEO_PID, muxer->first_packet, adaptation > 0, &muxer->video_continuity);
+    uint8_t *field = packet + TS_HEADER_SIZE;
+    if (adaptation > 0) {
+        field[0] = (uint8_t)(adaptation - 1);
+        if (adaptation > 1) {
+            field[1] = 0x00;
+            size_t used = 2;
+            if (muxer->first_packet) {
+                field[1] = 0x10 | (muxer->random_access ? 0x40 : 0x00);
+                uint64_t base = muxer->pcr_base;
+                field[2] = (uint8_t)(base >> 25);
+                field[3] = (uint8_t)(base >> 17);
+                field[4] = (uint8_t)(base >> 9);
+                field[5] = (uint8_t)(base >> 1);
+                field[6] = (uint8_t)(((base & 0x01) << 7) | 0x7E);
+                field[7] = 0x00;
+                used = TS_PCR_FIELD_SIZE;
+            }
+            memset(field + used, 0xFF, adaptation - used);
+        }
+    }
+    copy_payload(muxer, field + adaptation, payload);
+    muxer->first_packet = false;
+    return true;
+}
+
+size_t ts_muxer_frame_size(size_t length)
+{
+    size_t payload = length + TS_PES_PREFIX_MAX_SIZE + TS_PCR_FIELD_SIZE;
+    return ((payload + TS_PAYLOAD_SIZE - 1) / TS_PAYLOAD_SIZE + 2) * TS_PACKET_SIZE;
+}
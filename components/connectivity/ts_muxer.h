@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TS_PACKET_SIZE              188
+#define TS_PACKETS_PER_DATAGRAM     7
+#define TS_DATAGRAM_SIZE            (TS_PACKET_SIZE * TS_PACKETS_PER_DATAGRAM)
+#define TS_PMT_PID                  0x1000
+#define TS_VIDEO_PID                0x0100
+#define TS_PES_PREFIX_MAX_SIZE      24
+
+typedef enum {
+    TS_TABLE_NONE = 0,
+    TS_TABLE_PAT,
+    TS_TABLE_PMT,
+} ts_table_t;
+
+/*
+ * Single-program H.264 transport stream. Frames are emitted packet by packet straight into the
+ * caller's buffers; the muxer only keeps the PES header and a cursor into the access unit.
+ */
+typedef struct {
+    uint8_t pat_continuity;
+    uint8_t pmt_continuity;
+    uint8_t video_continuity;
+    bool has_base;
+    uint64_t base_timestamp_us;
+    uint64_t last_tables_us;
+    ts_table_t next_table;
+    bool first_packet;
+    bool random_access;
+    uint64_t pcr_base;
+    const uint8_t *payload;
+    size_t payload_length;
+    size_t payload_offset;
+    size_t prefix_length;
+    size_t prefix_offset;
+    uint8_t prefix[TS_PES_PREFIX_MAX_SIZE];
+} ts_muxer_t;
+
+void ts_muxer_init(ts_muxer_t *muxer);
+
+/* Starts an Annex-B access unit; PAT/PMT are repeated before keyframes and at least every 100 ms. */
+void ts_muxer_begin_frame(ts_muxer_t *muxer, const uint8_t *data, size_t length, uint64_t timestamp_us, bool is_keyframe);
+
+/* Writes the next TS_PACKET_SIZE bytes of the current frame; returns false once the frame is complete. */
+bool ts_muxer_write_packet(ts_muxer_t *muxer, uint8_t *packet);
+
+/* Bytes on the wire for a frame of `length` bytes, for pacing. */
+size_t ts_muxer_frame_size(size_t length);
+
+uint32_t ts_crc32(const uint8_t *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,136 @@
+#include "ts_output.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/inet.h"
+
+#include "memory_account.h"
+#include "socket_util.h"
+
+static const char *TAG = "ts_output";
+
+esp_err_t ts_output_init(ts_output_t *output, const transport_config_t *config, const frame_ring_t *ring)
+{
+    memset(output, 0, sizeof(*output));
+    output->socket = -1;
+
+    struct in_addr address;
+    const char *destination = config->mpegts.destination;
+    if (!destination || inet_aton(destination, &address) == 0) {
+        ESP_LOGE(TAG, "Invalid MPEG-TS destination %s", destination ? destination : "(null)");
+        return ESP_ERR_INVALID_ARG;
+    }
+    output->destination.sin_family = AF_INET;
+    output->destination.sin_addr = address;
+    output->destination.sin_port = htons(config->mpegts.port);
+
+    output->pool = memory_account_malloc(MEMORY_ACCOUNT_CONNECTIVITY, TS_OUTPUT_POOL_SIZE * TS_DATAGRAM_SIZE,
+                                         MEMORY_PLAN_HOT_CAPS);
+    if (!output->pool) {
+        return ESP_ERR_NO_MEM;
+    }
+    output->socket = socket_util_create_udp(INADDR_ANY, 0);
+    if (output->socket < 0) {
+        ESP_LOGE(TAG, "Failed to create MPEG-TS socket");
+        ts_output_deinit(output);
+        return ESP_FAIL;
+    }
+    if (IN_MULTICAST(ntohl(address.s_addr))) {
+        uint8_t ttl = config->mpegts.ttl;
+        setsockopt(output->socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    }
+
+    ts_muxer_init(&output->muxer);
+    frame_cursor_seek_live(&output->cursor, ring);
+    rtp_pacer_init(&output->pacer, config->pacing.bitrate / 8, config->pacing.burst_bytes, esp_timer_get_time());
+    ESP_LOGI(TAG, "MPEG-TS output to udp://%s:%u", destination, config->mpegts.port);
+    return ESP_OK;
+}
+
+void ts_output_deinit(ts_output_t *output)
+{
+    stream_frame_unref(output->current);
+    output->current = NULL;
+    if (output->socket >= 0) {
+        close(output->socket);
+        output->socket = -1;
+    }
+    memory_account_free(MEMORY_ACCOUNT_CONNECTIVITY, output->pool);
+    output->pool = NULL;
+}
+
+static bool next_frame(ts_output_t *output, const frame_ring_t *ring, const transport_config_t *config)
+{
+    stream_frame_unref(output->current);
+    output->current = frame_cursor_next(&output->cursor, ring);
+    if (!output->current) {
+        return false;
+    }
+    ts_muxer_begin_frame(&output->muxer, output->current->payload, output->current->length,
+                         output->current->timestamp_us, output->current->is_keyframe);
+    if (config->pacing.enable) {
+        uint32_t rate = rtp_pacer_frame_rate(config->pacing.bitrate, config->pacing.frame_rate,
+                                             config->pacing.spread_percent,
+                                             ts_muxer_frame_size(output->current->length));
+        rtp_pacer_set_rate(&output->pacer, rate, esp_timer_get_time());
+    }
+    return true;
+}
+
+/* Packets go straight into the next free pool slot; a datagram is closed early at the end of the available frames. */
+static void fill_pool(ts_output_t *output, const frame_ring_t *ring, const transport_config_t *config)
+{
+    while (output->count < TS_OUTPUT_POOL_SIZE) {
+        size_t slot = (output->head + output->count) % TS_OUTPUT_POOL_SIZE;
+        uint8_t *datagram = output->pool[slot];
+        size_t length = 0;
+        while (length < TS_DATAGRAM_SIZE) {
+            if (output->current && ts_muxer_write_packet(&output->muxer, datagram + length)) {
+                length += TS_PACKET_SIZE;
+            } else if (!next_frame(output, ring, config)) {
+                break;
+            }
+        }
+        if (length == 0) {
+            return;
+        }
+        output->lengths[slot] = length;
+        ++output->count;
+    }
+}
+
+void ts_output_pump(ts_output_t *output, const frame_ring_t *ring, const transport_config_t *config)
+{
+    output->deadline_us = 0;
+    if (output->blocked) {
+        return;
+    }
+    fill_pool(output, ring, config);
+    while (output->count > 0) {
+        size_t length = output->lengths[output->head];
+        if (config->pacing.enable) {
+            int64_t now = esp_timer_get_time();
+            int64_t wait_us = rtp_pacer_reserve(&output->pacer, length, now);
+            if (wait_us > 0) {
+                output->deadline_us = now + wait_us;
+                return;
+            }
+        }
+        if (sendto(output->socket, output->pool[output->head], length, 0, (struct sockaddr *)&output->destination,
+                   sizeof(output->destination)) < 0 && socket_util_would_block()) {
+            if (config->pacing.enable) {
+                rtp_pacer_refund(&output->pacer, length);
+            }
+            output->blocked = true;
+            return;
+        }
+        ++output->datagrams_sent;
+        output->head = (output->head + 1) % TS_OUTPUT_POOL_SIZE;
+        --output->count;
+        fill_pool(output, ring, config);
+    }
+}
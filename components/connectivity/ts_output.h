@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "lwip/sockets.h"
+
+#include "connectivity.h"
+#include "frame_ring.h"
+#include "rtp_pacer.h"
+#include "ts_muxer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TS_OUTPUT_POOL_SIZE 8
+
+/* Pushes the frame ring as MPEG-TS in 7x188-byte datagrams to a unicast or multicast destination. */
+typedef struct {
+    int socket;
+    struct sockaddr_in destination;
+    ts_muxer_t muxer;
+    frame_cursor_t cursor;
+    stream_frame_t *current;
+    rtp_pacer_t pacer;
+    bool blocked;
+    int64_t deadline_us;
+    uint8_t (*pool)[TS_DATAGRAM_SIZE];
+    size_t lengths[TS_OUTPUT_POOL_SIZE];
+    size_t head;
+    size_t count;
+    uint32_t datagrams_sent;
+} ts_output_t;
+
+esp_err_t ts_output_init(ts_output_t *output, const transport_config_t *config, const frame_ring_t *ring);
+void ts_output_deinit(ts_output_t *output);
+
+/* Packs queued frames into the datagram pool and sends what pacing allows; sets deadline_us when it must wait. */
+void ts_output_pump(ts_output_t *output, const frame_ring_t *ring, const transport_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif
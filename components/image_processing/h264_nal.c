@@ -0,0 +1,270 @@
+#include "h264_nal.h"
+
+#include <string.h>
+
+static size_t find_start_code(const uint8_t *data, size_t length, size_t from, size_t *code_length)
+{
+    for (size_t i = from; i + 3 <= length; ++i) {
+        if (data[i + 2] > 1) {
+            i += 2;
+            continue;
+        }
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if (i > from && data[i - 1] == 0) {
+                *code_length = 4;
+                return i - 1;
+            }
+            *code_length = 3;
+            return i;
+        }
+    }
+    *code_length = 0;
+    return length;
+}
+
+void h264_nal_iterator_init(h264_nal_iterator_t *it, const uint8_t *data, size_t length)
+{
+    it->data = data;
+    it->length = length;
+    size_t code_length = 0;
+    size_t start = find_start_code(data, length, 0, &code_length);
+    it->position = start + code_length;
+}
+
+bool h264_nal_iterator_next(h264_nal_iterator_t *it, const uint8_t **nal, size_t *nal_length)
+{
+    while (it->position < it->length) {
+        size_t code_length = 0;
+        size_t end = find_start_code(it->data, it->length, it->position, &code_length);
+        size_t begin = it->position;
+        it->position = end + code_length;
+
+        size_t trimmed_end = end;
+        while (trimmed_end > begin && it->data[trimmed_end - 1] == 0) {
+            --trimmed_end;
+        }
+        if (trimmed_end > begin) {
+            *nal = it->data + begin;
+            *nal_length = trimmed_end - begin;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* No byte of the UUID is zero, and neither is any byte of the 7-bit field groups, so no 00 00 0x can appear. */
+static const uint8_t timing_sei_uuid[16] = {
+    0x7a, 0x1f, 0x3c, 0x9e, 0x52, 0xd4, 0x4b, 0x8a, 0x9e, 0x61, 0xc2, 0xd8, 0x3f, 0x5a, 0xb7, 0xe4,
+};
+
+/* Big-endian 7-bit groups with the top bit set, so the bytes are never zero. */
+static uint8_t *write_septets(uint8_t *out, uint64_t value, int count)
+{
+    for (int i = count - 1; i >= 0; --i) {
+        *out++ = 0x80 | (uint8_t)((value >> (7 * i)) & 0x7F);
+    }
+    return out;
+}
+
+void h264_timing_sei_write(uint8_t *out, const h264_timing_sei_t *timing)
+{
+    static const uint8_t header[] = { 0x00, 0x00, 0x00, 0x01, H264_NAL_TYPE_SEI, 0x05 /* user_data_unregistered */ };
+    memcpy(out, header, sizeof(header));
+    uint8_t *payload_size = out + sizeof(header);
+    uint8_t *cursor = payload_size + 1;
+    memcpy(cursor, timing_sei_uuid, sizeof(timing_sei_uuid));
+    cursor += sizeof(timing_sei_uuid);
+    cursor = write_septets(cursor, timing->sequence, 5);
+    cursor = write_septets(cursor, timing->capture_us, 10);
+    cursor = write_septets(cursor, timing->encode_begin_us, 10);
+    cursor = write_septets(cursor, timing->encode_end_us, 10);
+    *payload_size = (uint8_t)(cursor - payload_size - 1);
+    *cursor = 0x80; /* rbsp_trailing_bits */
+}
+
+static const uint8_t *read_septets(const uint8_t *in, uint64_t *value, int count)
+{
+    *value = 0;
+    for (int i = 0; i < count; ++i) {
+        *value = (*value << 7) | (*in++ & 0x7F);
+    }
+    return in;
+}
+
+bool h264_timing_sei_parse(const uint8_t *nal, size_t length, h264_timing_sei_t *timing)
+{
+    /* NAL header, payload type and size, then the payload and the trailing bits. */
+    const size_t payload_size = H264_TIMING_SEI_SIZE - 8;
+    if (length < payload_size + 3 || H264_NAL_TYPE(nal[0]) != H264_NAL_TYPE_SEI || nal[1] != 0x05 ||
+        nal[2] != payload_size || memcmp(nal + 3, timing_sei_uuid, sizeof(timing_sei_uuid)) != 0) {
+        return false;
+    }
+    const uint8_t *cursor = nal + 3 + sizeof(timing_sei_uuid);
+    uint64_t sequence = 0;
+    cursor = read_septets(cursor, &sequence, 5);
+    cursor = read_septets(cursor, &timing->capture_us, 10);
+    cursor = read_septets(cursor, &timing->encode_begin_us, 10);
+    read_septets(cursor, &timing->encode_end_us, 10);
+    timing->sequence = (uint32_t)sequence;
+    return true;
+}
+
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    size_t byte;
+    int bit;
+    int zeros;
+    bool overrun;
+} rbsp_reader_t;
+
+static uint32_t read_bit(rbsp_reader_t *reader)
+{
+    if (reader->bit == 0) {
+        /* Skip emulation prevention bytes (00 00 03) while walking the RBSP. */
+        if (reader->zeros >= 2 && reader->byte < reader->length && reader->data[reader->byte] == 3) {
+            ++reader->byte;
+            reader->zeros = 0;
+        }
+        if (reader->byte >= reader->length) {
+            reader->overrun = true;
+            return 0;
+        }
+        reader->zeros = reader->data[reader->byte] == 0 ? reader->zeros + 1 : 0;
+    }
+    uint32_t value = (reader->data[reader->byte] >> (7 - reader->bit)) & 1;
+    if (++reader->bit == 8) {
+        reader->bit = 0;
+        ++reader->byte;
+    }
+    return value;
+}
+
+static uint32_t read_bits(rbsp_reader_t *reader, int count)
+{
+    uint32_t value = 0;
+    while (count-- > 0) {
+        value = (value << 1) | read_bit(reader);
+    }
+    return value;
+}
+
+static uint32_t read_ue(rbsp_reader_t *reader)
+{
+    int leading_zeros = 0;
+    while (read_bit(reader) == 0 && !reader->overrun) {
+        if (++leading_zeros > 31) {
+            reader->overrun = true;
+            return 0;
+        }
+    }
+    return ((1u << leading_zeros) - 1) + read_bits(reader, leading_zeros);
+}
+
+static int32_t read_se(rbsp_reader_t *reader)
+{
+    uint32_t value = read_ue(reader);
+    return (value & 1) ? (int32_t)((value + 1) / 2) : -(int32_t)(value / 2);
+}
+
+static void skip_scaling_list(rbsp_reader_t *reader, int size)
+{
+    int32_t last_scale = 8;
+    int32_t next_scale = 8;
+    for (int i = 0; i < size && next_scale != 0 && !reader->overrun; ++i) {
+        next_scale = (last_scale + read_se(reader) + 256) % 256;
+        last_scale = next_scale ? next_scale : last_scale;
+    }
+}
+
+static bool profile_has_chroma_info(uint8_t profile_idc)
+{
+    switch (profile_idc) {
+    case 100: case 110: case 122: case 244: case 44: case 83: case 86: case 118: case 128: case 138: case 139: case 134:
+    case 135:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool h264_sps_parse_resolution(const uint8_t *sps, size_t length, uint32_t *width, uint32_t *height)
+{
+    if (!sps || length < 4 || H264_NAL_TYPE(sps[0]) != H264_NAL_TYPE_SPS) {
+        return false;
+    }
+
+    rbsp_reader_t reader = {
+        .data = sps + 1,
+        .length = length - 1,
+    };
+    uint8_t profile_idc = (uint8_t)read_bits(&reader, 8);
+    read_bits(&reader, 16);
+    read_ue(&reader);
+
+    uint32_t chroma_format_idc = 1;
+    if (profile_has_chroma_info(profile_idc)) {
+        chroma_format_idc = read_ue(&reader);
+        if (chroma_format_idc == 3) {
+            read_bit(&reader);
+        }
+        read_ue(&reader);
+        read_ue(&reader);
+        read_bit(&reader);
+        if (read_bit(&reader)) {
+            for (int i = 0; i < (chroma_format_idc == 3 ? 12 : 8); ++i) {
+                if (read_bit(&reader)) {
+                    skip_scaling_list(&reader, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+
+    read_ue(&reader);
+    uint32_t pic_order_cnt_type = read_ue(&reader);
+    if (pic_order_cnt_type == 0) {
+        read_ue(&reader);
+    } else if (pic_order_cnt_type == 1) {
+        read_bit(&reader);
+        read_se(&reader);
+        read_se(&reader);
+        uint32_t cycle_length = read_ue(&reader);
+        for (uint32_t i = 0; i < cycle_length && !reader.overrun; ++i) {
+            read_se(&reader);
+        }
+    }
+    read_ue(&reader);
+    read_bit(&reader);
+
+    uint32_t width_in_mbs = read_ue(&reader) + 1;
+    uint32_t height_in_map_units = read_ue(&reader) + 1;
+    uint32_t frame_mbs_only = read_bit(&reader);
+    if (!frame_mbs_only) {
+        read_bit(&reader);
+    }
+    read_bit(&reader);
+
+    uint32_t crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+    if (read_bit(&reader)) {
+        crop_left = read_ue(&reader);
+        crop_right = read_ue(&reader);
+        crop_top = read_ue(&reader);
+        crop_bottom = read_ue(&reader);
+    }
+    if (reader.overrun) {
+        return false;
+    }
+
+    uint32_t crop_unit_x = chroma_format_idc == 0 || chroma_format_idc == 3 ? 1 : 2;
+    uint32_t crop_unit_y = (chroma_format_idc == 1 ? 2 : 1) * (2 - frame_mbs_only);
+    uint32_t full_width = width_in_mbs * 16;
+    uint32_t full_height = height_in_map_units * 16 * (2 - frame_mbs_only);
+    uint32_t crop_width = (crop_left + crop_right) * crop_unit_x;
+    uint32_t crop_height = (crop_top + crop_bottom) * crop_unit_y;
+    if (crop_width >= full_width || crop_height >= full_height) {
+        return false;
+    }
+    *width = full_width - crop_width;
+    *height = full_height - crop_height;
+    return true;
+}
@@ -9,15 +9,40 @@
 #include "esp_timer.h"
 #include "esp_heap_caps.h"
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
 #include "driver/h264_dma.h"
 
+#include "h264_nal.h"
+
+#include "memory_account.h"
+#include "metrics.h"
+#include "trace.h"
+
 static const char *TAG = "image_processing";
 
+#define IMAGE_PROCESSING_MAX_BITSTREAM_BUFFERS  4
+#define IMAGE_PROCESSING_BUFFER_WAIT_MS         1000
+/* Room for the timing SEI ahead of the encoder output, a whole cache line so the DMA target keeps its alignment. */
+#define IMAGE_PROCESSING_SEI_RESERVE            128
+
+static METRICS_DEFINE_COUNTER(s_frames_encoded, "encoder_frames_total", "Frames encoded to H.264");
+static METRICS_DEFINE_COUNTER(s_keyframes_encoded, "encoder_keyframes_total", "IDR frames encoded");
+static METRICS_DEFINE_COUNTER(s_bytes_encoded, "encoder_bytes_total", "H.264 bytes produced");
+static METRICS_DEFINE_COUNTER(s_encode_errors, "encoder_errors_total", "Frames the hardware encoder failed to encode");
+static METRICS_DEFINE_COUNTER(s_buffer_timeouts, "encoder_buffer_timeouts_total",
+                              "Frames not encoded because every bitstream buffer was still in use");
+static METRICS_DEFINE_HISTOGRAM(s_encode_latency, "encoder_latency_us", "Hardware encode time per frame in microseconds",
+                                2000, 4000, 8000, 12000, 16000, 24000, 33000, 50000, 100000);
+
 struct h264_encoder_context_t {
     h264_dma_encoder_handle_t hw_encoder;
     encoder_config_t config;
-    uint8_t *bitstream_buffer;
+    uint8_t *bitstream_buffers[IMAGE_PROCESSING_MAX_BITSTREAM_BUFFERS];
+    QueueHandle_t free_buffers;
     size_t bitstream_size;
+    volatile bool keyframe_requested;
 };
 
 encoder_config_t image_processing_default_encoder_config(void)
@@ -27,43 +52,97 @@ encoder_config_t image_processing_default_encoder_config(void)
         .height = 1080,
         .fps = 30,
         .bitrate = 8 * 1024 * 1024,
+        .bitstream_buffer_count = 4,
         .enable_psram = true,
+        .timing_sei = true,
     };
 }
 
+static uint32_t bitstream_buffer_count(const encoder_config_t *config)
+{
+    if (config->bitstream_buffer_count == 0) {
+        return 1;
+    }
+    if (config->bitstream_buffer_count > IMAGE_PROCESSING_MAX_BITSTREAM_BUFFERS) {
+        return IMAGE_PROCESSING_MAX_BITSTREAM_BUFFERS;
+    }
+    return config->bitstream_buffer_count;
+}
+
+/* Half a byte per pixel is far above any frame the rate control produces at streaming bitrates. */
+static size_t bitstream_size(const encoder_config_t *config)
+{
+    return config->width * config->height / 2;
+}
+
+static esp_err_t new_hw_encoder(encoder_handle_t handle, h264_dma_encoder_handle_t *out_encoder)
+{
+    h264_dma_encoder_config_t encoder_config = {
+        .width = handle->config.width,
+        .height = handle->config.height,
+        .frame_rate = handle->config.fps,
+        .bit_rate = handle->config.bitrate,
+        .profile = H264_PROFILE_HIGH,
+    };
+    return h264_dma_new_encoder(&encoder_config, out_encoder);
+}
+
 esp_err_t image_processing_create_encoder(const encoder_config_t *config, encoder_handle_t *out_handle)
 {
     if (!config || !out_handle) {
         return ESP_ERR_INVALID_ARG;
     }
+    metrics_register(&s_frames_encoded);
+    metrics_register(&s_keyframes_encoded);
+    metrics_register(&s_bytes_encoded);
+    metrics_register(&s_encode_errors);
+    metrics_register(&s_buffer_timeouts);
+    metrics_register(&s_encode_latency);
 
-    encoder_handle_t handle = calloc(1, sizeof(*handle));
+    encoder_handle_t handle = memory_account_calloc(MEMORY_ACCOUNT_IMAGE_PROCESSING, 1, sizeof(*handle),
+                                                    MALLOC_CAP_DEFAULT);
     if (!handle) {
         return ESP_ERR_NO_MEM;
     }
 
     handle->config = *config;
-    handle->bitstream_size = config->width * config->height * 4;
-    handle->bitstream_buffer = heap_caps_malloc(handle->bitstream_size, config->enable_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL);
-    if (!handle->bitstream_buffer) {
-        free(handle);
+    handle->config.bitstream_buffer_count = bitstream_buffer_count(config);
+    handle->bitstream_size = bitstream_size(config);
+    handle->free_buffers = xQueueCreate(handle->config.bitstream_buffer_count, sizeof(uint8_t *));
+    if (!handle->free_buffers) {
+        image_processing_destroy_encoder(handle);
         return ESP_ERR_NO_MEM;
     }
+    const uint32_t bitstream_caps = config->enable_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL;
+    for (uint32_t i = 0; i < handle->config.bitstream_buffer_count; ++i) {
+        handle->bitstream_buffers[i] = memory_account_malloc(MEMORY_ACCOUNT_IMAGE_PROCESSING, handle->bitstream_size,
+                                                             bitstream_caps);
+        if (!handle->bitstream_buffers[i]) {
+            image_processing_destroy_encoder(handle);
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(handle->free_buffers, &handle->bitstream_buffers[i], 0);
+    }
 
-    h264_dma_encoder_config_t encoder_config = {
-        .width = config->width,
-        .height = config->height,
-        .frame_rate = config->fps,
-        .bit_rate = config->bitrate,
-        .profile = H264_PROFILE_HIGH,
-    };
-
-    ESP_RETURN_ON_ERROR(h264_dma_new_encoder(&encoder_config, &handle->hw_encoder), TAG, "Failed to create H264 encoder");
+    esp_err_t err = new_hw_encoder(handle, &handle->hw_encoder);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create H264 encoder");
+        image_processing_destroy_encoder(handle);
+        return err;
+    }
 
     *out_handle = handle;
     return ESP_OK;
 }
 
+esp_err_t image_processing_plan_memory(const encoder_config_t *config, memory_plan_t *plan)
+{
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "encoder bitstream", memory_plan_region(config->enable_psram),
+                                        bitstream_size(config), bitstream_buffer_count(config)),
+                        TAG, "Failed to plan bitstream buffers");
+    return memory_plan_add(plan, "encoder context", MEMORY_PLAN_INTERNAL, sizeof(struct h264_encoder_context_t), 1);
+}
+
 void image_processing_destroy_encoder(encoder_handle_t handle)
 {
     if (!handle) {
@@ -73,10 +152,35 @@ void image_processing_destroy_encoder(encoder_handle_t handle)
         h264_dma_del_encoder(handle->hw_encoder);
         handle->hw_encoder = NULL;
     }
-    if (handle->bitstream_buffer) {
-        heap_caps_free(handle->bitstream_buffer);
+    for (uint32_t i = 0; i < IMAGE_PROCESSING_MAX_BITSTREAM_BUFFERS; ++i) {
+        if (handle->bitstream_buffers[i]) {
+            memory_account_free(MEMORY_ACCOUNT_IMAGE_PROCESSING, handle->bitstream_buffers[i]);
+        }
+    }
+    if (handle->free_buffers) {
+        vQueueDelete(handle->free_buffers);
+    }
+    memory_account_free(MEMORY_ACCOUNT_IMAGE_PROCESSING, handle);
+}
+
+/*
+ * Puts the SEI right in front of the access unit the encoder wrote at `encoded`, behind the access unit
+ * delimiter if the encoder emitted one, since nothing may precede that. Returns the new start of the unit.
+ */
+static uint8_t *insert_timing_sei(uint8_t *encoded, size_t output_size, const h264_timing_sei_t *timing)
+{
+    size_t aud_length = 0;
+    h264_nal_iterator_t it;
+    const uint8_t *nal = NULL;
+    size_t nal_length = 0;
+    h264_nal_iterator_init(&it, encoded, output_size);
+    if (h264_nal_iterator_next(&it, &nal, &nal_length) && H264_NAL_TYPE(nal[0]) == H264_NAL_TYPE_AUD) {
+        aud_length = (size_t)(nal - encoded) + nal_length;
     }
-    free(handle);
+    uint8_t *start = encoded - H264_TIMING_SEI_SIZE;
+    memmove(start, encoded, aud_length);
+    h264_timing_sei_write(start + aud_length, timing);
+    return start;
 }
 
 esp_err_t image_processing_encode_frame(encoder_handle_t handle, const camera_frame_t *frame, h264_packet_t *out_packet)
@@ -85,25 +189,68 @@ esp_err_t image_processing_encode_frame(encoder_handle_t handle, const camera_fr
         return ESP_ERR_INVALID_ARG;
     }
 
+    /*
+     * The DMA encoder has no per-frame IDR control; a fresh encoder instance always starts with one. Until one
+     * can be created the old encoder keeps running and the request stays pending for the next frame.
+     */
+    if (handle->keyframe_requested) {
+        h264_dma_encoder_handle_t hw_encoder = NULL;
+        if (new_hw_encoder(handle, &hw_encoder) == ESP_OK) {
+            handle->keyframe_requested = false;
+            h264_dma_del_encoder(handle->hw_encoder);
+            handle->hw_encoder = hw_encoder;
+        } else {
+            ESP_LOGW(TAG, "Failed to restart H264 encoder, keyframe deferred");
+        }
+    }
+
+    uint8_t *bitstream = NULL;
+    if (xQueueReceive(handle->free_buffers, &bitstream, pdMS_TO_TICKS(IMAGE_PROCESSING_BUFFER_WAIT_MS)) != pdTRUE) {
+        metrics_counter_add(&s_buffer_timeouts, 1);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    size_t reserve = handle->config.timing_sei ? IMAGE_PROCESSING_SEI_RESERVE : 0;
     h264_dma_encode_frame_config_t encode_config = {
         .input = frame->buffer,
         .input_size = frame->length,
         .input_format = H264_DMA_INPUT_FORMAT_YUV422,
-        .bitstream = handle->bitstream_buffer,
-        .bitstream_size = handle->bitstream_size,
+        .bitstream = bitstream + reserve,
+        .bitstream_size = handle->bitstream_size - reserve,
         .timestamp = esp_timer_get_time(),
     };
 
     size_t output_size = 0;
     h264_dma_packet_info_t packet_info = {0};
+    TRACE_EVENT(TRACE_EVENT_ENCODE_BEGIN, frame->sequence);
     esp_err_t err = h264_dma_encode_frame(handle->hw_encoder, &encode_config, &packet_info, &output_size);
+    TRACE_EVENT(TRACE_EVENT_ENCODE_END, encode_config.timestamp);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "H264 encode failed: %s", esp_err_to_name(err));
+        xQueueSend(handle->free_buffers, &bitstream, 0);
+        metrics_counter_add(&s_encode_errors, 1);
         return err;
     }
+    int64_t encode_end_us = esp_timer_get_time();
+    metrics_histogram_observe(&s_encode_latency, (uint32_t)(encode_end_us - encode_config.timestamp));
+    metrics_counter_add(&s_frames_encoded, 1);
+    metrics_counter_add(&s_bytes_encoded, output_size);
+    if (packet_info.is_idr) {
+        metrics_counter_add(&s_keyframes_encoded, 1);
+    }
 
-    out_packet->data = handle->bitstream_buffer;
+    out_packet->data = bitstream + reserve;
     out_packet->length = output_size;
+    if (reserve) {
+        h264_timing_sei_t timing = {
+            .sequence = frame->sequence,
+            .capture_us = frame->timestamp_us,
+            .encode_begin_us = encode_config.timestamp,
+            .encode_end_us = encode_end_us,
+        };
+        out_packet->data = insert_timing_sei(bitstream + reserve, output_size, &timing);
+        out_packet->length += H264_TIMING_SEI_SIZE;
+    }
     out_packet->is_keyframe = packet_info.is_idr;
     out_packet->timestamp_us = packet_info.timestamp;
 
@@ -112,9 +259,24 @@ esp_err_t image_processing_encode_frame(encoder_handle_t handle, const camera_fr
 
 void image_processing_release_packet(encoder_handle_t handle, h264_packet_t *packet)
 {
-    if (!handle || !packet) {
+    if (!handle || !packet || !packet->data) {
         return;
     }
+    /* With a timing SEI the packet starts a little way into its buffer. */
+    for (uint32_t i = 0; i < handle->config.bitstream_buffer_count; ++i) {
+        uint8_t *bitstream = handle->bitstream_buffers[i];
+        if (packet->data >= bitstream && packet->data < bitstream + handle->bitstream_size) {
+            xQueueSend(handle->free_buffers, &bitstream, 0);
+            break;
+        }
+    }
     packet->data = NULL;
     packet->length = 0;
 }
+
+void image_processing_request_keyframe(encoder_handle_t handle)
+{
+    if (handle) {
+        handle->keyframe_requested = true;
+    }
+}
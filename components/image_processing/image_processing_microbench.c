@@ -0,0 +1,105 @@
+#include "image_processing_microbench.h"
+
+#include <stdlib.h>
+
+#include "h264_nal.h"
+
+#define MICROBENCH_PIXELS               (1920 * 1080)
+/* About a keyframe at the default 8 Mbit/s and 30 fps. */
+#define MICROBENCH_ACCESS_UNIT_SIZE     (128 * 1024)
+
+/* Keeps the compiler from dropping results nothing else reads. */
+static volatile size_t s_sink;
+
+static esp_err_t access_unit_setup(void **out_ctx)
+{
+    uint8_t *access_unit = malloc(MICROBENCH_ACCESS_UNIT_SIZE);
+    if (!access_unit) {
+        return ESP_ERR_NO_MEM;
+    }
+    microbench_fill_access_unit(access_unit, MICROBENCH_ACCESS_UNIT_SIZE, 1);
+    *out_ctx = access_unit;
+    return ESP_OK;
+}
+
+static void free_ctx(void *ctx)
+{
+    free(ctx);
+}
+
+static void nal_scan_run(void *ctx)
+{
+    h264_nal_iterator_t it;
+    const uint8_t *nal = NULL;
+    size_t nal_length = 0;
+    size_t total = 0;
+    h264_nal_iterator_init(&it, (const uint8_t *)ctx, MICROBENCH_ACCESS_UNIT_SIZE);
+    while (h264_nal_iterator_next(&it, &nal, &nal_length)) {
+        total += nal_length;
+    }
+    s_sink = total;
+}
+
+static esp_err_t timing_sei_setup(void **out_ctx)
+{
+    *out_ctx = malloc(H264_TIMING_SEI_SIZE);
+    return *out_ctx ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static void timing_sei_write_run(void *ctx)
+{
+    static const h264_timing_sei_t timing = {
+        .sequence = 123456,
+        .capture_us = 3600000000ULL,
+        .encode_begin_us = 3600002000ULL,
+        .encode_end_us = 3600012000ULL,
+    };
+    h264_timing_sei_write((uint8_t *)ctx, &timing);
+    s_sink = ((const uint8_t *)ctx)[H264_TIMING_SEI_SIZE - 1];
+}
+
+static void timing_sei_parse_run(void *ctx)
+{
+    h264_timing_sei_t timing;
+    s_sink = h264_timing_sei_parse((const uint8_t *)ctx + 4, H264_TIMING_SEI_SIZE - 4, &timing) ? timing.sequence : 0;
+}
+
+static esp_err_t timing_sei_parse_setup(void **out_ctx)
+{
+    esp_err_t err = timing_sei_setup(out_ctx);
+    if (err == ESP_OK) {
+        timing_sei_write_run(*out_ctx);
+    }
+    return err;
+}
+
+static const microbench_case_t s_cases[] = {
+    {
+        .name = "h264_nal_scan",
+        .bytes = MICROBENCH_ACCESS_UNIT_SIZE,
+        .pixels = MICROBENCH_PIXELS,
+        .setup = access_unit_setup,
+        .run = nal_scan_run,
+        .teardown = free_ctx,
+    },
+    {
+        .name = "h264_timing_sei_write",
+        .bytes = H264_TIMING_SEI_SIZE,
+        .setup = timing_sei_setup,
+        .run = timing_sei_write_run,
+        .teardown = free_ctx,
+    },
+    {
+        .name = "h264_timing_sei_parse",
+        .bytes = H264_TIMING_SEI_SIZE,
+        .setup = timing_sei_parse_setup,
+        .run = timing_sei_parse_run,
+        .teardown = free_ctx,
+    },
+};
+
+const microbench_case_t *image_processing_microbench_cases(size_t *count)
+{
+    *count = sizeof(s_cases) / sizeof(s_cases[0]);
+    return s_cases;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H264_NAL_TYPE_SLICE     1
+#define H264_NAL_TYPE_IDR       5
+#define H264_NAL_TYPE_SEI       6
+#define H264_NAL_TYPE_SPS       7
+#define H264_NAL_TYPE_PPS       8
+#define H264_NAL_TYPE_AUD       9
+
+#define H264_NAL_TYPE(nal_header) ((nal_header) & 0x1F)
+
+/* Start code included; the size is fixed because the timing fields never need emulation prevention. */
+#define H264_TIMING_SEI_SIZE    59
+
+/* All times are esp_timer microseconds. */
+typedef struct {
+    uint32_t sequence;
+    uint64_t capture_us;
+    uint64_t encode_begin_us;
+    uint64_t encode_end_us;
+} h264_timing_sei_t;
+
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    size_t position;
+} h264_nal_iterator_t;
+
+void h264_nal_iterator_init(h264_nal_iterator_t *it, const uint8_t *data, size_t length);
+
+/* Returns the next NAL unit of an Annex-B stream without its start code. */
+bool h264_nal_iterator_next(h264_nal_iterator_t *it, const uint8_t **nal, size_t *nal_length);
+
+/*
+ * Writes a user-data-unregistered SEI NAL unit carrying `timing`, start code first, into `out`, which must
+ * hold H264_TIMING_SEI_SIZE bytes. The layout is documented in tools/latency_probe.py.
+ */
+void h264_timing_sei_write(uint8_t *out, const h264_timing_sei_t *timing);
+
+/* Reads a NAL unit (header byte included) written by h264_timing_sei_write(); false for any other NAL. */
+bool h264_timing_sei_parse(const uint8_t *nal, size_t length, h264_timing_sei_t *timing);
+
+/* Decodes the cropped picture size from an SPS NAL unit (header byte included). */
+bool h264_sps_parse_resolution(const uint8_t *sps, size_t length, uint32_t *width, uint32_t *height);
+
+#ifdef __cplusplus
+}
+#endif
@@ -6,6 +6,7 @@
 #include "esp_err.h"
 
 #include "camera_driver.h"
+#include "memory_plan.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,7 +19,10 @@ typedef struct {
     uint32_t height;
     uint32_t fps;
     uint32_t bitrate;
+    uint32_t bitstream_buffer_count;
     bool enable_psram;
+    /* Prefix every access unit with an SEI carrying the capture and encode times, see h264_nal.h. */
+    bool timing_sei;
 } encoder_config_t;
 
 typedef struct {
@@ -33,9 +37,19 @@ void image_processing_destroy_encoder(encoder_handle_t handle);
 
 encoder_config_t image_processing_default_encoder_config(void);
 
+/* Adds the bitstream buffers and context image_processing_create_encoder() allocates for `config`. */
+esp_err_t image_processing_plan_memory(const encoder_config_t *config, memory_plan_t *plan);
+
+/*
+ * Encodes into one of bitstream_buffer_count output buffers, so up to that many packets can be in flight
+ * between pipeline stages. Fails with ESP_ERR_TIMEOUT when every buffer is still held.
+ */
 esp_err_t image_processing_encode_frame(encoder_handle_t handle, const camera_frame_t *frame, h264_packet_t *out_packet);
 void image_processing_release_packet(encoder_handle_t handle, h264_packet_t *packet);
 
+/* The next encoded frame will be an IDR frame. */
+void image_processing_request_keyframe(encoder_handle_t handle);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "microbench.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Software kernels on the encoder's output path: NAL scanning and the timing SEI. */
+const microbench_case_t *image_processing_microbench_cases(size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memory_plan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    MEMORY_ACCOUNT_CAMERA,
+    MEMORY_ACCOUNT_IMAGE_PROCESSING,
+    MEMORY_ACCOUNT_CONNECTIVITY,
+    MEMORY_ACCOUNT_COMPONENT_COUNT,
+} memory_account_component_t;
+
+typedef struct {
+    size_t current[MEMORY_PLAN_REGION_COUNT];
+    size_t peak[MEMORY_PLAN_REGION_COUNT];
+    uint32_t allocations;
+    uint32_t failures;
+    /* Allocations made on the hot path after warm-up; see memory_account_enter_hot_path(). */
+    uint32_t steady_state_allocations;
+} memory_account_stats_t;
+
+/*
+ * heap_caps_*() that also charge the block to `component`, by the region it landed in and the size the heap
+ * actually handed out. On the linux target every block counts as internal. Blocks must be freed with
+ * memory_account_free() and the same component.
+ */
+void *memory_account_malloc(memory_account_component_t component, size_t size, uint32_t caps);
+void *memory_account_calloc(memory_account_component_t component, size_t count, size_t size, uint32_t caps);
+void memory_account_free(memory_account_component_t component, void *ptr);
+
+void memory_account_get_stats(memory_account_component_t component, memory_account_stats_t *stats);
+
+/* Logs current and peak bytes per component and region. */
+void memory_account_log(void);
+
+/*
+ * Marks the calling task as doing per-frame work until the matching leave. Nests. Once steady state has begun,
+ * any accounted allocation from a task in this state is counted and logged once per component.
+ */
+void memory_account_enter_hot_path(void);
+void memory_account_leave_hot_path(void);
+
+/* True when the calling task is on the hot path and steady state has begun. */
+bool memory_account_in_steady_hot_path(void);
+
+void memory_account_begin_steady_state(void);
+
+/*
+ * Called once per encoded frame. With CONFIG_MEMORY_ACCOUNT_STEADY_STATE, begins steady state on the first frame
+ * after CONFIG_MEMORY_ACCOUNT_WARMUP_FRAMES; otherwise does nothing.
+ */
+void memory_account_note_frame(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Placement policy. Descriptors, RTP headers, queues and anything else touched per packet go to internal SRAM;
+ * frames, bitstreams and other bulk data go to PSRAM.
+ */
+#define MEMORY_PLAN_HOT_CAPS    (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#define MEMORY_PLAN_BULK_CAPS   (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+
+#define MEMORY_PLAN_MAX_ENTRIES 32
+
+typedef enum {
+    MEMORY_PLAN_INTERNAL,
+    MEMORY_PLAN_SPIRAM,
+    MEMORY_PLAN_REGION_COUNT,
+} memory_plan_region_t;
+
+typedef struct {
+    const char *name;
+    memory_plan_region_t region;
+    size_t size;
+    uint32_t count;
+} memory_plan_entry_t;
+
+typedef struct {
+    /* Left free for allocations outside the plan: Wi-Fi and lwIP buffers, task stacks, sockets. */
+    size_t reserve[MEMORY_PLAN_REGION_COUNT];
+} memory_plan_config_t;
+
+typedef struct {
+    size_t free[MEMORY_PLAN_REGION_COUNT];
+    size_t largest_block[MEMORY_PLAN_REGION_COUNT];
+} memory_plan_heap_t;
+
+/*
+ * Everything the application allocates at start-up and keeps, filled by each component's *_plan_memory()
+ * from the same config it is started with. No heap is used, so a plan can be built before anything else.
+ */
+typedef struct {
+    memory_plan_config_t config;
+    memory_plan_entry_t entries[MEMORY_PLAN_MAX_ENTRIES];
+    size_t entry_count;
+    size_t required[MEMORY_PLAN_REGION_COUNT];
+} memory_plan_t;
+
+memory_plan_config_t memory_plan_default_config(void);
+
+void memory_plan_init(memory_plan_t *plan, const memory_plan_config_t *config);
+
+/* Adds `count` blocks of `size` bytes; entries with either zero are skipped. */
+esp_err_t memory_plan_add(memory_plan_t *plan, const char *name, memory_plan_region_t region, size_t size,
+                          uint32_t count);
+
+/* Drops the entries added after the first `entry_count`, e.g. an optional feature that did not fit. */
+void memory_plan_truncate(memory_plan_t *plan, size_t entry_count);
+
+static inline memory_plan_region_t memory_plan_region(bool spiram)
+{
+    return spiram ? MEMORY_PLAN_SPIRAM : MEMORY_PLAN_INTERNAL;
+}
+
+/* Free bytes and largest free block per region right now; zero for both on the linux target. */
+memory_plan_heap_t memory_plan_current_heap(void);
+
+/*
+ * True when every region's total plus its reserve is within the free memory and every block fits in the
+ * largest free block of its region.
+ */
+bool memory_plan_fits(const memory_plan_t *plan, const memory_plan_heap_t *heap);
+
+/*
+ * Logs every entry and the total per region against `heap`. Returns ESP_ERR_NO_MEM, after logging each
+ * shortfall, when a region's total plus its reserve exceeds the free memory or a single block is larger than
+ * the largest free block.
+ */
+esp_err_t memory_plan_check(const memory_plan_t *plan, const memory_plan_heap_t *heap);
+
+#ifdef __cplusplus
+}
+#endif
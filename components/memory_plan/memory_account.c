@@ -0,0 +1,210 @@
+#include "memory_account.h"
+
+#include <stdatomic.h>
+
+#include "esp_log.h"
+#include "metrics.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <malloc.h>
+#else
+#include "esp_memory_utils.h"
+#endif
+
+static const char *TAG = "memory_account";
+
+typedef struct {
+    const char *name;
+    atomic_size_t current[MEMORY_PLAN_REGION_COUNT];
+    atomic_size_t peak[MEMORY_PLAN_REGION_COUNT];
+    atomic_uint allocations;
+    atomic_uint failures;
+    atomic_uint steady_state_allocations;
+    atomic_bool reported;
+} memory_account_t;
+
+static memory_account_t s_accounts[MEMORY_ACCOUNT_COMPONENT_COUNT] = {
+    [MEMORY_ACCOUNT_CAMERA] = { .name = "camera_driver" },
+    [MEMORY_ACCOUNT_IMAGE_PROCESSING] = { .name = "image_processing" },
+    [MEMORY_ACCOUNT_CONNECTIVITY] = { .name = "connectivity" },
+};
+
+#define HEAP_GAUGE(metric_name, metric_help) { .name = metric_name, .help = metric_help, .type = METRICS_GAUGE }
+
+static metrics_metric_t s_bytes[MEMORY_ACCOUNT_COMPONENT_COUNT][MEMORY_PLAN_REGION_COUNT] = {
+    [MEMORY_ACCOUNT_CAMERA] = {
+        [MEMORY_PLAN_INTERNAL] = HEAP_GAUGE("heap_camera_internal_bytes", "Internal RAM held by camera_driver"),
+        [MEMORY_PLAN_SPIRAM] = HEAP_GAUGE("heap_camera_psram_bytes", "PSRAM held by camera_driver"),
+    },
+    [MEMORY_ACCOUNT_IMAGE_PROCESSING] = {
+        [MEMORY_PLAN_INTERNAL] = HEAP_GAUGE("heap_encoder_internal_bytes", "Internal RAM held by image_processing"),
+        [MEMORY_PLAN_SPIRAM] = HEAP_GAUGE("heap_encoder_psram_bytes", "PSRAM held by image_processing"),
+    },
+    [MEMORY_ACCOUNT_CONNECTIVITY] = {
+        [MEMORY_PLAN_INTERNAL] = HEAP_GAUGE("heap_network_internal_bytes", "Internal RAM held by connectivity"),
+        [MEMORY_PLAN_SPIRAM] = HEAP_GAUGE("heap_network_psram_bytes", "PSRAM held by connectivity"),
+    },
+};
+
+static METRICS_DEFINE_COUNTER(s_steady_state_allocations, "heap_steady_state_allocations_total",
+                              "Accounted allocations on the per-frame path after warm-up");
+
+static const char *const s_region_names[MEMORY_PLAN_REGION_COUNT] = {
+    [MEMORY_PLAN_INTERNAL] = "internal",
+    [MEMORY_PLAN_SPIRAM] = "psram",
+};
+
+static _Thread_local uint32_t s_hot_path_depth;
+static atomic_bool s_steady_state;
+#if CONFIG_MEMORY_ACCOUNT_STEADY_STATE
+static atomic_uint s_frames;
+#endif
+
+static size_t block_size(void *ptr)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return malloc_usable_size(ptr);
+#else
+    return heap_caps_get_allocated_size(ptr);
+#endif
+}
+
+static memory_plan_region_t block_region(const void *ptr)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    (void)ptr;
+    return MEMORY_PLAN_INTERNAL;
+#else
+    return memory_plan_region(esp_ptr_external_ram(ptr));
+#endif
+}
+
+static void charge(memory_account_component_t component, void *ptr)
+{
+    memory_account_t *account = &s_accounts[component];
+    memory_plan_region_t region = block_region(ptr);
+    size_t size = block_size(ptr);
+    size_t current = atomic_fetch_add_explicit(&account->current[region], size, memory_order_relaxed) + size;
+    size_t peak = atomic_load_explicit(&account->peak[region], memory_order_relaxed);
+    while (current > peak &&
+           !atomic_compare_exchange_weak_explicit(&account->peak[region], &peak, current, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+    atomic_fetch_add_explicit(&account->allocations, 1, memory_order_relaxed);
+    metrics_register(&s_bytes[component][region]);
+    metrics_gauge_add(&s_bytes[component][region], (int32_t)size);
+}
+
+static void check_steady_state(memory_account_component_t component, size_t size, const void *caller)
+{
+    if (!memory_account_in_steady_hot_path()) {
+        return;
+    }
+    memory_account_t *account = &s_accounts[component];
+    atomic_fetch_add_explicit(&account->steady_state_allocations, 1, memory_order_relaxed);
+    metrics_counter_add(&s_steady_state_allocations, 1);
+    /* Once per component; a per-frame allocation would otherwise log at the frame rate. */
+    if (!atomic_exchange(&account->reported, true)) {
+        ESP_LOGW(TAG, "%s allocated %zu bytes on the hot path after warm-up, called from %p", account->name, size,
+                 caller);
+    }
+}
+
+void *memory_account_malloc(memory_account_component_t component, size_t size, uint32_t caps)
+{
+    check_steady_state(component, size, __builtin_return_address(0));
+    void *ptr = heap_caps_malloc(size, caps);
+    if (!ptr) {
+        atomic_fetch_add_explicit(&s_accounts[component].failures, 1, memory_order_relaxed);
+        return NULL;
+    }
+    charge(component, ptr);
+    return ptr;
+}
+
+void *memory_account_calloc(memory_account_component_t component, size_t count, size_t size, uint32_t caps)
+{
+    check_steady_state(component, count * size, __builtin_return_address(0));
+    void *ptr = heap_caps_calloc(count, size, caps);
+    if (!ptr) {
+        atomic_fetch_add_explicit(&s_accounts[component].failures, 1, memory_order_relaxed);
+        return NULL;
+    }
+    charge(component, ptr);
+    return ptr;
+}
+
+void memory_account_free(memory_account_component_t component, void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    memory_plan_region_t region = block_region(ptr);
+    size_t size = block_size(ptr);
+    atomic_fetch_sub_explicit(&s_accounts[component].current[region], size, memory_order_relaxed);
+    metrics_gauge_add(&s_bytes[component][region], -(int32_t)size);
+    heap_caps_free(ptr);
+}
+
+void memory_account_get_stats(memory_account_component_t component, memory_account_stats_t *stats)
+{
+    const memory_account_t *account = &s_accounts[component];
+    for (int region = 0; region < MEMORY_PLAN_REGION_COUNT; ++region) {
+        stats->current[region] = atomic_load(&account->current[region]);
+        stats->peak[region] = atomic_load(&account->peak[region]);
+    }
+    stats->allocations = atomic_load(&account->allocations);
+    stats->failures = atomic_load(&account->failures);
+    stats->steady_state_allocations = atomic_load(&account->steady_state_allocations);
+}
+
+void memory_account_log(void)
+{
+    ESP_LOGI(TAG, "%-18s %-9s %10s %10s", "component", "region", "current", "peak");
+    for (int component = 0; component < MEMORY_ACCOUNT_COMPONENT_COUNT; ++component) {
+        memory_account_stats_t stats;
+        memory_account_get_stats(component, &stats);
+        for (int region = 0; region < MEMORY_PLAN_REGION_COUNT; ++region) {
+            ESP_LOGI(TAG, "%-18s %-9s %10zu %10zu", s_accounts[component].name, s_region_names[region],
+                     stats.current[region], stats.peak[region]);
+        }
+    }
+}
+
+void memory_account_enter_hot_path(void)
+{
+    ++s_hot_path_depth;
+}
+
+void memory_account_leave_hot_path(void)
+{
+    if (s_hot_path_depth > 0) {
+        --s_hot_path_depth;
+    }
+}
+
+bool memory_account_in_steady_hot_path(void)
+{
+    return s_hot_path_depth > 0 && atomic_load_explicit(&s_steady_state, memory_order_relaxed);
+}
+
+void memory_account_begin_steady_state(void)
+{
+    metrics_register(&s_steady_state_allocations);
+    if (atomic_exchange(&s_steady_state, true)) {
+        return;
+    }
+    ESP_LOGI(TAG, "Steady state: allocations on the hot path are now reported");
+    memory_account_log();
+}
+
+void memory_account_note_frame(void)
+{
+#if CONFIG_MEMORY_ACCOUNT_STEADY_STATE
+    /* From the frame after the last warm-up one, so everything downstream of it is steady state too. */
+    if (atomic_fetch_add_explicit(&s_frames, 1, memory_order_relaxed) == CONFIG_MEMORY_ACCOUNT_WARMUP_FRAMES) {
+        memory_account_begin_steady_state();
+    }
+#endif
+}
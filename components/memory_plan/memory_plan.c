@@ -0,0 +1,133 @@
+#include "memory_plan.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "memory_plan";
+
+static const char *const s_region_names[MEMORY_PLAN_REGION_COUNT] = {
+    [MEMORY_PLAN_INTERNAL] = "internal",
+    [MEMORY_PLAN_SPIRAM] = "psram",
+};
+
+memory_plan_config_t memory_plan_default_config(void)
+{
+    return (memory_plan_config_t) {
+        .reserve = {
+            [MEMORY_PLAN_INTERNAL] = 96 * 1024,
+            [MEMORY_PLAN_SPIRAM] = 512 * 1024,
+        },
+    };
+}
+
+void memory_plan_init(memory_plan_t *plan, const memory_plan_config_t *config)
+{
+    memset(plan, 0, sizeof(*plan));
+    plan->config = *config;
+}
+
+esp_err_t memory_plan_add(memory_plan_t *plan, const char *name, memory_plan_region_t region, size_t size,
+                          uint32_t count)
+{
+    if (!plan || !name || region >= MEMORY_PLAN_REGION_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (size == 0 || count == 0) {
+        return ESP_OK;
+    }
+    if (plan->entry_count >= MEMORY_PLAN_MAX_ENTRIES) {
+        ESP_LOGE(TAG, "No room in the plan for %s", name);
+        return ESP_ERR_NO_MEM;
+    }
+    plan->entries[plan->entry_count++] = (memory_plan_entry_t) {
+        .name = name,
+        .region = region,
+        .size = size,
+        .count = count,
+    };
+    plan->required[region] += size * count;
+    return ESP_OK;
+}
+
+void memory_plan_truncate(memory_plan_t *plan, size_t entry_count)
+{
+    while (plan->entry_count > entry_count) {
+        const memory_plan_entry_t *entry = &plan->entries[--plan->entry_count];
+        plan->required[entry->region] -= entry->size * entry->count;
+    }
+}
+
+memory_plan_heap_t memory_plan_current_heap(void)
+{
+    memory_plan_heap_t heap = {0};
+#if !CONFIG_IDF_TARGET_LINUX
+    static const uint32_t caps[MEMORY_PLAN_REGION_COUNT] = {
+        [MEMORY_PLAN_INTERNAL] = MEMORY_PLAN_HOT_CAPS,
+        [MEMORY_PLAN_SPIRAM] = MEMORY_PLAN_BULK_CAPS,
+    };
+    for (int region = 0; region < MEMORY_PLAN_REGION_COUNT; ++region) {
+        heap.free[region] = heap_caps_get_free_size(caps[region]);
+        heap.largest_block[region] = heap_caps_get_largest_free_block(caps[region]);
+    }
+#endif
+    return heap;
+}
+
+static bool entry_fits(const memory_plan_entry_t *entry, const memory_plan_heap_t *heap)
+{
+    return entry->size <= heap->largest_block[entry->region];
+}
+
+static bool region_fits(const memory_plan_t *plan, const memory_plan_heap_t *heap, int region)
+{
+    return plan->required[region] + plan->config.reserve[region] <= heap->free[region];
+}
+
+bool memory_plan_fits(const memory_plan_t *plan, const memory_plan_heap_t *heap)
+{
+    for (size_t i = 0; i < plan->entry_count; ++i) {
+        if (!entry_fits(&plan->entries[i], heap)) {
+            return false;
+        }
+    }
+    for (int region = 0; region < MEMORY_PLAN_REGION_COUNT; ++region) {
+        if (!region_fits(plan, heap, region)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t memory_plan_check(const memory_plan_t *plan, const memory_plan_heap_t *heap)
+{
+    if (!plan || !heap) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bool fits = true;
+    for (size_t i = 0; i < plan->entry_count; ++i) {
+        const memory_plan_entry_t *entry = &plan->entries[i];
+        ESP_LOGI(TAG, "%-24s %-8s %8zu x %-4u %9zu", entry->name, s_region_names[entry->region], entry->size,
+                 (unsigned)entry->count, entry->size * entry->count);
+        if (!entry_fits(entry, heap)) {
+            ESP_LOGE(TAG, "%s needs %zu contiguous bytes of %s, the largest free block is %zu", entry->name,
+                     entry->size, s_region_names[entry->region], heap->largest_block[entry->region]);
+            fits = false;
+        }
+    }
+    for (int region = 0; region < MEMORY_PLAN_REGION_COUNT; ++region) {
+        size_t needed = plan->required[region] + plan->config.reserve[region];
+        if (!region_fits(plan, heap, region)) {
+            ESP_LOGE(TAG, "%s: %zu bytes planned + %zu reserved, only %zu free (%zu short)", s_region_names[region],
+                     plan->required[region], plan->config.reserve[region], heap->free[region],
+                     needed - heap->free[region]);
+            fits = false;
+        } else {
+            ESP_LOGI(TAG, "%s: %zu bytes planned + %zu reserved of %zu free", s_region_names[region],
+                     plan->required[region], plan->config.reserve[region], heap->free[region]);
+        }
+    }
+    return fits ? ESP_OK : ESP_ERR_NO_MEM;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    METRICS_COUNTER,
+    METRICS_GAUGE,
+    METRICS_HISTOGRAM,
+} metrics_type_t;
+
+/*
+ * One metric, usually defined statically with the METRICS_DEFINE_* macros and registered once at start-up.
+ * Values are 32-bit atomics so every update is lock-free on the P4; a counter that wraps reads as a counter
+ * reset, which Prometheus rate() and increase() already handle.
+ */
+typedef struct metrics_metric_t {
+    const char *name;
+    const char *help;
+    metrics_type_t type;
+    const uint32_t *bounds;
+    size_t bound_count;
+    atomic_uint *buckets;
+    atomic_uint value;
+    atomic_bool registered;
+    struct metrics_metric_t *next;
+} metrics_metric_t;
+
+#define METRICS_DEFINE_COUNTER(var, metric_name, metric_help) \
+    metrics_metric_t var = { .name = metric_name, .help = metric_help, .type = METRICS_COUNTER }
+
+#define METRICS_DEFINE_GAUGE(var, metric_name, metric_help) \
+    metrics_metric_t var = { .name = metric_name, .help = metric_help, .type = METRICS_GAUGE }
+
+#define METRICS_BOUND_COUNT(...) (sizeof((const uint32_t[]){ __VA_ARGS__ }) / sizeof(uint32_t))
+
+/* Bucket upper bounds are given in ascending order; the +Inf bucket is implicit. Use at file scope only. */
+#define METRICS_DEFINE_HISTOGRAM(var, metric_name, metric_help, ...)                                         \
+    metrics_metric_t var = {                                                                                 \
+        .name = metric_name,                                                                                 \
+        .help = metric_help,                                                                                 \
+        .type = METRICS_HISTOGRAM,                                                                           \
+        .bounds = (const uint32_t[]){ __VA_ARGS__ },                                                         \
+        .bound_count = METRICS_BOUND_COUNT(__VA_ARGS__),                                                     \
+        .buckets = (atomic_uint[METRICS_BOUND_COUNT(__VA_ARGS__) + 1]){ 0 },                                 \
+    }
+
+/* Adds the metric to the export list; registering the same metric again does nothing. */
+void metrics_register(metrics_metric_t *metric);
+
+static inline void metrics_counter_add(metrics_metric_t *metric, uint32_t delta)
+{
+    atomic_fetch_add_explicit(&metric->value, delta, memory_order_relaxed);
+}
+
+static inline void metrics_gauge_set(metrics_metric_t *metric, int32_t value)
+{
+    atomic_store_explicit(&metric->value, (uint32_t)value, memory_order_relaxed);
+}
+
+static inline void metrics_gauge_add(metrics_metric_t *metric, int32_t delta)
+{
+    atomic_fetch_add_explicit(&metric->value, (uint32_t)delta, memory_order_relaxed);
+}
+
+void metrics_histogram_observe(metrics_metric_t *metric, uint32_t value);
+
+/*
+ * Writes every registered metric in the Prometheus text exposition format. Like snprintf(), returns the full
+ * length, which may exceed `size`; the output is truncated but always NUL-terminated when size > 0.
+ */
+size_t metrics_format_prometheus(char *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,105 @@
+#include "metrics.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+/* Registration only ever pushes at the head, so exporters can walk the list without a lock. */
+static metrics_metric_t *_Atomic s_metrics;
+
+void metrics_register(metrics_metric_t *metric)
+{
+    if (!metric || atomic_exchange(&metric->registered, true)) {
+        return;
+    }
+    metrics_metric_t *head = atomic_load(&s_metrics);
+    do {
+        metric->next = head;
+    } while (!atomic_compare_exchange_weak(&s_metrics, &head, metric));
+}
+
+void metrics_histogram_observe(metrics_metric_t *metric, uint32_t value)
+{
+    size_t bucket = 0;
+    while (bucket < metric->bound_count && value > metric->bounds[bucket]) {
+        ++bucket;
+    }
+    atomic_fetch_add_explicit(&metric->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metric->value, value, memory_order_relaxed);
+}
+
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+} metrics_writer_t;
+
+static void writer_printf(metrics_writer_t *writer, const char *format, ...)
+{
+    size_t offset = writer->length < writer->size ? writer->length : writer->size;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(writer->buffer ? writer->buffer + offset : NULL, writer->size - offset, format, args);
+    va_end(args);
+    if (written > 0) {
+        writer->length += (size_t)written;
+    }
+}
+
+static const char *type_name(metrics_type_t type)
+{
+    switch (type) {
+    case METRICS_COUNTER:
+        return "counter";
+    case METRICS_GAUGE:
+        return "gauge";
+    case METRICS_HISTOGRAM:
+        return "histogram";
+    }
+    return "untyped";
+}
+
+static void format_histogram(metrics_writer_t *writer, const metrics_metric_t *metric)
+{
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i <= metric->bound_count; ++i) {
+        cumulative += atomic_load_explicit(&metric->buckets[i], memory_order_relaxed);
+        if (i < metric->bound_count) {
+            writer_printf(writer, "%s_bucket{le=\"%" PRIu32 "\"} %" PRIu32 "\n", metric->name, metric->bounds[i],
+                          cumulative);
+        } else {
+            writer_printf(writer, "%s_bucket{le=\"+Inf\"} %" PRIu32 "\n", metric->name, cumulative);
+        }
+    }
+    writer_printf(writer, "%s_sum %" PRIu32 "\n", metric->name, atomic_load_explicit(&metric->value, memory_order_relaxed));
+    writer_printf(writer, "%s_count %" PRIu32 "\n", metric->name, cumulative);
+}
+
+size_t metrics_format_prometheus(char *buffer, size_t size)
+{
+    metrics_writer_t writer = {
+        .buffer = size ? buffer : NULL,
+        .size = size,
+    };
+    if (writer.buffer) {
+        writer.buffer[0] = '\0';
+    }
+
+    for (const metrics_metric_t *metric = atomic_load(&s_metrics); metric; metric = metric->next) {
+        writer_printf(&writer, "# HELP %s %s\n# TYPE %s %s\n", metric->name, metric->help, metric->name,
+                      type_name(metric->type));
+        uint32_t value = atomic_load_explicit(&metric->value, memory_order_relaxed);
+        switch (metric->type) {
+        case METRICS_COUNTER:
+            writer_printf(&writer, "%s %" PRIu32 "\n", metric->name, value);
+            break;
+        case METRICS_GAUGE:
+            writer_printf(&writer, "%s %" PRId32 "\n", metric->name, (int32_t)value);
+            break;
+        case METRICS_HISTOGRAM:
+            format_histogram(&writer, metric);
+            break;
+        }
+    }
+    return writer.length;
+}
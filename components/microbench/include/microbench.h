@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    /* Back-to-back calls with the input and code already cached. */
+    MICROBENCH_CACHE_WARM,
+    /* Every call starts after reading eviction_size bytes of unrelated memory. */
+    MICROBENCH_CACHE_COLD,
+} microbench_cache_t;
+
+/*
+ * One kernel. setup() allocates and fills the input once; run() is the measured call and must do the same
+ * work every time. `bytes` is what one call processes. `pixels` is the picture size the input stands for,
+ * zero for kernels that are not per frame.
+ */
+typedef struct microbench_case_t {
+    const char *name;
+    size_t bytes;
+    size_t pixels;
+    esp_err_t (*setup)(void **out_ctx);
+    void (*run)(void *ctx);
+    void (*teardown)(void *ctx);
+} microbench_case_t;
+
+typedef struct {
+    uint32_t iterations;
+    uint32_t warmup_iterations;
+    microbench_cache_t cache;
+    size_t eviction_size;
+} microbench_config_t;
+
+typedef struct {
+    uint32_t iterations;
+    /* Calls per timed sample; warm runs batch short kernels so timer overhead stays out of the figures. */
+    uint32_t batch;
+    double median_ns;
+    double min_ns;
+    double mean_ns;
+    double stddev_ns;
+    /* From the median; zero when the case has no byte or pixel count. */
+    double ns_per_byte;
+    /* Zero on the linux target, which has no cycle counter to read. */
+    double cycles_per_pixel;
+} microbench_result_t;
+
+microbench_config_t microbench_default_config(void);
+
+esp_err_t microbench_run(const microbench_config_t *config, const microbench_case_t *bench_case,
+                         microbench_result_t *result);
+
+/* Runs every case whose name contains `filter` (all of them when NULL) and prints one line per case. */
+esp_err_t microbench_run_suite(const microbench_config_t *config, const microbench_case_t *cases, size_t count,
+                               const char *filter);
+
+/* Smallest length microbench_fill_access_unit() accepts. */
+#define MICROBENCH_MIN_ACCESS_UNIT_SIZE 64
+
+/*
+ * Writes an Annex-B IDR access unit of exactly `length` bytes: SPS, PPS and one slice of fixed-seed
+ * pseudo-random bytes that, like entropy-coded data after emulation prevention, never contain 00 00 0x for
+ * x <= 3.
+ */
+void microbench_fill_access_unit(uint8_t *data, size_t length, uint32_t seed);
+
+#ifdef __cplusplus
+}
+#endif
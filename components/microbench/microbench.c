@@ -0,0 +1,271 @@
+#include "microbench.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_private/esp_clk.h"
+#endif
+
+static const char *TAG = "microbench";
+
+/* Warm samples are at least this long, so reading the timer is noise. */
+#define MICROBENCH_MIN_SAMPLE_US    20
+#define MICROBENCH_MAX_BATCH        4096
+#define MICROBENCH_CACHE_LINE_SIZE  64
+
+#if CONFIG_IDF_TARGET_LINUX
+/* Past the last-level cache of current desktop and server parts. */
+#define MICROBENCH_EVICTION_SIZE    (64 * 1024 * 1024)
+
+typedef uint64_t microbench_ticks_t;
+
+static microbench_ticks_t read_ticks(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t ticks_per_second(void)
+{
+    return 1000000000ULL;
+}
+
+static uint8_t *alloc_eviction_buffer(size_t size)
+{
+    return malloc(size);
+}
+
+static void free_eviction_buffer(uint8_t *buffer)
+{
+    free(buffer);
+}
+#else
+/* Twice the largest L2 cache the P4 can be configured with. */
+#define MICROBENCH_EVICTION_SIZE    (1024 * 1024)
+
+/* The 32-bit cycle counter wraps every few seconds; samples are far shorter, so differences stay exact. */
+typedef uint32_t microbench_ticks_t;
+
+static microbench_ticks_t read_ticks(void)
+{
+    return esp_cpu_get_cycle_count();
+}
+
+static uint64_t ticks_per_second(void)
+{
+    return (uint64_t)esp_clk_cpu_freq();
+}
+
+/* In PSRAM, so reading it pushes everything else out of L2 as well as L1. */
+static uint8_t *alloc_eviction_buffer(size_t size)
+{
+    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+}
+
+static void free_eviction_buffer(uint8_t *buffer)
+{
+    heap_caps_free(buffer);
+}
+#endif
+
+microbench_config_t microbench_default_config(void)
+{
+    return (microbench_config_t) {
+        .iterations = 200,
+        .warmup_iterations = 20,
+        .cache = MICROBENCH_CACHE_WARM,
+        .eviction_size = MICROBENCH_EVICTION_SIZE,
+    };
+}
+
+/* 1080p High profile SPS and PPS, then the IDR slice header byte. */
+static const uint8_t s_access_unit_prefix[] = {
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x28, 0xac, 0xd9, 0x40, 0x78, 0x02, 0x27, 0xe5, 0x84,
+    0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0,
+    0x00, 0x00, 0x00, 0x01, 0x65,
+};
+
+void microbench_fill_access_unit(uint8_t *data, size_t length, uint32_t seed)
+{
+    if (length < MICROBENCH_MIN_ACCESS_UNIT_SIZE) {
+        return;
+    }
+    memcpy(data, s_access_unit_prefix, sizeof(s_access_unit_prefix));
+    uint32_t state = seed ? seed : 1;
+    for (size_t i = sizeof(s_access_unit_prefix); i < length; ++i) {
+        state = state * 1664525u + 1013904223u;
+        data[i] = (uint8_t)(state >> 24);
+        if (i >= 2 && data[i - 2] == 0 && data[i - 1] == 0 && data[i] <= 3) {
+            data[i] = 0x03;
+        }
+    }
+}
+
+static void evict_caches(const uint8_t *buffer, size_t length)
+{
+    volatile uint8_t sink = 0;
+    for (size_t i = 0; i < length; i += MICROBENCH_CACHE_LINE_SIZE) {
+        sink += buffer[i];
+    }
+    (void)sink;
+}
+
+static int compare_ticks(const void *a, const void *b)
+{
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+    return (left > right) - (left < right);
+}
+
+static uint64_t time_calls(const microbench_case_t *bench_case, void *ctx, uint32_t calls)
+{
+    microbench_ticks_t start = read_ticks();
+    for (uint32_t i = 0; i < calls; ++i) {
+        bench_case->run(ctx);
+    }
+    return (microbench_ticks_t)(read_ticks() - start);
+}
+
+/* Enough calls per sample to reach MICROBENCH_MIN_SAMPLE_US, measured on a cached call. */
+static uint32_t calibrate_batch(const microbench_case_t *bench_case, void *ctx)
+{
+    uint64_t target = ticks_per_second() * MICROBENCH_MIN_SAMPLE_US / 1000000;
+    uint64_t single = time_calls(bench_case, ctx, 1);
+    if (single == 0) {
+        single = 1;
+    }
+    uint64_t batch = (target + single - 1) / single;
+    return batch > MICROBENCH_MAX_BATCH ? MICROBENCH_MAX_BATCH : (uint32_t)batch;
+}
+
+esp_err_t microbench_run(const microbench_config_t *config, const microbench_case_t *bench_case,
+                         microbench_result_t *result)
+{
+    if (!config || !bench_case || !bench_case->run || !result || config->iterations == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    void *ctx = NULL;
+    if (bench_case->setup) {
+        esp_err_t err = bench_case->setup(&ctx);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    uint64_t *samples = malloc(config->iterations * sizeof(uint64_t));
+    uint8_t *eviction = NULL;
+    if (config->cache == MICROBENCH_CACHE_COLD) {
+        eviction = alloc_eviction_buffer(config->eviction_size);
+    }
+    if (!samples || (config->cache == MICROBENCH_CACHE_COLD && !eviction)) {
+        free(samples);
+        free_eviction_buffer(eviction);
+        if (bench_case->teardown) {
+            bench_case->teardown(ctx);
+        }
+        return ESP_ERR_NO_MEM;
+    }
+    if (eviction) {
+        memset(eviction, 0x5a, config->eviction_size);
+    }
+
+    for (uint32_t i = 0; i < config->warmup_iterations; ++i) {
+        bench_case->run(ctx);
+    }
+    uint32_t batch = eviction ? 1 : calibrate_batch(bench_case, ctx);
+    for (uint32_t i = 0; i < config->iterations; ++i) {
+        if (eviction) {
+            evict_caches(eviction, config->eviction_size);
+        }
+        samples[i] = time_calls(bench_case, ctx, batch);
+    }
+
+    qsort(samples, config->iterations, sizeof(uint64_t), compare_ticks);
+    double sum = 0;
+    for (uint32_t i = 0; i < config->iterations; ++i) {
+        sum += (double)samples[i];
+    }
+    double mean = sum / config->iterations;
+    double squares = 0;
+    for (uint32_t i = 0; i < config->iterations; ++i) {
+        double deviation = (double)samples[i] - mean;
+        squares += deviation * deviation;
+    }
+
+    const double ns_per_tick = 1e9 / (double)ticks_per_second() / batch;
+    const double median_ticks = (double)samples[config->iterations / 2] / batch;
+    *result = (microbench_result_t) {
+        .iterations = config->iterations,
+        .batch = batch,
+        .median_ns = samples[config->iterations / 2] * ns_per_tick,
+        .min_ns = samples[0] * ns_per_tick,
+        .mean_ns = mean * ns_per_tick,
+        .stddev_ns = sqrt(squares / config->iterations) * ns_per_tick,
+    };
+    if (bench_case->bytes) {
+        result->ns_per_byte = result->median_ns / bench_case->bytes;
+    }
+#if !CONFIG_IDF_TARGET_LINUX
+    if (bench_case->pixels) {
+        result->cycles_per_pixel = median_ticks / bench_case->pixels;
+    }
+#else
+    (void)median_ticks;
+#endif
+
+    free(samples);
+    free_eviction_buffer(eviction);
+    if (bench_case->teardown) {
+        bench_case->teardown(ctx);
+    }
+    return ESP_OK;
+}
+
+esp_err_t microbench_run_suite(const microbench_config_t *config, const microbench_case_t *cases, size_t count,
+                               const char *filter)
+{
+    esp_err_t status = ESP_OK;
+    bool header_printed = false;
+    for (size_t i = 0; i < count; ++i) {
+        if (filter && !strstr(cases[i].name, filter)) {
+            continue;
+        }
+        if (!header_printed) {
+            printf("%-24s %9s %11s %11s %9s %8s %7s\n", "kernel", "bytes", "median ns", "min ns", "ns/byte", "cyc/px",
+                   "cv %");
+            header_printed = true;
+        }
+        microbench_result_t result;
+        esp_err_t err = microbench_run(config, &cases[i], &result);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "%s: %s", cases[i].name, esp_err_to_name(err));
+            status = err;
+            continue;
+        }
+        /* Figures that do not apply, such as cycles on the host, print as "-". */
+        char per_byte[16] = "-";
+        char per_pixel[16] = "-";
+        if (result.ns_per_byte > 0) {
+            snprintf(per_byte, sizeof(per_byte), "%.3f", result.ns_per_byte);
+        }
+        if (result.cycles_per_pixel > 0) {
+            snprintf(per_pixel, sizeof(per_pixel), "%.3f", result.cycles_per_pixel);
+        }
+        printf("%-24s %9zu %11.1f %11.1f %9s %8s %7.2f\n", cases[i].name, cases[i].bytes, result.median_ns,
+               result.min_ns, per_byte, per_pixel, result.mean_ns > 0 ? 100.0 * result.stddev_ns / result.mean_ns : 0.0);
+    }
+    return status;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#include "camera_driver.h"
+#include "image_processing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PIPELINE_MAX_STAGES 16
+
+typedef struct pipeline_context_t *pipeline_handle_t;
+
+typedef enum {
+    PIPELINE_ITEM_NONE,
+    PIPELINE_ITEM_RAW_FRAME,
+    PIPELINE_ITEM_H264_PACKET,
+} pipeline_item_type_t;
+
+typedef enum {
+    PIPELINE_STAGE_SOURCE,
+    PIPELINE_STAGE_FILTER,
+    PIPELINE_STAGE_ENCODER,
+    PIPELINE_STAGE_SINK,
+    PIPELINE_STAGE_TEE,
+} pipeline_stage_type_t;
+
+/* What a full input channel does with the next item. */
+typedef enum {
+    PIPELINE_DROP_NEWEST,
+    PIPELINE_DROP_OLDEST,
+    PIPELINE_DROP_TO_KEYFRAME,
+    PIPELINE_DROP_NEVER,
+} pipeline_drop_policy_t;
+
+typedef struct pipeline_buffer_t {
+    pipeline_item_type_t type;
+    union {
+        camera_frame_t frame;
+        h264_packet_t packet;
+    };
+    /* Set by the producing stage; called when the last stage lets go of the buffer. */
+    void (*release)(void *release_ctx, struct pipeline_buffer_t *buffer);
+    void *release_ctx;
+    atomic_uint refcount;
+    struct pipeline_context_t *owner;
+} pipeline_buffer_t;
+
+/*
+ * Sources get only `output`, sinks and filters only `input`, encoders both. Returning anything but ESP_OK
+ * drops the item; a filter that returns ESP_OK forwards its input unchanged.
+ */
+typedef esp_err_t (*pipeline_process_fn_t)(void *user_ctx, pipeline_buffer_t *input, pipeline_buffer_t *output);
+
+typedef struct {
+    const char *name;
+    pipeline_stage_type_t type;
+    const char *input;
+    pipeline_item_type_t input_type;
+    pipeline_item_type_t output_type;
+    pipeline_process_fn_t process;
+    void *user_ctx;
+    struct {
+        uint32_t length;
+        pipeline_drop_policy_t drop_policy;
+    } channel;
+    struct {
+        UBaseType_t priority;
+        BaseType_t core_id;
+        uint32_t stack_size;
+    } task;
+} pipeline_stage_config_t;
+
+typedef struct {
+    const pipeline_stage_config_t *stages;
+    size_t stage_count;
+    uint32_t report_interval_ms;
+} pipeline_config_t;
+
+typedef struct {
+    uint64_t busy_us;
+    uint64_t idle_us;
+    uint64_t blocked_us;
+    uint32_t items;
+    uint32_t dropped;
+} pipeline_stage_stats_t;
+
+pipeline_config_t pipeline_default_config(void);
+
+/*
+ * Builds the graph described by config->stages and starts one task per stage except tees. Each stage names
+ * its upstream stage in `input`; only tees may have more than one downstream stage, and they hand the same
+ * buffer to each of them by reference. Stage names must outlive the pipeline.
+ */
+esp_err_t pipeline_start(const pipeline_config_t *config, pipeline_handle_t *out_handle);
+void pipeline_stop(pipeline_handle_t handle);
+
+esp_err_t pipeline_get_stage_stats(pipeline_handle_t handle, const char *name, pipeline_stage_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
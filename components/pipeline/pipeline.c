@@ -0,0 +1,471 @@
+#include "pipeline.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "memory_account.h"
+
+static const char *TAG = "pipeline";
+
+#define PIPELINE_POLL_MS 100
+
+typedef struct {
+    pipeline_stage_config_t config;
+    struct pipeline_context_t *pipeline;
+    size_t outputs[PIPELINE_MAX_STAGES];
+    size_t output_count;
+    QueueHandle_t channel;
+    bool wait_keyframe;
+    pipeline_stage_stats_t stats;
+    pipeline_stage_stats_t reported;
+    int64_t last_report_us;
+} pipeline_node_t;
+
+struct pipeline_context_t {
+    pipeline_config_t config;
+    pipeline_node_t nodes[PIPELINE_MAX_STAGES];
+    size_t node_count;
+    pipeline_buffer_t *buffers;
+    QueueHandle_t free_buffers;
+    portMUX_TYPE stats_lock;
+    volatile bool stopping;
+    uint32_t task_count;
+    TaskHandle_t stop_waiter;
+};
+
+pipeline_config_t pipeline_default_config(void)
+{
+    return (pipeline_config_t) {
+        .stages = NULL,
+        .stage_count = 0,
+        .report_interval_ms = 10000,
+    };
+}
+
+static bool runs_task(const pipeline_node_t *node)
+{
+    return node->config.type != PIPELINE_STAGE_TEE;
+}
+
+static bool has_output(const pipeline_node_t *node)
+{
+    return node->config.type != PIPELINE_STAGE_SINK;
+}
+
+static pipeline_buffer_t *buffer_acquire(pipeline_handle_t handle)
+{
+    pipeline_buffer_t *buffer = NULL;
+    while (!handle->stopping) {
+        if (xQueueReceive(handle->free_buffers, &buffer, pdMS_TO_TICKS(PIPELINE_POLL_MS)) == pdTRUE) {
+            memset(buffer, 0, sizeof(*buffer));
+            buffer->owner = handle;
+            atomic_init(&buffer->refcount, 1);
+            return buffer;
+        }
+    }
+    return NULL;
+}
+
+static pipeline_buffer_t *buffer_ref(pipeline_buffer_t *buffer)
+{
+    atomic_fetch_add_explicit(&buffer->refcount, 1, memory_order_relaxed);
+    return buffer;
+}
+
+static void buffer_unref(pipeline_buffer_t *buffer)
+{
+    if (!buffer || atomic_fetch_sub_explicit(&buffer->refcount, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (buffer->release) {
+        buffer->release(buffer->release_ctx, buffer);
+    }
+    xQueueSend(buffer->owner->free_buffers, &buffer, 0);
+}
+
+static void count_drop(pipeline_handle_t handle, pipeline_node_t *node)
+{
+    portENTER_CRITICAL(&handle->stats_lock);
+    ++node->stats.dropped;
+    portEXIT_CRITICAL(&handle->stats_lock);
+}
+
+static bool is_keyframe(const pipeline_buffer_t *buffer)
+{
+    return buffer->type == PIPELINE_ITEM_H264_PACKET && buffer->packet.is_keyframe;
+}
+
+/* Only the single upstream stage ever sends to a channel, so the drop state needs no lock. */
+static void channel_push(pipeline_handle_t handle, pipeline_node_t *node, pipeline_buffer_t *buffer)
+{
+    if (node->wait_keyframe) {
+        if (!is_keyframe(buffer)) {
+            count_drop(handle, node);
+            return;
+        }
+        node->wait_keyframe = false;
+    }
+
+    buffer_ref(buffer);
+    switch (node->config.channel.drop_policy) {
+    case PIPELINE_DROP_NEVER:
+        while (xQueueSend(node->channel, &buffer, pdMS_TO_TICKS(PIPELINE_POLL_MS)) != pdTRUE) {
+            if (handle->stopping) {
+                buffer_unref(buffer);
+                return;
+            }
+        }
+        return;
+    case PIPELINE_DROP_OLDEST:
+        if (xQueueSend(node->channel, &buffer, 0) != pdTRUE) {
+            pipeline_buffer_t *oldest = NULL;
+            if (xQueueReceive(node->channel, &oldest, 0) == pdTRUE) {
+                buffer_unref(oldest);
+                count_drop(handle, node);
+            }
+            xQueueSend(node->channel, &buffer, 0);
+        }
+        return;
+    case PIPELINE_DROP_TO_KEYFRAME:
+    case PIPELINE_DROP_NEWEST:
+        if (xQueueSend(node->channel, &buffer, 0) != pdTRUE) {
+            node->wait_keyframe = node->config.channel.drop_policy == PIPELINE_DROP_TO_KEYFRAME;
+            buffer_unref(buffer);
+            count_drop(handle, node);
+        }
+        return;
+    }
+}
+
+static void deliver(pipeline_handle_t handle, pipeline_node_t *node, pipeline_buffer_t *buffer)
+{
+    for (size_t i = 0; i < node->output_count; ++i) {
+        pipeline_node_t *consumer = &handle->nodes[node->outputs[i]];
+        if (consumer->config.type == PIPELINE_STAGE_TEE) {
+            deliver(handle, consumer, buffer);
+        } else {
+            channel_push(handle, consumer, buffer);
+        }
+    }
+}
+
+static void report_stats(pipeline_handle_t handle, pipeline_node_t *node, int64_t now_us)
+{
+    if (handle->config.report_interval_ms == 0 ||
+        now_us - node->last_report_us < (int64_t)handle->config.report_interval_ms * 1000) {
+        return;
+    }
+    node->last_report_us = now_us;
+
+    pipeline_stage_stats_t current;
+    portENTER_CRITICAL(&handle->stats_lock);
+    current = node->stats;
+    portEXIT_CRITICAL(&handle->stats_lock);
+
+    uint64_t busy_us = current.busy_us - node->reported.busy_us;
+    uint64_t blocked_us = current.blocked_us - node->reported.blocked_us;
+    uint64_t total_us = busy_us + blocked_us + current.idle_us - node->reported.idle_us;
+    ESP_LOGI(TAG, "%s: %" PRIu32 " items, busy %u%%, blocked %u%%, %" PRIu32 " dropped", node->config.name,
+             current.items - node->reported.items, total_us ? (unsigned)(busy_us * 100 / total_us) : 0,
+             total_us ? (unsigned)(blocked_us * 100 / total_us) : 0, current.dropped - node->reported.dropped);
+    node->reported = current;
+}
+
+static void stage_task(void *arg)
+{
+    pipeline_node_t *node = (pipeline_node_t *)arg;
+    pipeline_handle_t handle = node->pipeline;
+    const pipeline_stage_config_t *config = &node->config;
+    bool is_source = config->type == PIPELINE_STAGE_SOURCE;
+
+    while (!handle->stopping) {
+        int64_t wait_start = esp_timer_get_time();
+        pipeline_buffer_t *input = NULL;
+        if (!is_source && xQueueReceive(node->channel, &input, pdMS_TO_TICKS(PIPELINE_POLL_MS)) != pdTRUE) {
+            portENTER_CRITICAL(&handle->stats_lock);
+            node->stats.idle_us += esp_timer_get_time() - wait_start;
+            portEXIT_CRITICAL(&handle->stats_lock);
+            continue;
+        }
+
+        pipeline_buffer_t *output = NULL;
+        if (is_source || config->type == PIPELINE_STAGE_ENCODER) {
+            output = buffer_acquire(handle);
+            if (!output) {
+                buffer_unref(input);
+                break;
+            }
+            output->type = config->output_type;
+        }
+
+        int64_t work_start = esp_timer_get_time();
+        memory_account_enter_hot_path();
+        esp_err_t err = config->process(config->user_ctx, input, output);
+        int64_t deliver_start = esp_timer_get_time();
+        pipeline_buffer_t *result = config->type == PIPELINE_STAGE_FILTER ? input : output;
+        if (err == ESP_OK && result) {
+            deliver(handle, node, result);
+        }
+        buffer_unref(input);
+        buffer_unref(output);
+        memory_account_leave_hot_path();
+        int64_t now = esp_timer_get_time();
+
+        portENTER_CRITICAL(&handle->stats_lock);
+        /* A source spends its callback waiting for data, so that time counts as idle. */
+        if (is_source) {
+            node->stats.idle_us += deliver_start - wait_start;
+        } else {
+            node->stats.idle_us += work_start - wait_start;
+            node->stats.busy_us += deliver_start - work_start;
+        }
+        node->stats.blocked_us += now - deliver_start;
+        if (err == ESP_OK) {
+            ++node->stats.items;
+        } else if (!is_source) {
+            ++node->stats.dropped;
+        }
+        portEXIT_CRITICAL(&handle->stats_lock);
+        report_stats(handle, node, now);
+    }
+
+    xTaskNotifyGive(handle->stop_waiter);
+    vTaskDelete(NULL);
+}
+
+static pipeline_node_t *find_node(pipeline_handle_t handle, const char *name)
+{
+    for (size_t i = 0; i < handle->node_count; ++i) {
+        if (strcmp(handle->nodes[i].config.name, name) == 0) {
+            return &handle->nodes[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t check_stage(const pipeline_stage_config_t *stage)
+{
+    if (!stage->name) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool needs_process = stage->type != PIPELINE_STAGE_TEE;
+    bool needs_input = stage->type != PIPELINE_STAGE_SOURCE;
+    if ((needs_process && !stage->process) || (needs_input != (stage->input != NULL))) {
+        ESP_LOGE(TAG, "Stage %s is missing its callback or has a wrong input", stage->name);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (needs_process && needs_input && stage->channel.length == 0) {
+        ESP_LOGE(TAG, "Stage %s needs a channel length", stage->name);
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+/* Links every stage to its upstream and settles the item type carried by each edge. */
+static esp_err_t link_graph(pipeline_handle_t handle)
+{
+    for (size_t i = 0; i < handle->node_count; ++i) {
+        pipeline_node_t *node = &handle->nodes[i];
+        if (find_node(handle, node->config.name) != node) {
+            ESP_LOGE(TAG, "Duplicate stage %s", node->config.name);
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (!node->config.input) {
+            continue;
+        }
+        pipeline_node_t *upstream = find_node(handle, node->config.input);
+        if (!upstream || upstream == node || !has_output(upstream)) {
+            ESP_LOGE(TAG, "Stage %s has no valid input %s", node->config.name, node->config.input);
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (upstream->output_count > 0 && upstream->config.type != PIPELINE_STAGE_TEE) {
+            ESP_LOGE(TAG, "Stage %s feeds several stages; branch through a tee", upstream->config.name);
+            return ESP_ERR_INVALID_ARG;
+        }
+        upstream->outputs[upstream->output_count++] = i;
+    }
+
+    /* Types flow downstream from the sources; anything left unresolved sits on a cycle. */
+    size_t resolved = 0;
+    bool done[PIPELINE_MAX_STAGES] = {0};
+    for (size_t pass = 0; pass < handle->node_count; ++pass) {
+        for (size_t i = 0; i < handle->node_count; ++i) {
+            pipeline_node_t *node = &handle->nodes[i];
+            pipeline_stage_config_t *config = &node->config;
+            if (done[i]) {
+                continue;
+            }
+            if (config->input) {
+                pipeline_node_t *upstream = find_node(handle, config->input);
+                if (!done[upstream - handle->nodes]) {
+                    continue;
+                }
+                if (config->input_type == PIPELINE_ITEM_NONE) {
+                    config->input_type = upstream->config.output_type;
+                }
+                if (config->input_type != upstream->config.output_type) {
+                    ESP_LOGE(TAG, "Stage %s does not accept the output of %s", config->name, upstream->config.name);
+                    return ESP_ERR_INVALID_ARG;
+                }
+            }
+            if (config->type == PIPELINE_STAGE_FILTER || config->type == PIPELINE_STAGE_TEE) {
+                config->output_type = config->input_type;
+            } else if (config->type == PIPELINE_STAGE_SINK) {
+                config->output_type = PIPELINE_ITEM_NONE;
+            }
+            if (has_output(node) && config->output_type == PIPELINE_ITEM_NONE) {
+                ESP_LOGE(TAG, "Stage %s has no output type", config->name);
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (config->channel.drop_policy == PIPELINE_DROP_TO_KEYFRAME &&
+                config->input_type != PIPELINE_ITEM_H264_PACKET) {
+                ESP_LOGE(TAG, "Stage %s drops to keyframe on a non-H.264 channel", config->name);
+                return ESP_ERR_INVALID_ARG;
+            }
+            done[i] = true;
+            ++resolved;
+        }
+    }
+    if (resolved != handle->node_count) {
+        ESP_LOGE(TAG, "Pipeline graph has a cycle");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t create_channels(pipeline_handle_t handle)
+{
+    /* Each queued item and each item a stage holds needs a descriptor; tees share them, so this is an upper bound. */
+    size_t buffer_count = 0;
+    for (size_t i = 0; i < handle->node_count; ++i) {
+        pipeline_node_t *node = &handle->nodes[i];
+        if (!runs_task(node)) {
+            continue;
+        }
+        buffer_count += 2;
+        if (node->config.input) {
+            node->channel = xQueueCreate(node->config.channel.length, sizeof(pipeline_buffer_t *));
+            if (!node->channel) {
+                return ESP_ERR_NO_MEM;
+            }
+            buffer_count += node->config.channel.length;
+        }
+    }
+
+    handle->buffers = calloc(buffer_count, sizeof(pipeline_buffer_t));
+    handle->free_buffers = xQueueCreate(buffer_count, sizeof(pipeline_buffer_t *));
+    if (!handle->buffers || !handle->free_buffers) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < buffer_count; ++i) {
+        pipeline_buffer_t *buffer = &handle->buffers[i];
+        xQueueSend(handle->free_buffers, &buffer, 0);
+    }
+    return ESP_OK;
+}
+
+esp_err_t pipeline_start(const pipeline_config_t *config, pipeline_handle_t *out_handle)
+{
+    if (!config || !out_handle || !config->stages || config->stage_count == 0 ||
+        config->stage_count > PIPELINE_MAX_STAGES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < config->stage_count; ++i) {
+        esp_err_t err = check_stage(&config->stages[i]);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    pipeline_handle_t handle = calloc(1, sizeof(*handle));
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+    handle->config = *config;
+    handle->config.stages = NULL;
+    handle->node_count = config->stage_count;
+    portMUX_INITIALIZE(&handle->stats_lock);
+    for (size_t i = 0; i < config->stage_count; ++i) {
+        handle->nodes[i].config = config->stages[i];
+        handle->nodes[i].pipeline = handle;
+    }
+
+    esp_err_t err = link_graph(handle);
+    if (err == ESP_OK) {
+        err = create_channels(handle);
+    }
+    /* Downstream stages first, so no stage produces before its consumers exist. */
+    for (size_t i = handle->node_count; err == ESP_OK && i-- > 0;) {
+        pipeline_node_t *node = &handle->nodes[i];
+        if (!runs_task(node)) {
+            continue;
+        }
+        BaseType_t task_created = xTaskCreatePinnedToCore(stage_task, node->config.name, node->config.task.stack_size,
+                                                          node, node->config.task.priority, NULL,
+                                                          node->config.task.core_id);
+        if (task_created != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create %s stage", node->config.name);
+            err = ESP_ERR_NO_MEM;
+        } else {
+            ++handle->task_count;
+        }
+    }
+    if (err != ESP_OK) {
+        pipeline_stop(handle);
+        return err;
+    }
+
+    *out_handle = handle;
+    return ESP_OK;
+}
+
+void pipeline_stop(pipeline_handle_t handle)
+{
+    if (!handle) {
+        return;
+    }
+
+    handle->stop_waiter = xTaskGetCurrentTaskHandle();
+    handle->stopping = true;
+    for (uint32_t i = 0; i < handle->task_count; ++i) {
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    }
+
+    for (size_t i = 0; i < handle->node_count; ++i) {
+        pipeline_node_t *node = &handle->nodes[i];
+        if (!node->channel) {
+            continue;
+        }
+        pipeline_buffer_t *buffer = NULL;
+        while (xQueueReceive(node->channel, &buffer, 0) == pdTRUE) {
+            buffer_unref(buffer);
+        }
+        vQueueDelete(node->channel);
+    }
+    if (handle->free_buffers) {
+        vQueueDelete(handle->free_buffers);
+    }
+    free(handle->buffers);
+    free(handle);
+}
+
+esp_err_t pipeline_get_stage_stats(pipeline_handle_t handle, const char *name, pipeline_stage_stats_t *stats)
+{
+    if (!handle || !name || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pipeline_node_t *node = find_node(handle, name);
+    if (!node) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    portENTER_CRITICAL(&handle->stats_lock);
+    *stats = node->stats;
+    portEXIT_CRITICAL(&handle->stats_lock);
+    return ESP_OK;
+}
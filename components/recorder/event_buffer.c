@@ -0,0 +1,333 @@
+#include "recorder.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+#include "fmp4_muxer.h"
+
+static const char *TAG = "event_buffer";
+
+typedef struct {
+    size_t offset;
+    size_t length;
+    uint64_t timestamp_us;
+    bool is_keyframe;
+} event_frame_t;
+
+/*
+ * A byte ring of whole frames plus a ring of frame descriptors. Frames [first_sequence, next_sequence) are
+ * valid; the ring always starts at a keyframe. Eviction moves first_sequence before the bytes are reused,
+ * which lets readers copy without holding the lock and detect an overrun afterwards.
+ */
+struct event_buffer_context_t {
+    event_buffer_config_t config;
+    portMUX_TYPE lock;
+    uint8_t *arena;
+    event_frame_t *frames;
+    size_t head;
+    uint32_t first_sequence;
+    uint32_t next_sequence;
+    bool wait_keyframe;
+    uint32_t frames_dropped;
+};
+
+event_buffer_config_t recorder_default_event_buffer_config(void)
+{
+    return (event_buffer_config_t) {
+        .capacity_bytes = 8 * 1024 * 1024,
+        .max_frames = 600,
+        .max_duration_ms = 10000,
+        .frame_rate = 30,
+        .enable_psram = true,
+    };
+}
+
+esp_err_t recorder_plan_event_buffer_memory(const event_buffer_config_t *config, memory_plan_t *plan)
+{
+    ESP_RETURN_ON_ERROR(memory_plan_add(plan, "event buffer", memory_plan_region(config->enable_psram),
+                                        config->capacity_bytes, 1), TAG, "Failed to plan arena");
+    return memory_plan_add(plan, "event buffer index", MEMORY_PLAN_INTERNAL,
+                           sizeof(struct event_buffer_context_t) + config->max_frames * sizeof(event_frame_t), 1);
+}
+
+esp_err_t recorder_create_event_buffer(const event_buffer_config_t *config, event_buffer_handle_t *out_handle)
+{
+    if (!config || !out_handle || config->capacity_bytes == 0 || config->max_frames == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    event_buffer_handle_t handle = heap_caps_calloc(1, sizeof(*handle), MEMORY_PLAN_HOT_CAPS);
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    handle->config = *config;
+    portMUX_INITIALIZE(&handle->lock);
+    handle->wait_keyframe = true;
+    handle->arena = heap_caps_malloc(config->capacity_bytes, config->enable_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL);
+    handle->frames = heap_caps_calloc(config->max_frames, sizeof(event_frame_t), MEMORY_PLAN_HOT_CAPS);
+    if (!handle->arena || !handle->frames) {
+        recorder_destroy_event_buffer(handle);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *out_handle = handle;
+    return ESP_OK;
+}
+
+void recorder_destroy_event_buffer(event_buffer_handle_t handle)
+{
+    if (!handle) {
+        return;
+    }
+    if (handle->arena) {
+        heap_caps_free(handle->arena);
+    }
+    heap_caps_free(handle->frames);
+    heap_caps_free(handle);
+}
+
+static event_frame_t *frame_at(event_buffer_handle_t handle, uint32_t sequence)
+{
+    return &handle->frames[sequence % handle->config.max_frames];
+}
+
+static uint32_t frame_count(event_buffer_handle_t handle)
+{
+    return handle->next_sequence - handle->first_sequence;
+}
+
+static bool is_buffered(event_buffer_handle_t handle, uint32_t sequence)
+{
+    return (int32_t)(sequence - handle->first_sequence) >= 0 && (int32_t)(handle->next_sequence - sequence) > 0;
+}
+
+/* Returns the sequence of the first keyframe after the oldest one, or next_sequence when only one GOP is held. */
+static uint32_t second_gop_start(event_buffer_handle_t handle)
+{
+    uint32_t sequence = handle->first_sequence + 1;
+    while (sequence != handle->next_sequence && !frame_at(handle, sequence)->is_keyframe) {
+        ++sequence;
+    }
+    return sequence;
+}
+
+static void evict_oldest_gop(event_buffer_handle_t handle)
+{
+    handle->first_sequence = second_gop_start(handle);
+}
+
+/* Byte offset where `length` bytes fit without touching buffered frames, or SIZE_MAX. */
+static size_t find_space(event_buffer_handle_t handle, size_t length)
+{
+    size_t capacity = handle->config.capacity_bytes;
+    if (frame_count(handle) == 0) {
+        return length <= capacity ? 0 : SIZE_MAX;
+    }
+    size_t tail = frame_at(handle, handle->first_sequence)->offset;
+    if (tail < handle->head) {
+        if (handle->head + length <= capacity) {
+            return handle->head;
+        }
+        return length <= tail ? 0 : SIZE_MAX;
+    }
+    return handle->head + length <= tail ? handle->head : SIZE_MAX;
+}
+
+static void evict_by_duration(event_buffer_handle_t handle, uint64_t newest_us)
+{
+    uint64_t max_duration_us = (uint64_t)handle->config.max_duration_ms * 1000;
+    while (true) {
+        uint32_t next_gop = second_gop_start(handle);
+        if (next_gop == handle->next_sequence || newest_us - frame_at(handle, next_gop)->timestamp_us < max_duration_us) {
+            return;
+        }
+        handle->first_sequence = next_gop;
+    }
+}
+
+esp_err_t recorder_event_buffer_append(event_buffer_handle_t handle, const h264_packet_t *packet)
+{
+    if (!handle || !packet || !packet->data || packet->length == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool is_keyframe = packet->is_keyframe;
+
+    portENTER_CRITICAL(&handle->lock);
+    if (is_keyframe) {
+        handle->wait_keyframe = false;
+    }
+    size_t offset = SIZE_MAX;
+    if (!handle->wait_keyframe) {
+        while (frame_count(handle) > 0 && frame_count(handle) >= handle->config.max_frames) {
+            evict_oldest_gop(handle);
+        }
+        while ((offset = find_space(handle, packet->length)) == SIZE_MAX && frame_count(handle) > 0) {
+            evict_oldest_gop(handle);
+        }
+        /* A delta frame whose GOP was just evicted cannot be decoded; resume at the next keyframe. */
+        if (offset != SIZE_MAX && frame_count(handle) == 0 && !is_keyframe) {
+            offset = SIZE_MAX;
+        }
+    }
+    if (offset == SIZE_MAX) {
+        handle->wait_keyframe = true;
+        ++handle->frames_dropped;
+        portEXIT_CRITICAL(&handle->lock);
+        return packet->length > handle->config.capacity_bytes ? ESP_ERR_INVALID_SIZE : ESP_OK;
+    }
+    if (frame_count(handle) == 0) {
+        handle->head = offset;
+    }
+    portEXIT_CRITICAL(&handle->lock);
+
+    memcpy(handle->arena + offset, packet->data, packet->length);
+
+    portENTER_CRITICAL(&handle->lock);
+    *frame_at(handle, handle->next_sequence) = (event_frame_t) {
+        .offset = offset,
+        .length = packet->length,
+        .timestamp_us = packet->timestamp_us,
+        .is_keyframe = is_keyframe,
+    };
+    ++handle->next_sequence;
+    handle->head = offset + packet->length;
+    evict_by_duration(handle, packet->timestamp_us);
+    portEXIT_CRITICAL(&handle->lock);
+    return ESP_OK;
+}
+
+esp_err_t recorder_event_buffer_span(event_buffer_handle_t handle, uint64_t *oldest_us, uint64_t *newest_us)
+{
+    if (!handle || !oldest_us || !newest_us) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    portENTER_CRITICAL(&handle->lock);
+    if (frame_count(handle) > 0) {
+        *oldest_us = frame_at(handle, handle->first_sequence)->timestamp_us;
+        *newest_us = frame_at(handle, handle->next_sequence - 1)->timestamp_us;
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&handle->lock);
+    return err;
+}
+
+/* Picks [first, end) for the requested range and the largest frame in it, all under one short lock. */
+static bool select_range(event_buffer_handle_t handle, uint64_t start_us, uint64_t end_us, uint32_t *first,
+                         uint32_t *end, size_t *max_length)
+{
+    portENTER_CRITICAL(&handle->lock);
+    *first = handle->first_sequence;
+    *end = handle->first_sequence;
+    *max_length = 0;
+    for (uint32_t sequence = handle->first_sequence; sequence != handle->next_sequence; ++sequence) {
+        const event_frame_t *frame = frame_at(handle, sequence);
+        if (frame->timestamp_us > end_us) {
+            break;
+        }
+        if (frame->is_keyframe && frame->timestamp_us <= start_us) {
+            *first = sequence;
+            *max_length = 0;
+        }
+        if (frame->length > *max_length) {
+            *max_length = frame->length;
+        }
+        *end = sequence + 1;
+    }
+    portEXIT_CRITICAL(&handle->lock);
+    return *end != *first;
+}
+
+/* Copies one frame out of the ring; false when the producer reclaimed it meanwhile. */
+static bool read_frame(event_buffer_handle_t handle, uint32_t sequence, uint8_t *scratch, event_frame_t *out)
+{
+    portENTER_CRITICAL(&handle->lock);
+    bool valid = is_buffered(handle, sequence);
+    if (valid) {
+        *out = *frame_at(handle, sequence);
+    }
+    portEXIT_CRITICAL(&handle->lock);
+    if (!valid) {
+        return false;
+    }
+
+    memcpy(scratch, handle->arena + out->offset, out->length);
+
+    portENTER_CRITICAL(&handle->lock);
+    valid = is_buffered(handle, sequence);
+    portEXIT_CRITICAL(&handle->lock);
+    return valid;
+}
+
+static esp_err_t write_mp4_frame(fmp4_muxer_t *muxer, const event_frame_t *frame, const uint8_t *data,
+                                 recorder_write_fn_t write, void *user_ctx)
+{
+    if (muxer->init_length == 0) {
+        ESP_RETURN_ON_ERROR(fmp4_muxer_write_init_segment(muxer, data, frame->length), TAG, "No parameter sets in keyframe");
+        ESP_RETURN_ON_ERROR(write(user_ctx, muxer->init, muxer->init_length), TAG, "Clip write failed");
+    }
+
+    fmp4_sample_t sample = {
+        .data = data,
+        .length = frame->length,
+        .timestamp_us = frame->timestamp_us,
+        .is_keyframe = frame->is_keyframe,
+    };
+    fmp4_fragment_t fragment;
+    ESP_RETURN_ON_ERROR(fmp4_muxer_write_fragment(muxer, &sample, 1, &fragment), TAG, "Failed to build fragment");
+    for (size_t i = 0; i < fragment.segment_count; ++i) {
+        ESP_RETURN_ON_ERROR(write(user_ctx, fragment.segments[i].data, fragment.segments[i].length), TAG,
+                            "Clip write failed");
+    }
+    return ESP_OK;
+}
+
+esp_err_t recorder_extract_clip(event_buffer_handle_t handle, uint64_t start_us, uint64_t end_us,
+                                recorder_clip_format_t format, recorder_write_fn_t write, void *user_ctx)
+{
+    if (!handle || !write || end_us < start_us) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t first = 0;
+    uint32_t end = 0;
+    size_t max_length = 0;
+    if (!select_range(handle, start_us, end_us, &first, &end, &max_length)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t *scratch = heap_caps_malloc(max_length, handle->config.enable_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL);
+    fmp4_muxer_t *muxer = format == RECORDER_CLIP_MP4 ? malloc(sizeof(*muxer)) : NULL;
+    esp_err_t err = ESP_OK;
+    if (!scratch || (format == RECORDER_CLIP_MP4 && !muxer)) {
+        err = ESP_ERR_NO_MEM;
+    } else if (muxer) {
+        fmp4_muxer_init(muxer, handle->config.frame_rate);
+    }
+
+    for (uint32_t sequence = first; err == ESP_OK && sequence != end; ++sequence) {
+        event_frame_t frame;
+        if (!read_frame(handle, sequence, scratch, &frame)) {
+            ESP_LOGW(TAG, "Clip overrun by the live stream at frame %" PRIu32, sequence - first);
+            err = ESP_ERR_INVALID_STATE;
+        } else if (format == RECORDER_CLIP_MP4) {
+            err = write_mp4_frame(muxer, &frame, scratch, write, user_ctx);
+        } else {
+            err = write(user_ctx, scratch, frame.length);
+        }
+    }
+
+    free(muxer);
+    if (scratch) {
+        heap_caps_free(scratch);
+    }
+    return err;
+}
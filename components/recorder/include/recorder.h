@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#include "image_processing.h"
+#include "memory_plan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct event_buffer_context_t *event_buffer_handle_t;
+typedef struct recording_context_t *recording_handle_t;
+
+typedef enum {
+    RECORDER_CLIP_ANNEX_B,
+    RECORDER_CLIP_MP4,
+} recorder_clip_format_t;
+
+typedef struct {
+    size_t capacity_bytes;
+    uint32_t max_frames;
+    uint32_t max_duration_ms;
+    uint32_t frame_rate;
+    bool enable_psram;
+} event_buffer_config_t;
+
+typedef struct {
+    const char *directory;
+    const char *prefix;
+    size_t block_size;
+    uint32_t block_count;
+    uint64_t segment_max_bytes;
+    uint32_t segment_max_duration_ms;
+    UBaseType_t task_priority;
+    BaseType_t core_id;
+    bool enable_psram;
+} recording_config_t;
+
+typedef struct {
+    uint32_t segments;
+    uint64_t bytes_written;
+    uint32_t frames_recorded;
+    uint32_t frames_dropped;
+    uint32_t write_errors;
+    uint32_t blocks_pending;
+    uint32_t write_latency_p50_us;
+    uint32_t write_latency_p90_us;
+    uint32_t write_latency_p99_us;
+    uint32_t write_latency_max_us;
+} recording_stats_t;
+
+/* Receives the clip in order; returning an error aborts the extraction. */
+typedef esp_err_t (*recorder_write_fn_t)(void *user_ctx, const void *data, size_t length);
+
+event_buffer_config_t recorder_default_event_buffer_config(void);
+
+/* All memory is allocated here; the buffer never grows afterwards. */
+esp_err_t recorder_create_event_buffer(const event_buffer_config_t *config, event_buffer_handle_t *out_handle);
+void recorder_destroy_event_buffer(event_buffer_handle_t handle);
+
+esp_err_t recorder_plan_event_buffer_memory(const event_buffer_config_t *config, memory_plan_t *plan);
+
+/*
+ * Copies an encoded frame into the ring, evicting whole GOPs from the oldest end when the byte, frame or
+ * duration budget is exceeded. Call from a single producer task.
+ */
+esp_err_t recorder_event_buffer_append(event_buffer_handle_t handle, const h264_packet_t *packet);
+
+/* Capture timestamps of the oldest and newest buffered frames. */
+esp_err_t recorder_event_buffer_span(event_buffer_handle_t handle, uint64_t *oldest_us, uint64_t *newest_us);
+
+/*
+ * Writes the frames from the keyframe at or before start_us through end_us as a raw Annex-B stream or a
+ * fragmented MP4 file. The producer is never blocked; if it overwrites a frame before it has been read the
+ * extraction stops with ESP_ERR_INVALID_STATE.
+ */
+esp_err_t recorder_extract_clip(event_buffer_handle_t handle, uint64_t start_us, uint64_t end_us,
+                                recorder_clip_format_t format, recorder_write_fn_t write, void *user_ctx);
+
+recording_config_t recorder_default_recording_config(void);
+
+/*
+ * Starts a low-priority writer task that appends Annex-B segments named <directory>/<prefix>NNNNN.264 (8.3
+ * names, so keep the prefix to three characters on FAT without long file names). Segment numbering restarts
+ * at 1 and existing files are overwritten.
+ */
+esp_err_t recorder_start_recording(const recording_config_t *config, recording_handle_t *out_handle);
+
+esp_err_t recorder_plan_recording_memory(const recording_config_t *config, memory_plan_t *plan);
+
+/* Flushes buffered blocks and closes the current segment. The producer must have stopped writing. */
+void recorder_stop_recording(recording_handle_t handle);
+
+/*
+ * Copies an encoded frame into the write-behind blocks without blocking. When not enough free blocks are
+ * left the frame is dropped and recording resumes at the next keyframe. New segments start on keyframes
+ * once the size or duration limit is reached. Call from a single producer task.
+ */
+esp_err_t recorder_recording_write(recording_handle_t handle, const h264_packet_t *packet);
+
+/* Latency percentiles cover the most recent block writes. */
+esp_err_t recorder_get_recording_stats(recording_handle_t handle, recording_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,390 @@
+#include "recorder.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+static const char *TAG = "recording";
+
+#define RECORDING_BLOCK_ALIGNMENT 512
+#define RECORDING_LATENCY_WINDOW 128
+#define RECORDING_PATH_MAX 64
+#define RECORDING_NO_BLOCK UINT32_MAX
+
+#define RECORDING_BLOCK_START_SEGMENT (1u << 0)
+#define RECORDING_BLOCK_STOP (1u << 1)
+
+typedef struct {
+    uint32_t index;
+    uint32_t flags;
+    size_t length;
+} recording_block_t;
+
+/*
+ * The producer fills one block at a time from free_queue and hands full blocks to the writer task through
+ * filled_queue. The first block of every segment carries RECORDING_BLOCK_START_SEGMENT, so the writer opens
+ * files in stream order and never needs a separate control message.
+ */
+struct recording_context_t {
+    recording_config_t config;
+    char directory[RECORDING_PATH_MAX];
+    char prefix[8];
+    uint8_t *blocks;
+    QueueHandle_t free_queue;
+    QueueHandle_t filled_queue;
+    TaskHandle_t task;
+    TaskHandle_t stop_waiter;
+
+    uint32_t current;
+    uint32_t current_flags;
+    size_t current_length;
+    bool start_pending;
+    bool wait_keyframe;
+    uint64_t segment_bytes;
+    uint64_t segment_start_us;
+
+    FILE *file;
+    uint32_t segment_index;
+
+    portMUX_TYPE stats_lock;
+    recording_stats_t stats;
+    uint32_t latencies[RECORDING_LATENCY_WINDOW];
+    uint32_t latency_count;
+};
+
+recording_config_t recorder_default_recording_config(void)
+{
+    return (recording_config_t) {
+        .directory = "/sdcard",
+        .prefix = "rec",
+        .block_size = 64 * 1024,
+        .block_count = 32,
+        .segment_max_bytes = 256ULL * 1024 * 1024,
+        .segment_max_duration_ms = 5 * 60 * 1000,
+        .task_priority = tskIDLE_PRIORITY + 1,
+        .core_id = tskNO_AFFINITY,
+        .enable_psram = true,
+    };
+}
+
+static uint8_t *block_data(recording_handle_t handle, uint32_t index)
+{
+    return handle->blocks + (size_t)index * handle->config.block_size;
+}
+
+static void record_latency(recording_handle_t handle, uint32_t latency_us)
+{
+    portENTER_CRITICAL(&handle->stats_lock);
+    handle->latencies[handle->latency_count % RECORDING_LATENCY_WINDOW] = latency_us;
+    ++handle->latency_count;
+    if (latency_us > handle->stats.write_latency_max_us) {
+        handle->stats.write_latency_max_us = latency_us;
+    }
+    portEXIT_CRITICAL(&handle->stats_lock);
+}
+
+static void close_segment(recording_handle_t handle)
+{
+    if (!handle->file) {
+        return;
+    }
+    fflush(handle->file);
+    fsync(fileno(handle->file));
+    fclose(handle->file);
+    handle->file = NULL;
+}
+
+static void open_segment(recording_handle_t handle)
+{
+    close_segment(handle);
+
+    char path[RECORDING_PATH_MAX + 24];
+    ++handle->segment_index;
+    snprintf(path, sizeof(path), "%s/%s%05" PRIu32 ".264", handle->directory, handle->prefix, handle->segment_index);
+    handle->file = fopen(path, "wb");
+    if (!handle->file) {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return;
+    }
+    /* Blocks are already large and aligned; skip the stdio copy. */
+    setvbuf(handle->file, NULL, _IONBF, 0);
+
+    portENTER_CRITICAL(&handle->stats_lock);
+    ++handle->stats.segments;
+    portEXIT_CRITICAL(&handle->stats_lock);
+    ESP_LOGI(TAG, "Recording to %s", path);
+}
+
+static void write_block(recording_handle_t handle, const recording_block_t *block)
+{
+    if (block->flags & RECORDING_BLOCK_START_SEGMENT) {
+        open_segment(handle);
+    }
+    if (!handle->file) {
+        portENTER_CRITICAL(&handle->stats_lock);
+        ++handle->stats.write_errors;
+        portEXIT_CRITICAL(&handle->stats_lock);
+        return;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    size_t written = fwrite(block_data(handle, block->index), 1, block->length, handle->file);
+    record_latency(handle, (uint32_t)(esp_timer_get_time() - start_us));
+
+    portENTER_CRITICAL(&handle->stats_lock);
+    handle->stats.bytes_written += written;
+    if (written != block->length) {
+        ++handle->stats.write_errors;
+    }
+    portEXIT_CRITICAL(&handle->stats_lock);
+
+    if (written != block->length) {
+        /* The rest of this segment is discarded; the next segment retries the storage. */
+        ESP_LOGE(TAG, "Write failed after %u of %u bytes", (unsigned)written, (unsigned)block->length);
+        close_segment(handle);
+    }
+}
+
+static void recording_task(void *arg)
+{
+    recording_handle_t handle = (recording_handle_t)arg;
+
+    while (true) {
+        recording_block_t block;
+        xQueueReceive(handle->filled_queue, &block, portMAX_DELAY);
+        if (block.index != RECORDING_NO_BLOCK) {
+            write_block(handle, &block);
+            xQueueSend(handle->free_queue, &block.index, 0);
+        }
+        if (block.flags & RECORDING_BLOCK_STOP) {
+            break;
+        }
+    }
+    close_segment(handle);
+
+    TaskHandle_t waiter = handle->stop_waiter;
+    handle->task = NULL;
+    xTaskNotifyGive(waiter);
+    vTaskDelete(NULL);
+}
+
+static void destroy_recording(recording_handle_t handle)
+{
+    if (handle->free_queue) {
+        vQueueDelete(handle->free_queue);
+    }
+    if (handle->filled_queue) {
+        vQueueDelete(handle->filled_queue);
+    }
+    if (handle->blocks) {
+        heap_caps_free(handle->blocks);
+    }
+    heap_caps_free(handle);
+}
+
+static size_t aligned_block_size(const recording_config_t *config)
+{
+    return (config->block_size + RECORDING_BLOCK_ALIGNMENT - 1) & ~(size_t)(RECORDING_BLOCK_ALIGNMENT - 1);
+}
+
+esp_err_t recorder_plan_recording_memory(const recording_config_t *config, memory_plan_t *plan)
+{
+    esp_err_t err = memory_plan_add(plan, "recording blocks", memory_plan_region(config->enable_psram),
+                                    aligned_block_size(config) * config->block_count, 1);
+    return err == ESP_OK ? memory_plan_add(plan, "recording context", MEMORY_PLAN_INTERNAL,
+                                           sizeof(struct recording_context_t), 1) : err;
+}
+
+esp_err_t recorder_start_recording(const recording_config_t *config, recording_handle_t *out_handle)
+{
+    if (!config || !out_handle || !config->directory || !config->prefix || config->block_size == 0 ||
+        config->block_count < 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    recording_handle_t handle = heap_caps_calloc(1, sizeof(*handle), MEMORY_PLAN_HOT_CAPS);
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    handle->config = *config;
+    handle->config.block_size = aligned_block_size(config);
+    strlcpy(handle->directory, config->directory, sizeof(handle->directory));
+    strlcpy(handle->prefix, config->prefix, sizeof(handle->prefix));
+    handle->config.directory = handle->directory;
+    handle->config.prefix = handle->prefix;
+    handle->current = RECORDING_NO_BLOCK;
+    handle->start_pending = true;
+    handle->wait_keyframe = true;
+    portMUX_INITIALIZE(&handle->stats_lock);
+
+    handle->blocks = heap_caps_aligned_alloc(RECORDING_BLOCK_ALIGNMENT, handle->config.block_size * config->block_count,
+                                             config->enable_psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL);
+    handle->free_queue = xQueueCreate(config->block_count, sizeof(uint32_t));
+    /* One extra slot for the stop message. */
+    handle->filled_queue = xQueueCreate(config->block_count + 1, sizeof(recording_block_t));
+    if (!handle->blocks || !handle->free_queue || !handle->filled_queue) {
+        destroy_recording(handle);
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint32_t i = 0; i < config->block_count; ++i) {
+        xQueueSend(handle->free_queue, &i, 0);
+    }
+
+    BaseType_t task_created = xTaskCreatePinnedToCore(recording_task, "recording", 4 * 1024, handle, config->task_priority,
+                                                      &handle->task, config->core_id);
+    if (task_created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create recording task");
+        destroy_recording(handle);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *out_handle = handle;
+    return ESP_OK;
+}
+
+void recorder_stop_recording(recording_handle_t handle)
+{
+    if (!handle) {
+        return;
+    }
+
+    if (handle->task) {
+        recording_block_t block = {
+            .index = handle->current,
+            .flags = handle->current_flags | RECORDING_BLOCK_STOP,
+            .length = handle->current_length,
+        };
+        handle->current = RECORDING_NO_BLOCK;
+        handle->stop_waiter = xTaskGetCurrentTaskHandle();
+        xQueueSend(handle->filled_queue, &block, portMAX_DELAY);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    destroy_recording(handle);
+}
+
+static void submit_current(recording_handle_t handle)
+{
+    recording_block_t block = {
+        .index = handle->current,
+        .flags = handle->current_flags,
+        .length = handle->current_length,
+    };
+    /* Cannot fail: the queue holds every block. */
+    xQueueSend(handle->filled_queue, &block, 0);
+    handle->current = RECORDING_NO_BLOCK;
+    handle->current_length = 0;
+}
+
+static void drop_frame(recording_handle_t handle)
+{
+    handle->wait_keyframe = true;
+    portENTER_CRITICAL(&handle->stats_lock);
+    ++handle->stats.frames_dropped;
+    portEXIT_CRITICAL(&handle->stats_lock);
+}
+
+esp_err_t recorder_recording_write(recording_handle_t handle, const h264_packet_t *packet)
+{
+    if (!handle || !packet || !packet->data || packet->length == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bool rotate = false;
+    if (packet->is_keyframe) {
+        handle->wait_keyframe = false;
+        uint64_t duration_us = packet->timestamp_us - handle->segment_start_us;
+        rotate = handle->segment_bytes > 0 &&
+                 (handle->segment_bytes + packet->length > handle->config.segment_max_bytes ||
+                  duration_us >= (uint64_t)handle->config.segment_max_duration_ms * 1000);
+    }
+    if (handle->wait_keyframe) {
+        drop_frame(handle);
+        return ESP_OK;
+    }
+
+    size_t block_size = handle->config.block_size;
+    size_t room = (handle->current != RECORDING_NO_BLOCK && !rotate) ? block_size - handle->current_length : 0;
+    size_t blocks_needed = packet->length > room ? (packet->length - room + block_size - 1) / block_size : 0;
+    /* Only this task takes from free_queue, so the count can only grow until the frame is copied. */
+    if (uxQueueMessagesWaiting(handle->free_queue) < blocks_needed) {
+        drop_frame(handle);
+        return ESP_OK;
+    }
+
+    if (rotate) {
+        if (handle->current != RECORDING_NO_BLOCK) {
+            submit_current(handle);
+        }
+        handle->start_pending = true;
+    }
+    if (handle->start_pending) {
+        handle->segment_bytes = 0;
+        handle->segment_start_us = packet->timestamp_us;
+    }
+
+    const uint8_t *data = packet->data;
+    size_t remaining = packet->length;
+    while (remaining > 0) {
+        if (handle->current == RECORDING_NO_BLOCK) {
+            xQueueReceive(handle->free_queue, &handle->current, 0);
+            handle->current_flags = handle->start_pending ? RECORDING_BLOCK_START_SEGMENT : 0;
+            handle->start_pending = false;
+        }
+        size_t chunk = block_size - handle->current_length;
+        if (chunk > remaining) {
+            chunk = remaining;
+        }
+        memcpy(block_data(handle, handle->current) + handle->current_length, data, chunk);
+        handle->current_length += chunk;
+        data += chunk;
+        remaining -= chunk;
+        if (handle->current_length == block_size) {
+            submit_current(handle);
+        }
+    }
+    handle->segment_bytes += packet->length;
+
+    portENTER_CRITICAL(&handle->stats_lock);
+    ++handle->stats.frames_recorded;
+    portEXIT_CRITICAL(&handle->stats_lock);
+    return ESP_OK;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    uint32_t left = *(const uint32_t *)a;
+    uint32_t right = *(const uint32_t *)b;
+    return (left > right) - (left < right);
+}
+
+esp_err_t recorder_get_recording_stats(recording_handle_t handle, recording_stats_t *stats)
+{
+    if (!handle || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t latencies[RECORDING_LATENCY_WINDOW];
+    portENTER_CRITICAL(&handle->stats_lock);
+    *stats = handle->stats;
+    uint32_t count = handle->latency_count < RECORDING_LATENCY_WINDOW ? handle->latency_count : RECORDING_LATENCY_WINDOW;
+    memcpy(latencies, handle->latencies, count * sizeof(uint32_t));
+    portEXIT_CRITICAL(&handle->stats_lock);
+
+    stats->blocks_pending = uxQueueMessagesWaiting(handle->filled_queue);
+    if (count > 0) {
+        qsort(latencies, count, sizeof(uint32_t), compare_latency);
+        stats->write_latency_p50_us = latencies[(count - 1) * 50 / 100];
+        stats->write_latency_p90_us = latencies[(count - 1) * 90 / 100];
+        stats->write_latency_p99_us = latencies[(count - 1) * 99 / 100];
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Event IDs are part of the dump format read by tools/trace_to_chrome.py; append new ones, never renumber.
+ * Capture and encode begin carry the camera frame sequence. Encode end and everything after it carry the
+ * low 32 bits of the packet timestamp, so one encode span links both numberings.
+ */
+typedef enum {
+    TRACE_EVENT_FRAME_CAPTURED = 1,
+    TRACE_EVENT_FRAME_DROPPED,
+    TRACE_EVENT_ENCODE_BEGIN,
+    TRACE_EVENT_ENCODE_END,
+    TRACE_EVENT_STREAM_SUBMIT_BEGIN,
+    TRACE_EVENT_STREAM_SUBMIT_END,
+    TRACE_EVENT_RTSP_PACKETIZE_BEGIN,
+    TRACE_EVENT_RTSP_PACKETIZE_END,
+    TRACE_EVENT_RTSP_SERVICE_BEGIN,
+    TRACE_EVENT_RTSP_SERVICE_END,
+    TRACE_EVENT_RTSP_FRAME_SENT,
+} trace_event_t;
+
+typedef esp_err_t (*trace_write_fn_t)(void *user_ctx, const void *data, size_t length);
+
+#if CONFIG_TRACE_ENABLE
+
+extern atomic_bool trace_recording;
+
+void trace_record(trace_event_t event, uint32_t arg);
+
+#define TRACE_EVENT(event, arg)                                                                      \
+    do {                                                                                             \
+        if (__builtin_expect(atomic_load_explicit(&trace_recording, memory_order_relaxed), 0)) {     \
+            trace_record((event), (uint32_t)(arg));                                                  \
+        }                                                                                            \
+    } while (0)
+
+#else
+
+#define TRACE_EVENT(event, arg) \
+    do {                        \
+        (void)(arg);            \
+    } while (0)
+
+#endif
+
+/* Both return ESP_ERR_NOT_SUPPORTED unless CONFIG_TRACE_ENABLE is set. */
+esp_err_t trace_start(void);
+esp_err_t trace_stop(void);
+
+/* Size in bytes of a full dump, or 0 when tracing is compiled out. */
+size_t trace_dump_size(void);
+
+/*
+ * Writes the rings, oldest event first, in the binary format documented in tools/trace_to_chrome.py.
+ * Recording is paused for the duration and resumed afterwards if it was running.
+ */
+esp_err_t trace_dump(trace_write_fn_t write, void *user_ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,170 @@
+#include "trace.h"
+
+#if CONFIG_TRACE_ENABLE
+
+#include "esp_cpu.h"
+#include "esp_ipc.h"
+#include "esp_private/esp_clk.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#define TRACE_MAGIC    0x43525450u /* "PTRC" */
+#define TRACE_VERSION  1
+
+_Static_assert((CONFIG_TRACE_RING_EVENTS & (CONFIG_TRACE_RING_EVENTS - 1)) == 0,
+               "CONFIG_TRACE_RING_EVENTS must be a power of two");
+
+typedef struct {
+    uint32_t cycles;
+    uint32_t arg;
+    uint16_t event;
+    uint16_t reserved;
+} trace_record_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t core_count;
+    uint32_t cpu_hz;
+    uint32_t ring_events;
+} trace_file_header_t;
+
+/* The anchor pairs this core's cycle counter with esp_timer, which is shared by both cores. */
+typedef struct {
+    uint32_t anchor_cycles;
+    uint32_t record_count;
+    int64_t anchor_us;
+    uint32_t overwritten;
+    uint32_t reserved;
+} trace_core_header_t;
+
+typedef struct {
+    trace_record_t records[CONFIG_TRACE_RING_EVENTS];
+    uint32_t head;
+    uint32_t dump_head;
+    trace_core_header_t dump;
+} trace_ring_t;
+
+atomic_bool trace_recording;
+
+static trace_ring_t s_rings[portNUM_PROCESSORS];
+
+/*
+ * Each core only writes its own ring, and masking interrupts keeps a task from being preempted or migrated
+ * between picking the ring and filling the slot, which is cheaper than an atomic on every event.
+ */
+void trace_record(trace_event_t event, uint32_t arg)
+{
+    UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    trace_ring_t *ring = &s_rings[esp_cpu_get_core_id()];
+    trace_record_t *record = &ring->records[ring->head++ & (CONFIG_TRACE_RING_EVENTS - 1)];
+    record->cycles = esp_cpu_get_cycle_count();
+    record->arg = arg;
+    record->event = (uint16_t)event;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+esp_err_t trace_start(void)
+{
+    atomic_store(&trace_recording, true);
+    return ESP_OK;
+}
+
+esp_err_t trace_stop(void)
+{
+    atomic_store(&trace_recording, false);
+    return ESP_OK;
+}
+
+size_t trace_dump_size(void)
+{
+    return sizeof(trace_file_header_t) +
+           portNUM_PROCESSORS * (sizeof(trace_core_header_t) + sizeof(trace_record_t) * CONFIG_TRACE_RING_EVENTS);
+}
+
+/* Runs on the ring's own core, so the anchor and the record count come from the same cycle counter. */
+static void capture_anchor(void *arg)
+{
+    trace_ring_t *ring = (trace_ring_t *)arg;
+    UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint32_t head = ring->head;
+    ring->dump_head = head;
+    ring->dump.anchor_cycles = esp_cpu_get_cycle_count();
+    ring->dump.anchor_us = esp_timer_get_time();
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+    ring->dump.record_count = head < CONFIG_TRACE_RING_EVENTS ? head : CONFIG_TRACE_RING_EVENTS;
+    ring->dump.overwritten = head - ring->dump.record_count;
+}
+
+static esp_err_t dump_ring(const trace_ring_t *ring, trace_write_fn_t write, void *user_ctx)
+{
+    esp_err_t err = write(user_ctx, &ring->dump, sizeof(ring->dump));
+    uint32_t first = ring->dump_head - ring->dump.record_count;
+    uint32_t remaining = ring->dump.record_count;
+    while (err == ESP_OK && remaining > 0) {
+        uint32_t index = first & (CONFIG_TRACE_RING_EVENTS - 1);
+        uint32_t run = CONFIG_TRACE_RING_EVENTS - index;
+        if (run > remaining) {
+            run = remaining;
+        }
+        err = write(user_ctx, &ring->records[index], run * sizeof(trace_record_t));
+        first += run;
+        remaining -= run;
+    }
+    return err;
+}
+
+esp_err_t trace_dump(trace_write_fn_t write, void *user_ctx)
+{
+    if (!write) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bool was_recording = atomic_exchange(&trace_recording, false);
+    for (int core = 0; core < portNUM_PROCESSORS; ++core) {
+        esp_err_t err = esp_ipc_call_blocking(core, capture_anchor, &s_rings[core]);
+        if (err != ESP_OK) {
+            atomic_store(&trace_recording, was_recording);
+            return err;
+        }
+    }
+
+    trace_file_header_t header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .core_count = portNUM_PROCESSORS,
+        .cpu_hz = (uint32_t)esp_clk_cpu_freq(),
+        .ring_events = CONFIG_TRACE_RING_EVENTS,
+    };
+    esp_err_t err = write(user_ctx, &header, sizeof(header));
+    for (int core = 0; core < portNUM_PROCESSORS && err == ESP_OK; ++core) {
+        err = dump_ring(&s_rings[core], write, user_ctx);
+    }
+
+    atomic_store(&trace_recording, was_recording);
+    return err;
+}
+
+#else
+
+esp_err_t trace_start(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t trace_stop(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+size_t trace_dump_size(void)
+{
+    return 0;
+}
+
+esp_err_t trace_dump(trace_write_fn_t write, void *user_ctx)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
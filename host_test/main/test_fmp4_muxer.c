@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "fmp4_muxer.h"
+#include "h264_nal.h"
+#include "test_util.h"
+
+#define OUTPUT_PATH         "/tmp/host_test_fmp4.mp4"
+#define FRAGMENT_COUNT      5
+#define SAMPLES_PER_FRAGMENT 4
+#define FRAME_INTERVAL_US   33333
+#define SLICE_SIZE          600
+#define MAX_CHILDREN        16
+
+/* A 1280x720 baseline SPS and its PPS, as the encoder emits them ahead of every IDR. */
+static const uint8_t s_sps[] = { 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe8, 0x06, 0xd0, 0xa1, 0x35 };
+static const uint8_t s_pps[] = { 0x68, 0xce, 0x06, 0xe2 };
+static const uint8_t s_aud[] = { 0x09, 0xf0 };
+
+typedef struct {
+    char type[5];
+    const uint8_t *data;
+    size_t size;
+} box_t;
+
+static size_t append_nal(uint8_t *out, const uint8_t *nal, size_t length)
+{
+    static const uint8_t start_code[] = { 0, 0, 0, 1 };
+    memcpy(out, start_code, sizeof(start_code));
+    memcpy(out + sizeof(start_code), nal, length);
+    return sizeof(start_code) + length;
+}
+
+/* AUD, SPS, PPS and one IDR slice for a keyframe; AUD and two slices otherwise. */
+static size_t make_access_unit(uint8_t *out, bool keyframe, uint8_t fill)
+{
+    uint8_t slice[SLICE_SIZE];
+    memset(slice, fill | 1, sizeof(slice));
+    size_t length = append_nal(out, s_aud, sizeof(s_aud));
+    if (keyframe) {
+        length += append_nal(out + length, s_sps, sizeof(s_sps));
+        length += append_nal(out + length, s_pps, sizeof(s_pps));
+        slice[0] = 0x65;
+        length += append_nal(out + length, slice, sizeof(slice));
+    } else {
+        slice[0] = 0x41;
+        length += append_nal(out + length, slice, sizeof(slice) / 2);
+        length += append_nal(out + length, slice, sizeof(slice) / 3);
+    }
+    return length;
+}
+
+/* Splits data into boxes, which must tile it exactly. */
+static size_t split_boxes(const uint8_t *data, size_t length, box_t *boxes, size_t max_boxes)
+{
+    size_t count = 0;
+    size_t offset = 0;
+    while (offset < length) {
+        TEST_ASSERT_TRUE(length - offset >= 8);
+        TEST_ASSERT_LESS_THAN_UINT32(max_boxes, count);
+        uint32_t size = get_u32(data + offset);
+        TEST_ASSERT_TRUE(size >= 8 && size <= length - offset);
+        box_t *box = &boxes[count++];
+        memcpy(box->type, data + offset + 4, 4);
+        box->type[4] = '\0';
+        box->data = data + offset;
+        box->size = size;
+        offset += size;
+    }
+    return count;
+}
+
+/* The child of a plain container box, checking along the way that its children tile it. */
+static box_t child_box(const box_t *parent, const char *type)
+{
+    box_t children[MAX_CHILDREN];
+    size_t count = split_boxes(parent->data + 8, parent->size - 8, children, MAX_CHILDREN);
+    for (size_t i = 0; i < count; ++i) {
+        if (strcmp(children[i].type, type) == 0) {
+            return children[i];
+        }
+    }
+    TEST_FAIL_MESSAGE(type);
+    return (box_t){ 0 };
+}
+
+static uint8_t *read_file(const char *path, size_t *length)
+{
+    FILE *file = fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL(file);
+    fseek(file, 0, SEEK_END);
+    *length = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = malloc(*length);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_EQUAL_UINT32(*length, fread(data, 1, *length, file));
+    fclose(file);
+    return data;
+}
+
+static void check_init_segment(const box_t *ftyp, const box_t *moov)
+{
+    TEST_ASSERT_EQUAL_MEMORY("iso6", ftyp->data + 8, 4);
+
+    box_t trak = child_box(moov, "trak");
+    box_t tkhd = child_box(&trak, "tkhd");
+    TEST_ASSERT_EQUAL_UINT32(1280u << 16, get_u32(tkhd.data + tkhd.size - 8));
+    TEST_ASSERT_EQUAL_UINT32(720u << 16, get_u32(tkhd.data + tkhd.size - 4));
+    box_t mdia = child_box(&trak, "mdia");
+    box_t mdhd = child_box(&mdia, "mdhd");
+    TEST_ASSERT_EQUAL_UINT32(FMP4_TIMESCALE, get_u32(mdhd.data + 20));
+    box_t minf = child_box(&mdia, "minf");
+    box_t stbl = child_box(&minf, "stbl");
+    box_t stsd = child_box(&stbl, "stsd");
+    TEST_ASSERT_EQUAL_UINT32(1, get_u32(stsd.data + 12));
+
+    /* avc1: sample entry and visual sample entry fields, then avcC. */
+    const uint8_t *avc1 = stsd.data + 16;
+    TEST_ASSERT_EQUAL_MEMORY("avc1", avc1 + 4, 4);
+    TEST_ASSERT_EQUAL_UINT32(1280, (avc1 + 32)[0] << 8 | (avc1 + 32)[1]);
+    TEST_ASSERT_EQUAL_UINT32(720, (avc1 + 34)[0] << 8 | (avc1 + 34)[1]);
+    const uint8_t *avcc = avc1 + 86;
+    TEST_ASSERT_EQUAL_MEMORY("avcC", avcc + 4, 4);
+    TEST_ASSERT_EQUAL_UINT8(1, avcc[8]);
+    TEST_ASSERT_EQUAL_MEMORY(s_sps + 1, avcc + 9, 3);
+    /* 4-byte NAL lengths, one SPS, one PPS. */
+    TEST_ASSERT_EQUAL_UINT8(0xFC | (FMP4_NAL_LENGTH_SIZE - 1), avcc[12]);
+    TEST_ASSERT_EQUAL_UINT8(0xE1, avcc[13]);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(s_sps), avcc[14] << 8 | avcc[15]);
+    TEST_ASSERT_EQUAL_MEMORY(s_sps, avcc + 16, sizeof(s_sps));
+    const uint8_t *pps = avcc + 16 + sizeof(s_sps);
+    TEST_ASSERT_EQUAL_UINT8(1, pps[0]);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(s_pps), pps[1] << 8 | pps[2]);
+    TEST_ASSERT_EQUAL_MEMORY(s_pps, pps + 3, sizeof(s_pps));
+
+    box_t mvex = child_box(moov, "mvex");
+    child_box(&mvex, "trex");
+}
+
+/* Checks one moof+mdat pair and returns the decode time just past its last sample. */
+static uint64_t check_fragment(const box_t *moof, const box_t *mdat, uint32_t sequence, uint64_t decode_time)
+{
+    box_t mfhd = child_box(moof, "mfhd");
+    TEST_ASSERT_EQUAL_UINT32(sequence, get_u32(mfhd.data + 12));
+    box_t traf = child_box(moof, "traf");
+    box_t tfhd = child_box(&traf, "tfhd");
+    /* default-base-is-moof: data offsets count from the start of the moof. */
+    TEST_ASSERT_EQUAL_UINT32(0x020000, get_u32(tfhd.data + 8) & 0xFFFFFF);
+    box_t tfdt = child_box(&traf, "tfdt");
+    TEST_ASSERT_EQUAL_UINT8(1, tfdt.data[8]);
+    TEST_ASSERT_EQUAL_UINT64(decode_time, get_u64(tfdt.data + 12));
+
+    box_t trun = child_box(&traf, "trun");
+    TEST_ASSERT_EQUAL_UINT32(0x000701, get_u32(trun.data + 8) & 0xFFFFFF);
+    uint32_t sample_count = get_u32(trun.data + 12);
+    TEST_ASSERT_EQUAL_UINT32(SAMPLES_PER_FRAGMENT, sample_count);
+    TEST_ASSERT_EQUAL_UINT32(20 + 12 * sample_count, trun.size);
+    TEST_ASSERT_TRUE(mdat->data == moof->data + moof->size);
+    TEST_ASSERT_EQUAL_UINT32(moof->size + 8, get_u32(trun.data + 16));
+
+    const uint8_t *sample = mdat->data + 8;
+    const uint8_t *mdat_end = mdat->data + mdat->size;
+    for (uint32_t i = 0; i < sample_count; ++i) {
+        const uint8_t *entry = trun.data + 20 + 12 * i;
+        uint32_t duration = get_u32(entry);
+        uint32_t size = get_u32(entry + 4);
+        uint32_t flags = get_u32(entry + 8);
+        TEST_ASSERT_UINT32_WITHIN(1, FMP4_TIMESCALE * (uint64_t)FRAME_INTERVAL_US / 1000000, duration);
+        TEST_ASSERT_EQUAL_HEX32(i == 0 ? 0x02000000 : 0x01010000, flags);
+        decode_time += duration;
+
+        /* Length-prefixed slices only: the parameter sets live in avcC, AUDs are dropped. */
+        TEST_ASSERT_TRUE(size <= (size_t)(mdat_end - sample));
+        size_t nal_count = 0;
+        for (size_t offset = 0; offset < size; ++nal_count) {
+            TEST_ASSERT_TRUE(size - offset > FMP4_NAL_LENGTH_SIZE);
+            uint32_t nal_length = get_u32(sample + offset);
+            offset += FMP4_NAL_LENGTH_SIZE;
+            TEST_ASSERT_TRUE(nal_length > 0 && nal_length <= size - offset);
+            uint8_t type = H264_NAL_TYPE(sample[offset]);
+            TEST_ASSERT_EQUAL_UINT8(i == 0 ? H264_NAL_TYPE_IDR : H264_NAL_TYPE_SLICE, type);
+            offset += nal_length;
+        }
+        TEST_ASSERT_EQUAL_UINT32(i == 0 ? 1 : 2, nal_count);
+        sample += size;
+    }
+    TEST_ASSERT_TRUE(sample == mdat_end);
+    return decode_time;
+}
+
+/* Runs ffprobe on the file when the host has it; prints and returns its one-line stream summary. */
+static bool ffprobe_summary(const char *path, char *line, size_t size)
+{
+    if (system("ffprobe -version > /dev/null 2>&1") != 0) {
+        return false;
+    }
+    char command[256];
+    snprintf(command, sizeof(command),
+             "ffprobe -v error -count_packets -select_streams v:0 "
+             "-show_entries stream=codec_name,width,height,nb_read_packets -of csv=p=0 %s", path);
+    FILE *pipe = popen(command, "r");
+    TEST_ASSERT_NOT_NULL(pipe);
+    bool read = fgets(line, (int)size, pipe) != NULL;
+    TEST_ASSERT_EQUAL_INT(0, pclose(pipe));
+    TEST_ASSERT_TRUE(read);
+    line[strcspn(line, "\r\n")] = '\0';
+    printf("ffprobe: %s\n", line);
+    return true;
+}
+
+TEST_CASE("fMP4 init segment and fragments written to a file have a valid box structure", "[fmp4_muxer]")
+{
+    static fmp4_muxer_t muxer;
+    static uint8_t access_units[SAMPLES_PER_FRAGMENT][2 * SLICE_SIZE + 64];
+    fmp4_muxer_init(&muxer, 30);
+    FILE *file = fopen(OUTPUT_PATH, "wb");
+    TEST_ASSERT_NOT_NULL(file);
+
+    size_t keyframe_length = make_access_unit(access_units[0], true, 0x10);
+    TEST_ASSERT_EQUAL(ESP_OK, fmp4_muxer_write_init_segment(&muxer, access_units[0], keyframe_length));
+    TEST_ASSERT_EQUAL_UINT32(1280, muxer.width);
+    TEST_ASSERT_EQUAL_UINT32(720, muxer.height);
+    TEST_ASSERT_EQUAL_UINT32(muxer.init_length, fwrite(muxer.init, 1, muxer.init_length, file));
+
+    /* One GOP per fragment, timestamps counting from an arbitrary capture time. */
+    uint64_t timestamp_us = 5000000;
+    for (int f = 0; f < FRAGMENT_COUNT; ++f) {
+        fmp4_sample_t samples[SAMPLES_PER_FRAGMENT];
+        for (int i = 0; i < SAMPLES_PER_FRAGMENT; ++i) {
+            samples[i] = (fmp4_sample_t){
+                .data = access_units[i],
+                .length = make_access_unit(access_units[i], i == 0, (uint8_t)(f * 16 + i)),
+                .timestamp_us = timestamp_us,
+                .is_keyframe = i == 0,
+            };
+            timestamp_us += FRAME_INTERVAL_US;
+        }
+        fmp4_fragment_t fragment;
+        TEST_ASSERT_EQUAL(ESP_OK, fmp4_muxer_write_fragment(&muxer, samples, SAMPLES_PER_FRAGMENT, &fragment));
+        size_t written = 0;
+        for (size_t s = 0; s < fragment.segment_count; ++s) {
+            written += fwrite(fragment.segments[s].data, 1, fragment.segments[s].length, file);
+        }
+        TEST_ASSERT_EQUAL_UINT32(fragment.length, written);
+    }
+    TEST_ASSERT_EQUAL_INT(0, fclose(file));
+
+    size_t length = 0;
+    uint8_t *data = read_file(OUTPUT_PATH, &length);
+    box_t boxes[2 + 2 * FRAGMENT_COUNT];
+    size_t count = split_boxes(data, length, boxes, sizeof(boxes) / sizeof(boxes[0]));
+    TEST_ASSERT_EQUAL_UINT32(2 + 2 * FRAGMENT_COUNT, count);
+    TEST_ASSERT_EQUAL_STRING("ftyp", boxes[0].type);
+    TEST_ASSERT_EQUAL_STRING("moov", boxes[1].type);
+    check_init_segment(&boxes[0], &boxes[1]);
+
+    uint64_t decode_time = 0;
+    for (int f = 0; f < FRAGMENT_COUNT; ++f) {
+        TEST_ASSERT_EQUAL_STRING("moof", boxes[2 + 2 * f].type);
+        TEST_ASSERT_EQUAL_STRING("mdat", boxes[3 + 2 * f].type);
+        decode_time = check_fragment(&boxes[2 + 2 * f], &boxes[3 + 2 * f], (uint32_t)f + 1, decode_time);
+    }
+    free(data);
+
+    char summary[128];
+    if (ffprobe_summary(OUTPUT_PATH, summary, sizeof(summary))) {
+        char expected[64];
+        snprintf(expected, sizeof(expected), "h264,1280,720,%d", FRAGMENT_COUNT * SAMPLES_PER_FRAGMENT);
+        TEST_ASSERT_EQUAL_STRING(expected, summary);
+    } else {
+        printf("ffprobe not found, %s checked by the box walk only\n", OUTPUT_PATH);
+    }
+}
@@ -0,0 +1,109 @@
+#include <string.h>
+
+#include "unity.h"
+
+#include "frame_pool.h"
+#include "memory_plan.h"
+#include "test_util.h"
+
+#define BLOCK_SIZE  256
+#define BLOCK_COUNT 64
+
+static void open_pool(frame_pool_t *pool)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, frame_pool_init(pool, BLOCK_COUNT * BLOCK_SIZE, BLOCK_SIZE, MEMORY_PLAN_HOT_CAPS));
+    TEST_ASSERT_EQUAL_UINT32(BLOCK_COUNT, pool->block_count);
+    TEST_ASSERT_EQUAL_UINT32(BLOCK_COUNT, pool->free_blocks);
+}
+
+TEST_CASE("frame pool hands out runs of whole blocks and takes them back", "[frame_pool]")
+{
+    frame_pool_t pool;
+    open_pool(&pool);
+
+    /* The header shares the first block, so a full block of payload needs two. */
+    uint8_t *small = frame_pool_alloc(&pool, 1);
+    uint8_t *large = frame_pool_alloc(&pool, BLOCK_SIZE);
+    TEST_ASSERT_NOT_NULL(small);
+    TEST_ASSERT_NOT_NULL(large);
+    TEST_ASSERT_EQUAL_UINT32(BLOCK_COUNT - 3, pool.free_blocks);
+    TEST_ASSERT_EQUAL_UINT32(0, ((uintptr_t)large - (uintptr_t)small) % BLOCK_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(0, (uintptr_t)large % 8);
+    memset(large, 0xA5, BLOCK_SIZE);
+
+    frame_pool_free(small);
+    frame_pool_free(large);
+    frame_pool_free(NULL);
+    TEST_ASSERT_EQUAL_UINT32(BLOCK_COUNT, pool.free_blocks);
+    frame_pool_deinit(&pool);
+}
+
+TEST_CASE("frame pool returns NULL when no run is long enough", "[frame_pool]")
+{
+    frame_pool_t pool;
+    open_pool(&pool);
+
+    TEST_ASSERT_NULL(frame_pool_alloc(&pool, BLOCK_COUNT * BLOCK_SIZE));
+    void *blocks[BLOCK_COUNT];
+    for (int i = 0; i < BLOCK_COUNT; ++i) {
+        blocks[i] = frame_pool_alloc(&pool, 1);
+        TEST_ASSERT_NOT_NULL(blocks[i]);
+    }
+    TEST_ASSERT_NULL(frame_pool_alloc(&pool, 1));
+
+    /* Every other block free: plenty of space, but no two blocks in a row. */
+    for (int i = 0; i < BLOCK_COUNT; i += 2) {
+        frame_pool_free(blocks[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(BLOCK_COUNT / 2, pool.free_blocks);
+    TEST_ASSERT_NULL(frame_pool_alloc(&pool, BLOCK_SIZE));
+    frame_pool_free(blocks[1]);
+    void *joined = frame_pool_alloc(&pool, 2 * BLOCK_SIZE);
+    TEST_ASSERT_EQUAL_PTR(blocks[0], joined);
+
+    frame_pool_free(joined);
+    for (int i = 3; i < BLOCK_COUNT; i += 2) {
+        frame_pool_free(blocks[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(BLOCK_COUNT, pool.free_blocks);
+    frame_pool_deinit(&pool);
+
+    /* A pool sized 0, as the FEC pool is with FEC off, is valid and always empty. */
+    TEST_ASSERT_EQUAL(ESP_OK, frame_pool_init(&pool, 0, BLOCK_SIZE, MEMORY_PLAN_BULK_CAPS));
+    TEST_ASSERT_NULL(frame_pool_alloc(&pool, 1));
+    frame_pool_deinit(&pool);
+}
+
+TEST_CASE("frame pool keeps a stream of frames flowing through a sliding window", "[frame_pool]")
+{
+    /* Sized as the RTSP server sizes its pools: the frames held at once plus headroom, at the average size. */
+    enum { HELD = 12, HEADROOM = 8, AVERAGE = 3000, FRAMES = 2000 };
+    frame_pool_t pool;
+    TEST_ASSERT_EQUAL(ESP_OK, frame_pool_init(&pool, frame_pool_size_for(BLOCK_SIZE, HELD + HEADROOM, AVERAGE),
+                                              BLOCK_SIZE, MEMORY_PLAN_BULK_CAPS));
+
+    /* Frames are freed oldest first; every tenth is four times the average, like a keyframe. */
+    lcg_t lcg = { .state = 42 };
+    uint8_t *window[HELD] = { NULL };
+    size_t lengths[HELD] = { 0 };
+    for (int i = 0; i < FRAMES; ++i) {
+        int slot = i % HELD;
+        if (window[slot]) {
+            for (size_t b = 0; b < lengths[slot]; ++b) {
+                TEST_ASSERT_EQUAL_HEX8((uint8_t)(slot + b), window[slot][b]);
+            }
+            frame_pool_free(window[slot]);
+        }
+        lengths[slot] = i % 10 == 0 ? 4 * AVERAGE : AVERAGE / 2 + lcg_next(&lcg) % (AVERAGE / 2);
+        window[slot] = frame_pool_alloc(&pool, lengths[slot]);
+        TEST_ASSERT_NOT_NULL(window[slot]);
+        for (size_t b = 0; b < lengths[slot]; ++b) {
+            window[slot][b] = (uint8_t)(slot + b);
+        }
+    }
+    for (int slot = 0; slot < HELD; ++slot) {
+        frame_pool_free(window[slot]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(pool.block_count, pool.free_blocks);
+    frame_pool_deinit(&pool);
+}
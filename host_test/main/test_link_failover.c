@@ -0,0 +1,105 @@
+#include "unity.h"
+
+#include "link_failover.h"
+
+#define HOLD_DOWN_MS    3000
+#define HOLD_DOWN_US    ((int64_t)HOLD_DOWN_MS * 1000)
+#define ETHERNET        CONNECTIVITY_TRANSPORT_ETHERNET
+#define WIFI            CONNECTIVITY_TRANSPORT_WIFI
+
+/* Preferring Ethernet, with both links healthy at time 0. */
+static void start_on_ethernet(link_failover_t *failover)
+{
+    link_failover_init(failover, ETHERNET, HOLD_DOWN_MS);
+    TEST_ASSERT_TRUE(link_failover_update(failover, true, true, 0));
+    TEST_ASSERT_EQUAL(ETHERNET, failover->active);
+    TEST_ASSERT_EQUAL_UINT32(0, failover->switches);
+}
+
+TEST_CASE("failover waits for a healthy link before choosing one", "[link_failover]")
+{
+    link_failover_t failover;
+    link_failover_init(&failover, ETHERNET, HOLD_DOWN_MS);
+    TEST_ASSERT_FALSE(link_failover_update(&failover, false, false, 0));
+    TEST_ASSERT_FALSE(failover.has_active);
+
+    /* The first link up is used at once, without a hold-down, and is not counted as a switch. */
+    TEST_ASSERT_TRUE(link_failover_update(&failover, false, true, 1000));
+    TEST_ASSERT_EQUAL(WIFI, failover.active);
+    TEST_ASSERT_EQUAL_UINT32(0, failover.switches);
+}
+
+TEST_CASE("failover leaves a failed link on the first update", "[link_failover]")
+{
+    link_failover_t failover;
+    start_on_ethernet(&failover);
+    TEST_ASSERT_FALSE(link_failover_update(&failover, true, true, 1000));
+
+    TEST_ASSERT_TRUE(link_failover_update(&failover, false, true, 2000));
+    TEST_ASSERT_EQUAL(WIFI, failover.active);
+    TEST_ASSERT_EQUAL_UINT32(1, failover.switches);
+}
+
+TEST_CASE("failover takes the preferred link back only after the hold-down", "[link_failover]")
+{
+    link_failover_t failover;
+    start_on_ethernet(&failover);
+    TEST_ASSERT_TRUE(link_failover_update(&failover, false, true, 1000));
+
+    int64_t recovered_us = 5000;
+    TEST_ASSERT_FALSE(link_failover_update(&failover, true, true, recovered_us));
+    TEST_ASSERT_FALSE(link_failover_update(&failover, true, true, recovered_us + HOLD_DOWN_US / 2));
+    TEST_ASSERT_FALSE(link_failover_update(&failover, true, true, recovered_us + HOLD_DOWN_US - 1));
+    TEST_ASSERT_EQUAL(WIFI, failover.active);
+
+    TEST_ASSERT_TRUE(link_failover_update(&failover, true, true, recovered_us + HOLD_DOWN_US));
+    TEST_ASSERT_EQUAL(ETHERNET, failover.active);
+    TEST_ASSERT_EQUAL_UINT32(2, failover.switches);
+}
+
+TEST_CASE("failover ignores a flapping preferred link", "[link_failover]")
+{
+    link_failover_t failover;
+    start_on_ethernet(&failover);
+    TEST_ASSERT_TRUE(link_failover_update(&failover, false, true, 1000));
+
+    /* Every time Ethernet comes back it drops again before the hold-down runs out. */
+    int64_t now = 2000;
+    for (int i = 0; i < 10; ++i) {
+        TEST_ASSERT_FALSE(link_failover_update(&failover, true, true, now));
+        now += HOLD_DOWN_US - 1000;
+        TEST_ASSERT_FALSE(link_failover_update(&failover, true, true, now));
+        now += 500;
+        TEST_ASSERT_FALSE(link_failover_update(&failover, false, true, now));
+        now += 500;
+    }
+    TEST_ASSERT_EQUAL(WIFI, failover.active);
+    TEST_ASSERT_EQUAL_UINT32(1, failover.switches);
+
+    /* Once it stays up, the hold-down counts from the last time it came back. */
+    int64_t stable_us = now;
+    TEST_ASSERT_FALSE(link_failover_update(&failover, true, true, stable_us));
+    TEST_ASSERT_FALSE(link_failover_update(&failover, true, true, stable_us + HOLD_DOWN_US - 1));
+    TEST_ASSERT_TRUE(link_failover_update(&failover, true, true, stable_us + HOLD_DOWN_US));
+    TEST_ASSERT_EQUAL(ETHERNET, failover.active);
+    TEST_ASSERT_EQUAL_UINT32(2, failover.switches);
+}
+
+TEST_CASE("failover keeps its link while both are down", "[link_failover]")
+{
+    link_failover_t failover;
+    start_on_ethernet(&failover);
+
+    TEST_ASSERT_FALSE(link_failover_update(&failover, false, false, 1000));
+    TEST_ASSERT_FALSE(link_failover_update(&failover, false, false, 1000 + 2 * HOLD_DOWN_US));
+    TEST_ASSERT_EQUAL(ETHERNET, failover.active);
+    TEST_ASSERT_EQUAL_UINT32(0, failover.switches);
+
+    /* The preferred link returning is no switch; the other one returning first is. */
+    TEST_ASSERT_FALSE(link_failover_update(&failover, true, false, 10000000));
+    TEST_ASSERT_EQUAL(ETHERNET, failover.active);
+    TEST_ASSERT_FALSE(link_failover_update(&failover, false, false, 11000000));
+    TEST_ASSERT_TRUE(link_failover_update(&failover, false, true, 12000000));
+    TEST_ASSERT_EQUAL(WIFI, failover.active);
+    TEST_ASSERT_EQUAL_UINT32(1, failover.switches);
+}
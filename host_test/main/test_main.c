@@ -0,0 +1,13 @@
+#include <stdlib.h>
+
+#include "unity.h"
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    int failures = UNITY_END();
+
+    /* On the linux target app_main returning leaves the scheduler running. */
+    exit(failures ? 1 : 0);
+}
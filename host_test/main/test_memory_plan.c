@@ -0,0 +1,101 @@
+#include "unity.h"
+
+#include "memory_plan.h"
+
+#define KIB 1024
+
+/* A board with 300 KiB of internal RAM in a 200 KiB largest block and 8 MiB of PSRAM in one block. */
+static const memory_plan_heap_t s_heap = {
+    .free = { [MEMORY_PLAN_INTERNAL] = 300 * KIB, [MEMORY_PLAN_SPIRAM] = 8192 * KIB },
+    .largest_block = { [MEMORY_PLAN_INTERNAL] = 200 * KIB, [MEMORY_PLAN_SPIRAM] = 8192 * KIB },
+};
+
+static void init_plan(memory_plan_t *plan)
+{
+    memory_plan_config_t config = {
+        .reserve = { [MEMORY_PLAN_INTERNAL] = 100 * KIB, [MEMORY_PLAN_SPIRAM] = 1024 * KIB },
+    };
+    memory_plan_init(plan, &config);
+}
+
+TEST_CASE("memory plan sums entries per region and skips empty ones", "[memory_plan]")
+{
+    static memory_plan_t plan;
+    init_plan(&plan);
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "descriptors", MEMORY_PLAN_INTERNAL, 64, 100));
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "frames", MEMORY_PLAN_SPIRAM, 256 * KIB, 4));
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "disabled", MEMORY_PLAN_SPIRAM, 0, 4));
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "none", MEMORY_PLAN_INTERNAL, 64, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, memory_plan_add(&plan, "bad", MEMORY_PLAN_REGION_COUNT, 64, 1));
+
+    TEST_ASSERT_EQUAL_UINT32(2, plan.entry_count);
+    TEST_ASSERT_EQUAL_UINT32(6400, plan.required[MEMORY_PLAN_INTERNAL]);
+    TEST_ASSERT_EQUAL_UINT32(1024 * KIB, plan.required[MEMORY_PLAN_SPIRAM]);
+    TEST_ASSERT_TRUE(memory_plan_fits(&plan, &s_heap));
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_check(&plan, &s_heap));
+}
+
+TEST_CASE("memory plan counts the reserve against free memory", "[memory_plan]")
+{
+    static memory_plan_t plan;
+    init_plan(&plan);
+    /* 200 KiB planned + 100 KiB reserved is exactly the 300 KiB free. */
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "queues", MEMORY_PLAN_INTERNAL, 100 * KIB, 2));
+    TEST_ASSERT_TRUE(memory_plan_fits(&plan, &s_heap));
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_check(&plan, &s_heap));
+
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "one more", MEMORY_PLAN_INTERNAL, 1, 1));
+    TEST_ASSERT_FALSE(memory_plan_fits(&plan, &s_heap));
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, memory_plan_check(&plan, &s_heap));
+}
+
+TEST_CASE("memory plan rejects a block larger than the largest free block", "[memory_plan]")
+{
+    static memory_plan_t plan;
+    init_plan(&plan);
+    /* Within the 200 KiB the region has room for, but not in one piece. */
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "ring", MEMORY_PLAN_INTERNAL, 200 * KIB + 1, 1));
+    TEST_ASSERT_EQUAL_UINT32(200 * KIB + 1, plan.required[MEMORY_PLAN_INTERNAL]);
+    TEST_ASSERT_FALSE(memory_plan_fits(&plan, &s_heap));
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, memory_plan_check(&plan, &s_heap));
+}
+
+TEST_CASE("memory plan drops an optional feature that does not fit", "[memory_plan]")
+{
+    static memory_plan_t plan;
+    init_plan(&plan);
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "encoder", MEMORY_PLAN_SPIRAM, 3 * 1024 * KIB, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "descriptors", MEMORY_PLAN_INTERNAL, 50 * KIB, 1));
+    memory_plan_t before = plan;
+
+    /* The same steps as check_memory_budget() in main_app.c for the pre-event buffer. */
+    size_t entries = plan.entry_count;
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "event GOPs", MEMORY_PLAN_SPIRAM, 1024 * KIB, 5));
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "event index", MEMORY_PLAN_INTERNAL, 1 * KIB, 8));
+    TEST_ASSERT_FALSE(memory_plan_fits(&plan, &s_heap));
+    memory_plan_truncate(&plan, entries);
+
+    TEST_ASSERT_EQUAL_UINT32(before.entry_count, plan.entry_count);
+    TEST_ASSERT_EQUAL_UINT32(before.required[MEMORY_PLAN_INTERNAL], plan.required[MEMORY_PLAN_INTERNAL]);
+    TEST_ASSERT_EQUAL_UINT32(before.required[MEMORY_PLAN_SPIRAM], plan.required[MEMORY_PLAN_SPIRAM]);
+    TEST_ASSERT_TRUE(memory_plan_fits(&plan, &s_heap));
+
+    /* A smaller feature still fits afterwards; truncating to the current count changes nothing. */
+    entries = plan.entry_count;
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "recording", MEMORY_PLAN_SPIRAM, 512 * KIB, 2));
+    TEST_ASSERT_TRUE(memory_plan_fits(&plan, &s_heap));
+    memory_plan_truncate(&plan, plan.entry_count);
+    TEST_ASSERT_EQUAL_UINT32(entries + 1, plan.entry_count);
+    TEST_ASSERT_EQUAL(ESP_OK, memory_plan_check(&plan, &s_heap));
+}
+
+TEST_CASE("memory plan refuses entries past its capacity", "[memory_plan]")
+{
+    static memory_plan_t plan;
+    init_plan(&plan);
+    for (int i = 0; i < MEMORY_PLAN_MAX_ENTRIES; ++i) {
+        TEST_ASSERT_EQUAL(ESP_OK, memory_plan_add(&plan, "entry", MEMORY_PLAN_INTERNAL, 16, 1));
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, memory_plan_add(&plan, "overflow", MEMORY_PLAN_INTERNAL, 16, 1));
+    TEST_ASSERT_EQUAL_UINT32(MEMORY_PLAN_MAX_ENTRIES * 16, plan.required[MEMORY_PLAN_INTERNAL]);
+}
@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "unity.h"
+
+#include "metrics.h"
+
+/* The registry is global and memory_account registers into it too, so each check looks for its own lines. */
+static METRICS_DEFINE_COUNTER(s_counter, "test_packets_total", "Packets counted by the test");
+static METRICS_DEFINE_GAUGE(s_gauge, "test_depth", "Depth set by the test");
+static METRICS_DEFINE_HISTOGRAM(s_histogram, "test_latency_us", "Latency observed by the test", 10, 100, 1000);
+
+static char s_output[16 * 1024];
+
+static size_t count_occurrences(const char *text, const char *needle)
+{
+    size_t count = 0;
+    for (const char *found = strstr(text, needle); found; found = strstr(found + 1, needle)) {
+        ++count;
+    }
+    return count;
+}
+
+static void register_test_metrics(void)
+{
+    metrics_register(&s_counter);
+    metrics_register(&s_gauge);
+    metrics_register(&s_histogram);
+}
+
+TEST_CASE("metrics export counters and gauges with HELP and TYPE lines", "[metrics]")
+{
+    register_test_metrics();
+    metrics_counter_add(&s_counter, 5);
+    metrics_counter_add(&s_counter, 2);
+    metrics_gauge_set(&s_gauge, 4);
+    metrics_gauge_add(&s_gauge, -7);
+
+    size_t length = metrics_format_prometheus(s_output, sizeof(s_output));
+    TEST_ASSERT_LESS_THAN(sizeof(s_output), length);
+    TEST_ASSERT_EQUAL(length, strlen(s_output));
+    TEST_ASSERT_NOT_NULL(strstr(s_output, "# HELP test_packets_total Packets counted by the test\n"
+                                          "# TYPE test_packets_total counter\n"
+                                          "test_packets_total 7\n"));
+    TEST_ASSERT_NOT_NULL(strstr(s_output, "# HELP test_depth Depth set by the test\n"
+                                          "# TYPE test_depth gauge\n"
+                                          "test_depth -3\n"));
+
+    /* Registering again must not list the metric twice. */
+    register_test_metrics();
+    metrics_format_prometheus(s_output, sizeof(s_output));
+    TEST_ASSERT_EQUAL(1, count_occurrences(s_output, "# TYPE test_packets_total "));
+    TEST_ASSERT_EQUAL(1, count_occurrences(s_output, "# TYPE test_depth "));
+}
+
+TEST_CASE("metrics export histograms with cumulative buckets, sum and count", "[metrics]")
+{
+    register_test_metrics();
+    metrics_format_prometheus(s_output, sizeof(s_output));
+    TEST_ASSERT_NOT_NULL(strstr(s_output, "test_latency_us_bucket{le=\"+Inf\"} 0\n"
+                                          "test_latency_us_sum 0\n"
+                                          "test_latency_us_count 0\n"));
+
+    /* A value on a bound lands in that bound's bucket; one above every bound only in +Inf. */
+    static const uint32_t values[] = { 5, 10, 11, 100, 640, 2000 };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        metrics_histogram_observe(&s_histogram, values[i]);
+    }
+    metrics_format_prometheus(s_output, sizeof(s_output));
+    TEST_ASSERT_NOT_NULL(strstr(s_output, "# HELP test_latency_us Latency observed by the test\n"
+                                          "# TYPE test_latency_us histogram\n"
+                                          "test_latency_us_bucket{le=\"10\"} 2\n"
+                                          "test_latency_us_bucket{le=\"100\"} 4\n"
+                                          "test_latency_us_bucket{le=\"1000\"} 5\n"
+                                          "test_latency_us_bucket{le=\"+Inf\"} 6\n"
+                                          "test_latency_us_sum 2766\n"
+                                          "test_latency_us_count 6\n"));
+}
+
+TEST_CASE("metrics output truncates like snprintf and returns the full length", "[metrics]")
+{
+    register_test_metrics();
+    size_t length = metrics_format_prometheus(NULL, 0);
+    TEST_ASSERT_GREATER_THAN(0, length);
+    TEST_ASSERT_EQUAL(length, metrics_format_prometheus(s_output, sizeof(s_output)));
+    TEST_ASSERT_EQUAL(length, strlen(s_output));
+
+    /* Size 0 never touches the buffer. */
+    char untouched = 'x';
+    TEST_ASSERT_EQUAL(length, metrics_format_prometheus(&untouched, 0));
+    TEST_ASSERT_EQUAL('x', untouched);
+
+    static char truncated[sizeof(s_output)];
+    for (size_t size = 1; size <= length + 1; ++size) {
+        memset(truncated, 'x', sizeof(truncated));
+        TEST_ASSERT_EQUAL(length, metrics_format_prometheus(truncated, size));
+        TEST_ASSERT_EQUAL(size - 1, strlen(truncated));
+        TEST_ASSERT_EQUAL_MEMORY(s_output, truncated, size - 1);
+        TEST_ASSERT_EQUAL('x', truncated[size]);
+    }
+}
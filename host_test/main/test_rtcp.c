@@ -0,0 +1,188 @@
+#include <string.h>
+
+#include "unity.h"
+
+#include "rtcp.h"
+#include "test_util.h"
+
+#define REPORTER_SSRC   0x5EC0DE01
+#define MEDIA_SSRC      0x12345678
+#define MAX_REPORTS     4
+#define MAX_NACKS       64
+
+typedef struct {
+    rtcp_report_block_t blocks[MAX_REPORTS];
+    uint32_t reporters[MAX_REPORTS];
+    size_t block_count;
+    uint16_t nacks[MAX_NACKS];
+    uint32_t nack_ssrc;
+    size_t nack_count;
+} rtcp_capture_t;
+
+static void on_report_block(void *user_ctx, uint32_t reporter_ssrc, const rtcp_report_block_t *block)
+{
+    rtcp_capture_t *capture = user_ctx;
+    if (capture->block_count < MAX_REPORTS) {
+        capture->reporters[capture->block_count] = reporter_ssrc;
+        capture->blocks[capture->block_count++] = *block;
+    }
+}
+
+static void on_nack(void *user_ctx, uint32_t media_ssrc, uint16_t sequence)
+{
+    rtcp_capture_t *capture = user_ctx;
+    capture->nack_ssrc = media_ssrc;
+    if (capture->nack_count < MAX_NACKS) {
+        capture->nacks[capture->nack_count++] = sequence;
+    }
+}
+
+static bool parse(const uint8_t *data, size_t length, rtcp_capture_t *capture)
+{
+    memset(capture, 0, sizeof(*capture));
+    rtcp_callbacks_t callbacks = {
+        .on_report_block = on_report_block,
+        .on_nack = on_nack,
+        .user_ctx = capture,
+    };
+    return rtcp_parse(data, length, &callbacks);
+}
+
+/* Writes an RR with one report block the way a receiver would, returns its length. */
+static size_t write_receiver_report(uint8_t *p, const rtcp_report_block_t *block)
+{
+    p[0] = (2 << 6) | 1;
+    p[1] = RTCP_PT_RR;
+    put_u16(p + 2, 7);
+    put_u32(p + 4, REPORTER_SSRC);
+    put_u32(p + 8, block->ssrc);
+    p[12] = block->fraction_lost;
+    uint32_t cumulative_lost = (uint32_t)block->cumulative_lost & 0xFFFFFF;
+    p[13] = cumulative_lost >> 16;
+    p[14] = (cumulative_lost >> 8) & 0xFF;
+    p[15] = cumulative_lost & 0xFF;
+    put_u32(p + 16, block->highest_sequence);
+    put_u32(p + 20, block->jitter);
+    put_u32(p + 24, block->last_sr);
+    put_u32(p + 28, block->delay_since_last_sr);
+    return 32;
+}
+
+/* Writes a generic NACK carrying `count` PID/BLP pairs, returns its length. */
+static size_t write_nack(uint8_t *p, const uint16_t (*pairs)[2], size_t count)
+{
+    p[0] = (2 << 6) | RTCP_FMT_GENERIC_NACK;
+    p[1] = RTCP_PT_RTPFB;
+    put_u16(p + 2, (uint16_t)(2 + count));
+    put_u32(p + 4, REPORTER_SSRC);
+    put_u32(p + 8, MEDIA_SSRC);
+    for (size_t i = 0; i < count; ++i) {
+        put_u16(p + 12 + i * 4, pairs[i][0]);
+        put_u16(p + 14 + i * 4, pairs[i][1]);
+    }
+    return 12 + count * 4;
+}
+
+TEST_CASE("receiver report yields loss, jitter and round-trip time", "[rtcp]")
+{
+    /* The SR went out at NTP 1000.5 s; the receiver held it for 0.25 s and the RR arrives at 1000.875 s. */
+    uint64_t sr_sent = (1000ULL << 32) | 0x80000000;
+    uint64_t rr_received = (1000ULL << 32) | 0xE0000000;
+    rtcp_report_block_t sent = {
+        .ssrc = MEDIA_SSRC,
+        .fraction_lost = 64,
+        .cumulative_lost = 1234,
+        .highest_sequence = (2u << 16) | 4321,
+        .jitter = 450,
+        .last_sr = rtcp_ntp_compact(sr_sent),
+        .delay_since_last_sr = 0x4000,
+    };
+    uint8_t packet[RTCP_MAX_PACKET_SIZE];
+    size_t length = write_receiver_report(packet, &sent);
+
+    rtcp_capture_t capture;
+    TEST_ASSERT_TRUE(parse(packet, length, &capture));
+    TEST_ASSERT_EQUAL_UINT32(1, capture.block_count);
+    const rtcp_report_block_t *block = &capture.blocks[0];
+    TEST_ASSERT_EQUAL_UINT32(REPORTER_SSRC, capture.reporters[0]);
+    TEST_ASSERT_EQUAL_UINT32(MEDIA_SSRC, block->ssrc);
+    /* 64/256 of the packets since the last report. */
+    TEST_ASSERT_EQUAL_UINT8(64, block->fraction_lost);
+    TEST_ASSERT_EQUAL_INT32(1234, block->cumulative_lost);
+    TEST_ASSERT_EQUAL_UINT32((2u << 16) | 4321, block->highest_sequence);
+    TEST_ASSERT_EQUAL_UINT32(450, block->jitter);
+    TEST_ASSERT_UINT32_WITHIN(20, 125000, rtcp_round_trip_us(block, rr_received));
+}
+
+TEST_CASE("negative cumulative loss from duplicates keeps its sign", "[rtcp]")
+{
+    rtcp_report_block_t sent = { .ssrc = MEDIA_SSRC, .cumulative_lost = -3 };
+    uint8_t packet[RTCP_MAX_PACKET_SIZE];
+    size_t length = write_receiver_report(packet, &sent);
+
+    rtcp_capture_t capture;
+    TEST_ASSERT_TRUE(parse(packet, length, &capture));
+    TEST_ASSERT_EQUAL_INT32(-3, capture.blocks[0].cumulative_lost);
+}
+
+TEST_CASE("round-trip time is 0 before an SR and when the clocks disagree", "[rtcp]")
+{
+    rtcp_report_block_t block = { .last_sr = 0, .delay_since_last_sr = 0x10000 };
+    TEST_ASSERT_EQUAL_UINT32(0, rtcp_round_trip_us(&block, 1000ULL << 32));
+
+    /* A delay longer than the time since the SR would give a negative round trip. */
+    block.last_sr = rtcp_ntp_compact(1000ULL << 32);
+    TEST_ASSERT_EQUAL_UINT32(0, rtcp_round_trip_us(&block, (1000ULL << 32) | 0x80000000));
+}
+
+TEST_CASE("generic NACK expands the PID and its bitmask", "[rtcp]")
+{
+    /* Bits 0 and 15 of the BLP name PID+1 and PID+16, wrapping past 65535. */
+    const uint16_t pairs[][2] = { { 100, 0x0000 }, { 65530, 0x8001 } };
+    uint8_t packet[RTCP_MAX_PACKET_SIZE];
+    size_t length = write_nack(packet, pairs, 2);
+
+    rtcp_capture_t capture;
+    TEST_ASSERT_TRUE(parse(packet, length, &capture));
+    TEST_ASSERT_EQUAL_UINT32(MEDIA_SSRC, capture.nack_ssrc);
+    const uint16_t expected[] = { 100, 65530, 65531, 10 };
+    TEST_ASSERT_EQUAL_UINT32(4, capture.nack_count);
+    for (size_t i = 0; i < 4; ++i) {
+        TEST_ASSERT_EQUAL_UINT16(expected[i], capture.nacks[i]);
+    }
+}
+
+TEST_CASE("compound SR, RR and NACK are all walked", "[rtcp]")
+{
+    uint8_t packet[RTCP_MAX_PACKET_SIZE * 2];
+    size_t length = rtcp_build_sender_report(packet, sizeof(packet), MEDIA_SSRC, 1000ULL << 32, 90000, 10, 12000,
+                                             "camera");
+    TEST_ASSERT_GREATER_THAN(0, length);
+    rtcp_report_block_t sent = { .ssrc = MEDIA_SSRC, .fraction_lost = 1 };
+    length += write_receiver_report(packet + length, &sent);
+    const uint16_t pairs[][2] = { { 7, 0x0003 } };
+    length += write_nack(packet + length, pairs, 1);
+
+    rtcp_capture_t capture;
+    TEST_ASSERT_TRUE(parse(packet, length, &capture));
+    TEST_ASSERT_EQUAL_UINT32(1, capture.block_count);
+    TEST_ASSERT_EQUAL_UINT32(3, capture.nack_count);
+    TEST_ASSERT_EQUAL_UINT16(9, capture.nacks[2]);
+}
+
+TEST_CASE("malformed compound packets are rejected", "[rtcp]")
+{
+    rtcp_report_block_t sent = { .ssrc = MEDIA_SSRC };
+    uint8_t packet[RTCP_MAX_PACKET_SIZE];
+    size_t length = write_receiver_report(packet, &sent);
+    rtcp_capture_t capture;
+
+    /* Length field beyond the datagram. */
+    TEST_ASSERT_FALSE(parse(packet, length - 4, &capture));
+    /* Trailing bytes that are not a whole header. */
+    TEST_ASSERT_FALSE(parse(packet, length + 2, &capture));
+    /* Wrong version. */
+    packet[0] = (1 << 6) | 1;
+    TEST_ASSERT_FALSE(parse(packet, length, &capture));
+    TEST_ASSERT_EQUAL_UINT32(0, capture.block_count);
+}
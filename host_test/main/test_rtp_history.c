@@ -0,0 +1,356 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "unity.h"
+
+#include "frame_pool.h"
+#include "memory_account.h"
+#include "rtcp.h"
+#include "rtp_history.h"
+#include "stream_frame.h"
+#include "test_util.h"
+
+#define FRAME_COUNT         40
+#define GOP_LENGTH          10
+#define MAX_FRAME_SIZE      24000
+#define HISTORY_PACKETS     512
+#define MAX_AGE_US          1000000
+#define FRAME_INTERVAL_US   33333
+#define DROP_PERCENT        8
+/* Starts close to the wrap, so the stream and its NACKs cross sequence 65535. */
+#define FIRST_SEQUENCE      65400
+#define MAX_DATAGRAM        (RTP_MAX_HEADER_SIZE + RTP_DEFAULT_MTU)
+#define MAX_PACKETS         1024
+#define MAX_FRAME_PACKETS   (MAX_FRAME_SIZE / (RTP_DEFAULT_MTU - RTP_MAX_HEADER_SIZE) + 1)
+
+/* Room for every frame either test holds at once, each as large as a keyframe. */
+static frame_pool_t s_frame_pool;
+static frame_pool_t s_descriptor_pool;
+
+static void open_pools(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, frame_pool_init(&s_frame_pool, frame_pool_size_for(4096, FRAME_COUNT, MAX_FRAME_SIZE),
+                                              4096, MEMORY_PLAN_BULK_CAPS));
+    TEST_ASSERT_EQUAL(ESP_OK, frame_pool_init(&s_descriptor_pool,
+                                              frame_pool_size_for(256, FRAME_COUNT,
+                                                                  MAX_FRAME_PACKETS * sizeof(rtp_packet_t)),
+                                              256, MEMORY_PLAN_HOT_CAPS));
+}
+
+/* Every frame went back to the pools once the last reference was dropped. */
+static void close_pools(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(s_frame_pool.block_count, s_frame_pool.free_blocks);
+    TEST_ASSERT_EQUAL_UINT32(s_descriptor_pool.block_count, s_descriptor_pool.free_blocks);
+    frame_pool_deinit(&s_frame_pool);
+    frame_pool_deinit(&s_descriptor_pool);
+}
+
+/* An IDR or non-IDR slice of pseudo-random size whose bytes never form a start code. */
+static stream_frame_t *create_frame(lcg_t *lcg, int index, uint8_t *scratch)
+{
+    bool keyframe = index % GOP_LENGTH == 0;
+    size_t length = keyframe ? MAX_FRAME_SIZE : 2000 + lcg_next(lcg) % 8000;
+    static const uint8_t start_code[] = { 0, 0, 0, 1 };
+    memcpy(scratch, start_code, sizeof(start_code));
+    scratch[4] = keyframe ? 0x65 : 0x41;
+    for (size_t i = 5; i < length; ++i) {
+        scratch[i] = (uint8_t)lcg_next(lcg) | 1;
+    }
+    h264_packet_t packet = {
+        .data = scratch,
+        .length = length,
+        .is_keyframe = keyframe,
+        .timestamp_us = (uint64_t)index * FRAME_INTERVAL_US,
+    };
+    return stream_frame_create(&s_frame_pool, &packet);
+}
+
+/* What ingest_frame() in rtsp_server.c does for a frame when FEC is off. */
+static void packetize_frame(rtp_packetizer_t *packetizer, stream_frame_t *frame)
+{
+    size_t count = rtp_packetizer_count(packetizer, frame->payload, frame->length);
+    frame->packets = frame_pool_alloc(&s_descriptor_pool, count * sizeof(rtp_packet_t));
+    TEST_ASSERT_NOT_NULL(frame->packets);
+    uint32_t rtp_timestamp = rtp_packetizer_timestamp(packetizer, frame->timestamp_us);
+    frame->media_packet_count = rtp_packetizer_packetize(packetizer, frame->payload, frame->length, rtp_timestamp,
+                                                         frame->packets, count);
+    frame->packet_count = frame->media_packet_count;
+    TEST_ASSERT_EQUAL_UINT32(count, frame->media_packet_count);
+}
+
+static size_t stream_index(uint16_t sequence)
+{
+    size_t index = (uint16_t)(sequence - FIRST_SEQUENCE);
+    TEST_ASSERT_LESS_THAN_UINT32(MAX_PACKETS, index);
+    return index;
+}
+
+static size_t serialize(const rtp_packet_t *packet, uint8_t *buffer)
+{
+    memcpy(buffer, packet->header, packet->header_length);
+    memcpy(buffer + packet->header_length, packet->payload, packet->payload_length);
+    return rtp_packet_size(packet);
+}
+
+/* Builds one RFC 4585 generic NACK for the sequences marked missing in [first, first + count). */
+static size_t build_nack(uint8_t *p, size_t size, uint32_t media_ssrc, const bool *missing, uint16_t first,
+                         size_t count)
+{
+    size_t length = 12;
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t sequence = (uint16_t)(first + i);
+        if (!missing[sequence]) {
+            continue;
+        }
+        uint16_t blp = 0;
+        size_t bit = 0;
+        for (; bit < 16 && i + 1 + bit < count; ++bit) {
+            if (missing[(uint16_t)(sequence + 1 + bit)]) {
+                blp |= 1u << bit;
+            }
+        }
+        if (length + 4 > size) {
+            break;
+        }
+        put_u16(p + length, sequence);
+        put_u16(p + length + 2, blp);
+        length += 4;
+        i += bit;
+    }
+    p[0] = (2 << 6) | RTCP_FMT_GENERIC_NACK;
+    p[1] = RTCP_PT_RTPFB;
+    put_u16(p + 2, (uint16_t)(length / 4 - 1));
+    put_u32(p + 4, 0);
+    put_u32(p + 8, media_ssrc);
+    return length;
+}
+
+typedef struct {
+    int rtp_rx;
+    int rtp_tx;
+    int rtcp_rx;
+    int rtcp_tx;
+    struct sockaddr_in rtp_address;
+    struct sockaddr_in rtcp_address;
+} loopback_t;
+
+static void loopback_open(loopback_t *loopback)
+{
+    loopback->rtp_rx = bind_loopback_socket(&loopback->rtp_address);
+    loopback->rtcp_rx = bind_loopback_socket(&loopback->rtcp_address);
+    loopback->rtp_tx = socket(AF_INET, SOCK_DGRAM, 0);
+    loopback->rtcp_tx = socket(AF_INET, SOCK_DGRAM, 0);
+    TEST_ASSERT_TRUE(loopback->rtp_tx >= 0 && loopback->rtcp_tx >= 0);
+}
+
+static void loopback_close(loopback_t *loopback)
+{
+    close(loopback->rtp_rx);
+    close(loopback->rtp_tx);
+    close(loopback->rtcp_rx);
+    close(loopback->rtcp_tx);
+}
+
+static void send_datagram(int sock, const struct sockaddr_in *address, const uint8_t *data, size_t length)
+{
+    TEST_ASSERT_EQUAL_INT((int)length, sendto(sock, data, length, 0, (const struct sockaddr *)address,
+                                              sizeof(*address)));
+}
+
+typedef struct {
+    rtp_history_t *history;
+    loopback_t *loopback;
+    uint32_t ssrc;
+    int64_t now_us;
+    uint32_t retransmitted;
+} sender_t;
+
+/* The sender side of on_nack() in rtsp_server.c, resending over the loopback RTP socket. */
+static void on_nack(void *user_ctx, uint32_t media_ssrc, uint16_t sequence)
+{
+    sender_t *sender = user_ctx;
+    TEST_ASSERT_EQUAL_UINT32(sender->ssrc, media_ssrc);
+    const rtp_packet_t *packet = rtp_history_lookup(sender->history, sequence, MAX_AGE_US, sender->now_us);
+    if (!packet) {
+        return;
+    }
+    uint8_t datagram[MAX_DATAGRAM];
+    size_t length = serialize(packet, datagram);
+    send_datagram(sender->loopback->rtp_tx, &sender->loopback->rtp_address, datagram, length);
+    ++sender->retransmitted;
+}
+
+TEST_CASE("NACKed packets dropped on a lossy loopback are resent from the history", "[rtp_history]")
+{
+    static uint8_t scratch[MAX_FRAME_SIZE];
+    static uint8_t received[MAX_PACKETS][MAX_DATAGRAM];
+    static uint16_t received_length[MAX_PACKETS];
+    static bool missing[65536];
+    memset(received_length, 0, sizeof(received_length));
+    memset(missing, 0, sizeof(missing));
+
+    open_pools();
+    rtp_history_t history;
+    TEST_ASSERT_EQUAL(ESP_OK, rtp_history_init(&history, HISTORY_PACKETS));
+    rtp_packetizer_t packetizer;
+    rtp_packetizer_init(&packetizer, RTP_DEFAULT_MTU);
+    packetizer.sequence = FIRST_SEQUENCE;
+    loopback_t loopback;
+    loopback_open(&loopback);
+    sender_t sender = {
+        .history = &history,
+        .loopback = &loopback,
+        .ssrc = packetizer.ssrc,
+    };
+    rtcp_callbacks_t callbacks = {
+        .on_nack = on_nack,
+        .user_ctx = &sender,
+    };
+
+    lcg_t lcg = { .state = 0xC0FFEE };
+    stream_frame_t *frames[FRAME_COUNT];
+    uint32_t sent = 0;
+    uint32_t dropped = 0;
+    for (int i = 0; i < FRAME_COUNT; ++i) {
+        sender.now_us = (int64_t)i * FRAME_INTERVAL_US;
+        frames[i] = create_frame(&lcg, i, scratch);
+        TEST_ASSERT_NOT_NULL(frames[i]);
+        packetize_frame(&packetizer, frames[i]);
+        rtp_history_store_frame(&history, frames[i], sender.now_us);
+
+        /* The channel: drop some packets, deliver the rest. */
+        uint16_t first = rtp_packet_sequence(&frames[i]->packets[0]);
+        for (size_t p = 0; p < frames[i]->packet_count; ++p) {
+            const rtp_packet_t *packet = &frames[i]->packets[p];
+            ++sent;
+            if (lcg_next(&lcg) % 100 < DROP_PERCENT) {
+                missing[rtp_packet_sequence(packet)] = true;
+                ++dropped;
+                continue;
+            }
+            uint8_t datagram[MAX_DATAGRAM];
+            send_datagram(loopback.rtp_tx, &loopback.rtp_address, datagram, serialize(packet, datagram));
+        }
+
+        /* The receiver: take in the frame, then NACK the gaps over RTCP. */
+        size_t expected = frames[i]->packet_count;
+        for (size_t p = 0; p < expected; ++p) {
+            uint16_t sequence = (uint16_t)(first + p);
+            if (missing[sequence]) {
+                continue;
+            }
+            uint8_t datagram[MAX_DATAGRAM];
+            ssize_t length = recv(loopback.rtp_rx, datagram, sizeof(datagram), 0);
+            TEST_ASSERT_TRUE(length > RTP_HEADER_SIZE);
+            uint16_t got = (uint16_t)((datagram[2] << 8) | datagram[3]);
+            memcpy(received[stream_index(got)], datagram, (size_t)length);
+            received_length[stream_index(got)] = (uint16_t)length;
+        }
+        uint8_t nack[RTCP_MAX_PACKET_SIZE];
+        size_t nack_length = build_nack(nack, sizeof(nack), packetizer.ssrc, missing, first, expected);
+        if (nack_length == 12) {
+            continue;
+        }
+        send_datagram(loopback.rtcp_tx, &loopback.rtcp_address, nack, nack_length);
+
+        /* The sender answers from the history; the receiver fills its gaps. */
+        uint8_t report[RTCP_MAX_PACKET_SIZE];
+        ssize_t report_length = recv(loopback.rtcp_rx, report, sizeof(report), 0);
+        TEST_ASSERT_EQUAL_INT((int)nack_length, (int)report_length);
+        uint32_t before = sender.retransmitted;
+        TEST_ASSERT_TRUE(rtcp_parse(report, (size_t)report_length, &callbacks));
+        for (uint32_t r = before; r < sender.retransmitted; ++r) {
+            uint8_t datagram[MAX_DATAGRAM];
+            ssize_t length = recv(loopback.rtp_rx, datagram, sizeof(datagram), 0);
+            TEST_ASSERT_TRUE(length > RTP_HEADER_SIZE);
+            uint16_t got = (uint16_t)((datagram[2] << 8) | datagram[3]);
+            TEST_ASSERT_TRUE(missing[got]);
+            missing[got] = false;
+            memcpy(received[stream_index(got)], datagram, (size_t)length);
+            received_length[stream_index(got)] = (uint16_t)length;
+        }
+    }
+
+    printf("history: %u packets, %u dropped, %u retransmitted, %u hits, %u misses\n", (unsigned)sent,
+           (unsigned)dropped, (unsigned)sender.retransmitted, (unsigned)history.hits, (unsigned)history.misses);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, dropped);
+    TEST_ASSERT_EQUAL_UINT32(dropped, sender.retransmitted);
+    TEST_ASSERT_EQUAL_UINT32(dropped, history.hits);
+    TEST_ASSERT_EQUAL_UINT32(0, history.misses);
+
+    /* Every packet arrived, byte for byte what was packetized, retransmissions included. */
+    for (int i = 0; i < FRAME_COUNT; ++i) {
+        for (size_t p = 0; p < frames[i]->packet_count; ++p) {
+            uint8_t datagram[MAX_DATAGRAM];
+            size_t length = serialize(&frames[i]->packets[p], datagram);
+            uint16_t sequence = rtp_packet_sequence(&frames[i]->packets[p]);
+            TEST_ASSERT_EQUAL_UINT32(length, received_length[stream_index(sequence)]);
+            TEST_ASSERT_EQUAL_MEMORY(datagram, received[stream_index(sequence)], length);
+        }
+        stream_frame_unref(frames[i]);
+    }
+    loopback_close(&loopback);
+    rtp_history_deinit(&history);
+    close_pools();
+}
+
+TEST_CASE("history misses evicted, expired and never-sent sequences", "[rtp_history]")
+{
+    static uint8_t scratch[MAX_FRAME_SIZE];
+    open_pools();
+    rtp_history_t history;
+    TEST_ASSERT_EQUAL(ESP_OK, rtp_history_init(&history, 48));
+    /* Rounded up so slots divide the sequence space. */
+    TEST_ASSERT_EQUAL_UINT32(64, history.capacity);
+    rtp_packetizer_t packetizer;
+    rtp_packetizer_init(&packetizer, RTP_DEFAULT_MTU);
+    packetizer.sequence = FIRST_SEQUENCE;
+
+    /* Enough keyframes to wrap the ring; only the newest 64 sequences are still held. */
+    lcg_t lcg = { .state = 7 };
+    uint16_t next = FIRST_SEQUENCE;
+    for (int i = 0; i < 8; ++i) {
+        stream_frame_t *frame = create_frame(&lcg, i * GOP_LENGTH, scratch);
+        TEST_ASSERT_NOT_NULL(frame);
+        packetize_frame(&packetizer, frame);
+        rtp_history_store_frame(&history, frame, 0);
+        next = (uint16_t)(next + frame->packet_count);
+        /* The history keeps its own reference. */
+        stream_frame_unref(frame);
+    }
+    TEST_ASSERT_GREATER_THAN_UINT32(2 * 64, (uint16_t)(next - FIRST_SEQUENCE));
+
+    uint16_t newest = (uint16_t)(next - 1);
+    const rtp_packet_t *packet = rtp_history_lookup(&history, newest, MAX_AGE_US, 0);
+    TEST_ASSERT_NOT_NULL(packet);
+    TEST_ASSERT_EQUAL_UINT16(newest, rtp_packet_sequence(packet));
+    packet = rtp_history_lookup(&history, (uint16_t)(newest - 63), MAX_AGE_US, 0);
+    TEST_ASSERT_NOT_NULL(packet);
+    TEST_ASSERT_EQUAL_UINT16((uint16_t)(newest - 63), rtp_packet_sequence(packet));
+    TEST_ASSERT_EQUAL_UINT32(2, history.hits);
+
+    /* Same slot as a held packet, overwritten by it. */
+    TEST_ASSERT_NULL(rtp_history_lookup(&history, (uint16_t)(newest - 64), MAX_AGE_US, 0));
+    TEST_ASSERT_NULL(rtp_history_lookup(&history, FIRST_SEQUENCE, MAX_AGE_US, 0));
+    /* Not sent yet. */
+    TEST_ASSERT_NULL(rtp_history_lookup(&history, next, MAX_AGE_US, 0));
+    /* Held, but older than the retransmission window. */
+    TEST_ASSERT_NULL(rtp_history_lookup(&history, newest, MAX_AGE_US, MAX_AGE_US + 1));
+    TEST_ASSERT_EQUAL_UINT32(2, history.hits);
+    TEST_ASSERT_EQUAL_UINT32(4, history.misses);
+
+    memory_account_stats_t before;
+    memory_account_get_stats(MEMORY_ACCOUNT_CONNECTIVITY, &before);
+    rtp_history_deinit(&history);
+    memory_account_stats_t after;
+    memory_account_get_stats(MEMORY_ACCOUNT_CONNECTIVITY, &after);
+    /* Dropping the last references freed the entries and returned the frames and descriptors to their pools. */
+    TEST_ASSERT_LESS_THAN_UINT32(before.current[MEMORY_PLAN_INTERNAL], after.current[MEMORY_PLAN_INTERNAL]);
+    TEST_ASSERT_NULL(history.entries);
+    close_pools();
+}
@@ -0,0 +1,143 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "esp_timer.h"
+#include "unity.h"
+
+#include "rtp_pacer.h"
+#include "test_util.h"
+
+#define PACKET_SIZE         RTP_PACER_MIN_BURST_BYTES
+#define PACKET_COUNT        200
+/* 8 Mbit/s, so one full-size packet every 1400 us once the burst is spent. */
+#define RATE_BYTES_PER_S    1000000
+#define NOMINAL_GAP_US      ((int64_t)PACKET_SIZE * 1000000 / RATE_BYTES_PER_S)
+#define BURST_PACKETS       4
+
+static int compare_gaps(const void *a, const void *b)
+{
+    int64_t left = *(const int64_t *)a;
+    int64_t right = *(const int64_t *)b;
+    return (left > right) - (left < right);
+}
+
+TEST_CASE("pacer sends the burst at once, then one packet per token interval", "[rtp_pacer]")
+{
+    rtp_pacer_t pacer;
+    rtp_pacer_init(&pacer, RATE_BYTES_PER_S, BURST_PACKETS * PACKET_SIZE, 0);
+
+    int64_t now = 0;
+    int64_t last_sent = 0;
+    for (int i = 0; i < PACKET_COUNT; ++i) {
+        int64_t wait_us = rtp_pacer_reserve(&pacer, PACKET_SIZE, now);
+        if (wait_us > 0) {
+            now += wait_us;
+            TEST_ASSERT_EQUAL_INT64(0, rtp_pacer_reserve(&pacer, PACKET_SIZE, now));
+        }
+        if (i < BURST_PACKETS) {
+            TEST_ASSERT_EQUAL_INT64(0, now);
+        } else {
+            TEST_ASSERT_EQUAL_INT64(NOMINAL_GAP_US, now - last_sent);
+        }
+        last_sent = now;
+    }
+}
+
+TEST_CASE("pacer without a burst allowance still paces at the token rate", "[rtp_pacer]")
+{
+    rtp_pacer_t pacer;
+    rtp_pacer_init(&pacer, RATE_BYTES_PER_S, 0, 0);
+
+    /* The bucket holds one MTU, so the first packet goes at once and the second waits for the rest. */
+    TEST_ASSERT_EQUAL_INT64(0, rtp_pacer_reserve(&pacer, PACKET_SIZE, 0));
+    int64_t expected_wait = (int64_t)(2 * PACKET_SIZE - RTP_PACER_MIN_BURST_BYTES) * 1000000 / RATE_BYTES_PER_S;
+    TEST_ASSERT_EQUAL_INT64(expected_wait, rtp_pacer_reserve(&pacer, PACKET_SIZE, 0));
+
+    int64_t now = expected_wait;
+    for (int i = 1; i < PACKET_COUNT; ++i) {
+        int64_t wait_us = rtp_pacer_reserve(&pacer, PACKET_SIZE, now);
+        now += wait_us;
+        if (wait_us > 0) {
+            TEST_ASSERT_EQUAL_INT64(0, rtp_pacer_reserve(&pacer, PACKET_SIZE, now));
+        }
+    }
+    int64_t paced_bytes = (int64_t)PACKET_COUNT * PACKET_SIZE - RTP_PACER_MIN_BURST_BYTES;
+    TEST_ASSERT_EQUAL_INT64(paced_bytes * 1000000 / RATE_BYTES_PER_S, now);
+}
+
+TEST_CASE("pacer refund lets a blocked packet go out without paying twice", "[rtp_pacer]")
+{
+    rtp_pacer_t pacer;
+    rtp_pacer_init(&pacer, RATE_BYTES_PER_S, PACKET_SIZE, 0);
+
+    TEST_ASSERT_EQUAL_INT64(0, rtp_pacer_reserve(&pacer, PACKET_SIZE, 0));
+    /* The send would block: without the refund the retry waits a whole token interval. */
+    rtp_pacer_refund(&pacer, PACKET_SIZE);
+    TEST_ASSERT_EQUAL_INT64(0, rtp_pacer_reserve(&pacer, PACKET_SIZE, 0));
+    TEST_ASSERT_EQUAL_INT64(NOMINAL_GAP_US, rtp_pacer_reserve(&pacer, PACKET_SIZE, 0));
+}
+
+TEST_CASE("pacer refund never raises the bucket above its depth", "[rtp_pacer]")
+{
+    rtp_pacer_t pacer;
+    rtp_pacer_init(&pacer, RATE_BYTES_PER_S, PACKET_SIZE, 0);
+
+    rtp_pacer_refund(&pacer, PACKET_SIZE);
+    rtp_pacer_refund(&pacer, PACKET_SIZE);
+    TEST_ASSERT_EQUAL_INT64(0, rtp_pacer_reserve(&pacer, PACKET_SIZE, 0));
+    TEST_ASSERT_EQUAL_INT64(NOMINAL_GAP_US, rtp_pacer_reserve(&pacer, PACKET_SIZE, 0));
+}
+
+/*
+ * Paces PACKET_COUNT datagrams to a socket on 127.0.0.1 in real time and stamps each one as it arrives. Receive
+ * times only lag send times, so no prefix of the stream may arrive faster than the burst plus the token rate
+ * allows, whatever the host load. The gap distribution is printed for comparison between runs.
+ */
+TEST_CASE("paced datagrams over loopback keep to the token rate", "[rtp_pacer]")
+{
+    struct sockaddr_in address;
+    int receiver = bind_loopback_socket(&address);
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    TEST_ASSERT_TRUE(sender >= 0);
+
+    static uint8_t packet[PACKET_SIZE];
+    static int64_t arrivals[PACKET_COUNT];
+    static int64_t gaps[PACKET_COUNT];
+    rtp_pacer_t pacer;
+    int64_t start = esp_timer_get_time();
+    rtp_pacer_init(&pacer, RATE_BYTES_PER_S, BURST_PACKETS * PACKET_SIZE, start);
+
+    for (int i = 0; i < PACKET_COUNT; ++i) {
+        int64_t wait_us;
+        while ((wait_us = rtp_pacer_reserve(&pacer, PACKET_SIZE, esp_timer_get_time())) > 0) {
+            usleep((useconds_t)wait_us);
+        }
+        TEST_ASSERT_EQUAL_INT(PACKET_SIZE, sendto(sender, packet, sizeof(packet), 0, (struct sockaddr *)&address,
+                                                  sizeof(address)));
+        TEST_ASSERT_EQUAL_INT(PACKET_SIZE, recv(receiver, packet, sizeof(packet), 0));
+        arrivals[i] = esp_timer_get_time();
+    }
+    close(sender);
+    close(receiver);
+
+    for (int i = 0; i < PACKET_COUNT; ++i) {
+        int64_t allowed = (int64_t)BURST_PACKETS * PACKET_SIZE + (arrivals[i] - start) * RATE_BYTES_PER_S / 1000000;
+        TEST_ASSERT_LESS_OR_EQUAL_INT64(allowed + PACKET_SIZE, (int64_t)(i + 1) * PACKET_SIZE);
+    }
+    size_t gap_count = 0;
+    for (int i = BURST_PACKETS + 1; i < PACKET_COUNT; ++i) {
+        gaps[gap_count++] = arrivals[i] - arrivals[i - 1];
+    }
+    qsort(gaps, gap_count, sizeof(int64_t), compare_gaps);
+    int64_t mean_us = (arrivals[PACKET_COUNT - 1] - arrivals[BURST_PACKETS]) / (int64_t)gap_count;
+    printf("inter-packet gap us: nominal %lld, mean %lld, p10 %lld, p50 %lld, p90 %lld, p99 %lld\n",
+           (long long)NOMINAL_GAP_US, (long long)mean_us, (long long)gaps[gap_count * 10 / 100],
+           (long long)gaps[gap_count / 2], (long long)gaps[gap_count * 90 / 100],
+           (long long)gaps[gap_count * 99 / 100]);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT64(NOMINAL_GAP_US * 95 / 100, mean_us);
+}
@@ -0,0 +1,316 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "esp_timer.h"
+#include "unity.h"
+
+#include "rtp_pacer.h"
+#include "ts_muxer.h"
+#include "test_util.h"
+
+#define FRAME_COUNT         60
+#define GOP_LENGTH          30
+#define FRAME_RATE          30
+#define FRAME_INTERVAL_US   (1000000 / FRAME_RATE)
+#define KEYFRAME_SIZE       60000
+#define MAX_FRAME_SIZE      KEYFRAME_SIZE
+#define MAX_STREAM_PACKETS  (FRAME_COUNT * (MAX_FRAME_SIZE / 184 + 4))
+#define PTS_DELAY_TICKS     (90 * 100)
+/* The defaults connectivity_default_config() gives the pacer. */
+#define PACING_BITRATE      (8 * 1024 * 1024)
+#define PACING_SPREAD       80
+#define PACING_BURST_BYTES  (8 * 1024)
+
+typedef struct {
+    uint8_t data[MAX_FRAME_SIZE];
+    size_t length;
+    bool is_keyframe;
+    uint64_t timestamp_us;
+} test_frame_t;
+
+/* A slice NAL of the size an 8 Mbit/s encoder would give, prefixed with SPS/PPS on keyframes. */
+static void make_frame(test_frame_t *frame, lcg_t *lcg, int index)
+{
+    static const uint8_t parameter_sets[] = {
+        0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe8, 0x06, 0xd0, 0xa1, 0x35,
+        0x00, 0x00, 0x00, 0x01, 0x68, 0xce, 0x06, 0xe2,
+    };
+    frame->is_keyframe = index % GOP_LENGTH == 0;
+    frame->timestamp_us = 7000000 + (uint64_t)index * FRAME_INTERVAL_US;
+    frame->length = frame->is_keyframe ? KEYFRAME_SIZE : 20000 + lcg_next(lcg) % 20000;
+    size_t offset = 0;
+    if (frame->is_keyframe) {
+        memcpy(frame->data, parameter_sets, sizeof(parameter_sets));
+        offset = sizeof(parameter_sets);
+    }
+    static const uint8_t start_code[] = { 0x00, 0x00, 0x00, 0x01 };
+    memcpy(frame->data + offset, start_code, sizeof(start_code));
+    frame->data[offset + 4] = frame->is_keyframe ? 0x65 : 0x41;
+    for (size_t i = offset + 5; i < frame->length; ++i) {
+        frame->data[i] = (uint8_t)lcg_next(lcg) | 1;
+    }
+}
+
+/* Muxes every packet of one frame into packets, returns how many. */
+static size_t mux_frame(ts_muxer_t *muxer, const test_frame_t *frame, uint8_t (*packets)[TS_PACKET_SIZE])
+{
+    ts_muxer_begin_frame(muxer, frame->data, frame->length, frame->timestamp_us, frame->is_keyframe);
+    size_t count = 0;
+    while (ts_muxer_write_packet(muxer, packets[count])) {
+        ++count;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(ts_muxer_frame_size(frame->length), count * TS_PACKET_SIZE);
+    return count;
+}
+
+static uint16_t packet_pid(const uint8_t *packet)
+{
+    return (uint16_t)(((packet[1] & 0x1F) << 8) | packet[2]);
+}
+
+static bool unit_start(const uint8_t *packet)
+{
+    return packet[1] & 0x40;
+}
+
+/* The adaptation field length including its length byte, or 0 when there is none. */
+static size_t adaptation_size(const uint8_t *packet)
+{
+    return (packet[3] & 0x20) ? 1 + (size_t)packet[4] : 0;
+}
+
+static uint64_t read_pcr_base(const uint8_t *packet)
+{
+    const uint8_t *pcr = packet + 6;
+    return ((uint64_t)pcr[0] << 25) | ((uint64_t)pcr[1] << 17) | ((uint64_t)pcr[2] << 9) | ((uint64_t)pcr[3] << 1) |
+           (pcr[4] >> 7);
+}
+
+static uint64_t read_timestamp(const uint8_t *p)
+{
+    return ((uint64_t)(p[0] & 0x0E) << 29) | ((uint64_t)p[1] << 22) | ((uint64_t)(p[2] & 0xFE) << 14) |
+           ((uint64_t)p[3] << 7) | (p[4] >> 1);
+}
+
+TEST_CASE("TS CRC-32 is the MPEG-2 CRC and closes every PAT and PMT section", "[ts_muxer]")
+{
+    /* The CRC-32/MPEG-2 check value. */
+    TEST_ASSERT_EQUAL_HEX32(0x0376E6E7, ts_crc32((const uint8_t *)"123456789", 9));
+
+    static test_frame_t frame;
+    lcg_t lcg = { .state = 3 };
+    make_frame(&frame, &lcg, 0);
+    static uint8_t packets[MAX_FRAME_SIZE / 184 + 4][TS_PACKET_SIZE];
+    ts_muxer_t muxer;
+    ts_muxer_init(&muxer);
+    size_t count = mux_frame(&muxer, &frame, packets);
+    TEST_ASSERT_GREATER_THAN_UINT32(2, count);
+
+    static const uint16_t pids[] = { 0x0000, TS_PMT_PID };
+    static const uint8_t table_ids[] = { 0x00, 0x02 };
+    for (int t = 0; t < 2; ++t) {
+        const uint8_t *packet = packets[t];
+        TEST_ASSERT_EQUAL_HEX8(0x47, packet[0]);
+        TEST_ASSERT_EQUAL_HEX16(pids[t], packet_pid(packet));
+        TEST_ASSERT_TRUE(unit_start(packet));
+        TEST_ASSERT_EQUAL_UINT8(0, packet[4]);
+        const uint8_t *section = packet + 5;
+        TEST_ASSERT_EQUAL_HEX8(table_ids[t], section[0]);
+        size_t section_length = 3 + (((size_t)(section[1] & 0x0F) << 8) | section[2]);
+        /* Over the section and its own CRC the remainder is zero. */
+        TEST_ASSERT_EQUAL_HEX32(0, ts_crc32(section, section_length));
+        TEST_ASSERT_EACH_EQUAL_HEX8(0xFF, section + section_length, TS_PACKET_SIZE - 5 - section_length);
+    }
+    /* The PMT lists the video PID as H.264. */
+    const uint8_t *pmt = packets[1] + 5;
+    TEST_ASSERT_EQUAL_HEX8(0x1B, pmt[12]);
+    TEST_ASSERT_EQUAL_HEX16(TS_VIDEO_PID, ((pmt[13] & 0x1F) << 8) | pmt[14]);
+}
+
+TEST_CASE("TS stream keeps continuity, stuffs with adaptation and spaces PCR and PTS", "[ts_muxer]")
+{
+    static test_frame_t frames[FRAME_COUNT];
+    static uint8_t packets[MAX_STREAM_PACKETS][TS_PACKET_SIZE];
+    static uint8_t pes[MAX_FRAME_SIZE + 64];
+    lcg_t lcg = { .state = 11 };
+    ts_muxer_t muxer;
+    ts_muxer_init(&muxer);
+
+    size_t total = 0;
+    size_t frame_start[FRAME_COUNT + 1];
+    for (int i = 0; i < FRAME_COUNT; ++i) {
+        make_frame(&frames[i], &lcg, i);
+        frame_start[i] = total;
+        TEST_ASSERT_LESS_THAN_UINT32(MAX_STREAM_PACKETS, total + MAX_FRAME_SIZE / 184 + 4);
+        total += mux_frame(&muxer, &frames[i], packets + total);
+    }
+    frame_start[FRAME_COUNT] = total;
+
+    int continuity[3] = { -1, -1, -1 };
+    int64_t last_tables_us = -1;
+    uint64_t first_pcr = 0;
+    for (int i = 0; i < FRAME_COUNT; ++i) {
+        size_t pes_length = 0;
+        bool tables = false;
+        for (size_t p = frame_start[i]; p < frame_start[i + 1]; ++p) {
+            const uint8_t *packet = packets[p];
+            TEST_ASSERT_EQUAL_HEX8(0x47, packet[0]);
+            uint16_t pid = packet_pid(packet);
+            int stream = pid == 0x0000 ? 0 : pid == TS_PMT_PID ? 1 : 2;
+            TEST_ASSERT_TRUE(stream < 2 || pid == TS_VIDEO_PID);
+            /* Every PID counts 0..15 by one per packet, all packets here carrying payload. */
+            TEST_ASSERT_TRUE(packet[3] & 0x10);
+            int cc = packet[3] & 0x0F;
+            if (continuity[stream] >= 0) {
+                TEST_ASSERT_EQUAL_INT((continuity[stream] + 1) & 0x0F, cc);
+            }
+            continuity[stream] = cc;
+            if (stream < 2) {
+                /* Tables come first, PAT before PMT. */
+                TEST_ASSERT_EQUAL_UINT32(frame_start[i] + (size_t)stream, p);
+                tables = true;
+                continue;
+            }
+
+            bool first = pes_length == 0;
+            TEST_ASSERT_EQUAL(first, unit_start(packet));
+            size_t adaptation = adaptation_size(packet);
+            const uint8_t *field = packet + 4;
+            if (first) {
+                /* PCR, and the random access indicator on keyframes. */
+                TEST_ASSERT_GREATER_OR_EQUAL_UINT32(8, adaptation);
+                TEST_ASSERT_EQUAL_HEX8(0x10 | (frames[i].is_keyframe ? 0x40 : 0x00), field[1]);
+                uint64_t pcr = read_pcr_base(packet);
+                if (i == 0) {
+                    first_pcr = pcr;
+                    TEST_ASSERT_EQUAL_UINT64(0, pcr);
+                }
+                uint64_t elapsed_us = frames[i].timestamp_us - frames[0].timestamp_us;
+                TEST_ASSERT_EQUAL_UINT64(first_pcr + elapsed_us * 90000 / 1000000, pcr);
+                if (adaptation > 8) {
+                    TEST_ASSERT_EACH_EQUAL_HEX8(0xFF, field + 8, adaptation - 8);
+                }
+            } else if (adaptation > 1) {
+                /* Only the last packet of a frame is short; it is padded with stuffing, not payload. */
+                TEST_ASSERT_EQUAL_UINT32(frame_start[i + 1] - 1, p);
+                TEST_ASSERT_EQUAL_HEX8(0x00, field[1]);
+                if (adaptation > 2) {
+                    TEST_ASSERT_EACH_EQUAL_HEX8(0xFF, field + 2, adaptation - 2);
+                }
+            } else {
+                TEST_ASSERT_TRUE(adaptation == 0 || p == frame_start[i + 1] - 1);
+            }
+            size_t payload = TS_PACKET_SIZE - 4 - adaptation;
+            TEST_ASSERT_LESS_OR_EQUAL_UINT32(sizeof(pes), pes_length + payload);
+            memcpy(pes + pes_length, packet + 4 + adaptation, payload);
+            pes_length += payload;
+        }
+
+        /* Tables ahead of every keyframe, and no further apart than 100 ms plus the frame that crosses it. */
+        if (frames[i].is_keyframe) {
+            TEST_ASSERT_TRUE(tables);
+        }
+        if (tables) {
+            last_tables_us = (int64_t)frames[i].timestamp_us;
+        }
+        TEST_ASSERT_TRUE((int64_t)frames[i].timestamp_us - last_tables_us < 100000 + FRAME_INTERVAL_US);
+
+        /* One PES per frame: header, PTS a fixed delay after the PCR, AUD, then the access unit untouched. */
+        static const uint8_t pes_start[] = { 0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x80, 0x05 };
+        TEST_ASSERT_EQUAL_MEMORY(pes_start, pes, sizeof(pes_start));
+        uint64_t elapsed_us = frames[i].timestamp_us - frames[0].timestamp_us;
+        TEST_ASSERT_EQUAL_UINT64(elapsed_us * 90000 / 1000000 + PTS_DELAY_TICKS, read_timestamp(pes + 9));
+        static const uint8_t aud[] = { 0x00, 0x00, 0x00, 0x01, 0x09, 0xF0 };
+        TEST_ASSERT_EQUAL_MEMORY(aud, pes + 14, sizeof(aud));
+        TEST_ASSERT_EQUAL_UINT32(14 + sizeof(aud) + frames[i].length, pes_length);
+        TEST_ASSERT_EQUAL_MEMORY(frames[i].data, pes + 14 + sizeof(aud), frames[i].length);
+    }
+}
+
+static int compare_spans(const void *a, const void *b)
+{
+    int64_t left = *(const int64_t *)a;
+    int64_t right = *(const int64_t *)b;
+    return (left > right) - (left < right);
+}
+
+/*
+ * The loop of ts_output_pump() on host sockets: frames arrive at the frame rate, each is muxed into 7-packet
+ * datagrams paced at rtp_pacer_frame_rate() for it, and the datagrams go to a socket on 127.0.0.1. No prefix of a
+ * frame may arrive faster than the bucket allows, and the stream as a whole must keep up with the frame rate.
+ */
+TEST_CASE("paced TS datagrams over loopback keep up with the frame rate", "[ts_muxer]")
+{
+    struct sockaddr_in address;
+    int receiver = bind_loopback_socket(&address);
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    TEST_ASSERT_TRUE(sender >= 0);
+
+    static test_frame_t frame;
+    static uint8_t packets[MAX_FRAME_SIZE / 184 + 4][TS_PACKET_SIZE];
+    static int64_t spans_us[FRAME_COUNT];
+    lcg_t lcg = { .state = 5 };
+    ts_muxer_t muxer;
+    ts_muxer_init(&muxer);
+    rtp_pacer_t pacer;
+    int64_t start = esp_timer_get_time();
+    rtp_pacer_init(&pacer, PACING_BITRATE / 8, PACING_BURST_BYTES, start);
+    uint64_t bytes = 0;
+    uint32_t datagrams = 0;
+    int64_t last_arrival = start;
+
+    for (int i = 0; i < FRAME_COUNT; ++i) {
+        int64_t due = start + (int64_t)i * FRAME_INTERVAL_US;
+        int64_t now = esp_timer_get_time();
+        if (now < due) {
+            usleep((useconds_t)(due - now));
+        }
+        make_frame(&frame, &lcg, i);
+        size_t count = mux_frame(&muxer, &frame, packets);
+        uint32_t rate = rtp_pacer_frame_rate(PACING_BITRATE, FRAME_RATE, PACING_SPREAD,
+                                             ts_muxer_frame_size(frame.length));
+        int64_t frame_begin = esp_timer_get_time();
+        rtp_pacer_set_rate(&pacer, rate, frame_begin);
+
+        size_t frame_bytes = 0;
+        for (size_t p = 0; p < count; p += TS_PACKETS_PER_DATAGRAM) {
+            size_t packets_left = count - p;
+            size_t length = (packets_left < TS_PACKETS_PER_DATAGRAM ? packets_left : TS_PACKETS_PER_DATAGRAM) *
+                            TS_PACKET_SIZE;
+            int64_t wait_us;
+            while ((wait_us = rtp_pacer_reserve(&pacer, length, esp_timer_get_time())) > 0) {
+                usleep((useconds_t)wait_us);
+            }
+            TEST_ASSERT_EQUAL_INT((int)length, sendto(sender, packets[p], length, 0, (struct sockaddr *)&address,
+                                                      sizeof(address)));
+            uint8_t datagram[TS_DATAGRAM_SIZE];
+            TEST_ASSERT_EQUAL_INT((int)length, recv(receiver, datagram, sizeof(datagram), 0));
+            TEST_ASSERT_EQUAL_MEMORY(packets[p], datagram, length);
+            last_arrival = esp_timer_get_time();
+            frame_bytes += length;
+            int64_t allowed = PACING_BURST_BYTES + (last_arrival - frame_begin) * (int64_t)rate / 1000000;
+            TEST_ASSERT_LESS_OR_EQUAL_INT64(allowed + TS_DATAGRAM_SIZE, (int64_t)frame_bytes);
+            ++datagrams;
+        }
+        spans_us[i] = last_arrival - frame_begin;
+        bytes += frame_bytes;
+    }
+    close(sender);
+    close(receiver);
+
+    int64_t elapsed_us = last_arrival - start;
+    qsort(spans_us, FRAME_COUNT, sizeof(int64_t), compare_spans);
+    printf("TS over loopback: %u datagrams, %.2f Mbit/s, frame send span p50 %lld us, p90 %lld us, max %lld us "
+           "(spread target %d us)\n", (unsigned)datagrams, bytes * 8.0 / (double)elapsed_us,
+           (long long)spans_us[FRAME_COUNT / 2], (long long)spans_us[FRAME_COUNT * 9 / 10],
+           (long long)spans_us[FRAME_COUNT - 1], FRAME_INTERVAL_US * PACING_SPREAD / 100);
+    /* Spread over 80% of the interval, the last frame is done well within its own interval. */
+    TEST_ASSERT_LESS_OR_EQUAL_INT64((int64_t)FRAME_COUNT * FRAME_INTERVAL_US + FRAME_INTERVAL_US / 2, elapsed_us);
+    TEST_ASSERT_LESS_OR_EQUAL_INT64(FRAME_INTERVAL_US, spans_us[FRAME_COUNT / 2]);
+}
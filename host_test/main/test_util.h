@@ -0,0 +1,66 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "unity.h"
+
+/* Fixed-seed generator for frame sizes, payload bytes and loss patterns, so every run sees the same stream. */
+typedef struct {
+    uint32_t state;
+} lcg_t;
+
+static inline uint32_t lcg_next(lcg_t *lcg)
+{
+    lcg->state = lcg->state * 1664525u + 1013904223u;
+    return lcg->state >> 8;
+}
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)get_u16(p) << 16) | get_u16(p + 2);
+}
+
+static inline uint64_t get_u64(const uint8_t *p)
+{
+    return ((uint64_t)get_u32(p) << 32) | get_u32(p + 4);
+}
+
+static inline void put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+static inline void put_u32(uint8_t *p, uint32_t value)
+{
+    put_u16(p, value >> 16);
+    put_u16(p + 2, value & 0xFFFF);
+}
+
+/* A UDP socket on an ephemeral loopback port, stored in `address`, with a large buffer and a 1 s receive timeout. */
+static inline int bind_loopback_socket(struct sockaddr_in *address)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    TEST_ASSERT_TRUE(sock >= 0);
+    *address = (struct sockaddr_in){
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t length = sizeof(*address);
+    TEST_ASSERT_EQUAL_INT(0, bind(sock, (struct sockaddr *)address, sizeof(*address)));
+    TEST_ASSERT_EQUAL_INT(0, getsockname(sock, (struct sockaddr *)address, &length));
+    int buffer_size = 4 * 1024 * 1024;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    struct timeval timeout = { .tv_sec = 1 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return sock;
+}
@@ -0,0 +1,66 @@
+#include "boot_timing.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "metrics.h"
+
+static const char *TAG = "boot";
+
+static const char *const s_phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_PHASE_APP_MAIN] = "app_main",
+    [BOOT_PHASE_CAMERA_READY] = "camera ready",
+    [BOOT_PHASE_ENCODER_READY] = "encoder ready",
+    [BOOT_PHASE_PIPELINE_STARTED] = "pipeline started",
+    [BOOT_PHASE_FIRST_FRAME] = "first frame",
+    [BOOT_PHASE_FIRST_ENCODED] = "first encoded frame",
+    [BOOT_PHASE_NVS_READY] = "NVS ready",
+    [BOOT_PHASE_NETWORK_STARTED] = "network started",
+    [BOOT_PHASE_GOT_IP] = "got IP",
+    [BOOT_PHASE_STORAGE_READY] = "storage ready",
+    [BOOT_PHASE_FIRST_PACKET] = "first packet",
+};
+
+/* Microseconds since esp_timer started early in boot; zero until the phase is reached. 32 bits last 71 minutes. */
+static atomic_uint s_phase_us[BOOT_PHASE_COUNT];
+
+static METRICS_DEFINE_GAUGE(s_first_frame_ms, "boot_time_to_first_frame_ms", "Boot to the first captured frame");
+static METRICS_DEFINE_GAUGE(s_first_packet_ms, "boot_time_to_first_packet_ms",
+                            "Boot to the first frame streamed once the board had an address");
+
+static void report(void)
+{
+    for (int phase = 0; phase < BOOT_PHASE_COUNT; ++phase) {
+        uint32_t us = atomic_load(&s_phase_us[phase]);
+        if (us) {
+            ESP_LOGI(TAG, "%-20s %6" PRIu32 " ms", s_phase_names[phase], us / 1000);
+        } else {
+            ESP_LOGI(TAG, "%-20s      - ", s_phase_names[phase]);
+        }
+    }
+    metrics_register(&s_first_frame_ms);
+    metrics_register(&s_first_packet_ms);
+    metrics_gauge_set(&s_first_frame_ms, (int32_t)(atomic_load(&s_phase_us[BOOT_PHASE_FIRST_FRAME]) / 1000));
+    metrics_gauge_set(&s_first_packet_ms, (int32_t)(atomic_load(&s_phase_us[BOOT_PHASE_FIRST_PACKET]) / 1000));
+}
+
+void boot_timing_mark(boot_phase_t phase)
+{
+    if (phase >= BOOT_PHASE_COUNT || atomic_load_explicit(&s_phase_us[phase], memory_order_relaxed)) {
+        return;
+    }
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+    unsigned int unset = 0;
+    if (atomic_compare_exchange_strong(&s_phase_us[phase], &unset, now_us ? now_us : 1) &&
+        phase == BOOT_PHASE_FIRST_PACKET) {
+        report();
+    }
+}
+
+bool boot_timing_reached(boot_phase_t phase)
+{
+    return phase < BOOT_PHASE_COUNT && atomic_load_explicit(&s_phase_us[phase], memory_order_relaxed) != 0;
+}
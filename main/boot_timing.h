@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    BOOT_PHASE_APP_MAIN,
+    BOOT_PHASE_CAMERA_READY,
+    BOOT_PHASE_ENCODER_READY,
+    BOOT_PHASE_PIPELINE_STARTED,
+    BOOT_PHASE_FIRST_FRAME,
+    BOOT_PHASE_FIRST_ENCODED,
+    BOOT_PHASE_NVS_READY,
+    BOOT_PHASE_NETWORK_STARTED,
+    BOOT_PHASE_GOT_IP,
+    BOOT_PHASE_STORAGE_READY,
+    /* The first encoded frame handed to the streaming servers once the board has an address. */
+    BOOT_PHASE_FIRST_PACKET,
+    BOOT_PHASE_COUNT,
+} boot_phase_t;
+
+/*
+ * Records the esp_timer time a phase was first reached; later marks of the same phase are ignored. Safe from
+ * any task. Marking BOOT_PHASE_FIRST_PACKET logs every phase and publishes time-to-first-frame and
+ * time-to-first-packet as metrics.
+ */
+void boot_timing_mark(boot_phase_t phase);
+
+bool boot_timing_reached(boot_phase_t phase);
+
+#ifdef __cplusplus
+}
+#endif
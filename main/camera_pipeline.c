@@ -0,0 +1,177 @@
+#include "camera_pipeline.h"
+
+#include "esp_log.h"
+
+#include "camera_driver.h"
+#include "boot_timing.h"
+#include "memory_account.h"
+
+static const char *TAG = "camera_pipeline";
+
+/* RTSP backlog, in frames, at which encoding halves its rate and stops; pacing alone keeps about one in flight. */
+#define CAMERA_BACKLOG_HALF_RATE_FRAMES 3
+#define CAMERA_BACKLOG_SKIP_FRAMES      5
+/* Still encode every fourth frame, so recording continues and a stalled viewer cannot stop the encoder. */
+#define CAMERA_MAX_SKIPPED_FRAMES       3
+
+static uint32_t s_skipped_run;
+
+static void release_camera_frame(void *release_ctx, pipeline_buffer_t *buffer)
+{
+    camera_driver_release_frame(&buffer->frame);
+}
+
+static void release_packet(void *release_ctx, pipeline_buffer_t *buffer)
+{
+    image_processing_release_packet((encoder_handle_t)release_ctx, &buffer->packet);
+}
+
+static esp_err_t capture_frame(void *user_ctx, pipeline_buffer_t *input, pipeline_buffer_t *output)
+{
+    esp_err_t err = camera_driver_acquire_frame(&output->frame, pdMS_TO_TICKS(1000));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Timeout waiting for camera frame");
+        return err;
+    }
+    boot_timing_mark(BOOT_PHASE_FIRST_FRAME);
+    output->release = release_camera_frame;
+    return ESP_OK;
+}
+
+/*
+ * Skipping before the encoder keeps every GOP intact: the next encoded frame simply predicts from the last
+ * one that was encoded, where a frame dropped after encoding would break the reference chain.
+ */
+static bool skip_for_backlog(camera_pipeline_t *camera)
+{
+    uint32_t backlog = connectivity_get_backlog(atomic_load(&camera->transport));
+    bool skip = backlog >= CAMERA_BACKLOG_SKIP_FRAMES || (backlog >= CAMERA_BACKLOG_HALF_RATE_FRAMES && s_skipped_run == 0);
+    if (!skip || s_skipped_run >= CAMERA_MAX_SKIPPED_FRAMES) {
+        s_skipped_run = 0;
+        return false;
+    }
+    ++s_skipped_run;
+    return true;
+}
+
+static esp_err_t encode_frame(void *user_ctx, pipeline_buffer_t *input, pipeline_buffer_t *output)
+{
+    camera_pipeline_t *camera = (camera_pipeline_t *)user_ctx;
+    if (connectivity_take_keyframe_request(atomic_load(&camera->transport))) {
+        image_processing_request_keyframe(camera->encoder);
+    } else if (skip_for_backlog(camera)) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+    esp_err_t err = image_processing_encode_frame(camera->encoder, &input->frame, &output->packet);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to encode frame");
+        return err;
+    }
+    boot_timing_mark(BOOT_PHASE_FIRST_ENCODED);
+    memory_account_note_frame();
+    output->release = release_packet;
+    output->release_ctx = camera->encoder;
+    return ESP_OK;
+}
+
+static esp_err_t stream_packet(void *user_ctx, pipeline_buffer_t *input, pipeline_buffer_t *output)
+{
+    transport_handle_t transport = atomic_load(&((camera_pipeline_t *)user_ctx)->transport);
+    if (!transport) {
+        return ESP_OK;
+    }
+    esp_err_t err = connectivity_stream_packet(transport, &input->packet);
+    if (err == ESP_OK && boot_timing_reached(BOOT_PHASE_GOT_IP)) {
+        boot_timing_mark(BOOT_PHASE_FIRST_PACKET);
+    }
+    return err;
+}
+
+static esp_err_t buffer_packet(void *user_ctx, pipeline_buffer_t *input, pipeline_buffer_t *output)
+{
+    return recorder_event_buffer_append((event_buffer_handle_t)user_ctx, &input->packet);
+}
+
+static esp_err_t record_packet(void *user_ctx, pipeline_buffer_t *input, pipeline_buffer_t *output)
+{
+    recording_handle_t recording = atomic_load(&((camera_pipeline_t *)user_ctx)->recording);
+    return recording ? recorder_recording_write(recording, &input->packet) : ESP_OK;
+}
+
+esp_err_t camera_pipeline_start(camera_pipeline_t *camera, pipeline_handle_t *out_pipeline)
+{
+    /*
+     * Capture and streaming share core 0 with the RTSP/HTTP servers; the encoder runs on core 1 next to the
+     * local storage sinks. Capture drops raw frames rather than stall the sensor, the stream never drops
+     * encoded frames, and the storage sinks skip to the next keyframe when they fall behind.
+     */
+    const pipeline_stage_config_t stages[] = {
+        {
+            .name = "capture",
+            .type = PIPELINE_STAGE_SOURCE,
+            .output_type = PIPELINE_ITEM_RAW_FRAME,
+            .process = capture_frame,
+            .task = { .priority = tskIDLE_PRIORITY + 6, .core_id = 0, .stack_size = 4 * 1024 },
+        },
+        {
+            .name = "encode",
+            .type = PIPELINE_STAGE_ENCODER,
+            .input = "capture",
+            .input_type = PIPELINE_ITEM_RAW_FRAME,
+            .output_type = PIPELINE_ITEM_H264_PACKET,
+            .process = encode_frame,
+            .user_ctx = camera,
+            .channel = { .length = 1, .drop_policy = PIPELINE_DROP_NEWEST },
+            .task = { .priority = tskIDLE_PRIORITY + 5, .core_id = 1, .stack_size = 4 * 1024 },
+        },
+        {
+            .name = "tee",
+            .type = PIPELINE_STAGE_TEE,
+            .input = "encode",
+        },
+        {
+            .name = "stream",
+            .type = PIPELINE_STAGE_SINK,
+            .input = "tee",
+            .input_type = PIPELINE_ITEM_H264_PACKET,
+            .process = stream_packet,
+            .user_ctx = (atomic_load(&camera->transport) || camera->attach_later.transport) ? camera : NULL,
+            .channel = { .length = 2, .drop_policy = PIPELINE_DROP_NEVER },
+            .task = { .priority = tskIDLE_PRIORITY + 5, .core_id = 0, .stack_size = 6 * 1024 },
+        },
+        {
+            .name = "event_buffer",
+            .type = PIPELINE_STAGE_SINK,
+            .input = "tee",
+            .input_type = PIPELINE_ITEM_H264_PACKET,
+            .process = buffer_packet,
+            .user_ctx = camera->event_buffer,
+            .channel = { .length = 1, .drop_policy = PIPELINE_DROP_TO_KEYFRAME },
+            .task = { .priority = tskIDLE_PRIORITY + 4, .core_id = 1, .stack_size = 3 * 1024 },
+        },
+        {
+            .name = "recording",
+            .type = PIPELINE_STAGE_SINK,
+            .input = "tee",
+            .input_type = PIPELINE_ITEM_H264_PACKET,
+            .process = record_packet,
+            .user_ctx = (atomic_load(&camera->recording) || camera->attach_later.recording) ? camera : NULL,
+            .channel = { .length = 1, .drop_policy = PIPELINE_DROP_TO_KEYFRAME },
+            .task = { .priority = tskIDLE_PRIORITY + 4, .core_id = 1, .stack_size = 3 * 1024 },
+        },
+    };
+
+    pipeline_stage_config_t active[PIPELINE_MAX_STAGES];
+    size_t active_count = 0;
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); ++i) {
+        if (stages[i].type == PIPELINE_STAGE_SINK && !stages[i].user_ctx) {
+            continue;
+        }
+        active[active_count++] = stages[i];
+    }
+
+    pipeline_config_t config = pipeline_default_config();
+    config.stages = active;
+    config.stage_count = active_count;
+    return pipeline_start(&config, out_pipeline);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "image_processing.h"
+#include "connectivity.h"
+#include "recorder.h"
+#include "pipeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    encoder_handle_t encoder;
+    event_buffer_handle_t event_buffer;
+    /*
+     * Loaded by the sinks on every packet, so they can be stored while the pipeline runs; until then the sink
+     * passes packets by. A recording attached late starts at the next keyframe, and viewers ask for one.
+     */
+    _Atomic(transport_handle_t) transport;
+    _Atomic(recording_handle_t) recording;
+    /* Keeps a sink in the graph although its handle is still NULL at start. */
+    struct {
+        bool transport;
+        bool recording;
+    } attach_later;
+} camera_pipeline_t;
+
+/*
+ * Starts capture -> encode -> tee -> {stream, event buffer, recording}. Sinks without a handle are left out of
+ * the graph unless marked in attach_later. `camera` is used by the stage tasks and must outlive the pipeline.
+ */
+esp_err_t camera_pipeline_start(camera_pipeline_t *camera, pipeline_handle_t *out_pipeline);
+
+#ifdef __cplusplus
+}
+#endif
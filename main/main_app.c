@@ -3,72 +3,235 @@
 #include "esp_err.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_netif.h"
 #include "nvs_flash.h"
+#include "esp_vfs_fat.h"
+#include "driver/sdmmc_host.h"
+#include "sd_pwr_ctrl_by_on_chip_ldo.h"
 
 #include "camera_driver.h"
 #include "image_processing.h"
 #include "connectivity.h"
+#include "recorder.h"
+#include "camera_pipeline.h"
+#include "boot_timing.h"
+#include "trace.h"
+#include "image_processing_microbench.h"
+#include "connectivity_microbench.h"
 
 static const char *TAG = "main";
 
+static esp_err_t mount_sdcard(const char *mount_point)
+{
+    /* The P4 SD card pins are powered from on-chip LDO channel 4. */
+    sd_pwr_ctrl_ldo_config_t ldo_cfg = {
+        .ldo_chan_id = 4,
+    };
+    sd_pwr_ctrl_handle_t pwr_ctrl = NULL;
+    esp_err_t err = sd_pwr_ctrl_new_on_chip_ldo(&ldo_cfg, &pwr_ctrl);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+    host.slot = SDMMC_HOST_SLOT_0;
+    host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+    host.pwr_ctrl_handle = pwr_ctrl;
+    sdmmc_slot_config_t slot_cfg = SDMMC_SLOT_CONFIG_DEFAULT();
+    slot_cfg.width = 4;
+    esp_vfs_fat_sdmmc_mount_config_t mount_cfg = {
+        .format_if_mount_failed = false,
+        .max_files = 2,
+        .allocation_unit_size = 64 * 1024,
+    };
+
+    sdmmc_card_t *card = NULL;
+    err = esp_vfs_fat_sdmmc_mount(mount_point, &host, &slot_cfg, &mount_cfg, &card);
+    if (err != ESP_OK) {
+        sd_pwr_ctrl_del_on_chip_ldo(pwr_ctrl);
+    }
+    return err;
+}
+
+#if CONFIG_MICROBENCH_RUN_ON_BOOT
+/* Before the camera and network start, so nothing else competes for the core or the caches. */
+static void run_microbenchmarks(void)
+{
+    microbench_config_t config = microbench_default_config();
+#if CONFIG_MICROBENCH_CACHE_COLD
+    config.cache = MICROBENCH_CACHE_COLD;
+#endif
+    size_t count = 0;
+    const microbench_case_t *cases = image_processing_microbench_cases(&count);
+    microbench_run_suite(&config, cases, count, NULL);
+    cases = connectivity_microbench_cases(&count);
+    microbench_run_suite(&config, cases, count, NULL);
+}
+#endif
+
+static transport_config_t transport_config(void)
+{
+    encoder_config_t encoder_cfg = image_processing_default_encoder_config();
+    transport_config_t transport_cfg = connectivity_default_transport_config();
+    transport_cfg.pacing.bitrate = encoder_cfg.bitrate;
+    transport_cfg.pacing.frame_rate = encoder_cfg.fps;
+    transport_cfg.server_task.core_id = 0;
+    return transport_cfg;
+}
+
 typedef struct {
-    encoder_handle_t encoder;
-    transport_handle_t transport;
-} camera_pipeline_handle_t;
+    bool event_buffer;
+    bool recording;
+} optional_features_t;
 
-static void camera_task(void *arg)
+/*
+ * Adds up what every component keeps before any of it is allocated, so a configuration that cannot fit stops
+ * here with a report rather than part-way through start-up. The pre-event buffer and local recording have
+ * always been optional; they are planned last and left out when there is no room for them.
+ */
+static esp_err_t check_memory_budget(const camera_config_t *camera_cfg, const encoder_config_t *encoder_cfg,
+                                     const event_buffer_config_t *event_buffer_cfg, optional_features_t *out_features)
 {
-    camera_pipeline_handle_t *pipeline = (camera_pipeline_handle_t *)arg;
-
-    while (true) {
-        camera_frame_t frame = {0};
-        if (camera_driver_acquire_frame(&frame, pdMS_TO_TICKS(1000)) == ESP_OK) {
-            h264_packet_t packet = {0};
-            if (image_processing_encode_frame(pipeline->encoder, &frame, &packet) == ESP_OK) {
-                connectivity_stream_packet(pipeline->transport, &packet);
-                image_processing_release_packet(pipeline->encoder, &packet);
-            } else {
-                ESP_LOGW(TAG, "Failed to encode frame");
-            }
-            camera_driver_release_frame(&frame);
-        } else {
-            ESP_LOGW(TAG, "Timeout waiting for camera frame");
-        }
+    static memory_plan_t plan;
+    memory_plan_config_t plan_cfg = memory_plan_default_config();
+    memory_plan_init(&plan, &plan_cfg);
+    transport_config_t transport_cfg = transport_config();
+    recording_config_t recording_cfg = recorder_default_recording_config();
+
+    esp_err_t err = camera_driver_plan_memory(camera_cfg, &plan);
+    if (err == ESP_OK) {
+        err = image_processing_plan_memory(encoder_cfg, &plan);
+    }
+    if (err == ESP_OK) {
+        err = connectivity_plan_memory(&transport_cfg, &plan);
+    }
+    if (err != ESP_OK) {
+        return err;
     }
+
+    memory_plan_heap_t heap = memory_plan_current_heap();
+    size_t entries = plan.entry_count;
+    out_features->event_buffer = recorder_plan_event_buffer_memory(event_buffer_cfg, &plan) == ESP_OK &&
+                                 memory_plan_fits(&plan, &heap);
+    if (!out_features->event_buffer) {
+        memory_plan_truncate(&plan, entries);
+    }
+    entries = plan.entry_count;
+    out_features->recording = recorder_plan_recording_memory(&recording_cfg, &plan) == ESP_OK &&
+                              memory_plan_fits(&plan, &heap);
+    if (!out_features->recording) {
+        memory_plan_truncate(&plan, entries);
+    }
+    return memory_plan_check(&plan, &heap);
 }
 
-void app_main(void)
+static void on_got_ip(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_err_t nvs_ret = nvs_flash_init();
-    if (nvs_ret == ESP_ERR_NVS_NO_FREE_PAGES || nvs_ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+    boot_timing_mark(BOOT_PHASE_GOT_IP);
+}
+
+/*
+ * NVS, Wi-Fi/Ethernet bring-up and the servers, beside the camera lane. Frames encoded before the transport is
+ * attached are simply not streamed.
+ */
+static void network_boot_task(void *arg)
+{
+    camera_pipeline_t *camera = (camera_pipeline_t *)arg;
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
-        nvs_ret = nvs_flash_init();
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+    boot_timing_mark(BOOT_PHASE_NVS_READY);
+
+    transport_config_t transport_cfg = transport_config();
+    transport_handle_t transport = NULL;
+    if (connectivity_start(&transport_cfg, &transport) == ESP_OK) {
+        boot_timing_mark(BOOT_PHASE_NETWORK_STARTED);
+        atomic_store(&camera->transport, transport);
+    } else {
+        ESP_LOGE(TAG, "Network unavailable, streaming disabled");
+    }
+    vTaskDelete(NULL);
+}
+
+/* Mounting the card and preallocating the recording buffers, which can take a few hundred milliseconds. */
+static void storage_boot_task(void *arg)
+{
+    camera_pipeline_t *camera = (camera_pipeline_t *)arg;
+    recording_config_t recording_cfg = recorder_default_recording_config();
+    recording_handle_t recording = NULL;
+    if (mount_sdcard(recording_cfg.directory) == ESP_OK &&
+        recorder_start_recording(&recording_cfg, &recording) == ESP_OK) {
+        boot_timing_mark(BOOT_PHASE_STORAGE_READY);
+        atomic_store(&camera->recording, recording);
+    } else {
+        ESP_LOGW(TAG, "No SD card, local recording disabled");
     }
-    ESP_ERROR_CHECK(nvs_ret);
+    vTaskDelete(NULL);
+}
+
+void app_main(void)
+{
+    boot_timing_mark(BOOT_PHASE_APP_MAIN);
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &on_got_ip, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &on_got_ip, NULL));
+#if CONFIG_TRACE_START_ON_BOOT
+    trace_start();
+#endif
+#if CONFIG_MICROBENCH_RUN_ON_BOOT
+    run_microbenchmarks();
+#endif
 
     camera_config_t camera_cfg = camera_driver_default_config();
+    encoder_config_t encoder_cfg = image_processing_default_encoder_config();
+    event_buffer_config_t event_buffer_cfg = recorder_default_event_buffer_config();
+    event_buffer_cfg.frame_rate = encoder_cfg.fps;
+    optional_features_t features = {0};
+    if (check_memory_budget(&camera_cfg, &encoder_cfg, &event_buffer_cfg, &features) != ESP_OK) {
+        ESP_LOGE(TAG, "Memory budget does not fit, not starting");
+        return;
+    }
+
+    /*
+     * Referenced by the stage tasks for the lifetime of the application. The network and the SD card come up on
+     * their own tasks and attach their sinks when ready, so capture and encoding start without waiting for DHCP
+     * or the card.
+     */
+    static camera_pipeline_t camera = {
+        .attach_later = { .transport = true },
+    };
+    if (xTaskCreatePinnedToCore(network_boot_task, "boot_network", 4096, &camera, tskIDLE_PRIORITY + 3, NULL, 0) !=
+        pdPASS) {
+        ESP_LOGE(TAG, "Failed to start network boot task");
+    }
+    if (!features.recording) {
+        ESP_LOGW(TAG, "No memory left for recording buffers, local recording disabled");
+    } else if (xTaskCreatePinnedToCore(storage_boot_task, "boot_storage", 4096, &camera, tskIDLE_PRIORITY + 2, NULL,
+                                       1) == pdPASS) {
+        camera.attach_later.recording = true;
+    } else {
+        ESP_LOGE(TAG, "Failed to start storage boot task");
+    }
+
     ESP_ERROR_CHECK(camera_driver_init(&camera_cfg));
+    boot_timing_mark(BOOT_PHASE_CAMERA_READY);
 
-    encoder_config_t encoder_cfg = image_processing_default_encoder_config();
-    transport_config_t transport_cfg = connectivity_default_transport_config();
+    ESP_ERROR_CHECK(image_processing_create_encoder(&encoder_cfg, &camera.encoder));
+    boot_timing_mark(BOOT_PHASE_ENCODER_READY);
+
+    if (!features.event_buffer ||
+        recorder_create_event_buffer(&event_buffer_cfg, &camera.event_buffer) != ESP_OK) {
+        ESP_LOGW(TAG, "Pre-event buffer unavailable, continuing without it");
+    }
 
-    camera_pipeline_handle_t pipeline = {0};
-    ESP_ERROR_CHECK(image_processing_create_encoder(&encoder_cfg, &pipeline.encoder));
-    ESP_ERROR_CHECK(connectivity_start(&transport_cfg, &pipeline.transport));
-
-    BaseType_t task_created = xTaskCreatePinnedToCore(
-        camera_task,
-        "camera_task",
-        8 * 1024,
-        &pipeline,
-        tskIDLE_PRIORITY + 5,
-        NULL,
-        tskNO_AFFINITY);
-
-    if (task_created != pdPASS) {
-        ESP_LOGE(TAG, "Failed to create camera task");
-        connectivity_stop(pipeline.transport);
-        image_processing_destroy_encoder(pipeline.encoder);
+    pipeline_handle_t pipeline = NULL;
+    if (camera_pipeline_start(&camera, &pipeline) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start camera pipeline");
+        image_processing_destroy_encoder(camera.encoder);
+        return;
     }
+    boot_timing_mark(BOOT_PHASE_PIPELINE_STARTED);
 }
@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+"""Measure capture-to-client latency from the timing SEI in the board's H.264 stream.
+
+Against a board (WebSocket stream and clock endpoint on the HTTP port):
+
+    tools/latency_probe.py <board> --duration 30
+
+On the host, with a simulated camera and encoder streaming over loopback:
+
+    tools/latency_probe.py --simulate --duration 10
+
+Every access unit starts with a user-data-unregistered SEI (payload type 5) written by h264_timing_sei_write()
+in components/image_processing:
+
+    00 00 00 01 06 05 <payload size 51> <16-byte UUID> <fields> 80
+
+The fields are sequence (5 bytes), capture, encode begin and encode end (10 bytes each) in esp_timer
+microseconds. Each is big-endian 7-bit groups with the top bit of every byte set, so the SEI never needs
+emulation prevention. The probe estimates the board clock offset from GET /clock round trips, taking the
+fastest of several, and counts a frame as displayed when its last WebSocket byte arrives; decode and
+display time on a real client come on top.
+"""
+
+import argparse
+import base64
+import os
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+
+SEI_UUID = bytes([0x7A, 0x1F, 0x3C, 0x9E, 0x52, 0xD4, 0x4B, 0x8A, 0x9E, 0x61, 0xC2, 0xD8, 0x3F, 0x5A, 0xB7, 0xE4])
+FIELD_SEPTETS = (5, 10, 10, 10)
+WS_HEADER_SIZE = 16
+STAGES = ("queue", "encode", "transport", "total")
+
+
+def now_us():
+    return time.monotonic_ns() // 1000
+
+
+def write_septets(value, count):
+    return bytes(0x80 | ((value >> (7 * i)) & 0x7F) for i in range(count - 1, -1, -1))
+
+
+def build_sei(sequence, capture_us, encode_begin_us, encode_end_us):
+    fields = b"".join(write_septets(v, n) for v, n in zip((sequence, capture_us, encode_begin_us, encode_end_us),
+                                                             FIELD_SEPTETS))
+    payload = SEI_UUID + fields
+    return b"\x00\x00\x00\x01\x06\x05" + bytes([len(payload)]) + payload + b"\x80"
+
+
+def iter_nals(data):
+    """Yields NAL units of an Annex-B stream without start codes."""
+    starts = []
+    i = data.find(b"\x00\x00\x01")
+    while i >= 0:
+        starts.append(i + 3)
+        i = data.find(b"\x00\x00\x01", i + 3)
+    for n, start in enumerate(starts):
+        end = starts[n + 1] - 3 if n + 1 < len(starts) else len(data)
+        yield data[start:end].rstrip(b"\x00")
+
+
+def unescape(rbsp):
+    return rbsp.replace(b"\x00\x00\x03", b"\x00\x00")
+
+
+def parse_timing_sei(access_unit):
+    """Returns (sequence, capture_us, encode_begin_us, encode_end_us) or None."""
+    for nal in iter_nals(access_unit):
+        if not nal or nal[0] & 0x1F != 6:
+            continue
+        payload = unescape(nal[1:])
+        pos = 0
+        while pos < len(payload) and payload[pos] != 0x80:
+            payload_type = payload_size = 0
+            while payload[pos] == 0xFF:
+                payload_type += 255
+                pos += 1
+            payload_type += payload[pos]
+            pos += 1
+            while payload[pos] == 0xFF:
+                payload_size += 255
+                pos += 1
+            payload_size += payload[pos]
+            pos += 1
+            body = payload[pos:pos + payload_size]
+            pos += payload_size
+            if payload_type != 5 or body[:16] != SEI_UUID:
+                continue
+            values, offset = [], 16
+            for count in FIELD_SEPTETS:
+                value = 0
+                for byte in body[offset:offset + count]:
+                    value = (value << 7) | (byte & 0x7F)
+                values.append(value)
+                offset += count
+            return tuple(values)
+    return None
+
+
+def http_get(host, port, path):
+    with socket.create_connection((host, port), timeout=5) as sock:
+        sock.sendall(f"GET {path} HTTP/1.1\r\nHost: {host}\r\nConnection: close\r\n\r\n".encode())
+        response = b""
+        while chunk := sock.recv(4096):
+            response += chunk
+    header, _, body = response.partition(b"\r\n\r\n")
+    if not header.startswith(b"HTTP/1.1 200"):
+        raise RuntimeError(f"GET {path}: {header.splitlines()[0].decode(errors='replace')}")
+    return body
+
+
+def clock_offset(host, port, path, samples=8):
+    """Board time minus host time in microseconds, from the round trip with the smallest delay."""
+    best = None
+    for _ in range(samples):
+        sent = now_us()
+        board = int(http_get(host, port, path))
+        received = now_us()
+        rtt = received - sent
+        if best is None or rtt < best[0]:
+            best = (rtt, board - (sent + received) // 2)
+    return best[1], best[0]
+
+
+class WebSocket:
+    def __init__(self, host, port, path):
+        self.sock = socket.create_connection((host, port), timeout=5)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall((f"GET {path} HTTP/1.1\r\nHost: {host}\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                           f"Sec-WebSocket-Key: {key}\r\nSec-WebSocket-Version: 13\r\n\r\n").encode())
+        self.buffer = b""
+        while b"\r\n\r\n" not in self.buffer:
+            self.buffer += self._recv()
+        header, _, self.buffer = self.buffer.partition(b"\r\n\r\n")
+        if not header.startswith(b"HTTP/1.1 101"):
+            raise RuntimeError(f"WebSocket upgrade failed: {header.splitlines()[0].decode(errors='replace')}")
+
+    def _recv(self):
+        chunk = self.sock.recv(65536)
+        if not chunk:
+            raise EOFError("stream closed")
+        return chunk
+
+    def _read(self, length):
+        while len(self.buffer) < length:
+            self.buffer += self._recv()
+        data, self.buffer = self.buffer[:length], self.buffer[length:]
+        return data
+
+    def message(self):
+        """Returns the next binary message and the host time its last byte arrived."""
+        while True:
+            first, second = self._read(2)
+            length = second & 0x7F
+            if length == 126:
+                length = struct.unpack(">H", self._read(2))[0]
+            elif length == 127:
+                length = struct.unpack(">Q", self._read(8))[0]
+            payload = self._read(length)
+            opcode = first & 0x0F
+            if opcode == 0x2:
+                return payload, now_us()
+            if opcode == 0x8:
+                raise EOFError("stream closed")
+
+    def close(self):
+        self.sock.close()
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def report(samples, lost, out=sys.stdout):
+    print(f"{len(samples['total'])} frames, {lost} lost in transit or skipped on the board", file=out)
+    print(f"{'stage':<10} {'p50':>8} {'p90':>8} {'p99':>8} {'max':>8}   (ms)", file=out)
+    for stage in STAGES:
+        values = samples[stage]
+        if values:
+            row = [percentile(values, f) / 1000 for f in (0.5, 0.9, 0.99)] + [max(values) / 1000]
+            print(f"{stage:<10} " + " ".join(f"{v:8.2f}" for v in row), file=out)
+
+
+def probe(host, port, args):
+    offset, rtt = clock_offset(host, port, args.clock_path)
+    print(f"clock offset {offset} us (+/- {rtt // 2} us)", file=sys.stderr)
+    last_sync = now_us()
+    ws = WebSocket(host, port, args.ws_path)
+    samples = {stage: [] for stage in STAGES}
+    lost = 0
+    last_sequence = None
+    keyframes = 0
+    deadline = now_us() + int(args.duration * 1e6)
+    try:
+        while now_us() < deadline:
+            message, received = ws.message()
+            flags = message[0]
+            keyframes += flags & 1
+            # The first GOP may come from the board's cache and says nothing about live latency.
+            if keyframes < 2:
+                continue
+            timing = parse_timing_sei(message[WS_HEADER_SIZE:])
+            if timing is None:
+                continue
+            sequence, capture, encode_begin, encode_end = timing
+            if last_sequence is not None and sequence > last_sequence + 1:
+                lost += sequence - last_sequence - 1
+            last_sequence = sequence
+            board_received = received + offset
+            samples["queue"].append(encode_begin - capture)
+            samples["encode"].append(encode_end - encode_begin)
+            samples["transport"].append(board_received - encode_end)
+            samples["total"].append(board_received - capture)
+            if received - last_sync > args.resync * 1e6:
+                offset, rtt = clock_offset(host, port, args.clock_path)
+                last_sync = now_us()
+    finally:
+        ws.close()
+    report(samples, lost)
+
+
+class SimulatedBoard(threading.Thread):
+    """Serves /clock and a WebSocket stream of synthetic access units with timing SEI over loopback."""
+
+    def __init__(self, fps, gop):
+        super().__init__(daemon=True)
+        self.listener = socket.create_server(("127.0.0.1", 0))
+        self.port = self.listener.getsockname()[1]
+        self.fps = fps
+        self.gop = gop
+        # A board clock that started at an unrelated time, so the offset estimate has real work to do.
+        self.epoch = random.randint(10_000_000, 1_000_000_000)
+
+    def board_us(self):
+        return now_us() + self.epoch
+
+    def run(self):
+        while True:
+            client, _ = self.listener.accept()
+            threading.Thread(target=self.serve, args=(client,), daemon=True).start()
+
+    def serve(self, client):
+        with client:
+            request = b""
+            while b"\r\n\r\n" not in request:
+                chunk = client.recv(4096)
+                if not chunk:
+                    return
+                request += chunk
+            if request.startswith(b"GET /clock"):
+                body = f"{self.board_us()}\n".encode()
+                client.sendall(b"HTTP/1.1 200 OK\r\nContent-Length: %d\r\nConnection: close\r\n\r\n%s"
+                               % (len(body), body))
+            elif request.startswith(b"GET /ws"):
+                client.sendall(b"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                               b"Sec-WebSocket-Accept: simulated\r\n\r\n")
+                try:
+                    self.stream(client)
+                except OSError:
+                    pass
+
+    def stream(self, client):
+        interval = 1.0 / self.fps
+        sequence = 0
+        next_capture = time.monotonic()
+        while True:
+            time.sleep(max(0.0, next_capture - time.monotonic()))
+            next_capture += interval
+            capture = self.board_us()
+            # Queueing, encoding and sending times loosely modelled on the board at 1080p30.
+            time.sleep(random.uniform(0.5, 4) / 1000)
+            encode_begin = self.board_us()
+            time.sleep(random.uniform(8, 14) / 1000)
+            encode_end = self.board_us()
+            keyframe = sequence % self.gop == 0
+            slice_data = os.urandom(20000 if keyframe else 4000).replace(b"\x00", b"\x01")
+            access_unit = build_sei(sequence, capture, encode_begin, encode_end)
+            if keyframe:
+                access_unit += b"\x00\x00\x00\x01\x67\x64\x00\x28" + b"\x00\x00\x00\x01\x68\xee\x3c\x80"
+            access_unit += b"\x00\x00\x00\x01" + (b"\x65" if keyframe else b"\x41") + slice_data
+            header = struct.pack(">B3xIQ", 1 if keyframe else 0, sequence & 0xFFFFFFFF, encode_begin)
+            time.sleep(random.uniform(1, 6) / 1000)
+            payload = header + access_unit
+            client.sendall(struct.pack(">BBQ", 0x82, 127, len(payload)) + payload)
+            sequence += 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("board", nargs="?", help="board address (host or host:port)")
+    parser.add_argument("--simulate", action="store_true", help="measure a simulated source over loopback")
+    parser.add_argument("--duration", type=float, default=30.0, help="seconds to measure")
+    parser.add_argument("--ws-path", default="/ws")
+    parser.add_argument("--clock-path", default="/clock")
+    parser.add_argument("--resync", type=float, default=10.0, help="seconds between clock offset updates")
+    parser.add_argument("--fps", type=int, default=30, help="simulated frame rate")
+    parser.add_argument("--gop", type=int, default=30, help="simulated keyframe interval")
+    args = parser.parse_args()
+
+    if args.simulate:
+        board = SimulatedBoard(args.fps, args.gop)
+        board.start()
+        host, port = "127.0.0.1", board.port
+    elif args.board:
+        host, _, port = args.board.partition(":")
+        port = int(port or 8080)
+    else:
+        parser.error("give a board address or --simulate")
+    probe(host, port, args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Convert a pipeline trace dump into Chrome trace / Perfetto JSON.
+
+Fetch a dump from the board and convert it:
+
+    curl -s "http://<board>:8080/trace?start"
+    curl -s -o trace.bin http://<board>:8080/trace
+    tools/trace_to_chrome.py trace.bin -o trace.json
+
+then open trace.json in https://ui.perfetto.dev or chrome://tracing.
+
+Dump format (little-endian), written by trace_dump() in components/trace:
+
+    file header:  u32 magic "PTRC", u16 version, u16 core_count, u32 cpu_hz, u32 ring_events
+    per core:     u32 anchor_cycles, u32 record_count, i64 anchor_us, u32 overwritten, u32 reserved,
+                  then record_count records, oldest first
+    record:       u32 cycles, u32 arg, u16 event, u16 reserved
+
+Each core counts its own cycles. The anchor pairs that core's counter with esp_timer, which both cores share,
+so timestamps are rebuilt backwards from the anchor. Gaps longer than one 32-bit cycle wrap (about 10 s at
+400 MHz) between consecutive events on a core cannot be told apart from shorter ones.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = 0x43525450
+FILE_HEADER = struct.Struct("<IHHII")
+CORE_HEADER = struct.Struct("<IIqII")
+RECORD = struct.Struct("<IIHH")
+
+# Mirrors trace_event_t in components/trace/include/trace.h: id -> (name, phase, argument name).
+EVENTS = {
+    1: ("capture", "i", "sequence"),
+    2: ("capture dropped", "i", "sequence"),
+    3: ("encode", "B", "sequence"),
+    4: ("encode", "E", "timestamp"),
+    5: ("stream submit", "B", "timestamp"),
+    6: ("stream submit", "E", "timestamp"),
+    7: ("rtsp packetize", "B", "timestamp"),
+    8: ("rtsp packetize", "E", "timestamp"),
+    9: ("rtsp service", "B", "ready"),
+    10: ("rtsp service", "E", "backlog"),
+    11: ("rtsp frame sent", "i", "timestamp"),
+}
+
+
+def read_dump(data):
+    if len(data) < FILE_HEADER.size:
+        raise ValueError("dump is truncated")
+    magic, version, core_count, cpu_hz, _ = FILE_HEADER.unpack_from(data, 0)
+    if magic != MAGIC or version != 1:
+        raise ValueError("not a version 1 trace dump")
+    offset = FILE_HEADER.size
+    cores = []
+    for core in range(core_count):
+        anchor_cycles, count, anchor_us, overwritten, _ = CORE_HEADER.unpack_from(data, offset)
+        offset += CORE_HEADER.size
+        records = [RECORD.unpack_from(data, offset + i * RECORD.size) for i in range(count)]
+        offset += count * RECORD.size
+        cores.append((core, anchor_cycles, anchor_us, overwritten, records))
+    return cpu_hz, cores
+
+
+def core_timestamps(cpu_hz, anchor_cycles, anchor_us, records):
+    elapsed = 0
+    later = anchor_cycles
+    stamps = [0.0] * len(records)
+    for i in range(len(records) - 1, -1, -1):
+        cycles = records[i][0]
+        elapsed += (later - cycles) & 0xFFFFFFFF
+        later = cycles
+        stamps[i] = anchor_us - elapsed * 1e6 / cpu_hz
+    return stamps
+
+
+def convert(data):
+    cpu_hz, cores = read_dump(data)
+    events = []
+    for core, anchor_cycles, anchor_us, overwritten, records in cores:
+        events.append({"ph": "M", "pid": 0, "tid": core, "name": "thread_name", "args": {"name": f"core {core}"}})
+        if overwritten:
+            print(f"core {core}: {overwritten} older events were overwritten", file=sys.stderr)
+        open_spans = {}
+        stamps = core_timestamps(cpu_hz, anchor_cycles, anchor_us, records)
+        for (_, arg, event_id, _), ts in zip(records, stamps):
+            name, phase, arg_name = EVENTS.get(event_id, (f"event {event_id}", "i", "arg"))
+            if phase == "B":
+                open_spans[name] = open_spans.get(name, 0) + 1
+            elif phase == "E":
+                # The matching begin may have been overwritten at the start of the ring.
+                if not open_spans.get(name):
+                    continue
+                open_spans[name] -= 1
+            event = {"ph": phase, "pid": 0, "tid": core, "name": name, "ts": ts, "args": {arg_name: arg}}
+            if phase == "i":
+                event["s"] = "t"
+            events.append(event)
+            if name == "rtsp service" and phase == "E":
+                events.append({"ph": "C", "pid": 0, "name": "rtsp backlog", "ts": ts, "args": {"frames": arg}})
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="binary dump from GET /trace or trace_dump()")
+    parser.add_argument("-o", "--output", help="JSON output path (default: stdout)")
+    args = parser.parse_args()
+
+    with open(args.dump, "rb") as f:
+        trace = convert(f.read())
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()